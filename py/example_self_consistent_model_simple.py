@@ -7,6 +7,9 @@ We use the true DF of the Plummer model, expressed in terms of actions,
 and start iterations from a deliberately wrong initial guess;
 nevertheless, after 10 iterations we converge to the true solution within 1%;
 each iteration approximately halves the error.
+Alternatively, the iterations may be performed by the 'iterateToConvergence' method,
+which stops once the density has converged, and accelerates the convergence by mixing
+the densities from several previous iterations (Anderson acceleration).
 """
 import agama, numpy, matplotlib.pyplot as plt
 
@@ -36,6 +39,16 @@ for i in range(10):
         (i, scm.potential.potential(0,0,0), scm.potential.totalMass()))
     plt.plot(r, scm.potential.density(xyz), label='Iteration #'+str(i))
 
+# the same model constructed by the accelerated iterations, which stop once the relative
+# change in density drops below the tolerance (it should exceed the accuracy of density computation)
+comp2 = agama.Component(df=df, density=dens, disklike=False, **params)
+scm2 = agama.SelfConsistentModel(**params)
+scm2.components=[comp2]
+numIter = scm2.iterateToConvergence(maxNumIter=20, tolerance=3e-3, historySize=4)
+print('Accelerated iterations converged after %i steps, Phi(0)=%g, Mass=%g' % \
+    (numIter, scm2.potential.potential(0,0,0), scm2.potential.totalMass()))
+plt.plot(r, scm2.potential.density(xyz), label='Anderson-accelerated', c='r')[0].set_dashes([2,2])
+
 # save the final density/potential profile
 scm.potential.export("simple_scm.coef_mul")
 
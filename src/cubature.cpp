@@ -453,6 +453,81 @@ static void destroy_rule75genzmalik(rule *r_)
      free(r->p);
 }
 
+/* minimum number of points evaluated in a single call to the integrand,
+   which is also the unit of work for OpenMP threads */
+#define MIN_POINTS_PER_BLOCK 64
+
+/* combine the function values at all points of one region into the
+   seventh- and fifth-order estimates of its integral and determine the
+   dimension to split.  The loops over the components of the integrand
+   are innermost and run over contiguous memory, so they are vectorized
+   by the compiler, and the order of summation is the same as in the
+   loop over components performed one at a time.
+   v[k*fdim + j] is the j-th component at the k-th point of the region;
+   sums is a temporary array of length 5*fdim+dim. */
+static void rule75genzmalik_combine(const rule75genzmalik *r, unsigned fdim,
+				    double ratio, double weight2, double weight4,
+				    double weightE2, double weightE4,
+				    const double *v, double *sums, region *R)
+{
+     const unsigned dim = r->parent.dim;
+     double *val0 = sums, *sum2 = sums + fdim, *sum3 = sums + 2*fdim,
+	  *sum4 = sums + 3*fdim, *sum5 = sums + 4*fdim, *diff = sums + 5*fdim;
+     unsigned i, j, k, k0 = 0;
+     double maxdiff = 0;
+     unsigned dimDiffMax = 0;
+
+     /* NOTE: this relies on the ordering of the eval functions above,
+	as well as on the internal structure of the evalR0_0fs4d function */
+     for (j = 0; j < fdim; ++j) {
+	  val0[j] = v[j]; /* central point */
+	  sum2[j] = sum3[j] = sum4[j] = sum5[j] = 0;
+     }
+     k0 += 1;
+
+     for (k = 0; k < dim; ++k) {
+	  const double *v0 = v + (k0 + 4*k) * fdim, *v1 = v0 + fdim,
+	       *v2 = v1 + fdim, *v3 = v2 + fdim;
+	  double d = 0;
+	  for (j = 0; j < fdim; ++j) {
+	       sum2[j] += v0[j] + v1[j];
+	       sum3[j] += v2[j] + v3[j];
+	       d += fabs(v0[j] + v1[j] - 2*val0[j] - ratio * (v2[j] + v3[j] - 2*val0[j]));
+	  }
+	  diff[k] = d;
+     }
+     k0 += 4*k;
+
+     for (k = 0; k < numRR0_0fs(dim); ++k) {
+	  const double *vk = v + (k0 + k) * fdim;
+	  for (j = 0; j < fdim; ++j)
+	       sum4[j] += vk[j];
+     }
+     k0 += k;
+
+     for (k = 0; k < numR_Rfs(dim); ++k) {
+	  const double *vk = v + (k0 + k) * fdim;
+	  for (j = 0; j < fdim; ++j)
+	       sum5[j] += vk[j];
+     }
+
+     /* Calculate fifth and seventh order results */
+     for (j = 0; j < fdim; ++j) {
+	  double result = R->h.vol * (r->weight1 * val0[j] + weight2 * sum2[j] + r->weight3 * sum3[j] + weight4 * sum4[j] + r->weight5 * sum5[j]);
+	  double res5th = R->h.vol * (r->weightE1 * val0[j] + weightE2 * sum2[j] + r->weightE3 * sum3[j] + weightE4 * sum4[j]);
+	  R->ee[j].val = result;
+	  R->ee[j].err = fabs(res5th - result);
+     }
+
+     /* figure out dimension to split: */
+     for (i = 0; i < dim; ++i)
+	  if (diff[i] > maxdiff) {
+	       maxdiff = diff[i];
+	       dimDiffMax = i;
+	  }
+     R->splitDim = dimDiffMax;
+}
+
 static int rule75genzmalik_evalError(rule *r_, unsigned fdim, integrand_v f, void *fdata, unsigned nR, region *R)
 {
      /* lambda2 = sqrt(9/70), lambda4 = sqrt(9/10), lambda5 = sqrt(9/19) */
@@ -466,9 +541,9 @@ static int rule75genzmalik_evalError(rule *r_, unsigned fdim, integrand_v f, voi
      const double ratio = (lambda2 * lambda2) / (lambda4 * lambda4);
 
      rule75genzmalik *r = (rule75genzmalik *) r_;
-     unsigned i, j, iR, dim = r_->dim;
+     unsigned i, iR, dim = r_->dim;
      unsigned int npts = 0;
-     double *diff, *pts, *vals;
+     double *pts, *vals;
 
      if (alloc_rule_pts(r_, nR)) return FAILURE;
      pts = r_->pts; vals = r_->vals;
@@ -502,78 +577,45 @@ static int rule75genzmalik_evalError(rule *r_, unsigned fdim, integrand_v f, voi
 	  npts += numR_Rfs(dim);
      }
 
-     /* Evaluate the integrand function(s) at all the points */
-     if (f(dim, npts, pts, fdata, fdim, vals))
-	  return FAILURE;
-
-     /* we are done with the points, and so we can re-use the pts
-	array to store the maximum difference diff[i] in each dimension 
-	for each hypercube */
-     diff = pts;
-     for (i = 0; i < dim * nR; ++i) diff[i] = 0;
-
-     for (j = 0; j < fdim; ++j) {
-	  const double *v = vals + j;
-#         define VALS(i) v[fdim*(i)]	       
-	  for (iR = 0; iR < nR; ++iR) {
-	       double result, res5th;
-	       double val0, sum2=0, sum3=0, sum4=0, sum5=0;
-	       unsigned k, k0 = 0;
-	       /* accumulate j-th function values into j-th integrals
-		     NOTE: this relies on the ordering of the eval functions
-		     above, as well as on the internal structure of
-		     the evalR0_0fs4d function */
-
-	       val0 = VALS(0); /* central point */
-	       k0 += 1;
-
-	       for (k = 0; k < dim; ++k) {
-		    double v0 = VALS(k0 + 4*k);
-		    double v1 = VALS((k0 + 4*k) + 1);
-		    double v2 = VALS((k0 + 4*k) + 2);
-		    double v3 = VALS((k0 + 4*k) + 3);
-		    
-		    sum2 += v0 + v1;
-		    sum3 += v2 + v3;
-		    
-		    diff[iR * dim + k] += 
-			 fabs(v0 + v1 - 2*val0 - ratio * (v2 + v3 - 2*val0));
+     /* Evaluate the integrand function(s) at all the points and combine
+	the function values into the integral and error estimates.
+	The regions are processed in blocks of at least MIN_POINTS_PER_BLOCK
+	points, which may be handled by different OpenMP threads (the integrand
+	must then be thread-safe); the results do not depend on the number of
+	threads, since each region is processed independently. */
+     {
+	  const unsigned num_points = r_->num_points;
+	  const unsigned regionsPerBlock =
+	       (MIN_POINTS_PER_BLOCK + num_points - 1) / num_points;
+	  const int numBlocks = (nR + regionsPerBlock - 1) / regionsPerBlock;
+	  int status = SUCCESS, b;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if(numBlocks > 1)
+#endif
+	  for (b = 0; b < numBlocks; ++b) {
+	       unsigned iR0 = b * regionsPerBlock, iR1 = iR0 + regionsPerBlock, iRb;
+	       double *sums;
+	       if (iR1 > nR) iR1 = nR;
+	       if (status != SUCCESS) continue;
+	       if (f(dim, (iR1 - iR0) * num_points, pts + iR0 * num_points * dim,
+		     fdata, fdim, vals + iR0 * num_points * fdim)) {
+		    status = FAILURE;
+		    continue;
 	       }
-	       k0 += 4*k;
-
-	       for (k = 0; k < numRR0_0fs(dim); ++k)
-		    sum4 += VALS(k0 + k);
-	       k0 += k;
-	       
-	       for (k = 0; k < numR_Rfs(dim); ++k)
-		    sum5 += VALS(k0 + k);
-	       
-	       /* Calculate fifth and seventh order results */
-	       result = R[iR].h.vol * (r->weight1 * val0 + weight2 * sum2 + r->weight3 * sum3 + weight4 * sum4 + r->weight5 * sum5);
-	       res5th = R[iR].h.vol * (r->weightE1 * val0 + weightE2 * sum2 + r->weightE3 * sum3 + weightE4 * sum4);
-	       
-	       R[iR].ee[j].val = result;
-	       R[iR].ee[j].err = fabs(res5th - result);
-	       
-	       v += r_->num_points * fdim;
-	  }
-#         undef VALS
-     }
-
-
-     /* figure out dimension to split: */
-     for (iR = 0; iR < nR; ++iR) {
-	  double maxdiff = 0;
-	  unsigned dimDiffMax = 0;
-
-	  for (i = 0; i < dim; ++i)
-	       if (diff[iR*dim + i] > maxdiff) {
-		    maxdiff = diff[iR*dim + i];
-		    dimDiffMax = i;
+	       /* temporary arrays for val0, sum2, ..., sum5 (fdim each) and diff (dim) */
+	       sums = (double *) malloc(sizeof(double) * (5 * fdim + dim));
+	       if (!sums) {
+		    status = FAILURE;
+		    continue;
 	       }
-	  R[iR].splitDim = dimDiffMax;
+	       for (iRb = iR0; iRb < iR1; ++iRb)
+		    rule75genzmalik_combine(r, fdim, ratio, weight2, weight4,
+					    weightE2, weightE4,
+					    vals + iRb * num_points * fdim, sums, R + iRb);
+	       free(sums);
+	  }
+	  return status;
      }
-     return SUCCESS;
 }
 
 static rule *make_rule75genzmalik(unsigned dim, unsigned fdim)
@@ -973,6 +1015,13 @@ static int converged(unsigned fdim, const esterr *ee,
 
 /* adaptive integration, analogous to adaptintegrator.cpp in HIntLib */
 
+/* maximum number of regions split in a single iteration of the serial
+   (non-Gladwell) algorithm, and the minimum ratio of the error of a region
+   to the largest error among all regions for it to be split together with
+   the worst region */
+#define MAX_SPLIT_REGIONS 16
+#define SPLIT_ERROR_FRACTION 0.5
+
 static int rulecubature(rule *r, unsigned fdim, 
 			integrand_v f, void *fdata, 
 			const hypercube *h, 
@@ -1060,12 +1109,36 @@ static int rulecubature(rule *r, unsigned fdim,
 		    goto bad;
 	  }
 	  else { /* minimize number of function evaluations */
-	       R[0] = heap_pop(&regions); /* get worst region */
-	       if (cut_region(R, R+1)
-		   || eval_regions(2, R, f, fdata, r)
-		   || heap_push_many(&regions, 2, R))
+	       /* Split the worst region, together with all other regions
+		  whose error is comparable to it (these would be split in the
+		  next few iterations anyway), up to MAX_SPLIT_REGIONS at once,
+		  so that the function values in all new regions are computed
+		  in parallel.  As in the Gladwell approach above, we stop
+		  once the remaining regions satisfy the tolerance.  The set
+		  of regions depends only on their errors, hence the result
+		  does not depend on the number of threads. */
+	       unsigned int nR = 0;
+	       double errWorst = KEY(regions.items[0]);
+	       for (j = 0; j < fdim; ++j) ee[j] = regions.ee[j];
+	       do {
+		    if (nR + 2 > nR_alloc) {
+			 nR_alloc = (nR + 2) * 2;
+			 R = (region *) realloc(R, nR_alloc * sizeof(region));
+			 if (!R) goto bad;
+		    }
+		    R[nR] = heap_pop(&regions); /* get worst region */
+		    for (j = 0; j < fdim; ++j) ee[j].err -= R[nR].ee[j].err;
+		    if (cut_region(R+nR, R+nR+1)) goto bad;
+		    numEval += r->num_points * 2;
+		    nR += 2;
+		    if (converged(fdim, ee, reqAbsError, reqRelError, norm))
+			 break; /* other regions have small errs */
+	       } while (regions.n > 0 && nR < 2 * MAX_SPLIT_REGIONS &&
+			KEY(regions.items[0]) >= SPLIT_ERROR_FRACTION * errWorst &&
+			(numEval < maxEval || !maxEval));
+	       if (eval_regions(nR, R, f, fdata, r)
+		   || heap_push_many(&regions, nR, R))
 		    goto bad;
-	       numEval += r->num_points * 2;
 	  }
      }
 
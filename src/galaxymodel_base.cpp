@@ -1,15 +1,20 @@
 #include "galaxymodel_base.h"
+#include "galaxymodel_cache.h"
 #include "math_core.h"
 #include "math_sample.h"
 #include "math_specfunc.h"
 #include "math_spline.h"
 #include "math_linalg.h"
 #include "actions_torus.h"
+#include "particles_io.h"
 #include "smart.h"
 #include "utils.h"
 #include <cmath>
 #include <stdexcept>
 #include <cassert>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace galaxymodel{
 
@@ -476,6 +481,53 @@ std::vector<double> solveForAmplitudes(const math::BsplineInterpolator1d<N>& bsp
 }
 
 
+/// types of quantities stored in the cache of integration results
+enum CachedQuantity {
+    CQ_MOMENTS           = 1,
+    CQ_PROJECTED_MOMENTS = 2,
+    CQ_PROJECTED_DF      = 3
+};
+
+/** retrieve the values of integrals from the cache associated with the model, if it exists.
+    \param[in]  model  is the galaxy model, which may contain a pointer to the cache;
+    \param[in]  type  is the type of computed quantity;
+    \param[in,out] params  are the input parameters that determine the integrand (e.g., the position);
+    if the cache is used, the type of quantity and the accuracy parameters are appended to them,
+    and the resulting array should be passed to `storeCached` after computing the integrals;
+    \param[in]  numValues  is the number of integrals;
+    \param[out] result, error  will contain the values of integrals and their errors
+    (error may be NULL);
+    \return  true if the values were found in the cache.
+*/
+bool lookupCached(const GalaxyModel& model, CachedQuantity type, std::vector<double>& params,
+    const double reqRelError, const int maxNumEval,
+    unsigned int numValues, double result[], double error[])
+{
+    if(model.cache == NULL || model.cacheKey == 0)
+        return false;
+    params.push_back(type);
+    params.push_back(reqRelError);
+    params.push_back(maxNumEval);
+    std::vector<double> values;
+    if(!model.cache->lookup(model.cacheKey, params, values) || values.size() != 2*numValues)
+        return false;
+    std::copy(values.begin(), values.begin() + numValues, result);
+    if(error!=NULL)
+        std::copy(values.begin() + numValues, values.end(), error);
+    return true;
+}
+
+/// store the values of integrals and their errors in the cache, if it exists
+void storeCached(const GalaxyModel& model, const std::vector<double>& params,
+    unsigned int numValues, const double result[], const double error[])
+{
+    if(model.cache == NULL || model.cacheKey == 0)
+        return;
+    std::vector<double> values(result, result + numValues);
+    values.insert(values.end(), error, error + numValues);
+    model.cache->store(model.cacheKey, params, values);
+}
+
 }  // unnamed namespace
 
 //------- DRIVER ROUTINES -------//
@@ -495,7 +547,18 @@ void computeMoments(const GalaxyModel& model, const coord::PosCyl& point,
     // the values of integrals and their error estimates
     std::vector<double> result(fnc.numValues()), error(fnc.numValues());
 
-    math::integrateNdim(fnc, xlower, xupper, reqRelError, maxNumEval, &result[0], &error[0]);
+    // the integrals depend on the position and the set of requested moments
+    std::vector<double> params(4);
+    params[0] = point.R;
+    params[1] = point.z;
+    params[2] = point.phi;
+    params[3] = mode;
+    if(!lookupCached(model, CQ_MOMENTS, params, reqRelError, maxNumEval,
+        fnc.numValues(), &result[0], &error[0]))
+    {
+        math::integrateNdim(fnc, xlower, xupper, reqRelError, maxNumEval, &result[0], &error[0]);
+        storeCached(model, params, fnc.numValues(), &result[0], &error[0]);
+    }
 
     // store the results
     unsigned int numCompDF = model.distrFunc.numValues();
@@ -607,6 +670,13 @@ double computeProjectedDF(const GalaxyModel& model,
     const double R, const double vz, const double vz_error,
     const double reqRelError, const int maxNumEval)
 {
+    double result, error;
+    std::vector<double> params(3);
+    params[0] = R;
+    params[1] = vz;
+    params[2] = vz_error;
+    if(lookupCached(model, CQ_PROJECTED_DF, params, reqRelError, maxNumEval, 1, &result, &error))
+        return result;
     double xlower[4] = {0, 0, 0, 0};  // integration region in scaled variables
     double xupper[4] = {1, 1, 1, 1};
     DFIntegrandProjected fnc(model, R, vz, vz_error);
@@ -614,8 +684,8 @@ double computeProjectedDF(const GalaxyModel& model,
         xlower[0] = math::findRoot(fnc, 0, 0.5, 1e-8);  // set the lower and upper limits for integration
         xupper[0] = math::findRoot(fnc, 0.5, 1, 1e-8);  // to the region where v^2-vz^2>0
     }
-    double result;
-    math::integrateNdim(fnc, xlower, xupper, reqRelError, maxNumEval, &result);
+    math::integrateNdim(fnc, xlower, xupper, reqRelError, maxNumEval, &result, &error);
+    storeCached(model, params, 1, &result, &error);
     return result;
 }
 
@@ -629,7 +699,11 @@ void computeProjectedMoments(const GalaxyModel& model, const double R,
     double xupper[4] = {1, 1, 1, 1};
     DFIntegrandProjectedMoments fnc(model, R);
     double result[3], error[3];
-    math::integrateNdim(fnc, xlower, xupper, reqRelError, maxNumEval, result, error);
+    std::vector<double> params(1, R);
+    if(!lookupCached(model, CQ_PROJECTED_MOMENTS, params, reqRelError, maxNumEval, 3, result, error)) {
+        math::integrateNdim(fnc, xlower, xupper, reqRelError, maxNumEval, result, error);
+        storeCached(model, params, 3, result, error);
+    }
     if(surfaceDensity)
         *surfaceDensity = result[0];
     if(rmsHeight)
@@ -704,6 +778,71 @@ particles::ParticleArrayCyl samplePosVel(
 }
 
 
+double samplePosVel(
+    const GalaxyModel& model, const size_t numSamples,
+    const particles::BaseIOSnapshot& output, const size_t chunkSize, const size_t seed)
+{
+    if(numSamples == 0 || chunkSize == 0)
+        throw std::invalid_argument("samplePosVel: number of samples and chunk size must be positive");
+    DFIntegrand6dim fnc(model);
+    double xlower[6] = {0,0,0,0,0,0}; // boundaries of sampling region in scaled coordinates
+    double xupper[6] = {1,1,1,1,1,1};
+    math::SampleGenerator generator(fnc, xlower, xupper, std::min(numSamples, chunkSize), seed);
+    double totalMass, errorMass;      // total normalization of the DF and its estimated error
+    generator.integral(totalMass, errorMass);
+    const double pointMass = totalMass / numSamples;
+    const size_t numChunks = (numSamples - 1) / chunkSize + 1;
+#ifdef _OPENMP
+    const size_t numThreads = std::max(1, omp_get_max_threads());
+#else
+    const size_t numThreads = 1;
+#endif
+    size_t numEvals = 0, numClipped = 0, numInFloor = 0;
+    // chunks are generated in groups (one chunk per thread) and then written to the file in order
+    for(size_t group = 0; group < numChunks; group += numThreads) {
+        const ptrdiff_t groupSize = std::min(numThreads, numChunks - group);
+        std::vector<particles::ParticleArrayCar> parts(groupSize);
+        std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:numEvals,numClipped,numInFloor)
+#endif
+        for(ptrdiff_t i=0; i<groupSize; i++) {
+            const size_t chunk = group + i, size = std::min(chunkSize, numSamples - chunk * chunkSize);
+            try {
+                math::Matrix<double> result;  // sampled scaled coordinates/velocities
+                size_t chunkClipped, chunkInFloor;
+                numEvals   += generator.generateChunk(chunk, size, result, &chunkClipped, &chunkInFloor);
+                numClipped += chunkClipped;
+                numInFloor += chunkInFloor;
+                parts[i].data.reserve(size);
+                for(size_t k=0; k<size; k++) {
+                    double scaledvars[6] = {result(k,0), result(k,1), result(k,2),
+                        result(k,3), result(k,4), result(k,5)};
+                    // transform from scaled vars (array of 6 numbers) to real pos/vel
+                    parts[i].add(toPosVelCar(fnc.unscaleVars(scaledvars)), pointMass);
+                }
+            }
+            // guard against possible exceptions, since they must not leave the OpenMP parallel section
+            catch(std::exception& e) {
+                errorMsg = e.what();
+            }
+        }
+        if(!errorMsg.empty())
+            throw std::runtime_error("Error in samplePosVel: " + errorMsg);
+        for(ptrdiff_t i=0; i<groupSize; i++)
+            output.writeSnapshotPart(parts[i], (group + i) * chunkSize, numSamples);
+    }
+    utils::msg(numClipped > 0 || numInFloor > 0 ? utils::VL_WARNING : utils::VL_VERBOSE, "samplePosVel",
+        "Generated " + utils::toString(numSamples) + " samples in " + utils::toString(numChunks) +
+        " chunks using " + utils::toString(numEvals) + " function evaluations" +
+        (numClipped > 0 ? "; the DF exceeded the envelope in " + utils::toString(numClipped) +
+        " evaluations, which biases the sampling" : "") +
+        (numInFloor > 0 ? "; the DF was positive in " + utils::toString(numInFloor) +
+        " evaluations in " + utils::toString(generator.numFlooredCells()) +
+        " cells where it was zero during exploration, which may be undersampled" : ""));
+    return totalMass;
+}
+
 particles::ParticleArray<coord::PosCyl> sampleDensity(
     const potential::BaseDensity& dens, const size_t numPoints)
 {
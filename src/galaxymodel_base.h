@@ -9,27 +9,38 @@
 #include "df_base.h"
 #include "particles_base.h"
 
+namespace particles { class BaseIOSnapshot; }
+
 /// A complete galaxy model (potential, action finder and distribution function) and associated routines
 namespace galaxymodel{
 
+class IntegralCache;  // defined in galaxymodel_cache.h
+
 /** Data-only structure defining a galaxy model: 
     a combination of potential, action finder, and distribution function.
     Its purpose is to temporarily bind together the three common ingredients that are passed
     to various functions; however, as it only keeps references and not shared pointers, 
     it should not generally be used for a long-term storage.
+    Optionally, the model may be associated with a cache of integration results, which is
+    used by `computeMoments`, `computeProjectedMoments` and `computeProjectedDF`:
+    repeated calls with the same arguments return the stored values instead of recomputing them.
 */
 struct GalaxyModel{
 public:
     const potential::BasePotential&     potential;  ///< gravitational potential
     const actions::BaseActionFinder&    actFinder;  ///< action finder for the given potential
     const df::BaseDistributionFunction& distrFunc;  ///< distribution function expressed in terms of actions
+    IntegralCache* cache;        ///< optional cache of integration results (NULL if not used)
+    unsigned long long cacheKey; ///< identifier of the model in the cache (must be nonzero to use it)
 
-    /** Create an instance of the galaxy model from the three ingredients */
+    /** Create an instance of the galaxy model from the three ingredients,
+        and optionally attach a cache with the given key of the model (see galaxymodel_cache.h) */
     GalaxyModel(
         const potential::BasePotential& pot,
         const actions::BaseActionFinder& af,
-        const df::BaseDistributionFunction& df) :
-    potential(pot), actFinder(af), distrFunc(df) {}
+        const df::BaseDistributionFunction& df,
+        IntegralCache* _cache=NULL, unsigned long long _cacheKey=0) :
+    potential(pot), actFinder(af), distrFunc(df), cache(_cache), cacheKey(_cacheKey) {}
 };
 
 
@@ -181,6 +192,27 @@ particles::ParticleArrayCyl samplePosVel(
     const GalaxyModel& model, const size_t numPoints);
 
 
+/** Generate N-body samples of the distribution function in position/velocity space
+    (same as above), producing them in chunks and writing each chunk to a snapshot file
+    as soon as it is ready, so that the entire array never needs to be kept in memory:
+    one chunk is generated by each OpenMP thread at a time, so the memory usage is proportional
+    to chunkSize times the number of threads.
+    The sampling is performed by `math::SampleGenerator`: each chunk has its own stream of
+    random numbers determined by the seed and the chunk index, hence the output is reproducible
+    regardless of the number of threads (several chunks are generated in parallel).
+    \param[in]  model  is the galaxy model;
+    \param[in]  numPoints  is the required number of samples;
+    \param[in]  output  is the snapshot writer, which must support writing in parts;
+    \param[in]  chunkSize  is the number of samples in each chunk, which also sets the number of
+    exploration samples used to construct the envelope function;
+    \param[in]  seed  is the base seed for random number streams.
+    \returns    the total mass of the model (the mass of each particle is this value / numPoints).
+*/
+double samplePosVel(
+    const GalaxyModel& model, const size_t numPoints,
+    const particles::BaseIOSnapshot& output, const size_t chunkSize=1048576, const size_t seed=0);
+
+
 /** Sample the density profile by discrete points.
     \param[in]  dens  is the density model;
     \param[in]  numPoints  is the required number of sampling points;
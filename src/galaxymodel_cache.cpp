@@ -0,0 +1,213 @@
+#include "galaxymodel_cache.h"
+#include "utils.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace galaxymodel{
+
+namespace{
+
+/// signature at the beginning of the cache file
+static const char FILE_MAGIC[8] = {'A','G','A','M','A','I','C','1'};
+
+/// write an array of doubles preceded by its length
+inline bool writeArray(std::FILE* file, const std::vector<double>& arr)
+{
+    unsigned int size = arr.size();
+    return std::fwrite(&size, sizeof(size), 1, file) == 1 &&
+        (size == 0 || std::fwrite(&arr[0], sizeof(double), size, file) == size);
+}
+
+/// read an array of doubles written by writeArray
+inline bool readArray(std::FILE* file, std::vector<double>& arr)
+{
+    unsigned int size = 0;
+    if(std::fread(&size, sizeof(size), 1, file) != 1 || size > 1000000)
+        return false;
+    arr.resize(size);
+    return size == 0 || std::fread(&arr[0], sizeof(double), size, file) == size;
+}
+
+}  // internal namespace
+
+unsigned long long hashString(const std::string& text)
+{
+    // 64-bit FNV-1a hash
+    unsigned long long hash = 14695981039346656037ull;
+    for(size_t i=0; i<text.size(); i++) {
+        hash ^= static_cast<unsigned char>(text[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+IntegralCache::IntegralCache(size_t _capacity, const std::string& _fileName) :
+    capacity(_capacity), fileName(_fileName), numHits(0), numMisses(0), modified(false)
+{
+    if(fileName.empty())
+        return;
+    std::FILE* file = std::fopen(fileName.c_str(), "rb");
+    if(!file)  // the file does not exist yet, and will be created upon destruction of the cache
+        return;
+    std::fclose(file);
+    size_t numLoaded = load(fileName);
+    modified = false;
+    utils::msg(utils::VL_DEBUG, "IntegralCache",
+        "Loaded " + utils::toString(numLoaded) + " entries from " + fileName);
+}
+
+IntegralCache::~IntegralCache()
+{
+    if(fileName.empty() || !modified)
+        return;
+    try{
+        save(fileName);
+    }
+    catch(std::exception& e) {
+        utils::msg(utils::VL_WARNING, "IntegralCache", e.what());
+    }
+}
+
+void IntegralCache::insert(const Key& key, const std::vector<double>& values)
+{
+    std::map<Key, EntryList::iterator>::iterator iter = index.find(key);
+    if(iter != index.end()) {  // replace the existing entry and move it to the front
+        iter->second->second = values;
+        entries.splice(entries.begin(), entries, iter->second);
+    } else {
+        entries.push_front(std::make_pair(key, values));
+        index[key] = entries.begin();
+        // evict the least recently used entries
+        while(entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+    modified = true;
+}
+
+bool IntegralCache::lookup(unsigned long long modelKey, const std::vector<double>& params,
+    std::vector<double>& values)
+{
+    Key key(modelKey, params);
+    bool found = false;
+#ifdef _OPENMP
+#pragma omp critical(IntegralCache)
+#endif
+    {
+        std::map<Key, EntryList::iterator>::iterator iter = index.find(key);
+        found = iter != index.end();
+        if(found) {
+            entries.splice(entries.begin(), entries, iter->second);
+            values = iter->second->second;
+            numHits++;
+        } else
+            numMisses++;
+    }
+    return found;
+}
+
+void IntegralCache::store(unsigned long long modelKey, const std::vector<double>& params,
+    const std::vector<double>& values)
+{
+    Key key(modelKey, params);
+#ifdef _OPENMP
+#pragma omp critical(IntegralCache)
+#endif
+    insert(key, values);
+}
+
+void IntegralCache::save(const std::string& fileName) const
+{
+    // write into a temporary file first, so that an existing file is not damaged in case of errors
+    std::string tmpName = fileName + ".tmp";
+    bool ok = false;
+#ifdef _OPENMP
+#pragma omp critical(IntegralCache)
+#endif
+    {
+        std::FILE* file = std::fopen(tmpName.c_str(), "wb");
+        if(file) {
+            unsigned long long count = entries.size();
+            ok = std::fwrite(FILE_MAGIC, sizeof(FILE_MAGIC), 1, file) == 1 &&
+                std::fwrite(&count, sizeof(count), 1, file) == 1;
+            // the least recently used entries go first, so that the order is restored upon loading
+            for(EntryList::const_reverse_iterator iter = entries.rbegin();
+                ok && iter != entries.rend(); ++iter)
+            {
+                ok = std::fwrite(&iter->first.first, sizeof(unsigned long long), 1, file) == 1 &&
+                    writeArray(file, iter->first.second) && writeArray(file, iter->second);
+            }
+            ok &= std::fclose(file) == 0;
+        }
+    }
+    if(!ok || std::rename(tmpName.c_str(), fileName.c_str()) != 0) {
+        std::remove(tmpName.c_str());
+        throw std::runtime_error("IntegralCache: cannot write file " + fileName);
+    }
+}
+
+size_t IntegralCache::load(const std::string& fileName)
+{
+    std::FILE* file = std::fopen(fileName.c_str(), "rb");
+    if(!file)
+        throw std::runtime_error("IntegralCache: cannot open file " + fileName);
+    char magic[sizeof(FILE_MAGIC)];
+    unsigned long long count = 0;
+    bool ok = std::fread(magic, sizeof(magic), 1, file) == 1 &&
+        std::memcmp(magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 &&
+        std::fread(&count, sizeof(count), 1, file) == 1;
+    size_t numLoaded = 0;
+    Key key;
+    std::vector<double> values;
+    for(; ok && numLoaded < count; numLoaded++) {
+        ok = std::fread(&key.first, sizeof(key.first), 1, file) == 1 &&
+            readArray(file, key.second) && readArray(file, values);
+        if(ok) {
+#ifdef _OPENMP
+#pragma omp critical(IntegralCache)
+#endif
+            insert(key, values);
+        }
+    }
+    std::fclose(file);
+    if(!ok)
+        throw std::runtime_error("IntegralCache: file " + fileName + " is corrupted");
+    return numLoaded;
+}
+
+void IntegralCache::clear()
+{
+#ifdef _OPENMP
+#pragma omp critical(IntegralCache)
+#endif
+    {
+        modified |= !entries.empty();
+        entries.clear();
+        index.clear();
+    }
+}
+
+size_t IntegralCache::size() const
+{
+    size_t result;
+#ifdef _OPENMP
+#pragma omp critical(IntegralCache)
+#endif
+    result = entries.size();
+    return result;
+}
+
+void IntegralCache::stats(size_t& hits, size_t& misses) const
+{
+#ifdef _OPENMP
+#pragma omp critical(IntegralCache)
+#endif
+    {
+        hits   = numHits;
+        misses = numMisses;
+    }
+}
+
+}  // namespace
@@ -0,0 +1,111 @@
+/** \file    galaxymodel_cache.h
+    \brief   Cache of results of computationally expensive integrals of the distribution function
+    \date    2018
+    \author  Eugene Vasiliev
+
+    Moments and projections of the distribution function (density, velocity dispersion tensor,
+    projected DF, etc.) are computed by multidimensional integration over velocities, which
+    takes from milliseconds to seconds per point. In interactive analysis, the same quantities
+    are often requested repeatedly on the same grid of points for the same model;
+    the cache defined in this module stores the results of these integrals and returns them
+    immediately on subsequent calls with the same input parameters.
+
+    The model itself is identified by a 64-bit key provided by the user: it could be a hash
+    of the text of parameters that define the potential and the DF (see `hashString`), or just
+    a counter incremented each time the model is changed. It is the responsibility of the user
+    to ensure that different models have different keys; if the cache is stored in a file and
+    reused between sessions, the key should also remain the same for the same model
+    (hence should not be derived from memory addresses of objects, for instance),
+    and the units of length, velocity and mass must not change.
+*/
+#pragma once
+#include <vector>
+#include <list>
+#include <map>
+#include <string>
+
+namespace galaxymodel{
+
+/** compute a 64-bit hash of a string (e.g., the concatenated parameters of the potential and DF),
+    which may serve as a persistent key of the model in the IntegralCache */
+unsigned long long hashString(const std::string& text);
+
+/** Cache of integration results with the least-recently-used (LRU) eviction policy.
+    Each entry is identified by the model key and an array of input parameters
+    (e.g., the type of computed quantity, the coordinates of the point, the required accuracy),
+    and contains an array of output values (e.g., the values of integrals and their errors).
+    Parameters are compared exactly (bitwise), i.e., a query at a slightly different point is a miss.
+    When the number of entries exceeds the capacity, the least recently accessed ones are discarded.
+    All methods are thread-safe, so that the cache may be shared between OpenMP threads
+    (access is serialized, but the cost of lookup is negligible compared to the integration).
+    The cache may be saved to a binary file and loaded back in another session.
+*/
+class IntegralCache {
+public:
+    /** create an empty cache, or load it from a file.
+        \param[in]  capacity  is the maximum number of stored entries;
+        \param[in]  fileName  if not empty, the cache is loaded from this file (if it exists),
+        and is written back to the same file when the object is destroyed (if its content
+        has changed in the meantime).
+    */
+    explicit IntegralCache(size_t capacity=100000, const std::string& fileName="");
+
+    /// save the cache to the file provided in the constructor (errors are not reported in this case)
+    ~IntegralCache();
+
+    /** retrieve an entry from the cache and mark it as the most recently used one.
+        \param[in]  modelKey  is the identifier of the model;
+        \param[in]  params  is the array of input parameters;
+        \param[out] values  will contain the stored output values, if the entry exists;
+        \return  true if the entry was found.
+    */
+    bool lookup(unsigned long long modelKey, const std::vector<double>& params,
+        std::vector<double>& values);
+
+    /** add an entry to the cache (or replace an existing one), evicting the least recently used
+        entry if the capacity is exceeded */
+    void store(unsigned long long modelKey, const std::vector<double>& params,
+        const std::vector<double>& values);
+
+    /** write all entries to a binary file (in the order of increasing recency).
+        \throw  std::runtime_error if the file cannot be written.
+    */
+    void save(const std::string& fileName) const;
+
+    /** add all entries from a file created by `save()` to the cache.
+        \return  the number of loaded entries.
+        \throw  std::runtime_error if the file cannot be read or has a wrong format.
+    */
+    size_t load(const std::string& fileName);
+
+    /// remove all entries
+    void clear();
+
+    /// return the current number of entries
+    size_t size() const;
+
+    /// return the number of successful and unsuccessful lookups since the creation of the cache
+    void stats(size_t& numHits, size_t& numMisses) const;
+
+private:
+    /// key of an entry: model identifier and the array of input parameters
+    typedef std::pair<unsigned long long, std::vector<double> > Key;
+    /// list of entries ordered by the time of last access (most recent first)
+    typedef std::list<std::pair<Key, std::vector<double> > > EntryList;
+
+    const size_t capacity;       ///< maximum number of entries
+    const std::string fileName;  ///< file associated with the cache (may be empty)
+    EntryList entries;           ///< the stored entries
+    std::map<Key, EntryList::iterator> index;  ///< search tree for locating the entries
+    size_t numHits, numMisses;   ///< statistics of lookups
+    bool modified;               ///< whether new entries were added since the last save or load
+
+    /// add or replace an entry, without locking (called from the public methods)
+    void insert(const Key& key, const std::vector<double>& values);
+
+    // copying is not allowed
+    IntegralCache(const IntegralCache&);
+    IntegralCache& operator=(const IntegralCache&);
+};
+
+}  // namespace
@@ -259,6 +259,57 @@ std::vector<double> regularizeAmplitudes(
     return result;
 }
 
+/// apply the boundary conditions to the matrix equation  L f_new = rhs:
+/// zero-flux (Neumann) b/c does not need anything special,
+/// while a constant-value (Dirichlet) b/c essentially eliminates the first/last row
+/// of the matrix equation, or, rather, makes it trivial
+void applyBoundaryConditions(const std::vector<double>& oldf, bool absorbingBoundaryCondition,
+    math::BandMatrix<double>& lhsMatrix, std::vector<double>& rhs)
+{
+    const unsigned int dim = oldf.size(), bandwidth = lhsMatrix.bandwidth();
+    for(unsigned int b = 0; b <= bandwidth; b++) {
+        lhsMatrix(dim-1, dim-1-b) = b==0 ? 1. : 0.;
+        if(absorbingBoundaryCondition)
+            lhsMatrix(0, b) = b==0 ? 1. : 0.;
+    }
+    rhs[dim-1] = oldf[dim-1];
+    if(absorbingBoundaryCondition)
+        rhs[0] = oldf[0];
+}
+
+/// perform a single backward-Euler step  (M - dt A) f_new = M f_old + dt S,
+/// where M is the weight matrix, A is the sum of relaxation and drain matrices,
+/// and S is the source term (NULL if absent)
+std::vector<double> stepBackwardEuler(const math::BandMatrix<double>& weightMatrix,
+    const math::BandMatrix<double>& rateMatrix, const std::vector<double>* source,
+    bool absorbingBoundaryCondition, double deltat, const std::vector<double>& oldf)
+{
+    math::BandMatrix<double> lhsMatrix = weightMatrix;
+    math::blas_daxpy(-deltat, rateMatrix, lhsMatrix);
+    std::vector<double> rhs(oldf.size());
+    math::blas_dgemv(math::CblasNoTrans, 1., weightMatrix, oldf, 0., rhs);
+    if(source)
+        math::blas_daxpy(deltat, *source, rhs);
+    applyBoundaryConditions(oldf, absorbingBoundaryCondition, lhsMatrix, rhs);
+    return math::solveBand(lhsMatrix, rhs);
+}
+
+/// maximum relative difference |log(f1/f2)| between two discretized DFs,
+/// ignoring the grid nodes that contain a negligible fraction of mass
+/// (e.g., those inside the loss cone, where the DF is driven to zero)
+double maxRelDifference(const std::vector<double>& f1, const std::vector<double>& f2,
+    const std::vector<double>& gridMass)
+{
+    const double MIN_MASS_FRACTION = 1e-8;
+    double maxMass = 0., result = 0.;
+    for(unsigned int i=0; i<f1.size(); i++)
+        maxMass = fmax(maxMass, fabs(f1[i] * gridMass[i]));
+    for(unsigned int i=0; i<f1.size(); i++)
+        if(f1[i] > 0. && f2[i] > 0. && fabs(f1[i] * gridMass[i]) > MIN_MASS_FRACTION * maxMass)
+            result = fmax(result, fabs(log(f1[i] / f2[i])));
+    return result;
+}
+
 } // internal namespace
 
 
@@ -604,6 +655,12 @@ public:
     /// if the boundary condition is absorbing, whether to use loss-cone draining at all energies (fixed)
     bool lossConeDrain;
 
+    /// maximum number of fixed-point iterations in an implicit timestep (fixed)
+    const unsigned int maxImplicitIterations;
+
+    /// tolerance for terminating the implicit iterations (fixed)
+    const double implicitTolerance;
+
     /// array of masses of a single star in each species (fixed)
     std::vector<double> Mstar;
 
@@ -688,6 +745,25 @@ public:
     /// length of the previous timestep (evolves)
     double prevdeltat;
 
+    /// current simulation time (evolves)
+    double time;
+
+    /// suggested length of the next timestep in the adaptive time integration (evolves)
+    double nextdeltat;
+
+    /// relative accuracy of the adaptive time integration (fixed)
+    const double timeAccuracy;
+
+    /// tolerance on the relative change of DF that triggers the potential update (fixed)
+    const double potentialUpdateTolerance;
+
+    /// time elapsed since the last update of the potential,
+    /// and the interval between the last two updates (evolve)
+    double timeSincePotentialUpdate, prevPotentialUpdateInterval;
+
+    /// amplitudes of the DF of all components at the time of the last potential update (evolve)
+    std::vector< std::vector<double> > gridfPotentialUpdate;
+
     /// number of times that the evolve() routine was called (evolves)
     int numSteps;
 
@@ -700,6 +776,8 @@ public:
         updatePotential(params.updatePotential),
         absorbingBoundaryCondition(false),
         lossConeDrain(params.lossConeDrain),
+        maxImplicitIterations(params.maxImplicitIterations),
+        implicitTolerance(params.implicitTolerance),
         Mstar(numComp, 0.),
         captureRadius(numComp, 0.),
         captureMassFraction(numComp, 0.),
@@ -713,7 +791,12 @@ public:
         gridSourceRate(numComp),
         drainMatrix(numComp),
         prevRelaxationMatrix(numComp),
-        prevdeltat(0.), numSteps(0)
+        prevdeltat(0.),
+        time(0.), nextdeltat(0.),
+        timeAccuracy(params.timeAccuracy),
+        potentialUpdateTolerance(params.potentialUpdateTolerance),
+        timeSincePotentialUpdate(0.), prevPotentialUpdateInterval(0.),
+        numSteps(0)
     {
         if(numComp == 0)
             throw std::runtime_error("FokkerPlanckSolver: empty component list");
@@ -844,6 +927,7 @@ FokkerPlanckSolver::FokkerPlanckSolver(
     // recompute the initial potential from the DF (as opposed to the initial density profile)
     if(params.updatePotential)
         reinitPotential(0.);
+    data->gridfPotentialUpdate = data->gridf;
     // compute the initial advection/diffusion coefficients and 
     // assign the values of mass and energy from the combined DF of all components
     reinitAdvDifCoefs();
@@ -911,7 +995,7 @@ void FokkerPlanckSolver::reinitPotential(double deltat)
         // extrapolate the potential and phasevol mapping at the end of the timestep
         potential::PtrPotential nextPot;
         potential::PtrPhaseVolume nextPhasevol;
-        if(!data->prevPot || deltat>=data->prevdeltat*2) {
+        if(!data->prevPot || deltat>=data->prevPotentialUpdateInterval*2) {
             // do not extrapolate, use the current ones
             nextPot = data->currPot;
             nextPhasevol = data->phasevol;
@@ -924,8 +1008,9 @@ void FokkerPlanckSolver::reinitPotential(double deltat)
                 coord::GradCyl currGrad, prevGrad;
                 data->prevPot->eval(coord::PosCyl(gridr[i],0,0), &prevPhi, &prevGrad);
                 data->currPot->eval(coord::PosCyl(gridr[i],0,0), &currPhi, &currGrad);
-                Phi [0][i] = currPhi + (currPhi-prevPhi) / data->prevdeltat * deltat;
-                dPhi[0][i] = currGrad.dR + (currGrad.dR-prevGrad.dR) / data->prevdeltat * deltat;
+                Phi [0][i] = currPhi + (currPhi-prevPhi) / data->prevPotentialUpdateInterval * deltat;
+                dPhi[0][i] = currGrad.dR +
+                    (currGrad.dR-prevGrad.dR) / data->prevPotentialUpdateInterval * deltat;
             }
             nextPot.reset(new potential::Multipole(gridr, Phi, dPhi));
             // set up the phase volume mapping for the extrapolated potential
@@ -958,15 +1043,16 @@ void FokkerPlanckSolver::reinitPotential(double deltat)
     data->gridEnergy = impl->projVector(FncEnergy(*data->phasevol));
 }
 
-void FokkerPlanckSolver::reinitAdvDifCoefs()
+void FokkerPlanckSolver::reinitAdvDifCoefs(bool updateDrainMatrix)
 {
     // constant multiplicative factor for advection/diffusion coefs
     const double GAMMA = 16*M_PI*M_PI * data->coulombLog;
     // recompute the angular-momentum draining rate once in a while only,
     // because this is a rather expensive operation, and being slightly off in estimating
     // the angular momentum diffusion is not a big deal
-    bool computeDrainMatrix = data->absorbingBoundaryCondition && data->numSteps%16 == 0;
-    const unsigned int
+    bool computeDrainMatrix = updateDrainMatrix &&
+        data->absorbingBoundaryCondition && data->numSteps%16 == 0;
+    const int
     numComp   = data->numComp,           // number of DF components
     gridSize  = data->gridh.size(),      // size of the grid in phase volume that defines the DF
     numPoints = data->gridAdvDifCoefs.size();   // size of the auxiliary grid for adv/dif coefs
@@ -981,31 +1067,51 @@ void FokkerPlanckSolver::reinitAdvDifCoefs()
     // DF values and the integrals I0, at the innermost boundary, for all species
     std::vector<double> fval0(numComp), fint0(numComp);
 
-    // collect and sum up the advection and diffusion coefficients from each component;
-    // the diffusion coef is the same for all species, and the functional form of the advection coef
-    // is also universal, but its magnitude will be later multiplied by the stellar mass of each species
-    for(unsigned int comp = 0; comp < numComp; comp++) {
-
-        // construct the spherical model for this DF in the current potential
-        math::PtrFunction df = impl->getInterpolatedFunction(data->gridf[comp]);
-        SphericalModel model(*data->phasevol, *df, data->gridh);
-
-        // store diagnostic quantities
-        data->Mass += model.cumulMass();
-        data->Etot += model.cumulEtotal();
-        data->Ekin += model.cumulEkin();
+    // construct the spherical model for the DF of each component in the current potential;
+    // this is the most expensive part, and the components are processed in parallel
+    std::vector<math::PtrFunction> dfs(numComp);
+    std::vector<shared_ptr<const SphericalModel> > models(numComp);
+    std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int comp = 0; comp < numComp; comp++) {
+        try{
+            dfs[comp] = impl->getInterpolatedFunction(data->gridf[comp]);
+            models[comp].reset(new SphericalModel(*data->phasevol, *dfs[comp], data->gridh));
+        }
+        catch(std::exception& e) {
+            errorMsg = e.what();
+        }
+    }
+    if(!errorMsg.empty())
+        throw std::runtime_error("FokkerPlanckSolver: " + errorMsg);
+
+    // store diagnostic quantities
+    for(int comp = 0; comp < numComp; comp++) {
+        data->Mass += models[comp]->cumulMass();
+        data->Etot += models[comp]->cumulEtotal();
+        data->Ekin += models[comp]->cumulEkin();
         // one could also compute them as
         //data->Mass += math::blas_ddot(data->gridf[comp], data->gridMass);
         //data->Etot += math::blas_ddot(data->gridf[comp], data->gridEnergy);
+    }
 
-        // compute the advection and diffusion coefficients for the given component
-        // at the points of grid where these coefs are needed
-        for(unsigned int p=0; p<numPoints; p++) {
-            double h  = data->gridAdvDifCoefs[p], g;
-            double I0 = model.I0(h);
-            double Kg = model.cumulMass(h);
-            double Kh = model.cumulEkin(h) * (2./3);
-            data->phasevol->E(h, &g);
+    // compute the advection and diffusion coefficients at the points of grid where these coefs
+    // are needed, summing up the contributions from all components (in the same order at each point,
+    // so that the result does not depend on the number of threads);
+    // the diffusion coef is the same for all species, and the functional form of the advection coef
+    // is also universal, but its magnitude will be later multiplied by the stellar mass of each species
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int p=0; p<numPoints; p++) {
+        double h = data->gridAdvDifCoefs[p], g;
+        data->phasevol->E(h, &g);
+        for(int comp = 0; comp < numComp; comp++) {
+            double I0 = models[comp]->I0(h);
+            double Kg = models[comp]->cumulMass(h);
+            double Kh = models[comp]->cumulEkin(h) * (2./3);
 
             // advection coefficient D_h  without the pre-factor m_star
             data->gridAdv[p] += GAMMA * Kg;
@@ -1013,24 +1119,31 @@ void FokkerPlanckSolver::reinitAdvDifCoefs()
             // diffusion coefficient D_hh
             data->gridDif[p] += GAMMA * data->Mstar[comp] * g * (Kh + h * I0);
         }
+    }
 
-        // if needed, compute the angular-momentum diffusion coefficient on a different grid in h
-        if(computeDrainMatrix && data->lossConeDrain) {
-            for(unsigned int i=0; i<gridSize; i++) {
-                gridLC[i]  += difCoefLosscone(model,
-                    potential::PotentialWrapper(*data->currPot),
-                    data->phasevol->E(data->gridh[i])) *
-                    (data->coulombLog * data->Mstar[comp] / model.cumulMass());
+    // if needed, compute the angular-momentum diffusion coefficient on a different grid in h
+    if(computeDrainMatrix && data->lossConeDrain) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for(int i=0; i<gridSize; i++) {
+            double E = data->phasevol->E(data->gridh[i]);
+            for(int comp = 0; comp < numComp; comp++) {
+                gridLC[i]  += difCoefLosscone(*models[comp],
+                    potential::PotentialWrapper(*data->currPot), E) *
+                    (data->coulombLog * data->Mstar[comp] / models[comp]->cumulMass());
             }
         }
+    }
 
-        // store the value of f(h) and the integral I0(h) at the inner boundary
-        // and accumulate the advection/diffusion coefs at this point
-        double h0   = data->gridh[0];
-        fval0[comp] = df->value(h0);
-        fint0[comp] = model.I0(h0);
-        adv0 += GAMMA * model.cumulMass(h0);
-        dif0 += GAMMA * data->Mstar[comp] * (model.cumulEkin(h0) * (2./3) + h0 * fint0[comp]);
+    // store the value of f(h) and the integral I0(h) at the inner boundary
+    // and accumulate the advection/diffusion coefs at this point
+    double h0 = data->gridh[0];
+    for(int comp = 0; comp < numComp; comp++) {
+        fval0[comp] = dfs[comp]->value(h0);
+        fint0[comp] = models[comp]->I0(h0);
+        adv0 += GAMMA * models[comp]->cumulMass(h0);
+        dif0 += GAMMA * data->Mstar[comp] * (models[comp]->cumulEkin(h0) * (2./3) + h0 * fint0[comp]);
     }
 
     // convert the sum of total energies of all stars into the total energy of the entire system
@@ -1040,7 +1153,7 @@ void FokkerPlanckSolver::reinitAdvDifCoefs()
     // we may compute the energy conduction flux through the innermost boundary
     // (advection flux will be computed later in the evolve() method)
     data->drainRateEnergy = 0.;
-    for(unsigned int comp=0; comp<numComp; comp++) {
+    for(int comp=0; comp<numComp; comp++) {
         data->drainRateEnergy += -adv0 * data->Mstar[comp] * fint0[comp] + dif0 * fval0[comp];
     }
 
@@ -1049,7 +1162,7 @@ void FokkerPlanckSolver::reinitAdvDifCoefs()
         // construct interpolator for the angular-momentum diffusion coef
         math::LogLogSpline interpLC(data->gridh, gridLC);
         // compute the matrix elements for the draining rate, separately for each species
-        for(unsigned int comp=0; comp<numComp; comp++) {
+        for(int comp=0; comp<numComp; comp++) {
             math::BandMatrix<double> mat = impl->projMatrix(
                 FncDrainRate(*data->currPot, *data->phasevol,
                     2 * data->Mbh * data->captureRadius[comp], interpLC));
@@ -1073,7 +1186,7 @@ void FokkerPlanckSolver::reinitAdvDifCoefs()
 
     // initialize the source term in the matrix equation
     data->sourceRateMass = data->sourceRateEnergy = 0.;
-    for(unsigned int comp=0; comp<numComp; comp++) {
+    for(int comp=0; comp<numComp; comp++) {
         if(data->sourceRate[comp] == 0)
             continue;
         // translate the radius of the source term to phase volume
@@ -1092,124 +1205,217 @@ void FokkerPlanckSolver::reinitAdvDifCoefs()
 }
 
 double FokkerPlanckSolver::evolve(double deltat)
+{
+    double error;
+    return evolveStep(deltat, INFINITY, error);
+}
+
+double FokkerPlanckSolver::evolveStep(double deltat, double maxError, double& error)
 {
     // use energy correction if the ratio of the current to the previous timesteps is not too extreme
     bool useCorrection  = deltat < data->prevdeltat*2;
-    double accretedMass = 0;   // keep track of the change in Mbh
-
-    // evolve the DF of each component
+    bool computeError   = maxError < INFINITY;
+    const int numComp   = data->numComp;
+
+    // the rates of change of mass and energy due to the source and the conductive flux
+    // through the inner boundary, computed for the DF at the beginning of the timestep
+    // (they would be overwritten in the course of implicit iterations)
+    const double sourceRateMass = data->sourceRateMass, sourceRateEnergy = data->sourceRateEnergy,
+        drainRateEnergy = data->drainRateEnergy;
+
+    // the new DF of each component at the end of the timestep, and the same array for
+    // the previous iteration of the implicit scheme (the current DF is kept in data->gridf)
+    std::vector< std::vector<double> > newf(numComp), prevIterf;
+    // relaxation matrices at the beginning of the timestep (stored for the next timestep)
+    std::vector< math::BandMatrix<double> > relaxationMatrices(numComp);
+    // maximum relative change of DF for each component and the mass and energy lost through
+    // the inner boundary and the loss cone (accumulated separately for each component),
+    // and the estimate of the local error of the time integration for each component
+    std::vector<double> deltaf(numComp), lostMass(numComp), lostEnergy(numComp), errors(numComp, 0.);
     double maxdeltaf = 0.;
-    for(unsigned int comp = 0; comp < data->numComp; comp++) {
-        // prepare the advection and diffusion coefficients for the current component
-        std::vector<double> compAdv = data->gridAdv, compDif = data->gridDif;
-        math::blas_dmul(data->Mstar[comp], compAdv);
+    error = 0.;
+
+    for(unsigned int iter=0; ; iter++) {
+        // energy correction is only applied in the first (semi-implicit) iteration,
+        // since the subsequent ones use the coefficients computed from the DF at the end of timestep
+        bool useCorr = useCorrection && iter==0;
+        std::string errorMsg;
+
+        // evolve the DF of each component: species are coupled only through the total
+        // advection/diffusion coefficients, so the linear systems are solved in parallel
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for(int comp = 0; comp < numComp; comp++) {
+            try{
+                const std::vector<double>& oldf = data->gridf[comp];
+                // prepare the advection and diffusion coefficients for the current component
+                std::vector<double> compAdv = data->gridAdv, compDif = data->gridDif;
+                math::blas_dmul(data->Mstar[comp], compAdv);
+
+                // weight matrix M and relaxation matrix R
+                const math::BandMatrix<double> weightMatrix = impl->weightMatrix();
+                const math::BandMatrix<double> relaxationMatrix = impl->relaxationMatrix(compAdv, compDif);
+                const unsigned int bandwidth = weightMatrix.bandwidth();  // bandwidth of band matrices
+                const unsigned int dim = oldf.size();  // dimension of the linear system
+                assert(relaxationMatrix.rows() == dim && weightMatrix.rows() == dim);
+                if(iter==0)
+                    relaxationMatrices[comp] = relaxationMatrix;
+
+                // estimate the local error of the time integration by step doubling:
+                // compare the solution obtained by a single backward-Euler step of length deltat
+                // with the one obtained by two consecutive steps of length deltat/2
+                // (both computed without the energy correction term)
+                if(iter==0 && computeError) {
+                    math::BandMatrix<double> rateMatrix = relaxationMatrix;
+                    if(data->absorbingBoundaryCondition)
+                        math::blas_daxpy(1., data->drainMatrix[comp], rateMatrix);
+                    const std::vector<double>* source =
+                        data->sourceRate[comp]>0. ? &data->gridSourceRate[comp] : NULL;
+                    std::vector<double>
+                    fullStep  = stepBackwardEuler(weightMatrix, rateMatrix, source,
+                        data->absorbingBoundaryCondition, deltat, oldf),
+                    halfStep1 = stepBackwardEuler(weightMatrix, rateMatrix, source,
+                        data->absorbingBoundaryCondition, deltat*0.5, oldf),
+                    halfStep2 = stepBackwardEuler(weightMatrix, rateMatrix, source,
+                        data->absorbingBoundaryCondition, deltat*0.5, halfStep1);
+                    errors[comp] = maxRelDifference(halfStep2, fullStep, data->gridMass);
+                    // if the error is too large, the step will be rejected, so skip the rest
+                    if(errors[comp] > maxError)
+                        continue;
+                }
 
-        // weight matrix M and relaxation matrix R
-        const math::BandMatrix<double> weightMatrix = impl->weightMatrix();
-        const math::BandMatrix<double> relaxationMatrix = impl->relaxationMatrix(compAdv, compDif);
-        const unsigned int bandwidth = weightMatrix.bandwidth();  // bandwidth of band matrices
-        const unsigned int dim = data->gridf[comp].size();  // dimension of the linear system
-        assert(relaxationMatrix.rows() == dim && weightMatrix.rows() == dim);
-
-        // assemble the matrix equation  L f_new = R f_old + dt S,
-        // where the lhs matrix L = weightMatrix - dt * (relaxationMatrix + drainMatrix),
-        // and   the rhs matrix R = weightMatrix + dt * deltaRel
-        // (the latter is the energy correction term), and S is the source matrix
-        math::BandMatrix<double> lhsMatrix = weightMatrix;
-        math::blas_daxpy(-deltat, relaxationMatrix, lhsMatrix);
-
-        std::vector<double> rhs(dim);    // the r.h.s. of the above equation
-        math::blas_dgemv(math::CblasNoTrans, 1., weightMatrix, data->gridf[comp], 0., rhs);
-
-        // energy correction term
-        if(useCorrection) {
-            // estimate d relMatrix / d t = (relMatrix - prevRel) / prevdt,
-            // and then extrapolate forward in time to estimate  deltaRel = (newRel - relMatrix) * deltat
-            math::BandMatrix<double> deltaRel = data->prevRelaxationMatrix[comp];
-            math::blas_daxpy(-1., relaxationMatrix, deltaRel);   // deltaRel := prevRel-relMatrix
-            for(unsigned int b = 0; b <= deltaRel.bandwidth(); b++)
-                deltaRel(0, b) = 0.;   // zero out the first row which sometimes leads to instability
-            // add the correction term  "dt * deltaRel * f_old"  to the rhs
-            math::blas_dgemv(math::CblasNoTrans, -pow_2(deltat) / data->prevdeltat, deltaRel,
-                data->gridf[comp], 1., rhs);
-        }
-        data->prevRelaxationMatrix[comp] = relaxationMatrix;
+                // assemble the matrix equation  L f_new = R f_old + dt S,
+                // where the lhs matrix L = weightMatrix - dt * (relaxationMatrix + drainMatrix),
+                // and   the rhs matrix R = weightMatrix + dt * deltaRel
+                // (the latter is the energy correction term), and S is the source matrix
+                math::BandMatrix<double> lhsMatrix = weightMatrix;
+                math::blas_daxpy(-deltat, relaxationMatrix, lhsMatrix);
+
+                std::vector<double> rhs(dim);    // the r.h.s. of the above equation
+                math::blas_dgemv(math::CblasNoTrans, 1., weightMatrix, oldf, 0., rhs);
+
+                // energy correction term
+                if(useCorr) {
+                    // estimate d relMatrix / d t = (relMatrix - prevRel) / prevdt,
+                    // and then extrapolate forward in time to estimate  deltaRel = (newRel - relMatrix) * deltat
+                    math::BandMatrix<double> deltaRel = data->prevRelaxationMatrix[comp];
+                    math::blas_daxpy(-1., relaxationMatrix, deltaRel);   // deltaRel := prevRel-relMatrix
+                    for(unsigned int b = 0; b <= deltaRel.bandwidth(); b++)
+                        deltaRel(0, b) = 0.;   // zero out the first row which sometimes leads to instability
+                    // add the correction term  "dt * deltaRel * f_old"  to the rhs
+                    math::blas_dgemv(math::CblasNoTrans, -pow_2(deltat) / data->prevdeltat, deltaRel,
+                        oldf, 1., rhs);
+                }
 
-        // sink term in the lhs:  lhsMatrix -= deltat * drainMatrix
-        if(data->absorbingBoundaryCondition)
-            math::blas_daxpy(-deltat, data->drainMatrix[comp], lhsMatrix);
-
-        // source term in the rhs
-        if(data->sourceRate[comp]>0.)
-            math::blas_daxpy(deltat, data->gridSourceRate[comp], rhs);
-
-        // boundary conditions: zero-flux (Neumann) b/c does not need anything special,
-        // while a constant-value (Dirichlet) b/c essentially eliminates the first/last row
-        // of the matrix equation, or, rather, makes it trivial
-        for(unsigned int b = 0; b <= bandwidth; b++) {
-            lhsMatrix(dim-1, dim-1-b) = b==0 ? 1. : 0.;
-            rhs[dim-1] = data->gridf[comp][dim-1];
-            if(data->absorbingBoundaryCondition) {
-                lhsMatrix(0, b) = b==0 ? 1. : 0.;
-                rhs[0] = data->gridf[comp][0];
-            }
-        }
+                // sink term in the lhs:  lhsMatrix -= deltat * drainMatrix
+                if(data->absorbingBoundaryCondition)
+                    math::blas_daxpy(-deltat, data->drainMatrix[comp], lhsMatrix);
 
-        // solve the matrix equation  L f_new = R f_old + dt S
-        // newf := L^{-1} rhs
-        std::vector<double> newf = math::solveBand(lhsMatrix, rhs);
+                // source term in the rhs
+                if(data->sourceRate[comp]>0.)
+                    math::blas_daxpy(deltat, data->gridSourceRate[comp], rhs);
 
-        // keep track of the maximum relative change of DF over all grid points,
-        // excluding those inside the loss cone (those will always be set to near-zero)
-        for(unsigned int i=0; i<dim; i++) {
-            if(data->gridf[comp][i] > 0. && newf[i] > 0.)
-                maxdeltaf = fmax(maxdeltaf, fabs(log(newf[i] / data->gridf[comp][i])));
-        }
+                // boundary conditions
+                applyBoundaryConditions(oldf, data->absorbingBoundaryCondition, lhsMatrix, rhs);
+
+                // solve the matrix equation  L f_new = R f_old + dt S
+                // newf := L^{-1} rhs
+                newf[comp] = math::solveBand(lhsMatrix, rhs);
+
+                // keep track of the maximum relative change of DF over all grid points,
+                // excluding those inside the loss cone (those will always be set to near-zero)
+                deltaf[comp] = 0.;
+                for(unsigned int i=0; i<dim; i++) {
+                    if(oldf[i] > 0. && newf[comp][i] > 0.)
+                        deltaf[comp] = fmax(deltaf[comp], fabs(log(newf[comp][i] / oldf[i])));
+                }
+
+                lostMass[comp] = lostEnergy[comp] = 0.;
+                // reconstruct the mass flux through the boundary (in case of Dirichlet b/c) and
+                if(data->absorbingBoundaryCondition) {
+                    double lostMassBoundary = 0.;
+                    // use the first row of the matrix equation that we have previously replaced with (1 0 0 ...)
+                    // now we take back the original matrices and compute the flux by summing up
+                    // M_{0j} (fnew_j - fold_j) - R_{0j} fnew_j dt.
+                    // note that this won't work if the absorbing boundary was effectively not at 0th element
+                    for(unsigned int b=1; b<=bandwidth; b++) {
+                        lostMassBoundary += (newf[comp][b] - oldf[b]) * weightMatrix(0, b) -
+                            newf[comp][b] * relaxationMatrix(0, b) * deltat;
+                    }
+                    lostMass  [comp] += lostMassBoundary;
+                    lostEnergy[comp] += lostMassBoundary * data->phasevol->E(data->gridh[0]);
+                }
 
-        // reconstruct the mass flux through the boundary (in case of Dirichlet b/c) and
-        if(data->absorbingBoundaryCondition) {
-            double lostMass = 0.;
-            // use the first row of the matrix equation that we have previously replaced with (1 0 0 ...)
-            // now we take back the original matrices and compute the flux by summing up
-            // M_{0j} (fnew_j - fold_j) - R_{0j} fnew_j dt.
-            // note that this won't work if the absorbing boundary was effectively not at 0th element
-            for(unsigned int b=1; b<=bandwidth; b++) {
-                lostMass += (newf[b] - data->gridf[comp][b]) * weightMatrix(0, b) - 
-                    newf[b] * relaxationMatrix(0, b) * deltat;
+                // keep track of mass and energy removed from the system through the loss cone
+                if(data->absorbingBoundaryCondition) {
+                    // compute the change of DF resulting from the loss-cone term alone:
+                    // solve the same matrix equation L f_{new,LC} = R f_old,
+                    // but with R = weightMatrix, L = weightMatrix - deltat * drainMatrix
+                    lhsMatrix = weightMatrix;
+                    math::blas_daxpy(-deltat, data->drainMatrix[comp], lhsMatrix);
+                    math::blas_dgemv(math::CblasNoTrans, 1., weightMatrix, oldf, 0., rhs);
+                    std::vector<double> newfLC = math::solveBand(lhsMatrix, rhs);
+                    // compute deltaf:  f_{new,LC} -= f_old
+                    math::blas_daxpy(-1., oldf, newfLC);
+                    // compute the change in total mass of this component
+                    lostMass  [comp] += math::blas_ddot(newfLC, data->gridMass);
+                    lostEnergy[comp] += math::blas_ddot(newfLC, data->gridEnergy);
+                }
+            }
+            catch(std::exception& e) {
+                errorMsg = e.what();
             }
-            data->drainMass   += lostMass;
-            data->drainEnergy += lostMass * data->phasevol->E(data->gridh[0]);
-            accretedMass      -= lostMass * data->captureMassFraction[comp];
         }
-
-        // keep track of mass and energy removed from the system through the loss cone
-        if(data->absorbingBoundaryCondition) {
-            // compute the change of DF resulting from the loss-cone term alone:
-            // solve the same matrix equation L f_{new,LC} = R f_old, 
-            // but with R = weightMatrix, L = weightMatrix - deltat * drainMatrix
-            lhsMatrix = weightMatrix;
-            math::blas_daxpy(-deltat, data->drainMatrix[comp], lhsMatrix);
-            math::blas_dgemv(math::CblasNoTrans, 1., weightMatrix, data->gridf[comp], 0., rhs);
-            std::vector<double> newfLC = math::solveBand(lhsMatrix, rhs);
-            // compute deltaf:  f_{new,LC} -= f_old
-            math::blas_daxpy(-1., data->gridf[comp], newfLC);
-            // compute the change in total mass of this component
-            double lostMass    = math::blas_ddot(newfLC, data->gridMass);
-            data->drainMass   += lostMass;
-            data->drainEnergy += math::blas_ddot(newfLC, data->gridEnergy);
-            // a fraction of this mass will be contributed to the black hole mass
-            accretedMass      -= lostMass * data->captureMassFraction[comp];
+        if(!errorMsg.empty())
+            throw std::runtime_error("FokkerPlanckSolver: " + errorMsg);
+
+        // reject the step if the error estimate is too large; nothing has been modified so far
+        if(iter==0 && computeError) {
+            error = maxElement(errors);
+            if(error > maxError)
+                return NAN;
         }
+        maxdeltaf = maxElement(deltaf);
+
+        // stop if the implicit scheme is not used, or if the iterations have converged
+        if(iter >= data->maxImplicitIterations)
+            break;
+        if(iter > 0) {
+            double maxchange = 0.;
+            for(int comp = 0; comp < numComp; comp++)
+                for(unsigned int i=0; i<newf[comp].size(); i++)
+                    if(prevIterf[comp][i] > 0. && newf[comp][i] > 0.)
+                        maxchange = fmax(maxchange, fabs(log(newf[comp][i] / prevIterf[comp][i])));
+            if(maxchange < data->implicitTolerance)
+                break;
+        }
+        prevIterf = newf;
 
-        // overwrite the array of DF values at grid nodes with the new ones
-        data->gridf[comp] = newf;
+        // recompute the advection/diffusion coefficients from the DF at the end of the timestep
+        // (temporarily swapping it with the current one, which is still needed as the initial value)
+        data->gridf.swap(newf);
+        reinitAdvDifCoefs(/*updateDrainMatrix*/ false);
+        data->gridf.swap(newf);
+    }
+
+    // overwrite the array of DF values at grid nodes with the new ones,
+    // and keep track of the mass and energy lost through the inner boundary and the loss cone
+    double accretedMass = 0;   // keep track of the change in Mbh
+    for(int comp = 0; comp < numComp; comp++) {
+        data->gridf[comp]  = newf[comp];
+        data->prevRelaxationMatrix[comp] = relaxationMatrices[comp];
+        data->drainMass   += lostMass[comp];
+        data->drainEnergy += lostEnergy[comp];
+        // a fraction of this mass will be contributed to the black hole mass
+        accretedMass      -= lostMass[comp] * data->captureMassFraction[comp];
     }
 
     // keep track of the mass and energy added to the system through the source term
-    data->sourceMass   += deltat * data->sourceRateMass;
-    data->sourceEnergy += deltat * data->sourceRateEnergy;
+    data->sourceMass   += deltat * sourceRateMass;
+    data->sourceEnergy += deltat * sourceRateEnergy;
     // same for the energy lost through the conduction across the inner boundary
-    data->drainEnergy  += deltat * data->drainRateEnergy;
+    data->drainEnergy  += deltat * drainRateEnergy;
     if(data->Mbh) {
         // increase the black hole mass
         data->Mbh         += accretedMass;
@@ -1217,9 +1423,20 @@ double FokkerPlanckSolver::evolve(double deltat)
         data->drainEnergy += accretedMass * data->Phi0;
     }
 
-    // recompute the potential (if necessary) and the adv/dif coefs
-    if(data->updatePotential && data->numSteps%1==0) {
-        reinitPotential(deltat);
+    // recompute the potential (if necessary) and the adv/dif coefs;
+    // the potential is updated only if the DF has changed by more than the given tolerance
+    // since the previous update (the relative change of density, which is an integral of DF
+    // over velocity, does not exceed the maximum relative change of the DF itself)
+    data->time += deltat;
+    data->timeSincePotentialUpdate += deltat;
+    if(data->updatePotential && (data->potentialUpdateTolerance <= 0. ||
+        maxRelDifference(sumVectors(data->gridf), sumVectors(data->gridfPotentialUpdate), data->gridMass)
+        > data->potentialUpdateTolerance))
+    {
+        reinitPotential(data->timeSincePotentialUpdate);
+        data->prevPotentialUpdateInterval = data->timeSincePotentialUpdate;
+        data->timeSincePotentialUpdate = 0.;
+        data->gridfPotentialUpdate = data->gridf;
     }
     reinitAdvDifCoefs();
 
@@ -1229,4 +1446,682 @@ double FokkerPlanckSolver::evolve(double deltat)
     return maxdeltaf;
 }
 
+double FokkerPlanckSolver::evolveAdaptive(double deltatMax)
+{
+    // safety factor and the range of allowed changes of the timestep between consecutive steps
+    const double SAFETY = 0.8, MAXGROW = 4., MAXSHRINK = 0.2;
+    // the step may be stretched by this fraction to reach deltatMax, rather than leaving a short
+    // remainder for the next step (e.g., when deltatMax is the time until the next output)
+    const double MAXSTRETCH = 0.2;
+    // upper limit on the number of rejected attempts
+    const int MAXATTEMPTS = 30;
+    const double tolerance = data->timeAccuracy;
+    if(!(tolerance > 0.))
+        throw std::runtime_error("FokkerPlanckSolver: timeAccuracy should be positive");
+    if(!(deltatMax > 0.))
+        throw std::invalid_argument("FokkerPlanckSolver: maximum timestep should be positive");
+    double deltat = data->nextdeltat > 0. ?
+        data->nextdeltat :   // the length suggested after the previous step
+        0.01 * tolerance * relaxationTime();   // initial guess for the first timestep
+    for(int attempt=0; attempt<MAXATTEMPTS; attempt++) {
+        if(deltat >= deltatMax || (attempt == 0 && deltat * (1 + MAXSTRETCH) >= deltatMax))
+            deltat = deltatMax;
+        double error;
+        double relChange = evolveStep(deltat, tolerance, error);
+        // the error estimate of the first-order scheme scales as deltat^2
+        double factor = error > 0. ?
+            fmax(MAXSHRINK, fmin(MAXGROW, SAFETY * sqrt(tolerance / error))) : MAXGROW;
+        if(relChange == relChange) {   // step accepted (not NAN)
+            // do not let the suggested timestep be limited by the (possibly small) length
+            // of the last step, if it was truncated to reach the target time
+            if(deltat < deltatMax || deltat * factor > data->nextdeltat)
+                data->nextdeltat = deltat * factor;
+            return deltat;
+        }
+        utils::msg(utils::VL_DEBUG, "FokkerPlanckSolver", "Timestep " + utils::toString(deltat) +
+            " rejected: error=" + utils::toString(error));
+        deltat *= factor;
+    }
+    throw std::runtime_error("FokkerPlanckSolver: timestep too small at t=" + utils::toString(data->time));
+}
+
+double FokkerPlanckSolver::evolveUntil(double timeEnd, const FokkerPlanckStopCondition* stop)
+{
+    // the remaining time shorter than this fraction of timeEnd is attributed to roundoff errors
+    // and does not warrant another (tiny) timestep
+    const double TIME_TOLERANCE = 1e-12;
+    const double timeTol = TIME_TOLERANCE * fabs(timeEnd);
+    while(timeEnd - data->time > timeTol) {
+        evolveAdaptive(timeEnd - data->time);
+        if(fabs(timeEnd - data->time) <= timeTol)
+            data->time = timeEnd;   // eliminate roundoff errors
+        if(stop && (*stop)(*this))
+            break;
+    }
+    return data->time;
+}
+
+double FokkerPlanckSolver::time() const { return data->time; }
+
+double FokkerPlanckSolver::nextTimestep() const { return data->nextdeltat; }
+
+bool FokkerPlanckDensityThreshold::operator()(const FokkerPlanckSolver& solver) const
+{
+    // compute the total density of all components at the given radius in the current potential
+    std::vector<double> gridPhi(1, solver.potential()->value(radius));
+    double rho = 0.;
+    for(unsigned int comp=0; comp<solver.numComp(); comp++)
+        rho += computeDensity(*solver.df(comp), *solver.phaseVolume(), gridPhi)[0];
+    return rho >= threshold;
+}
+
+
+
+// ------ the two-dimensional Fokker-Planck solver in (h, R) ------ //
+
+namespace {
+
+/// default grid size in scaled squared angular momentum R
+static const size_t DEFAULT_GRID_SIZE_R = 40;
+
+/// order of Gauss-Legendre quadrature for the orbit-averaging of the diffusion coefficient in R
+static const int GLORDER_ORBIT = 16;
+
+/// relative accuracy of locating the peri- and apocenter radii
+static const double ACCURACY_ROOT = 1e-10;
+
+/// the function whose roots are the peri/apocenter radii of an orbit with the given E and L:
+/// r^2 v_r^2 = 2 [E - Phi(r)] r^2 - L^2
+class FncRadialVelocity: public math::IFunctionNoDeriv {
+    const math::IFunction& pot;  ///< gravitational potential
+    const double E, L2;          ///< energy and squared angular momentum
+public:
+    FncRadialVelocity(const math::IFunction& _pot, double _E, double _L2) :
+        pot(_pot), E(_E), L2(_L2) {}
+    virtual double value(const double r) const {
+        return r==0 ? -L2 : 2 * (E - pot(r)) * pow_2(r) - L2;
+    }
+};
+
+/** compute the orbit-averaged diffusion coefficient in scaled squared angular momentum
+    D_RR = (1/2) <Delta R^2>  for an orbit with energy E and R = L^2 / Lcirc^2(E),
+    summing up the contributions of all species, each multiplied by the given factor.
+    The local coefficient is
+    <Delta R^2> = 4 R r^2 / Lcirc^2 [ (v_t^2 / v^2) <Delta v_par^2> + (v_r^2 / v^2) <Delta v_per^2> / 2 ],
+    and it is averaged over the radial period using the substitution r = r_mid - r_half cos(theta),
+    which eliminates the singularities of 1/v_r at the turning points.
+*/
+double difCoefR(const math::IFunction& pot,
+    const std::vector<shared_ptr<const SphericalModelLocal> >& models,
+    const std::vector<double>& mult,
+    double E, double rcirc, double rmax, double Lcirc2, double R)
+{
+    double L2 = R * Lcirc2;
+    FncRadialVelocity fnc(pot, E, L2);
+    double rperi = math::findRoot(fnc, 0, rcirc, ACCURACY_ROOT);
+    double rapo  = math::findRoot(fnc, rcirc, rmax, ACCURACY_ROOT);
+    if(!(rperi < rapo))   // nearly circular orbit, or a failure to locate the turning points
+        rperi = rapo = rcirc;
+    double rmid = 0.5 * (rapo + rperi), rhalf = 0.5 * (rapo - rperi);
+    double sumT = 0, sumD = 0;
+    const double *glnodes = math::GLPOINTS[GLORDER_ORBIT], *glweights = math::GLWEIGHTS[GLORDER_ORBIT];
+    for(int k=0; k<GLORDER_ORBIT; k++) {
+        double theta = M_PI * glnodes[k], r = rmid - rhalf * cos(theta), Phi = pot(r);
+        double v2 = 2 * (E - Phi), vt2 = L2 / pow_2(r), vr2 = v2 - vt2;
+        if(!(vr2 > 0))
+            continue;
+        // in the limit of a circular orbit, rhalf*sin(theta)/v_r tends to a finite value,
+        // and the average is taken over the circle
+        double w = rhalf > 0 ? glweights[k] * rhalf * sin(theta) / sqrt(vr2) : glweights[k];
+        double local = 0;
+        for(unsigned int c=0; c<models.size(); c++) {
+            double dvpar, dv2par, dv2per;
+            models[c]->evalLocal(Phi, E, dvpar, dv2par, dv2per);
+            local += mult[c] * (vt2 * dv2par + 0.5 * vr2 * dv2per) / v2;
+        }
+        sumT += w;
+        sumD += w * pow_2(r) * local;
+    }
+    return sumT > 0 ? 2 * R / Lcirc2 * sumD / sumT : 0;
+}
+
+}  // internal namespace
+
+/// The aggregate structure containing all internal data of FokkerPlanckSolver2d
+class FokkerPlanckData2d {
+public:
+
+    /// number of species (fixed)
+    const unsigned int numComp;
+
+    /// Coulomb logarithm that enters the expressions for diffusion coefs (fixed)
+    const double coulombLog;
+
+    /// whether the density of evolving system contributes to the potential (fixed)
+    const bool selfGravity;
+
+    /// whether the stellar potential is updated in the course of simulation (fixed)
+    const bool updatePotential;
+
+    /// array of masses of a single star in each species (fixed)
+    std::vector<double> Mstar;
+
+    /// array of capture radii in each species (fixed)
+    std::vector<double> captureRadius;
+
+    /// fractions of mass of disrupted stars of each species that is added to the black hole mass (fixed)
+    std::vector<double> captureMassFraction;
+
+    /// total potential of all components plus the black hole (evolves or stays fixed)
+    potential::PtrPotential currPot;
+
+    /// mapping between energy and phase volume for the total potential (evolves together with totalPot)
+    potential::PtrPhaseVolume phasevol;
+
+    /// mass of the central black hole (grows with time)
+    double Mbh;
+
+    /// total mass of all stellar components (evolves)
+    double Mass;
+
+    /// stellar potential at r=0 (evolves)
+    double Phi0;
+
+    /// total and kinetic energy of the entire system (evolves)
+    double Etot, Ekin;
+
+    /// total change in mass (<0) and energy resulting from the stars
+    /// being captured by the black hole (evolves)
+    double drainMass, drainEnergy;
+
+    /// the capture rate during the last timestep (evolves)
+    double drainRate;
+
+    /// grid in phase volume h (fixed)
+    std::vector<double> gridh;
+
+    /// grid in scaled squared angular momentum R (fixed)
+    std::vector<double> gridR;
+
+    /// widths of cells in R surrounding each node of gridR; the cell boundaries are placed
+    /// half-way between the nodes in log(R), and the outermost cells extend to 0 and 1 (fixed)
+    std::vector<double> gridWeightsR;
+
+    /// values of the DF at the nodes of the 2d grid, stored in row-major order
+    /// (index i*gridR.size()+j corresponds to gridh[i], gridR[j]), one vector for each component (evolve)
+    std::vector< std::vector<double> > gridf;
+
+    /// mass associated with each node of the 2d grid (fixed)
+    std::vector<double> gridMass;
+
+    /// auxiliary grid in phase volume where the advection/diffusion coefs in h are computed (fixed)
+    std::vector<double> gridAdvDifCoefs;
+
+    /// values of advection and diffusion coefficients in h collected at the nodes of
+    /// the auxiliary grid (sum over all species, evolve)
+    std::vector<double> gridAdv, gridDif;
+
+    /// conductance of the faces between adjacent nodes in R (rows - nodes in h, columns - faces in R):
+    /// the flux between nodes j and j+1 per unit h is  K_{i,j} (f_{i,j} - f_{i,j+1}),
+    /// where K = D_RR(R_face) / R_face / ln(R_{j+1} / R_j),  exact for D_RR proportional to R (evolve)
+    math::Matrix<double> gridCondR;
+
+    /// loss-cone diffusion coefficient D(h) = lim_{R->0} D_RR / R at the nodes of gridh (evolve)
+    std::vector<double> gridLC;
+
+    /// boundary of the loss cone R_0(h) at the nodes of gridh, one vector per species (evolve)
+    std::vector< std::vector<double> > gridR0;
+
+    /// current simulation time (evolves)
+    double time;
+
+    /// check the input parameters and initialize all member variables
+    FokkerPlanckData2d(const FokkerPlanckParams2d& params,
+        const std::vector<FokkerPlanckComponent>& components) :
+        numComp(components.size()),
+        coulombLog(params.coulombLog),
+        selfGravity(params.selfGravity),
+        updatePotential(params.updatePotential),
+        Mstar(numComp, 0.),
+        captureRadius(numComp, 0.),
+        captureMassFraction(numComp, 0.),
+        Mbh(params.Mbh),
+        Mass(0.), Phi0(0.), Etot(0.), Ekin(0.),
+        drainMass(0.), drainEnergy(0.), drainRate(0.),
+        gridf(numComp),
+        gridR0(numComp),
+        time(0.)
+    {
+        if(numComp == 0)
+            throw std::runtime_error("FokkerPlanckSolver2d: empty component list");
+        if(params.method != FP_CHANGCOOPER)
+            throw std::runtime_error("FokkerPlanckSolver2d: only the Chang&Cooper method is supported");
+        if(!(params.Rmin > 0 && params.Rmin < 1))
+            throw std::runtime_error("FokkerPlanckSolver2d: Rmin should be between 0 and 1");
+
+        // assemble the total density of all components
+        FncSum initDens(numComp);
+        for(unsigned int c=0; c<numComp; c++){
+            if(!components[c].initDensity)
+                throw std::runtime_error("FokkerPlanckSolver2d: must provide initial density");
+            if(components[c].captureMassFraction < 0. || components[c].captureMassFraction > 1.)
+                throw std::runtime_error("FokkerPlanckSolver2d: capture mass faction be between 0 and 1");
+            if(components[c].captureRadius < 0.)
+                throw std::runtime_error("FokkerPlanckSolver2d: capture radius should be non-negative");
+            if(components[c].Mstar <= 0.)
+                throw std::runtime_error("FokkerPlanckSolver2d: stellar masses should be positive");
+            if(components[c].sourceRate != 0.)
+                throw std::runtime_error("FokkerPlanckSolver2d: source term is not supported");
+            Mstar[c]               = components[c].Mstar;
+            captureRadius[c]       = components[c].captureRadius;
+            captureMassFraction[c] = components[c].captureMassFraction;
+            initDens.comps[c]      = components[c].initDensity;
+        }
+
+        // initialize the potential and the phase volume
+        currPot = computePotential(Mbh, selfGravity? &initDens : NULL,
+            /*rmin-autodetect*/ 0., /*rmax*/ 0., /*diagnostic output*/ Phi0);
+        phasevol.reset(new potential::PhaseVolume(potential::PotentialWrapper(*currPot)));
+    }
+
+    /// compute the DF averaged over R for the given component (or the sum of all components if
+    /// comp==numComp), expressed as an array of values at the nodes of gridh
+    std::vector<double> averagedDF(unsigned int comp) const
+    {
+        unsigned int sizeh = gridh.size(), sizeR = gridR.size();
+        std::vector<double> result(sizeh, 0.);
+        for(unsigned int c = comp<numComp ? comp : 0; c <= comp && c < numComp; c++)
+            for(unsigned int i=0; i<sizeh; i++)
+                for(unsigned int j=0; j<sizeR; j++)
+                    result[i] += gridf[c][i * sizeR + j] * gridWeightsR[j];
+        return result;
+    }
+};
+
+
+FokkerPlanckSolver2d::FokkerPlanckSolver2d(
+    const FokkerPlanckParams2d& params,
+    const std::vector<FokkerPlanckComponent>& components)
+:
+    data(new FokkerPlanckData2d(params, components))
+{
+    // set up the grid parameters in the same way as for the one-dimensional solver
+    size_t gridSize = params.gridSize ?: DEFAULT_GRID_SIZE;
+    size_t gridSizeR = params.gridSizeR ?: DEFAULT_GRID_SIZE_R;
+    if(gridSizeR < 2)
+        throw std::runtime_error("FokkerPlanckSolver2d: grid in R should have at least two nodes");
+    double hmin = params.hmin ?: INFINITY, hmax = params.hmax ?: 0.;
+    bool fixmin = params.hmin!=0, fixmax = params.hmax!=0;
+
+    // if there is a central black hole with a non-zero capture radius, the innermost boundary
+    // is placed at the energy where the loss cone occupies the entire range of angular momentum
+    double rcapt = minElement(data->captureRadius);
+    if(rcapt > 0. && data->Mbh > 0.) {
+        double rmin  = R_from_Lz(*data->currPot, sqrt(2 * data->Mbh * rcapt)), Phi;
+        coord::GradCyl dPhi;
+        data->currPot->eval(coord::PosCyl(rmin,0,0), &Phi, &dPhi);
+        hmin = data->phasevol->value(Phi + 0.5 * rmin * dPhi.dR);
+        fixmin = true;
+    }
+    if(params.rmax){
+        double Phi = data->currPot->value(coord::PosCyl(params.rmax,0,0));
+        hmax = data->phasevol->value(Phi);
+        fixmax = true;
+    }
+    if(hmin>0. && hmax>hmin)
+        data->gridh = math::createExpGrid(gridSize, hmin, hmax);
+
+    // construct the initial isotropic distribution function(s)
+    std::vector<math::PtrFunction> initDF(data->numComp);
+    for(unsigned int comp=0; comp<data->numComp; comp++) {
+        std::vector<double> gridh(data->gridh), initf;
+        makeEddingtonDF(*components[comp].initDensity, potential::PotentialWrapper(*data->currPot),
+            /*input/output*/ gridh, /*output*/ initf);
+        initDF[comp].reset(new math::LogLogSpline(gridh, initf));
+        if(!fixmin)
+            hmin = std::min(hmin, gridh.front());
+        if(!fixmax)
+            hmax = std::max(hmax, gridh.back());
+    }
+    utils::msg(utils::VL_DEBUG, "FokkerPlanckSolver2d", "Grid in h=[" +
+        utils::toString(hmin) + ":" + utils::toString(hmax) + "], " + utils::toString(gridSize) +
+        " nodes; grid in R=[" + utils::toString(params.Rmin) + ":1], " + utils::toString(gridSizeR) + " nodes");
+    data->gridh = math::createExpGrid(gridSize, hmin, hmax);
+    impl.reset(new FokkerPlanckImplChangCooper(data->gridh));
+
+    // grid in R and the widths of cells
+    data->gridR = math::createExpGrid(gridSizeR, params.Rmin, 1.);
+    data->gridR.back() = 1.;
+    data->gridWeightsR.resize(gridSizeR);
+    for(unsigned int j=0; j<gridSizeR; j++)
+        data->gridWeightsR[j] =
+            (j<gridSizeR-1 ? sqrt(data->gridR[j] * data->gridR[j+1]) : 1.) -
+            (j>0 ? sqrt(data->gridR[j-1] * data->gridR[j]) : 0.);
+
+    // initialize the DF at the nodes of the 2d grid (the Chang&Cooper scheme uses the values
+    // of the function at grid nodes as amplitudes), and the mass associated with each node
+    const math::BandMatrix<double> weightMatrix = impl->weightMatrix();
+    data->gridMass.resize(gridSize * gridSizeR);
+    for(unsigned int comp=0; comp<data->numComp; comp++) {
+        data->gridf[comp].resize(gridSize * gridSizeR);
+        for(unsigned int i=0; i<gridSize; i++) {
+            double f = initDF[comp]->value(data->gridh[i]);
+            for(unsigned int j=0; j<gridSizeR; j++) {
+                data->gridf[comp][i * gridSizeR + j] = f;
+                data->gridMass[i * gridSizeR + j] = weightMatrix(i, i) * data->gridWeightsR[j];
+            }
+        }
+    }
+    data->gridAdvDifCoefs = impl->getGridForCoefs();
+
+    if(params.updatePotential)
+        reinitPotential();
+    reinitAdvDifCoefs();
+
+    // initially empty the loss cone
+    for(unsigned int comp=0; comp<data->numComp; comp++)
+        for(unsigned int i=0; i<gridSize; i++)
+            for(unsigned int j=0; j<gridSizeR && data->gridR[j] <= data->gridR0[comp][i]; j++)
+                data->gridf[comp][i * gridSizeR + j] = 0.;
+}
+
+math::PtrFunction FokkerPlanckSolver2d::potential() const
+{
+    return math::PtrFunction(new potential::PotentialWrapper(*data->currPot));
+}
+potential::PtrPhaseVolume FokkerPlanckSolver2d::phaseVolume() const { return data->phasevol; }
+double FokkerPlanckSolver2d::time() const { return data->time; }
+double FokkerPlanckSolver2d::Mbh()  const { return data->Mbh; }
+double FokkerPlanckSolver2d::Mass() const { return data->Mass; }
+double FokkerPlanckSolver2d::Phi0() const { return data->Phi0; }
+double FokkerPlanckSolver2d::Etot() const { return data->Etot; }
+double FokkerPlanckSolver2d::Ekin() const { return data->Ekin; }
+double FokkerPlanckSolver2d::drainMass()   const { return data->drainMass; }
+double FokkerPlanckSolver2d::drainEnergy() const { return data->drainEnergy; }
+double FokkerPlanckSolver2d::drainRate()   const { return data->drainRate; }
+unsigned int FokkerPlanckSolver2d::numComp() const { return data->numComp; }
+std::vector<double> FokkerPlanckSolver2d::gridh() const { return data->gridh; }
+std::vector<double> FokkerPlanckSolver2d::gridR() const { return data->gridR; }
+
+math::Matrix<double> FokkerPlanckSolver2d::df(unsigned int indexComp) const
+{
+    if(indexComp >= data->numComp)
+        throw std::out_of_range("FokkerPlanckSolver2d: component index out of range");
+    unsigned int sizeh = data->gridh.size(), sizeR = data->gridR.size();
+    math::Matrix<double> result(sizeh, sizeR);
+    for(unsigned int i=0; i<sizeh; i++)
+        for(unsigned int j=0; j<sizeR; j++)
+            result(i, j) = data->gridf[indexComp][i * sizeR + j];
+    return result;
+}
+
+math::PtrFunction FokkerPlanckSolver2d::dfIsotropic(unsigned int indexComp) const
+{
+    if(indexComp >= data->numComp)
+        throw std::out_of_range("FokkerPlanckSolver2d: component index out of range");
+    return impl->getInterpolatedFunction(data->averagedDF(indexComp));
+}
+
+std::vector<double> FokkerPlanckSolver2d::lossConeBoundary(unsigned int indexComp) const
+{
+    if(indexComp >= data->numComp)
+        throw std::out_of_range("FokkerPlanckSolver2d: component index out of range");
+    return data->gridR0[indexComp];
+}
+
+double FokkerPlanckSolver2d::relaxationTime() const
+{
+    double maxf = 0;
+    for(unsigned int c=0; c<data->numComp; c++)
+        maxf = fmax(maxf, maxElement(data->gridf[c]) * data->Mstar[c]);
+    return 0.34 * pow(2*M_PI, -1.5) / maxf;
+}
+
+void FokkerPlanckSolver2d::reinitPotential()
+{
+    if(data->selfGravity) {
+        // construct the combined R-averaged DF of all components
+        math::PtrFunction df = impl->getInterpolatedFunction(data->averagedDF(data->numComp));
+
+        // create an auxiliary grid in radius and the corresponding values of potential
+        unsigned int gridRsize = std::min<unsigned int>(100, data->gridh.size()/2);
+        std::vector<double> gridr = math::createExpGrid(gridRsize,
+            R_max(*data->currPot, data->phasevol->E(data->gridh.front())),
+            R_max(*data->currPot, data->phasevol->E(data->gridh.back())));
+        std::vector<double> gridPhi(gridRsize);
+        for(unsigned int i=0; i<gridRsize; i++)
+            data->currPot->eval(coord::PosCyl(gridr[i],0,0), &gridPhi[i]);
+
+        // compute the density by integrating the DF over velocity and solve the Poisson equation
+        math::LogLogSpline density(gridr, computeDensity(*df, *data->phasevol, gridPhi));
+        data->currPot = computePotential(data->Mbh, &density, gridr.front(), gridr.back(),
+            /*diagnostic output*/ data->Phi0);
+    } else {
+        data->currPot = computePotential(data->Mbh, /*no stellar density*/ NULL,
+            /*rmin-autodetect*/ 0, /*rmax*/ 0, /*diagnostic output, ignored*/ data->Phi0);
+    }
+    data->phasevol.reset(new potential::PhaseVolume(potential::PotentialWrapper(*data->currPot)));
+}
+
+void FokkerPlanckSolver2d::reinitAdvDifCoefs()
+{
+    const double GAMMA = 16*M_PI*M_PI * data->coulombLog;
+    const int
+    numComp   = data->numComp,
+    sizeh     = data->gridh.size(),
+    sizeR     = data->gridR.size(),
+    numPoints = data->gridAdvDifCoefs.size();
+    data->Mass = data->Etot = data->Ekin = 0.;
+    data->gridAdv.assign(numPoints, 0.);
+    data->gridDif.assign(numPoints, 0.);
+    data->gridLC.assign(sizeh, 0.);
+    data->gridCondR = math::Matrix<double>(sizeh, sizeR-1, 0.);
+
+    // construct the spherical models for the R-averaged DF of each component in parallel,
+    // together with the local diffusion coefficients needed for the orbit-averaging in R
+    std::vector<shared_ptr<const SphericalModel> > models(numComp);
+    std::vector<shared_ptr<const SphericalModelLocal> > modelsLocal(numComp);
+    std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int comp = 0; comp < numComp; comp++) {
+        try{
+            math::PtrFunction df = impl->getInterpolatedFunction(data->averagedDF(comp));
+            models[comp].reset(new SphericalModel(*data->phasevol, *df, data->gridh));
+            modelsLocal[comp].reset(new SphericalModelLocal(*models[comp], data->gridh));
+        }
+        catch(std::exception& e) {
+            errorMsg = e.what();
+        }
+    }
+    if(!errorMsg.empty())
+        throw std::runtime_error("FokkerPlanckSolver2d: " + errorMsg);
+
+    // the local diffusion coefficients of each species are multiplied by  N^{-1} ln Lambda
+    std::vector<double> mult(numComp);
+    for(int comp = 0; comp < numComp; comp++) {
+        data->Mass += models[comp]->cumulMass();
+        data->Etot += models[comp]->cumulEtotal();
+        data->Ekin += models[comp]->cumulEkin();
+        mult[comp]  = data->coulombLog * data->Mstar[comp] / models[comp]->cumulMass();
+    }
+    data->Etot = 0.5 * (data->Etot + (data->Mbh!=0. ? data->Mbh * data->Phi0 : 0.) + data->Ekin);
+
+    // advection and diffusion coefficients in h, as in the one-dimensional case
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int p=0; p<numPoints; p++) {
+        double h = data->gridAdvDifCoefs[p], g;
+        data->phasevol->E(h, &g);
+        for(int comp = 0; comp < numComp; comp++) {
+            double I0 = models[comp]->I0(h);
+            data->gridAdv[p] += GAMMA * models[comp]->cumulMass(h);
+            data->gridDif[p] += GAMMA * data->Mstar[comp] * g *
+                (models[comp]->cumulEkin(h) * (2./3) + h * I0);
+        }
+    }
+
+    // diffusion coefficients in R and the loss-cone boundary at each node in h;
+    // this is the most expensive part, since each coefficient requires orbit-averaging
+    for(int comp = 0; comp < numComp; comp++)
+        data->gridR0[comp].assign(sizeh, 0.);
+    const potential::PotentialWrapper pot(*data->currPot);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int i=0; i<sizeh; i++) {
+        try{
+            double g, E = data->phasevol->E(data->gridh[i], &g);
+            double Lcirc2 = pow_2(L_circ(pot, E)), rcirc = R_circ(pot, E), rmax = R_max(pot, E);
+            for(int comp = 0; comp < numComp; comp++)
+                data->gridLC[i] += difCoefLosscone(*models[comp], pot, E) * mult[comp];
+            for(int j=0; j<sizeR-1; j++) {
+                double Rface = sqrt(data->gridR[j] * data->gridR[j+1]);
+                data->gridCondR(i, j) = difCoefR(pot, modelsLocal, mult, E, rcirc, rmax, Lcirc2, Rface) /
+                    Rface / log(data->gridR[j+1] / data->gridR[j]);
+            }
+            // boundary of the loss cone [Cohn&Kulsrud 1978]:  R_0 = R_lc exp(-alpha),
+            // where alpha depends on the ratio q of diffusion per radial period to the loss-cone size
+            double Trad = g / (4*M_PI*M_PI * Lcirc2);
+            for(int comp = 0; comp < numComp; comp++) {
+                double Rlc = 2 * data->Mbh * data->captureRadius[comp] / Lcirc2;
+                if(Rlc >= 1) {
+                    data->gridR0[comp][i] = 1.;  // all orbits at this energy are inside the loss cone
+                } else if(Rlc > 0) {
+                    double q = data->gridLC[i] * Trad / Rlc;
+                    data->gridR0[comp][i] = Rlc * exp(-sqrt(q * sqrt(1 + q*q)));
+                }
+            }
+        }
+        catch(std::exception& e) {
+            errorMsg = e.what();
+        }
+    }
+    if(!errorMsg.empty())
+        throw std::runtime_error("FokkerPlanckSolver2d: " + errorMsg);
+}
+
+double FokkerPlanckSolver2d::evolve(double deltat)
+{
+    const int numComp = data->numComp, sizeh = data->gridh.size(), sizeR = data->gridR.size();
+    const math::BandMatrix<double> weightMatrix = impl->weightMatrix();  // diagonal
+    std::vector<double> gridE(sizeh);
+    for(int i=0; i<sizeh; i++)
+        gridE[i] = data->phasevol->E(data->gridh[i]);
+    double maxdeltaf = 0., totalLostMass = 0., totalLostEnergy = 0., capturedMass = 0.;
+
+    for(int comp = 0; comp < numComp; comp++) {
+        const std::vector<double>& oldf = data->gridf[comp];
+        const std::vector<double>& R0   = data->gridR0[comp];
+        std::vector<double> compAdv = data->gridAdv;
+        math::blas_dmul(data->Mstar[comp], compAdv);
+        // tridiagonal relaxation matrix in h, which is the same for all R
+        const math::BandMatrix<double> relMatrix = impl->relaxationMatrix(compAdv, data->gridDif);
+
+        // index of the first node outside the loss cone at each h (sizeR if the entire row is inside)
+        std::vector<int> first(sizeh);
+        for(int i=0; i<sizeh; i++)
+            first[i] = std::upper_bound(data->gridR.begin(), data->gridR.end(), R0[i]) -
+                data->gridR.begin();
+
+        // assemble the sparse matrix equation  (M - dt A) f_new = M f_old,  where M is the diagonal
+        // weight matrix and A is the relaxation operator in h and R; the nodes inside the loss cone
+        // and at the outer boundary hmax are fixed (Dirichlet boundary conditions).
+        // The rows corresponding to each node in h are assembled in parallel;
+        // at the same time, we record the rate of mass loss from each active node into the loss cone
+        // (either directly through its boundary R_0 or by diffusion in h into the loss-cone region)
+        std::vector< std::vector<math::Triplet> > rowTriplets(sizeh);
+        std::vector<double> rhs(sizeh * sizeR), leak(sizeh * sizeR, 0.);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for(int i=0; i<sizeh; i++) {
+            std::vector<math::Triplet>& trip = rowTriplets[i];
+            trip.reserve(sizeR * 5);
+            double Wh = weightMatrix(i, i);
+            for(int j=0; j<sizeR; j++) {
+                int n = i * sizeR + j;
+                if(j < first[i] || i == sizeh-1) {
+                    trip.push_back(math::Triplet(n, n, 1.));
+                    rhs[n] = j < first[i] ? 0. : oldf[n];
+                    continue;
+                }
+                double WR = data->gridWeightsR[j], diag = Wh * WR;
+                rhs[n] = diag * oldf[n];
+                // diffusion in h: the coupling to nodes inside the loss cone is dropped,
+                // and the flux into these nodes (except the outer boundary) is counted as lost
+                diag -= deltat * relMatrix(i, i) * WR;
+                for(int k = i-1; k <= i+1; k += 2) {
+                    if(k < 0 || k >= sizeh)
+                        continue;
+                    if(j >= first[k])
+                        trip.push_back(math::Triplet(n, k * sizeR + j, -deltat * relMatrix(i, k) * WR));
+                    else if(k < sizeh-1)
+                        leak[n] += relMatrix(k, i) * WR;
+                }
+                // diffusion in R between adjacent active nodes
+                if(j > first[i]) {
+                    double K = data->gridCondR(i, j-1) * Wh;
+                    diag += deltat * K;
+                    trip.push_back(math::Triplet(n, n-1, -deltat * K));
+                }
+                if(j < sizeR-1) {
+                    double K = data->gridCondR(i, j) * Wh;
+                    diag += deltat * K;
+                    trip.push_back(math::Triplet(n, n+1, -deltat * K));
+                }
+                // flux through the loss-cone boundary, assuming the logarithmic profile
+                // f ~ ln(R/R_0) between R_0 and the first active node (zero flux if there is no loss cone)
+                if(j == first[i] && R0[i] > 0) {
+                    double K = data->gridLC[i] * Wh / log(data->gridR[j] / R0[i]);
+                    diag += deltat * K;
+                    leak[n] += K;
+                }
+                trip.push_back(math::Triplet(n, n, diag));
+            }
+        }
+        std::vector<math::Triplet> triplets;
+        for(int i=0; i<sizeh; i++)
+            triplets.insert(triplets.end(), rowTriplets[i].begin(), rowTriplets[i].end());
+        math::SparseMatrix<double> lhsMatrix(sizeh * sizeR, sizeh * sizeR, triplets);
+
+        // solve the linear system
+        std::vector<double> newf = math::LUDecomp(lhsMatrix).solve(rhs);
+        for(int n=0; n<sizeh * sizeR; n++)
+            newf[n] = fmax(newf[n], 0.);   // eliminate tiny negative values caused by roundoff
+
+        // mass and energy lost into the loss cone: the flux from active nodes during the timestep,
+        // plus the mass at nodes that were active before the step but have ended up inside
+        // the loss cone because its boundary R_0 has grown (these nodes are emptied instantly)
+        double lostMass = 0., lostEnergy = 0.;
+        for(int n=0; n<sizeh * sizeR; n++) {
+            double dm = deltat * leak[n] * newf[n];
+            if(n % sizeR < first[n / sizeR])
+                dm += oldf[n] * data->gridMass[n];
+            lostMass   += dm;
+            lostEnergy += dm * gridE[n / sizeR];
+        }
+        totalLostMass   += lostMass;
+        totalLostEnergy += lostEnergy;
+        capturedMass    += lostMass * data->captureMassFraction[comp];
+        maxdeltaf = fmax(maxdeltaf, maxRelDifference(newf, oldf, data->gridMass));
+        data->gridf[comp] = newf;
+    }
+
+    data->drainMass   -= totalLostMass;
+    data->drainEnergy -= totalLostEnergy;
+    data->drainRate    = totalLostMass / deltat;
+    data->time        += deltat;
+
+    // update the potential if the stellar DF or the black hole mass have changed,
+    // and recompute the diffusion coefficients
+    data->Mbh += capturedMass;
+    if(data->updatePotential || capturedMass > 0)
+        reinitPotential();
+    reinitAdvDifCoefs();
+    return maxdeltaf;
+}
+
 }
@@ -5,10 +5,12 @@
 
     This module contains the `FokkerPlanckSolver` class that manages
     the self-consistent evolution of a DF f(h) driven by the relaxation,
-    together with the changes in the density/potential.
+    together with the changes in the density/potential, and its two-dimensional
+    counterpart `FokkerPlanckSolver2d` for the DF f(h, R) in the presence of a loss cone.
 */
 #pragma once
 #include "potential_utils.h"
+#include "math_linalg.h"
 #include "smart.h"
 #include <vector>
 
@@ -96,6 +98,28 @@ struct FokkerPlanckParams {
         ultimately, everything is determined by captureRadius and relaxationRate. */
     bool lossConeDrain;
 
+    /** maximum number of fixed-point iterations in each timestep, in which the advection and
+        diffusion coefficients are recomputed from the DFs of all species at the end of the step
+        and the step is repeated; this makes the time integration fully implicit in all species
+        simultaneously and allows for longer timesteps. The default value 0 corresponds to
+        a semi-implicit scheme with coefficients taken from the beginning of the timestep. */
+    unsigned int maxImplicitIterations;
+
+    /** tolerance for terminating the implicit iterations: the maximum relative change of f
+        across the grid |log(f_k/f_{k-1})| between successive iterations. */
+    double implicitTolerance;
+
+    /** relative accuracy of the adaptive time integration in `evolveAdaptive()` and `evolveUntil()`:
+        the upper limit on the estimated local error of the DF per timestep
+        (maximum relative error across the grid). */
+    double timeAccuracy;
+
+    /** tolerance for the potential update: the potential and the phase volume mapping are
+        recomputed only when the DF has changed by more than this relative amount since the previous
+        update (the relative change of density, being an integral of the DF over velocity,
+        does not exceed that of the DF itself); 0 means that the potential is updated every timestep. */
+    double potentialUpdateTolerance;
+
     /** set default values in the constructor */
     FokkerPlanckParams() :
         method(FP_CHANGCOOPER),
@@ -106,11 +130,38 @@ struct FokkerPlanckParams {
         coulombLog(1.),
         selfGravity(true),
         updatePotential(true),
-        lossConeDrain(true)
+        lossConeDrain(true),
+        maxImplicitIterations(0),
+        implicitTolerance(1e-4),
+        timeAccuracy(1e-3),
+        potentialUpdateTolerance(0.)
     {}
 };
 
 
+class FokkerPlanckSolver;
+
+/** Prototype of a stopping condition checked after each timestep in `FokkerPlanckSolver::evolveUntil()` */
+class FokkerPlanckStopCondition {
+public:
+    virtual ~FokkerPlanckStopCondition() {}
+
+    /** return true if the evolution should be terminated */
+    virtual bool operator()(const FokkerPlanckSolver& solver) const = 0;
+};
+
+/** Stopping condition triggered when the total density of all components at the given radius
+    exceeds the threshold value (e.g., to detect the core collapse) */
+class FokkerPlanckDensityThreshold: public FokkerPlanckStopCondition {
+    const double radius;     ///< radius at which the density is computed
+    const double threshold;  ///< critical value of density
+public:
+    FokkerPlanckDensityThreshold(double _radius, double _threshold) :
+        radius(_radius), threshold(_threshold) {}
+    virtual bool operator()(const FokkerPlanckSolver& solver) const;
+};
+
+
 /// opaque internal implementation of the Fokker-Planck discretization scheme
 class FokkerPlanckImpl;
 
@@ -150,9 +201,39 @@ public:
 
     /** evolve the DF using the Fokker-Planck equation for a time deltat,
         followed by recomputation of the potential (if required) and the relaxation coefficients;
+        if maxImplicitIterations>0, the step is repeated with the coefficients computed from
+        the DFs of all species at the end of the step, until they converge.
         return the maximum relative change of f across the grid |log(f_new/f_old)|. */
     double evolve(double deltat);
 
+    /** evolve the DF for one timestep, whose length is chosen automatically from the estimate of
+        the local error of the time integration (controlled by the parameter `timeAccuracy`).
+        The error is estimated by comparing a single step with two half-steps; if it exceeds
+        the tolerance, the step is rejected and repeated with a shorter length.
+        \param[in]  deltatMax  is the upper limit on the length of the timestep
+        (e.g., the time remaining until the next output); if it is only slightly longer than
+        the suggested timestep, the step is stretched to deltatMax to avoid a short remainder.
+        \return  the length of the timestep actually made.
+        \throw  std::runtime_error if the timestep becomes too short.
+    */
+    double evolveAdaptive(double deltatMax);
+
+    /** evolve the DF with adaptive timesteps until the given time,
+        or until the stopping condition (if provided) is triggered;
+        the target time is reached exactly (up to a relative tolerance of 1e-12 attributed to
+        roundoff errors), without a tiny final step.
+        \param[in]  timeEnd  is the target time.
+        \param[in]  stop  is an optional stopping condition checked after each timestep.
+        \return  the time actually reached (less than timeEnd if the condition was triggered).
+    */
+    double evolveUntil(double timeEnd, const FokkerPlanckStopCondition* stop=NULL);
+
+    /// return the current simulation time (the sum of lengths of all timesteps)
+    double time() const;
+
+    /// return the suggested length of the next timestep in the adaptive scheme
+    double nextTimestep() const;
+
     /// return the total potential
     math::PtrFunction potential() const;
 
@@ -196,14 +277,142 @@ private:
     /// opaque internal implementation of the discretization scheme
     shared_ptr<const FokkerPlanckImpl> impl;
 
+    /** perform one timestep of length deltat;
+        \param[in]  maxError  if finite, the local error of the time integration is estimated first,
+        and the step is rejected (leaving the state of the system unchanged) if it exceeds maxError;
+        \param[out] error  will contain the error estimate (0 if it was not computed);
+        \return  the maximum relative change of f, or NAN if the step was rejected. */
+    double evolveStep(double deltat, double maxError, double& error);
+
     /** Recompute the potential and the phase volume mapping (h <-> E)
         by first computing the density by integrating the DF over velocity,
-        and then solving the Poisson equation (adding the central black hole if present). */
+        and then solving the Poisson equation (adding the central black hole if present);
+        deltat is the time elapsed since the previous update. */
     void reinitPotential(double deltat);
 
-    /** Update the advection and diffusion coefficients using the current DFs of all components */
-    void reinitAdvDifCoefs();
+    /** Update the advection and diffusion coefficients using the current DFs of all components.
+        \param[in]  updateDrainMatrix  if false, do not recompute the loss-cone draining term
+        (used in the intermediate iterations of an implicit timestep). */
+    void reinitAdvDifCoefs(bool updateDrainMatrix=true);
+
+};
+
+
+/** Parameters passed to the constructor of FokkerPlanckSolver2d: in addition to those of the
+    one-dimensional solver, they specify the grid in the scaled squared angular momentum R */
+struct FokkerPlanckParams2d: public FokkerPlanckParams {
 
+    /** size of the logarithmic grid in R = L^2 / L_circ^2(E) */
+    size_t gridSizeR;
+
+    /** lowest value of R in the grid (the uppermost node is always at R=1);
+        it need not be smaller than the loss-cone boundary, since the DF between the boundary
+        and the first active node of the grid follows the analytic logarithmic profile */
+    double Rmin;
+
+    /** set default values in the constructor */
+    FokkerPlanckParams2d() :
+        gridSizeR(0),        // use default grid size
+        Rmin(1e-6)
+    {}
+};
+
+/// opaque internal data for the FokkerPlanckSolver2d
+class FokkerPlanckData2d;
+
+/** The class that solves the two-dimensional orbit-averaged Fokker-Planck equation for the DF
+    f(h, R) of one or several species in the space of phase volume h and the scaled squared
+    angular momentum R = L^2 / L_circ^2(E), 0 <= R <= 1, in the presence of a central black hole
+    with a loss cone.
+    The diffusion in energy is described by the same isotropic orbit-averaged coefficients
+    as in the one-dimensional solver, computed from the R-averaged DF, while the diffusion
+    in angular momentum uses the coefficient  D_RR(h,R) = (1/2) <Delta R^2>,  obtained by averaging
+    the local velocity diffusion coefficients provided by `SphericalModelLocal` over the orbit
+    with the given h and R (the mixed terms D_hR are neglected, and the radial period is assumed
+    to be independent of R, so that the density of states is uniform in R).
+    Stars with R below the Cohn&Kulsrud(1978) boundary value R_0(h), which depends on the size of
+    the loss cone and on the ratio of diffusion per orbit to the loss-cone size, are captured by
+    the black hole; the boundary may lie between the grid nodes, in which case the flux into
+    the loss cone is computed from the logarithmic profile of the DF near R_0.
+    The discretization uses the Chang&Cooper scheme in h and a finite-volume scheme in R,
+    and each timestep is a backward-Euler step solved with the sparse LU decomposition
+    (which is efficient only when the library is compiled with Eigen), with the matrix
+    assembled in parallel. After each step, the potential (if `updatePotential` is set)
+    and all diffusion coefficients are recomputed.
+*/
+class FokkerPlanckSolver2d {
+public:
+
+    /** Construct the Fokker-Planck model with the given density profile and isotropic initial DF.
+        \param[in]  params  specifies all parameters of the solver (only the Chang&Cooper
+        discretization is supported, and the loss-cone drain term of the 1d solver is irrelevant);
+        \param[in]  components  is the array of individual components (species) of the model.
+        \throw  std::runtime_error or some other exception if the parameters are incorrect.
+    */
+    FokkerPlanckSolver2d(const FokkerPlanckParams2d& params,
+        const std::vector<FokkerPlanckComponent>& components);
+
+    /** evolve the DF for a time deltat, followed by recomputation of the potential (if required)
+        and the diffusion coefficients;
+        return the maximum relative change of f across the grid |log(f_new/f_old)|. */
+    double evolve(double deltat);
+
+    /// return the current simulation time
+    double time() const;
+
+    /// return the total potential
+    math::PtrFunction potential() const;
+
+    /// return the phase volume
+    potential::PtrPhaseVolume phaseVolume() const;
+
+    /// return the grid in phase volume
+    std::vector<double> gridh() const;
+
+    /// return the grid in scaled squared angular momentum R
+    std::vector<double> gridR() const;
+
+    /// return the values of the given DF component at the nodes of the 2d grid:
+    /// the row index corresponds to h and the column index to R
+    math::Matrix<double> df(unsigned int indexComp) const;
+
+    /// return the DF of the given component averaged over R, represented by an interpolator in h
+    math::PtrFunction dfIsotropic(unsigned int indexComp) const;
+
+    /// return the boundary of the loss cone R_0(h) for the given component at the nodes of gridh
+    std::vector<double> lossConeBoundary(unsigned int indexComp) const;
+
+    /// return the number of DF components
+    unsigned int numComp() const;
+
+    /// return the estimate of the shortest relaxation time across the grid
+    double relaxationTime() const;
+
+    /// return mass of the central black hole, which grows due to the capture of stars
+    double Mbh() const;
+
+    /// diagnostic quantities updated in the course of evolution:
+    double Mass() const;         ///< total mass of all stellar components (not including the BH)
+    double Phi0() const;         ///< stellar potential at origin (not including the BH)
+    double Etot() const;         ///< total energy of the entire system including the BH
+    double Ekin() const;         ///< kinetic energy of all components
+    double drainMass()    const; ///< total change of mass (negative) due to capture by the BH
+    double drainEnergy()  const; ///< change in total energy associated with the removed mass
+    double drainRate()    const; ///< capture rate (mass per unit time) during the last timestep
+
+private:
+    /// opaque structure containing the initial parameters and all internal data that evolves with time
+    shared_ptr<FokkerPlanckData2d> data;
+
+    /// opaque internal implementation of the discretization scheme in h
+    shared_ptr<const FokkerPlanckImpl> impl;
+
+    /** Recompute the potential and the phase volume mapping from the R-averaged DF */
+    void reinitPotential();
+
+    /** Update the diffusion coefficients in h and R and the loss-cone boundary
+        using the current DFs of all components */
+    void reinitAdvDifCoefs();
 };
 
 }  // namespace
@@ -7,6 +7,7 @@
 #include <cmath>
 #include <stdexcept>
 #include <cassert>
+#include <algorithm>
 #include <alloca.h>
 
 namespace galaxymodel{
@@ -22,6 +23,9 @@ static const double EPSREL_PIXEL_MASS = 1e-4;
 /// max number of density evaluations per each pixel in the above integrals
 static const int MAX_NUM_EVAL_PIXEL_MASS = 1e4;
 
+/// relative threshold for discarding the elements of a convolution matrix far from its diagonal
+static const double EPSREL_CONVOLUTION_BAND = 1e-15;
+
 /// IFunction interface for a gaussian function 
 class GaussianPSFfnc: public math::IFunctionNoDeriv {
     GaussianPSF psf;
@@ -78,6 +82,34 @@ math::Matrix<double> getConvolutionMatrix(
     return conv;
 }
 
+/// convolution matrix together with the range of its non-negligible elements in each row:
+/// the matrix returned by getConvolutionMatrix is formally dense, but its elements decay
+/// exponentially away from the diagonal, so it is effectively banded
+struct BandedConvolution {
+    math::Matrix<double> mat;     ///< the original matrix
+    std::vector<int> first, last; ///< the range of columns [first, last) retained in each row
+    BandedConvolution() {}
+    explicit BandedConvolution(const math::Matrix<double>& _mat) :
+        mat(_mat), first(mat.rows()), last(mat.rows())
+    {
+        const int size = mat.cols();
+        for(size_t r = 0; r < mat.rows(); r++) {
+            const double* row = &mat(r, 0);
+            double maxval = 0;
+            for(int c = 0; c < size; c++)
+                maxval = fmax(maxval, fabs(row[c]));
+            const double threshold = maxval * EPSREL_CONVOLUTION_BAND;
+            int c1 = 0, c2 = size;
+            while(c1 < c2 && !(fabs(row[c1]) > threshold))
+                c1++;
+            while(c2 > c1 && !(fabs(row[c2-1]) > threshold))
+                c2--;
+            first[r] = c1;
+            last [r] = c2;
+        }
+    }
+};
+
 //--------- VELOCITY MOMENTS ----------//
 
 /** Accuracy parameter for integrating the product f(x)*exp(-x^2) over the entire real axis.
@@ -215,6 +247,85 @@ public:
     }
 };
 
+/// lightweight counterpart of math::BsplineWrapper, which refers to the interpolator and
+/// the array of amplitudes instead of copying them (used in the batch fitting of many LOSVDs)
+template<int N>
+class BsplineReference: public math::IFunctionNoDeriv {
+    const math::BsplineInterpolator1d<N>& bspl;
+    const std::vector<double>& ampl;
+public:
+    BsplineReference(const math::BsplineInterpolator1d<N>& _bspl, const std::vector<double>& _ampl) :
+        bspl(_bspl), ampl(_ampl) {}
+    virtual double value(const double x) const {
+        return bspl.interpolate(x, ampl);
+    }
+};
+
+/// number of components processed together in computeGaussHermiteMomentsBatch
+static const size_t GH_BATCH_BLOCK_SIZE = 256;
+
+/// fit the GH expansion for each of many LOSVDs given by their B-spline amplitudes
+template<int N>
+void fitGaussHermiteBatch(const math::BsplineInterpolator1d<N>& bspl, unsigned int order,
+    size_t numLOSVDs, const StorageNumT input[], StorageNumT output[])
+{
+    const size_t numBasisFnc = bspl.numValues(), numOutput = order+4;
+    const double vmin = bspl.xmin(), vmax = bspl.xmax();
+    std::string errorMsg;
+    volatile bool fail = false;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<double> ampl(numBasisFnc);
+        const BsplineReference<N> fnc(bspl, ampl);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for(ptrdiff_t i = 0; i < (ptrdiff_t)numLOSVDs; i++) {
+            if(fail) continue;
+            const StorageNumT* src = input  + i * numBasisFnc;
+            StorageNumT* dest      = output + i * numOutput;
+            bool zero = true;
+            for(size_t k = 0; k < numBasisFnc; k++) {
+                ampl[k] = src[k];
+                zero &= src[k] == 0;
+            }
+            if(zero) {
+                // an empty LOSVD (e.g., an orbit that never visits this aperture) has zero
+                // normalization and undefined parameters and moments, no need to fit it
+                dest[0] = 0;
+                std::fill(dest+1, dest + numOutput, static_cast<StorageNumT>(NAN));
+                continue;
+            }
+            try{
+                // the starting point for the fit is given by the normalization, mean value and
+                // dispersion of the LOSVD, which are computed exactly from its B-spline representation
+                double params[3];
+                params[0] = bspl.integrate(vmin, vmax, ampl, 0);
+                params[1] = bspl.integrate(vmin, vmax, ampl, 1) / params[0];
+                params[2] = sqrt(fmax(0, bspl.integrate(vmin, vmax, ampl, 2) / params[0] - pow_2(params[1])));
+                math::nonlinearMultiFit(GaussianFitter(2, fnc), /*init*/params, 1e-6, 100, /*output*/params);
+                std::vector<double> moments =
+                    computeGaussHermiteMoments(order, fnc, params[0], params[1], params[2]);
+                for(int m = 0; m < 3; m++)
+                    dest[m] = static_cast<StorageNumT>(params[m]);
+                for(unsigned int m = 0; m <= order; m++)
+                    dest[m+3] = static_cast<StorageNumT>(moments[m]);
+            }
+            catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(fitGaussHermiteBatch)
+#endif
+                errorMsg = e.what();
+                fail = true;
+            }
+        }
+    }
+    if(fail)
+        throw std::runtime_error("fitGaussHermiteBatch: " + errorMsg);
+}
+
 /// helper class for computing the surface density in the image plane, multiplied by
 /// basis functions of a 2d tensor-product B-spline expansion.
 template<int N>
@@ -344,6 +455,88 @@ math::Matrix<double> computeGaussHermiteMatrix(int N, const std::vector<double>&
     }
 }
 
+void computeGaussHermiteMomentsBatch(int N, const std::vector<double>& grid, unsigned int order,
+    size_t numComponents, size_t numApertures, const double ghparams[],
+    const StorageNumT input[], StorageNumT output[])
+{
+    if(N<0 || N>3)
+        throw std::invalid_argument("computeGaussHermiteMomentsBatch: wrong B-spline degree");
+    const size_t numBasisFnc = grid.size() + N - 1, numMoments = order+1;
+    std::string errorMsg;
+    volatile bool fail = false;
+
+    // conversion matrices are computed once for each aperture and shared between all components
+    std::vector< math::Matrix<double> > ghmat(numApertures);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(ptrdiff_t a = 0; a < (ptrdiff_t)numApertures; a++) {
+        if(fail) continue;
+        try{
+            ghmat[a] = computeGaussHermiteMatrix(N, grid, order,
+                ghparams[a*3], ghparams[a*3+1], ghparams[a*3+2]);
+        }
+        catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(computeGaussHermiteMomentsBatch)
+#endif
+            errorMsg = e.what();
+            fail = true;
+        }
+    }
+    if(fail)
+        throw std::runtime_error("computeGaussHermiteMomentsBatch: " + errorMsg);
+
+    // the input LOSVDs are split into blocks of components, and each block in each aperture
+    // is converted by a single matrix product; these tasks are distributed between threads
+    const size_t numBlocks = (numComponents + GH_BATCH_BLOCK_SIZE - 1) / GH_BATCH_BLOCK_SIZE;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        math::Matrix<double> src, dest;  // thread-local storage for one block
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for(ptrdiff_t task = 0; task < (ptrdiff_t)(numBlocks * numApertures); task++) {
+            const size_t a = task % numApertures, firstRow = task / numApertures * GH_BATCH_BLOCK_SIZE,
+                numRows = std::min(GH_BATCH_BLOCK_SIZE, numComponents - firstRow);
+            if(src.rows() != numRows) {
+                src  = math::Matrix<double>(numRows, numBasisFnc);
+                dest = math::Matrix<double>(numRows, numMoments);
+            }
+            for(size_t r = 0; r < numRows; r++) {
+                const StorageNumT* row = input + ((firstRow + r) * numApertures + a) * numBasisFnc;
+                for(size_t k = 0; k < numBasisFnc; k++)
+                    src(r, k) = row[k];
+            }
+            math::blas_dgemm(math::CblasNoTrans, math::CblasTrans, 1., src, ghmat[a], 0., dest);
+            for(size_t r = 0; r < numRows; r++) {
+                StorageNumT* row = output + ((firstRow + r) * numApertures + a) * numMoments;
+                for(size_t m = 0; m < numMoments; m++)
+                    row[m] = static_cast<StorageNumT>(dest(r, m));
+            }
+        }
+    }
+}
+
+void fitGaussHermiteBatch(int N, const std::vector<double>& grid, unsigned int order,
+    size_t numLOSVDs, const StorageNumT input[], StorageNumT output[])
+{
+    switch(N) {
+        case 0: fitGaussHermiteBatch(
+            math::BsplineInterpolator1d<0>(grid), order, numLOSVDs, input, output); break;
+        case 1: fitGaussHermiteBatch(
+            math::BsplineInterpolator1d<1>(grid), order, numLOSVDs, input, output); break;
+        case 2: fitGaussHermiteBatch(
+            math::BsplineInterpolator1d<2>(grid), order, numLOSVDs, input, output); break;
+        case 3: fitGaussHermiteBatch(
+            math::BsplineInterpolator1d<3>(grid), order, numLOSVDs, input, output); break;
+        default:
+            throw std::invalid_argument("fitGaussHermiteBatch: wrong B-spline degree");
+    }
+}
+
 //----- TargetLOSVD -----//
 
 template<int N>
@@ -354,8 +547,7 @@ TargetLOSVD<N>::TargetLOSVD(const LOSVDParams& params) :
 {
     const size_t
         numApertures = params.apertures.size(),
-        numBasisFncX = bsplx.numValues(),  numBasisFncY = bsply.numValues(),
-        numBasisFnc  = numBasisFncX * numBasisFncY,  numBasisFncX2 = pow_2(numBasisFncX);
+        numBasisFncX = bsplx.numValues(),  numBasisFncY = bsply.numValues();
 
     if(numApertures <= 0)
         throw std::invalid_argument("LOSVDGrid: no apertures defined");
@@ -374,73 +566,93 @@ TargetLOSVD<N>::TargetLOSVD(const LOSVDParams& params) :
     // intrinsic 3d coordinate system into image plane coordinates and line-of-sight velocity
     math::makeRotationMatrix(params.theta, params.phi, params.chi, transformMatrix);
 
-    // construct the spatial rebinning matrix
-    math::Matrix<double> apertureMatrix(numApertures, numBasisFnc, 0.);
-    volatile bool outOfBounds = false;
-#ifdef _OPENMP
-#pragma omp parallel for schedule(static)
-#endif
-    for(int i = 0; i < (int)numApertures; i++) {
-        bool apOutOfBounds = math::computeBsplineIntegralsOverPolygon(
-            params.apertures[i], bsplx, bsply, &apertureMatrix(i, 0));
-        outOfBounds |= apOutOfBounds;
-    }
+    // construct the spatial rebinning matrix (or load it from the cache, if it was computed before)
+    bool outOfBounds = false;
+    const std::vector<math::Triplet> apertureMatrix = math::computeBsplineIntegralsOverPolygons(
+        params.apertures, bsplx, bsply, &outOfBounds, params.apertureCacheDir).values();
     if(outOfBounds)
         utils::msg(utils::VL_MESSAGE, "LOSVDGrid", "Datacube does not cover all apertures");
 
     // ensure that there is at least one PSF, even with a zero width
     std::vector<GaussianPSF> spatialPSF = checkPSF(params.spatialPSF);
+    const size_t numPSF = spatialPSF.size();
+    std::vector<BandedConvolution> convx(numPSF), convy(numPSF);
+    for(size_t g = 0; g < numPSF; g++) {
+        convx[g] = BandedConvolution(getConvolutionMatrix(bsplx, spatialPSF[g]));
+        convy[g] = BandedConvolution(getConvolutionMatrix(bsply, spatialPSF[g]));
+    }
 
-    // construct the combined aperture rebinning + spatial convolution matrix
-    for(size_t g = 0; g < spatialPSF.size(); g++) {
-        const math::Matrix<double> convx = getConvolutionMatrix(bsplx, spatialPSF[g]);
-        const math::Matrix<double> convy = getConvolutionMatrix(bsply, spatialPSF[g]);
+    // group the nonzero elements of the aperture matrix by rows
+    // (they are returned in an arbitrary order, typically by columns)
+    std::vector<size_t> rowStart(numApertures+1, 0), rowIndices(apertureMatrix.size());
+    for(size_t t = 0; t < apertureMatrix.size(); t++)
+        rowStart[apertureMatrix[t].i + 1]++;
+    for(size_t a = 0; a < numApertures; a++)
+        rowStart[a+1] += rowStart[a];
+    {
+        std::vector<size_t> rowPos(rowStart.begin(), rowStart.end()-1);
+        for(size_t t = 0; t < apertureMatrix.size(); t++)
+            rowIndices[rowPos[apertureMatrix[t].i]++] = t;
+    }
 
+    // construct the combined aperture rebinning + spatial convolution matrix Q = A L,
+    // where the matrix A (apertureMatrix) has Na (numApertures) rows and Nx * Ny
+    // (numBasisFncX * numBasisFncY) columns, and the matrix L is the sum over PSF components
+    // of outer products of two convolution matrices Lx (convx) and Ly (convy):
+    // L_{uw} = Lx_{lk} Ly_{ji}, where the combined indices are u = Nx j + l, w = Nx i + k;
+    // 0 <= k,l < Nx,  0 <= i,j < Ny.
+    // It would be impractical to assemble the entire matrix L; instead we use its separability:
+    // each row of A, reshaped into a Ny x Nx matrix R, is converted into the corresponding
+    // row of Q, reshaped in the same way, as  Ly^T R Lx.  Since R is nonzero only in a small
+    // rectangular region covered by the aperture, the first product  T = R Lx  is computed only
+    // for the few rows j of this region, and both Lx and Ly are effectively banded, so that
+    // the cost per aperture is proportional to the number of its nonzero elements times
+    // the bandwidth, rather than Nx * Ny.  Rows of Q are computed in parallel.
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
-        {   // define thread-local intermediate matrices
-            math::Matrix<double> block(numBasisFnc, numBasisFncX), tmpprod(numApertures, numBasisFncX);
-            // faster access to matrix elements in row-major order through pointers to flattened data
-            const double *dconvx = convx.data(), *dprod = tmpprod.data();
-            double *dconva = apertureConvolutionMatrix.data(), *dblock = block.data();
-
-            // we need to compute the product Q = A L  of the matrix A (apertureMatrix)
-            // having Na (numApertures) rows and Nx * Ny (numBasisFncX * numBasisFncY) columns
-            // by a matrix L formed by outer product of two convolution matrices
-            // Lx (convx) and Ly (convy):  L_{uw} = Lx_{lk} Ly_{ji}, where the combined indices
-            // are u = Nx j + l, w = Nx i + k;   0 <= k,l < Nx,  0 <= i,j < Ny.
-            // It would be impractical to assemble the entire matrix L (it may not even fit into memory),
-            // so we multiply A by Ny vertically elongated sub-blocks of the matrix L, each with Nx
-            // columns and Nx * Ny rows, and store the result in corresponding vertical stripes
-            // of the matrix Q (Nx columns and Na rows). The outermost loop over the sub-blocks
-            // is OpenMP-parallelized, as the destination regions do not overlap.
+    {
+        std::vector<double> tmp;   // thread-local storage for the intermediate matrix T
 #ifdef _OPENMP
-#pragma omp for schedule(static)
+#pragma omp for schedule(dynamic, 16)
 #endif
-            for(int i = 0; i < (int)numBasisFncY; i++) {
-                // assemble the sub-block with index i of the matrix L:
-                // it consists of Ny copies of matrix Lx, stacked vertically,
-                // each one multiplied by one element of matrix Ly from j-th row, i-th column
-                for(size_t j = 0; j < numBasisFncY; j++) {
-                    double convYji = convy(j, i);
-                    // copy the entire matrix Lx multiplied by a constant (element [j,i] of matrix Ly)
-                    // into a contiguous chunk of memory of length Nx^2
-                    // (Nx consecutive rows of temporary matrix block, starting from row j)
-                    for(size_t lk = 0, dest = j * numBasisFncX2; lk < numBasisFncX2; lk++, dest++)
-                        dblock[dest] = dconvx[lk] * convYji;
+        for(int a = 0; a < (int)numApertures; a++) {
+            if(rowStart[a] == rowStart[a+1])
+                continue;
+            // the range of rows j of the matrix R for this aperture
+            int jmin = numBasisFncY, jmax = 0;
+            for(size_t t = rowStart[a]; t < rowStart[a+1]; t++) {
+                const int j = apertureMatrix[rowIndices[t]].j / numBasisFncX;
+                jmin = std::min(jmin, j);
+                jmax = std::max(jmax, j+1);
+            }
+            double* dest = &apertureConvolutionMatrix(a, 0);
+            tmp.resize((jmax-jmin) * numBasisFncX);
+            for(size_t g = 0; g < numPSF; g++) {
+                const BandedConvolution &Lx = convx[g], &Ly = convy[g];
+                // T = R Lx, restricted to rows [jmin, jmax) and columns [kmin, kmax)
+                std::fill(tmp.begin(), tmp.end(), 0.);
+                int kmin = numBasisFncX, kmax = 0;
+                for(size_t t = rowStart[a]; t < rowStart[a+1]; t++) {
+                    const math::Triplet& elem = apertureMatrix[rowIndices[t]];
+                    const int j = elem.j / numBasisFncX, l = elem.j % numBasisFncX;
+                    const double* rowLx = &Lx.mat(l, 0);
+                    double* rowT = &tmp[(j-jmin) * numBasisFncX];
+                    for(int k = Lx.first[l]; k < Lx.last[l]; k++)
+                        rowT[k] += elem.v * rowLx[k];
+                    kmin = std::min(kmin, Lx.first[l]);
+                    kmax = std::max(kmax, Lx.last [l]);
                 }
-                // multiply the matrix A by the block and store the result in temporary product matrix
-                math::blas_dgemm(math::CblasNoTrans, math::CblasNoTrans, 1.,
-                    apertureMatrix, block, 0., tmpprod);
-                // copy-add the result into the vertical stripe of destination matrix Q,
-                // spanning all rows and Nx consecutive columns starting from i * Nx
-                for(size_t a = 0; a < numApertures; a++) {
-                    // 'a' is the row index in both the destination matrix Q and the temporary
-                    // product matrix; copy Nx contiguous elements
-                    for(size_t l = 0, src = a * numBasisFncX, dest = a * numBasisFnc + i * numBasisFncX;
-                        l < numBasisFncX; l++, src++, dest++)
-                        dconva[dest] += dprod[src];
+                // Q += Ly^T T
+                for(int j = jmin; j < jmax; j++) {
+                    const double* rowLy = &Ly.mat(j, 0);
+                    const double* rowT  = &tmp[(j-jmin) * numBasisFncX];
+                    for(int i = Ly.first[j]; i < Ly.last[j]; i++) {
+                        const double convYji = rowLy[i];
+                        double* rowQ = dest + i * numBasisFncX;
+                        for(int k = kmin; k < kmax; k++)
+                            rowQ[k] += convYji * rowT[k];
+                    }
                 }
             }
         }
@@ -470,14 +682,18 @@ inline void reallyAddPoint(const math::BsplineInterpolator1d<N>& bsplx,
         indy = bsply.nonzeroComponents(yp, 0, weighty),
         indv = bsplv.nonzeroComponents(vl, 0, weightv);
 
-    // add the contribution of this point to the datacube
+    // add the contribution of this point to the datacube,
+    // and mark the touched spatial basis functions in the flags stored after the data
     const int nx = bsplx.numValues(), nv = bsplv.numValues();
+    double* touched = datacube + nx * bsply.numValues() * nv;
     for(int ky=0; ky<=N; ky++)
-        for(int kx=0; kx<=N; kx++)
+        for(int kx=0; kx<=N; kx++) {
+            touched[(indy + ky) * nx + indx + kx] = 1.;
             for(int kv=0; kv<=N; kv++)
                 //datacube((indy + ky) * nx + indx + kx, indv + kv) +=
                 datacube[ ((indy + ky) * nx + indx + kx) * nv + indv + kv ] +=
                     mult * weightx[kx] * weighty[ky] * weightv[kv];
+        }
 }
 }
 
@@ -509,21 +725,73 @@ void TargetLOSVD<N>::addPoint(const double point[6], const double mult, double*
     }
 }
 
+template<int N>
+void TargetLOSVD<N>::eval(const double point[], double values[]) const
+{
+    math::Matrix<double> datacube = newDatacube();
+    addPoint(point, 1., datacube.data());
+    std::copy(datacube.data(), datacube.data() + numValues(), values);
+}
+
+template<int N>
+std::vector<size_t> TargetLOSVD<N>::touchedRows(const math::Matrix<double> &datacube) const
+{
+    const size_t numRows = bsplx.numValues() * bsply.numValues(), numCols = bsplv.numValues();
+    const double* touched = datacube.data() + numRows * numCols;
+    std::vector<size_t> rows;
+    for(size_t r=0; r<numRows; r++)
+        if(touched[r] || (symmetricGrids && touched[numRows-1-r]))
+            rows.push_back(r);
+    return rows;
+}
+
+template<int N>
+void TargetLOSVD<N>::clearDatacube(math::Matrix<double> &datacube) const
+{
+    const size_t numRows = bsplx.numValues() * bsply.numValues(), numCols = bsplv.numValues();
+    const std::vector<size_t> rows = touchedRows(datacube);
+    double* data = datacube.data();
+    for(size_t k=0; k<rows.size(); k++)
+        std::fill(data + rows[k] * numCols, data + (rows[k]+1) * numCols, 0.);
+    std::fill(data + numRows * numCols, data + datacube.size(), 0.);
+}
+
 template<int N>
 void TargetLOSVD<N>::finalizeDatacube(math::Matrix<double> &datacube, StorageNumT* output) const
 {
+    // only the rows touched by addPoint (and their mirror counterparts) contain nonzero values
+    const size_t numRows = bsplx.numValues() * bsply.numValues(), numCols = bsplv.numValues();
+    const std::vector<size_t> rows = touchedRows(datacube);
+    const size_t numTouched = rows.size(), numApertures = apertureConvolutionMatrix.rows();
+    double* cube = datacube.data();
+
     // 0th stage: mirror-symmetrization (if the grids are reflection-symmetric, this can be done now
-    // for the entire datacube, otherwise it was done for each added point individually)
+    // for the entire datacube, otherwise it was done for each added point individually):
+    // average the symmetric elements from the head and tail of the flattened array
     if(symmetricGrids) {
-        double* data = datacube.data();
-        // average the symmetric elements from the head and tail of the flattened array
-        for(size_t i=0, size = datacube.size(); i<size/2; i++)
-            data[i] = data[size-1-i] = 0.5 * (data[i] + data[size-1-i]);
+        for(size_t k=0; k<numTouched; k++) {
+            size_t r = rows[k], m = numRows-1-r;  // the mirror row has reversed order of columns
+            if(r > m) break;
+            for(size_t c=0; c<numCols; c++) {
+                size_t i = r * numCols + c, j = m * numCols + numCols-1-c;
+                if(i < j)
+                    cube[i] = cube[j] = 0.5 * (cube[i] + cube[j]);
+            }
+        }
+    }
+    // 1st stage: spatial convolution and rebinning, using only the touched rows of the datacube
+    // and the corresponding columns of the convolution matrix
+    math::Matrix<double> tmpmat(numApertures, numCols, 0.);
+    if(numTouched > 0) {
+        math::Matrix<double> compactData(numTouched, numCols), compactConv(numApertures, numTouched);
+        for(size_t k=0; k<numTouched; k++)
+            std::copy(cube + rows[k] * numCols, cube + (rows[k]+1) * numCols, &compactData(k, 0));
+        for(size_t a=0; a<numApertures; a++)
+            for(size_t k=0; k<numTouched; k++)
+                compactConv(a, k) = apertureConvolutionMatrix(a, rows[k]);
+        math::blas_dgemm(math::CblasNoTrans, math::CblasNoTrans,
+            1., compactConv, compactData, 0., tmpmat);
     }
-    // 1st stage: spatial convolution and rebinning
-    math::Matrix<double> tmpmat(apertureConvolutionMatrix.rows(), bsplv.numValues());
-    math::blas_dgemm(math::CblasNoTrans, math::CblasNoTrans,
-        1., apertureConvolutionMatrix, datacube, 0., tmpmat);
     // 2nd stage: velocity convolution
     math::Matrix<double> result(apertureConvolutionMatrix.rows(), bsplv.numValues());
     math::blas_dgemm(math::CblasNoTrans, math::CblasTrans,
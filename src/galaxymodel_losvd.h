@@ -60,6 +60,45 @@ public:
 math::Matrix<double> computeGaussHermiteMatrix(int N, const std::vector<double>& grid,
     unsigned int order, double gamma, double center, double sigma);
 
+/** Compute the Gauss-Hermite moments of LOSVDs of many components (e.g., orbits) in many apertures,
+    for known parameters of GH expansion in each aperture, shared between all components
+    (so that a linear superposition of LOSVDs corresponds to the same superposition of GH moments).
+    The conversion matrix (see `computeGaussHermiteMatrix`) is computed only once per aperture,
+    and the moments are obtained by matrix multiplication, in parallel over apertures and
+    blocks of components.
+    \param[in]  N, grid, order  are the same as in `computeGaussHermiteMatrix`;
+    \param[in]  numComponents  is the number of components;
+    \param[in]  numApertures   is the number of apertures;
+    \param[in]  ghparams  is the array of 3 * numApertures parameters of GH expansion:
+    gamma, center and sigma for each aperture;
+    \param[in]  input  is the array of B-spline amplitudes of LOSVDs in row-major order:
+    each of numComponents rows contains numApertures groups of numBasisFnc = grid.size()+N-1 elements;
+    \param[out] output  will contain the GH moments h_0..h_M for each component and aperture,
+    grouped in the same way (numComponents * numApertures * (order+1) elements).
+    \throw  std::invalid_argument if N is not in the range 0..3, or any exception
+    that occurs in constructing the conversion matrices.
+*/
+void computeGaussHermiteMomentsBatch(int N, const std::vector<double>& grid, unsigned int order,
+    size_t numComponents, size_t numApertures, const double ghparams[],
+    const StorageNumT input[], StorageNumT output[]);
+
+/** Find the best-fit Gauss-Hermite expansion for each of many LOSVDs, in parallel.
+    This is equivalent to constructing `GaussHermiteExpansion` from each LOSVD without specifying
+    the parameters of expansion, except that the initial guess for the fit is computed exactly
+    from the B-spline amplitudes rather than by numerical integration, and empty LOSVDs
+    (with all amplitudes zero) are not fitted: their normalization is zero and the other
+    values are NAN.
+    \param[in]  N, grid, order  are the same as in `computeGaussHermiteMatrix`;
+    \param[in]  numLOSVDs  is the number of input LOSVDs (e.g., number of components times
+    the number of apertures);
+    \param[in]  input  is the array of numLOSVDs * numBasisFnc B-spline amplitudes;
+    \param[out] output  will contain numLOSVDs * (order+4) values: the parameters of the best-fit
+    Gaussian (gamma, center and sigma), followed by GH moments h_0..h_M, for each LOSVD.
+    \throw  std::invalid_argument if N is not in the range 0..3, std::runtime_error if the fit failed.
+*/
+void fitGaussHermiteBatch(int N, const std::vector<double>& grid, unsigned int order,
+    size_t numLOSVDs, const StorageNumT input[], StorageNumT output[]);
+
 
 /** Definition of a Gaussian point-spread function with the given width and amplitude */
 struct GaussianPSF {
@@ -80,6 +119,7 @@ struct LOSVDParams {
     std::vector<GaussianPSF> spatialPSF;  ///< array of spatial point-spread functions
     double velocityPSF;                   ///< width of the gaussian velocity smoothing kernel
     std::vector<math::Polygon> apertures; ///< array of apertures on the image plane
+    std::string apertureCacheDir;         ///< directory for caching the aperture rebinning matrix
 
     /// set (unreasonable) default values
     LOSVDParams() :
@@ -115,6 +155,10 @@ class TargetLOSVD: public BaseTarget {
     math::Matrix<double> apertureConvolutionMatrix;  ///< spatial convolution and rebinning matrix
     math::Matrix<double> velocityConvolutionMatrix;  ///< velocity convolution matrix
     bool symmetricGrids;      ///< whether the input grids are reflection-symmetric
+
+    /// return the indices of spatial basis functions touched by addPoint() (and in the case
+    /// of symmetric grids, also their mirror counterparts), in increasing order
+    std::vector<size_t> touchedRows(const math::Matrix<double> &datacube) const;
 public:
     /// construct the grid with given parameters
     /// \throw std::invalid_argument if the parameters are incorrect
@@ -134,11 +178,19 @@ public:
         return apertureConvolutionMatrix.rows() * bsplv.numValues();
     }
 
-    /// allocate a new internal 3d data cube stored in a 2d matrix of the appropriate shape
+    /// allocate a new internal 3d data cube stored in a 2d matrix of the appropriate shape:
+    /// each row corresponds to a spatial basis function and contains the amplitudes of all
+    /// velocity basis functions; the matrix has a few extra rows at the end that contain
+    /// the flags marking the spatial basis functions touched by addPoint(),
+    /// so that only these rows are processed in finalizeDatacube() and clearDatacube()
     virtual math::Matrix<double> newDatacube() const {
-        return math::Matrix<double>(bsplx.numValues() * bsply.numValues(), bsplv.numValues(), 0.);
+        size_t numRows = bsplx.numValues() * bsply.numValues(), numCols = bsplv.numValues();
+        return math::Matrix<double>(numRows + (numRows + numCols - 1) / numCols, numCols, 0.);
     }
 
+    /// reset only the touched rows of the datacube and the flags
+    virtual void clearDatacube(math::Matrix<double> &datacube) const;
+
     /// add a weighted point to the datacube.
     /// \param[in]  point  is the 6d point in phase space: x,y,z,vx,vy,vz, which is
     /// internally converted to the sky plane position x', y' and the line-of-sight velocity v_los;
@@ -148,8 +200,14 @@ public:
     /// the weights of corresponding basis functions multiplied by the input factor 'mult'.
     virtual void addPoint(const double point[6], const double mult, double* datacube) const;
 
+    /// compute the contributions of a single point to the first numValues() elements of
+    /// the datacube (overrides the default implementation, since addPoint() also writes
+    /// the flags stored after these elements, and hence needs the entire datacube)
+    virtual void eval(const double point[], double values[]) const;
+
     /// convert the intermediate data stored in the regular 3d data cube
     /// into the array of basis function amplitudes for the LOSVD in each aperture
+    /// (only the rows of the datacube touched by addPoint() are used in the computation)
     virtual void finalizeDatacube(math::Matrix<double> &datacube, StorageNumT* output) const;
 
     /// compute the normalizations of the LOSVD (total mass in each aperture, i.e., integral of
@@ -0,0 +1,86 @@
+#include "galaxymodel_orbitlibrary.h"
+#include "utils.h"
+#include <stdexcept>
+
+namespace galaxymodel{
+
+void buildOrbitLibrary(
+    const potential::BasePotential& pot,
+    double Omega,
+    const std::vector<coord::PosVelCar>& initConds,
+    const std::vector<double>& integrTimes,
+    const std::vector<PtrTarget>& targets,
+    BaseOrbitLibraryOutput& output,
+    const orbit::OrbitIntParams& params,
+    const int numSamplesPerStep)
+{
+    const ptrdiff_t numOrbits = initConds.size();
+    const unsigned int numTargets = targets.size();
+    if((ptrdiff_t)integrTimes.size() != numOrbits)
+        throw std::invalid_argument("buildOrbitLibrary: arrays of initial conditions "
+            "and integration times must have the same length");
+    if(numTargets == 0)
+        throw std::invalid_argument("buildOrbitLibrary: no targets provided");
+    if(numSamplesPerStep <= 0)
+        throw std::invalid_argument("buildOrbitLibrary: number of samples per step must be positive");
+    const orbit::OrbitIntegratorRot orbitIntegrator(pot, Omega);
+    std::string errorMsg;
+    volatile bool fail = false;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        // per-thread storage reused for all orbits processed by this thread:
+        // the intermediate datacubes and the output rows of all targets
+        std::vector< math::Matrix<double> > datacubes(numTargets);
+        std::vector< std::vector<StorageNumT> > rows(numTargets);
+        std::vector<StorageNumT*> rowPtrs(numTargets);
+        RuntimeFncTargets* fnc = NULL;
+        orbit::RuntimeFncArray fncs(1);
+        try{
+            for(unsigned int t=0; t<numTargets; t++) {
+                datacubes[t] = targets[t]->newDatacube();
+                rows[t].resize(targets[t]->numCoefs());
+                rowPtrs[t] = rows[t].empty() ? NULL : &rows[t][0];
+            }
+            fnc = new RuntimeFncTargets(targets, datacubes, numSamplesPerStep);
+            fncs[0].reset(fnc);
+        }
+        catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(buildOrbitLibrary)
+#endif
+            errorMsg = e.what();
+            fail = true;
+        }
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+        for(ptrdiff_t orb=0; orb<numOrbits; orb++) {
+            if(fail || utils::CtrlBreakHandler::triggered()) continue;
+            try{
+                if(!(integrTimes[orb] > 0))
+                    throw std::invalid_argument("integration time must be positive");
+                orbit::integrate(initConds[orb], integrTimes[orb], orbitIntegrator, fncs, params);
+                fnc->finalize(&rowPtrs[0]);
+                for(unsigned int t=0; t<numTargets; t++)
+                    output.addRow(t, orb, rowPtrs[t]);
+            }
+            catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(buildOrbitLibrary)
+#endif
+                errorMsg = "orbit " + utils::toString((long)orb) + ": " + e.what();
+                fail = true;
+            }
+        }
+    }
+    if(fail)
+        throw std::runtime_error("Error in buildOrbitLibrary: " + errorMsg);
+    if(utils::CtrlBreakHandler::triggered())
+        throw std::runtime_error("buildOrbitLibrary: keyboard interrupt");
+}
+
+}  // namespace
@@ -0,0 +1,95 @@
+/** \file    galaxymodel_orbitlibrary.h
+    \brief   Construction of orbit libraries for Schwarzschild models
+    \date    2018
+    \author  Eugene Vasiliev
+
+    An orbit library is a set of matrices (one per Target object), in which each row contains
+    the contributions of a single orbit to all constraints of the given target (e.g., the masses
+    in the cells of a density grid, or the LOSVDs in the apertures), normalized by the integration
+    time. The routine defined in this module integrates many orbits in parallel and collects
+    these contributions for all targets at once: the points on each trajectory are computed only
+    once per sub-step and passed to all targets, and the intermediate datacubes are allocated only
+    once per thread and reused for all orbits processed by this thread. After each orbit they are
+    reset by `BaseTarget::clearDatacube()`, which in targets with large and sparsely filled
+    datacubes (`TargetLOSVD`) only processes the elements modified by this orbit.
+    The rows are passed to an output object as soon as each orbit is finished, so that the library
+    may be written directly to disk in a compressed form (see `math::CompressedMatrixWriter`)
+    without ever keeping the entire dense matrix in memory.
+*/
+#pragma once
+#include "galaxymodel_target.h"
+#include "math_matrixstorage.h"
+
+namespace galaxymodel{
+
+/** Receiver of the rows of an orbit library: the contributions of each orbit to each target.
+    The method `addRow` is called from multiple threads and in an arbitrary order of orbits,
+    so it must be thread-safe, but it is never called simultaneously for the same row.
+*/
+class BaseOrbitLibraryOutput {
+public:
+    virtual ~BaseOrbitLibraryOutput() {}
+
+    /** store the data of a single orbit for the given target.
+        \param[in]  targetIndex  is the index of the target in the array;
+        \param[in]  orbitIndex   is the index of the orbit;
+        \param[in]  data  is the array of length target.numCoefs().
+    */
+    virtual void addRow(unsigned int targetIndex, size_t orbitIndex, const StorageNumT* data) = 0;
+};
+
+/** Output into dense matrices provided externally (one per target), which should have
+    the dimensions numOrbits x target.numCoefs() and be stored in the row-major order */
+class OrbitLibraryOutputDense: public BaseOrbitLibraryOutput {
+    const std::vector<StorageNumT*> matrices;  ///< pointers to the beginning of each matrix
+    const std::vector<size_t> rowSizes;        ///< number of columns in each matrix
+public:
+    OrbitLibraryOutputDense(const std::vector<StorageNumT*>& _matrices,
+        const std::vector<size_t>& _rowSizes) :
+        matrices(_matrices), rowSizes(_rowSizes) {}
+    virtual void addRow(unsigned int targetIndex, size_t orbitIndex, const StorageNumT* data) {
+        std::copy(data, data + rowSizes.at(targetIndex),
+            matrices.at(targetIndex) + orbitIndex * rowSizes[targetIndex]);
+    }
+};
+
+/** Output into compressed sparse matrix files, written by `math::CompressedMatrixWriter`
+    objects provided externally (one per target) and subsequently memory-mapped by
+    `math::CompressedMatrix`; the writers should be created with numRows equal to the number
+    of orbits and numCols equal to target.numCoefs() */
+class OrbitLibraryOutputCompressed: public BaseOrbitLibraryOutput {
+    const std::vector<math::CompressedMatrixWriter*> writers;
+public:
+    explicit OrbitLibraryOutputCompressed(const std::vector<math::CompressedMatrixWriter*>& _writers) :
+        writers(_writers) {}
+    virtual void addRow(unsigned int targetIndex, size_t orbitIndex, const StorageNumT* data) {
+        writers.at(targetIndex)->addRow(orbitIndex, data);
+    }
+};
+
+/** Integrate a set of orbits in parallel and compute their contributions to all targets.
+    \param[in]  pot  is the gravitational potential;
+    \param[in]  Omega  is the pattern speed of the rotating frame (0 for the inertial frame);
+    \param[in]  initConds  is the array of initial conditions of all orbits;
+    \param[in]  integrTimes  is the array of integration times for each orbit (same length);
+    \param[in]  targets  is the array of targets;
+    \param[in,out]  output  receives the rows of the library for each orbit and target;
+    \param[in]  params  are the parameters of the orbit integrator;
+    \param[in]  numSamplesPerStep  is the number of points taken from the trajectory at equal
+    intervals of time during each timestep of the orbit integrator and passed to all targets
+    (a larger number reduces the discreteness noise in the datacubes at the expense of speed).
+    \throw  std::invalid_argument if the array sizes do not match or there are no targets,
+    std::runtime_error if the computation was interrupted by the user, or any exception
+    that occurred during the orbit integration (it is rethrown after all other orbits are finished).
+*/
+void buildOrbitLibrary(
+    const potential::BasePotential& pot,
+    double Omega,
+    const std::vector<coord::PosVelCar>& initConds,
+    const std::vector<double>& integrTimes,
+    const std::vector<PtrTarget>& targets,
+    BaseOrbitLibraryOutput& output,
+    const orbit::OrbitIntParams& params = orbit::OrbitIntParams(),
+    const int numSamplesPerStep = RuntimeFncTargets::NUM_SAMPLES_PER_STEP);
+
+}  // namespace
@@ -5,10 +5,16 @@
 #include "potential_composite.h"
 #include "potential_multipole.h"
 #include "potential_cylspline.h"
+#include "math_linalg.h"
 #include <stdexcept>
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <map>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace galaxymodel{
 
@@ -23,15 +29,70 @@ const T& ensureNotNull(const T& x) {
 
 namespace{
 
-/// Helper class for providing a BaseDensity interface to a density computed via integration over DF
+/// in the incremental mode, the preliminary estimate of density is computed with the relative
+/// accuracy equal to this fraction of the tolerance (but not better than the required accuracy)
+static const double INCREMENTAL_COARSE_ACCURACY = 0.3;
+
+/// the preliminary estimate uses this fraction of the max number of DF evaluations
+static const double INCREMENTAL_COARSE_NUM_EVAL = 0.25;
+
+/** Compute the densities of one or several DF components at the given point in the incremental mode:
+    first obtain a preliminary estimate with a reduced accuracy, and compare it with the previous
+    value of density at the same point; if the difference (plus the error estimate) is below
+    the tolerance, the previous value is retained, and if the preliminary estimate already has
+    the required accuracy, it is used as the result; only if neither is the case, the density is
+    recomputed with the full accuracy.
+    \param[in]  model  is the galaxy model (its DF may have several components);
+    \param[in]  point  is the position;
+    \param[in]  previous  is the array of previous density values of each DF component;
+    \param[in]  needed  if not NULL, indicates which components need to be computed at this point
+    (the values of others are taken from the preliminary estimate without further checks);
+    \param[in]  relError, maxNumEval  are the accuracy parameters of the full computation;
+    \param[in]  tolerance  is the relative change of density below which it is not recomputed;
+    \param[out] result  will contain the densities of all components.
+*/
+void computeDensityIncremental(const GalaxyModel& model, const coord::PosCyl& point,
+    const double previous[], const char needed[], double relError, unsigned int maxNumEval,
+    double tolerance, double result[])
+{
+    const unsigned int numComp = model.distrFunc.numValues();
+    std::vector<double> coarse(numComp), coarseErr(numComp);
+    computeMoments(model, point, &coarse[0], NULL, NULL, &coarseErr[0], NULL, NULL,
+        fmax(relError, tolerance * INCREMENTAL_COARSE_ACCURACY),
+        std::max<int>(maxNumEval * INCREMENTAL_COARSE_NUM_EVAL, 1));
+    std::vector<char> refine(numComp, false);
+    bool refineAny = false;
+    for(unsigned int c=0; c<numComp; c++) {
+        if(needed && !needed[c])
+            result[c] = coarse[c];
+        else if(fabs(coarse[c] - previous[c]) + coarseErr[c] <= tolerance * fabs(previous[c]))
+            result[c] = previous[c];   // the change is insignificant
+        else if(coarseErr[c] <= relError * fabs(coarse[c]))
+            result[c] = coarse[c];     // the estimate is already accurate enough
+        else
+            refine[c] = refineAny = true;
+    }
+    if(!refineAny)
+        return;
+    std::vector<double> full(numComp);
+    computeMoments(model, point, &full[0], NULL, NULL, NULL, NULL, NULL, relError, maxNumEval);
+    for(unsigned int c=0; c<numComp; c++)
+        if(refine[c])
+            result[c] = full[c];
+}
+
+/** Helper class for providing a BaseDensity interface to a density computed via integration over DF;
+    if the previous density profile is provided, the density is computed in the incremental mode */
 class DensityFromDF: public potential::BaseDensity{
 public:
     DensityFromDF(
         const potential::BasePotential& pot,
         const actions::BaseActionFinder& af,
         const df::BaseDistributionFunction& df,
-        double _relError, unsigned int _maxNumEval) :
-    model(pot, af, df), relError(_relError), maxNumEval(_maxNumEval) {};
+        double _relError, unsigned int _maxNumEval,
+        const potential::BaseDensity* _previous=NULL, double _tolerance=0) :
+    model(pot, af, df), relError(_relError), maxNumEval(_maxNumEval),
+    previous(_previous), tolerance(_tolerance) {};
 
     virtual coord::SymmetryType symmetry() const { return coord::ST_AXISYMMETRIC; }
     virtual const char* name() const { return myName(); };
@@ -42,6 +103,8 @@ private:
     const GalaxyModel model;  ///< aggregate of potential, action finder and DF
     double       relError;    ///< requested relative error of density computation
     unsigned int maxNumEval;  ///< max # of DF evaluations per one density calculation
+    const potential::BaseDensity* previous;  ///< previous density profile (may be NULL)
+    double       tolerance;   ///< relative change of density below which it is not recomputed
 
     virtual double densityCar(const coord::PosCar &pos) const {
         return densityCyl(toPosCyl(pos)); }
@@ -52,14 +115,478 @@ private:
     /// compute the density as the integral of DF over velocity at a given position
     virtual double densityCyl(const coord::PosCyl &point) const {
         double result;
-        computeMoments(model, point, &result, NULL, NULL, NULL, NULL, NULL, relError, maxNumEval);
+        if(previous) {
+            double prevValue = previous->density(point);
+            computeDensityIncremental(model, point, &prevValue, NULL,
+                relError, maxNumEval, tolerance, &result);
+        } else
+            computeMoments(model, point, &result, NULL, NULL, NULL, NULL, NULL, relError, maxNumEval);
+        return result;
+    }
+};
+
+/// a point in the meridional plane (plus the azimuthal angle), ordered lexicographically
+struct PointKey {
+    double R, z, phi;
+    explicit PointKey(const coord::PosCyl& pos) : R(pos.R), z(pos.z), phi(pos.phi) {}
+    bool operator< (const PointKey& other) const {
+        return R<other.R || (R==other.R && (z<other.z || (z==other.z && phi<other.phi))); }
+};
+
+/// correspondence between points and their indices in the array of density values
+typedef std::map<PointKey, size_t> PointIndex;
+
+/** Helper class that records all points at which the density is requested (in a thread-safe way),
+    returning a placeholder value; it is used to collect the grid points of a component
+    without computing the actual density */
+class DensityPointRecorder: public potential::BaseDensity{
+public:
+    explicit DensityPointRecorder(PointIndex& _points) : points(_points) {}
+    virtual coord::SymmetryType symmetry() const { return coord::ST_AXISYMMETRIC; }
+    virtual const char* name() const { return myName(); };
+    static const char* myName() { return "DensityPointRecorder"; };
+private:
+    PointIndex& points;
+    virtual double densityCar(const coord::PosCar &pos) const {
+        return densityCyl(toPosCyl(pos)); }
+    virtual double densitySph(const coord::PosSph &pos) const {
+        return densityCyl(toPosCyl(pos)); }
+    virtual double densityCyl(const coord::PosCyl &point) const {
+#ifdef _OPENMP
+#pragma omp critical(DensityPointRecorder)
+#endif
+        points.insert(std::make_pair(PointKey(point), points.size()));
+        return 1.;
+    }
+};
+
+/// return the array of recorded points arranged in the order of their indices
+std::vector<coord::PosCyl> listPoints(const PointIndex& points)
+{
+    std::vector<coord::PosCyl> result(points.size(), coord::PosCyl(0,0,0));
+    for(PointIndex::const_iterator iter = points.begin(); iter != points.end(); ++iter)
+        result[iter->second] = coord::PosCyl(iter->first.R, iter->first.z, iter->first.phi);
+    return result;
+}
+
+/** Helper class that returns the precomputed density values at the recorded points;
+    if a point is not found, the density is computed by the fallback density object (if provided) */
+class DensityFromTable: public potential::BaseDensity{
+public:
+    DensityFromTable(const PointIndex& _points, const double* _values, unsigned int _stride,
+        const potential::BaseDensity* _fallback=NULL) :
+    points(_points), values(_values), stride(_stride), fallback(_fallback) {}
+    virtual coord::SymmetryType symmetry() const { return coord::ST_AXISYMMETRIC; }
+    virtual const char* name() const { return myName(); };
+    static const char* myName() { return "DensityFromTable"; };
+private:
+    const PointIndex& points;       ///< indices of recorded points
+    const double* values;           ///< density values of this component at the recorded points
+    const unsigned int stride;      ///< distance between values at consecutive points
+    const potential::BaseDensity* fallback;  ///< direct computation for points not in the table
+    virtual double densityCar(const coord::PosCar &pos) const {
+        return densityCyl(toPosCyl(pos)); }
+    virtual double densitySph(const coord::PosSph &pos) const {
+        return densityCyl(toPosCyl(pos)); }
+    virtual double densityCyl(const coord::PosCyl &point) const {
+        PointIndex::const_iterator iter = points.find(PointKey(point));
+        if(iter != points.end())
+            return values[iter->second * stride];
+        if(!fallback)
+            throw std::runtime_error("DensityFromTable: point not found");
+        return fallback->density(point);
+    }
+};
+
+/** Helper class combining several DFs into one with multiple output values,
+    so that the velocity integration is performed for all of them at once */
+class MultiComponentDF: public df::BaseDistributionFunction{
+public:
+    explicit MultiComponentDF(const std::vector<const df::BaseDistributionFunction*>& _components) :
+        components(_components) {}
+    virtual unsigned int numValues() const { return components.size(); }
+    virtual double value(const actions::Actions &J) const {
+        double sum = 0;
+        for(unsigned int i=0; i<components.size(); i++)
+            sum += components[i]->value(J);
+        return sum;
+    }
+    virtual void eval(const actions::Actions &J, double values[]) const {
+        for(unsigned int i=0; i<components.size(); i++)
+            values[i] = components[i]->value(J);
+    }
+private:
+    const std::vector<const df::BaseDistributionFunction*> components;
+};
+
+/** Recompute the densities of all given components with DF in a single pass:
+    first collect the union of grid points of all components, then compute the densities
+    of all components at each point simultaneously (so that actions are computed only once
+    for each velocity sample), and finally construct the density representation of each
+    component from the precomputed values.
+    If tolerance>0, the densities are computed in the incremental mode at the points where
+    all components have a previous density profile.
+*/
+void updateComponentsWithDF(const std::vector<BaseComponentWithDF*>& components,
+    const potential::BasePotential& pot, const actions::BaseActionFinder& af, double tolerance)
+{
+    const unsigned int numComp = components.size();
+    std::vector<const df::BaseDistributionFunction*> dfs(numComp);
+    std::vector<PtrDensity> previous(numComp);
+    double relError = INFINITY;
+    unsigned int maxNumEval = 0;
+    PointIndex points;
+    std::vector<PointIndex> compPoints(numComp);
+    for(unsigned int c=0; c<numComp; c++) {
+        dfs[c] = components[c]->getDF().get();
+        previous[c] = components[c]->getDensity();
+        relError   = fmin(relError, components[c]->getRelError());
+        maxNumEval = std::max(maxNumEval, components[c]->getMaxNumEval());
+        // only record the grid points of each component, and then add them to the common list
+        components[c]->createDensity(DensityPointRecorder(compPoints[c]));
+        for(PointIndex::const_iterator iter = compPoints[c].begin(); iter != compPoints[c].end(); ++iter)
+            points.insert(std::make_pair(iter->first, points.size()));
+    }
+
+    const size_t numPoints = points.size();
+    const std::vector<coord::PosCyl> pointList = listPoints(points);
+    std::cout << "Computing density for "<<numComp<<" components at "<<
+        numPoints<<" points..."<<std::flush;
+
+    // for the incremental mode, determine which components are needed at each point
+    // and their previous density values
+    std::vector<char> needed;
+    std::vector<double> prevValues;
+    if(tolerance > 0) {
+        needed.assign(numPoints * numComp, 0);
+        prevValues.assign(numPoints * numComp, 0.);
+        for(unsigned int c=0; c<numComp; c++) {
+            if(!previous[c]) {  // no previous profile - the incremental mode cannot be used
+                needed.clear();
+                break;
+            }
+            for(PointIndex::const_iterator iter = compPoints[c].begin();
+                iter != compPoints[c].end(); ++iter)
+            {
+                size_t i = points.find(iter->first)->second;
+                needed    [i * numComp + c] = 1;
+                prevValues[i * numComp + c] = previous[c]->density(pointList[i]);
+            }
+        }
+    }
+
+    // compute the densities of all components at all points
+    const MultiComponentDF multiDF(dfs);
+    const GalaxyModel model(pot, af, multiDF);
+    std::vector<double> values(numPoints * numComp);
+    std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(ptrdiff_t i=0; i<(ptrdiff_t)numPoints; i++) {
+        try{
+            if(!needed.empty())
+                computeDensityIncremental(model, pointList[i], &prevValues[i * numComp],
+                    &needed[i * numComp], relError, maxNumEval, tolerance, &values[i * numComp]);
+            else
+                computeMoments(model, pointList[i], &values[i * numComp],
+                    NULL, NULL, NULL, NULL, NULL, relError, maxNumEval);
+        }
+        catch(std::exception& e) {
+            errorMsg = e.what();
+        }
+    }
+    if(!errorMsg.empty())
+        throw std::runtime_error("Error in computing density: "+errorMsg);
+
+    // construct the density profiles of all components from the precomputed values
+    for(unsigned int c=0; c<numComp; c++) {
+        const DensityFromDF fallback(pot, af, *dfs[c],
+            components[c]->getRelError(), components[c]->getMaxNumEval());
+        components[c]->setDensity(components[c]->createDensity(
+            DensityFromTable(points, &values[c], numComp, &fallback)));
+    }
+    std::cout << "done"<<std::endl;
+}
+
+/// collect the components of the model that have a DF
+std::vector<BaseComponentWithDF*> getComponentsWithDF(const SelfConsistentModel& model)
+{
+    std::vector<BaseComponentWithDF*> result;
+    for(unsigned int index=0; index<model.components.size(); index++) {
+        BaseComponentWithDF* comp =
+            dynamic_cast<BaseComponentWithDF*>(model.components[index].get());
+        if(comp)
+            result.push_back(comp);
+    }
+    return result;
+}
+
+/// a unit of work that may be executed concurrently with other such units by `runConcurrently`
+class ConcurrentJob {
+public:
+    virtual ~ConcurrentJob() {}
+    virtual void run() = 0;
+};
+
+/** Execute several independent jobs concurrently, splitting the available OpenMP threads
+    between them, so that the parallelized loops inside each job use their share of threads
+    (this requires nested parallelism, which is temporarily enabled for the duration of the call).
+    The number of threads and the max number of active parallel levels are restored on exit.
+    If any of the jobs throws an exception, it is rethrown after all jobs are finished.
+*/
+void runConcurrently(const std::vector<ConcurrentJob*>& jobs)
+{
+    const int numJobs = jobs.size();
+    std::string errorMsg;
+#ifdef _OPENMP
+    const int numThreads = std::max(1, omp_get_max_threads());
+    const int numOuter   = std::min(numJobs, numThreads);
+    const int numInner   = std::max(1, numThreads / std::max(1, numOuter));
+    const int prevLevels = omp_get_max_active_levels();
+    const bool concurrent= numOuter > 1;
+    if(concurrent)
+        omp_set_max_active_levels(std::max(prevLevels, 2));
+#pragma omp parallel for schedule(dynamic,1) num_threads(numOuter) if(concurrent)
+#endif
+    for(int j=0; j<numJobs; j++) {
+#ifdef _OPENMP
+        // this only affects the nested parallel regions created by the current thread
+        if(concurrent)
+            omp_set_num_threads(numInner);
+#endif
+        try{
+            jobs[j]->run();
+        }
+        catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(runConcurrently)
+#endif
+            errorMsg = e.what();
+        }
+    }
+#ifdef _OPENMP
+    if(concurrent) {
+        omp_set_max_active_levels(prevLevels);
+        omp_set_num_threads(numThreads);
+    }
+#endif
+    if(!errorMsg.empty())
+        throw std::runtime_error(errorMsg);
+}
+
+/// job that updates the density of a single component
+class ComponentUpdateJob: public ConcurrentJob {
+    BaseComponent& comp;
+    const SelfConsistentModel& model;
+    const double tolerance;  ///< tolerance of the incremental update (0 means a full update)
+public:
+    ComponentUpdateJob(BaseComponent& _comp, const SelfConsistentModel& _model, double _tolerance) :
+        comp(_comp), model(_model), tolerance(_tolerance) {}
+    virtual void run() {
+        BaseComponentWithDF* compDF = tolerance > 0 ?
+            dynamic_cast<BaseComponentWithDF*>(&comp) : NULL;
+        if(compDF)
+            compDF->updateIncremental(*model.totalPotential, *model.actionFinder, tolerance);
+        else
+            comp.update(*model.totalPotential, *model.actionFinder);
+    }
+};
+
+/// job that constructs the Multipole or CylSpline potential expansion of the given density
+class PotentialExpansionJob: public ConcurrentJob {
+    const SelfConsistentModel& model;
+    const PtrDensity density;
+    const bool disklike;
+public:
+    PtrPotential result;
+    PotentialExpansionJob(const SelfConsistentModel& _model, const PtrDensity& _density,
+        bool _disklike) : model(_model), density(_density), disklike(_disklike) {}
+    virtual void run() {
+        if(disklike)
+            result = potential::CylSpline::create(*density, model.mmaxAngularCyl,
+                model.sizeRadialCyl,   model.RminCyl, model.RmaxCyl,
+                model.sizeVerticalCyl, model.zminCyl, model.zmaxCyl, true /*use derivs*/);
+        else
+            result = potential::Multipole::create(*density,
+                model.lmaxAngularSph, model.mmaxAngularSph,
+                model.sizeRadialSph, model.rminSph, model.rmaxSph);
+    }
+};
+
+/// recompute the densities of all components in the current potential (step 3 of the workflow)
+void updateComponents(SelfConsistentModel& model)
+{
+    // the incremental mode is used at most maxIncrementalUpdates times in a row, after which
+    // the densities are recomputed in full, so that small changes do not accumulate indefinitely
+    double tolerance = 0;
+    if(model.incrementalTolerance > 0 && model.numIncrementalUpdates < model.maxIncrementalUpdates) {
+        tolerance = model.incrementalTolerance;
+        model.numIncrementalUpdates++;
+    } else
+        model.numIncrementalUpdates = 0;
+
+    // collect the components with DF that will be updated in a single pass
+    std::vector<BaseComponentWithDF*> componentsWithDF;
+    if(model.fuseDensityComputation) {
+        componentsWithDF = getComponentsWithDF(model);
+        if(componentsWithDF.size() > 1)
+            updateComponentsWithDF(componentsWithDF, *model.totalPotential, *model.actionFinder,
+                tolerance);
+        else
+            componentsWithDF.clear();
+    }
+
+    // update the density of each remaining component (this may be a no-op if the component is
+    // 'dead', i.e. provides only a fixed density or potential, but does not possess a DF) --
+    // the implementation is at the discretion of each component individually.
+    std::vector<ComponentUpdateJob> jobs;
+    for(unsigned int index=0; index<model.components.size(); index++) {
+        if(std::find(componentsWithDF.begin(), componentsWithDF.end(),
+            model.components[index].get()) != componentsWithDF.end())
+            continue;  // already updated
+        jobs.push_back(ComponentUpdateJob(*model.components[index], model, tolerance));
+        if(!model.concurrentTasks) {
+            std::cout << "Computing density for component "<<index<<"..."<<std::flush;
+            jobs.back().run();
+            std::cout << "done"<<std::endl;
+        }
+    }
+    if(model.concurrentTasks && !jobs.empty()) {
+        // all components are updated simultaneously, sharing the available threads
+        std::cout << "Computing density for "<<jobs.size()<<" components..."<<std::flush;
+        std::vector<ConcurrentJob*> jobPtrs(jobs.size());
+        for(unsigned int j=0; j<jobs.size(); j++)
+            jobPtrs[j] = &jobs[j];
+        runConcurrently(jobPtrs);
+        std::cout << "done"<<std::endl;
+    }
+}
+
+/// grid points of components with DF, which define the state vector of the iterative procedure
+struct ComponentGrids {
+    std::vector<BaseComponentWithDF*> components;  ///< components with DF
+    std::vector<PointIndex> indices;               ///< indices of grid points of each component
+    std::vector< std::vector<coord::PosCyl> > points;  ///< grid points of each component
+    std::vector<size_t> offsets;  ///< start of each component's block in the state vector
+
+    explicit ComponentGrids(const std::vector<BaseComponentWithDF*>& _components) :
+        components(_components), indices(_components.size()), points(_components.size()),
+        offsets(_components.size()+1, 0)
+    {
+        for(unsigned int c=0; c<components.size(); c++) {
+            components[c]->createDensity(DensityPointRecorder(indices[c]));
+            points[c] = listPoints(indices[c]);
+            offsets[c+1] = offsets[c] + points[c].size();
+        }
+    }
+
+    /// evaluate the current densities of all components at their grid points
+    std::vector<double> evalDensities() const
+    {
+        std::vector<double> result(offsets.back(), 0.);
+        for(unsigned int c=0; c<components.size(); c++) {
+            potential::PtrDensity dens = components[c]->getDensity();
+            if(dens)  // otherwise the initial density is absent and assumed to be zero
+                for(size_t i=0; i<points[c].size(); i++)
+                    result[offsets[c] + i] = dens->density(points[c][i]);
+        }
         return result;
     }
+
+    /// replace the densities of all components by the ones constructed from the given values
+    void setDensities(const std::vector<double>& values) const
+    {
+        for(unsigned int c=0; c<components.size(); c++)
+            components[c]->setDensity(components[c]->createDensity(
+                DensityFromTable(indices[c], &values[offsets[c]], 1)));
+    }
 };
+
+/** Anderson mixing: given the history of input states x_j and the corresponding outputs g_j=G(x_j)
+    of the fixed-point map, find the coefficients gamma_j that minimize the weighted norm of
+    the linear combination of residuals f = f_k - sum_j gamma_j (f_{j+1}-f_j), where f_j=g_j-x_j,
+    and return the next input state  x_k + beta f_k - sum_j gamma_j (dx_j + beta df_j).
+*/
+std::vector<double> andersonMix(
+    const std::vector< std::vector<double> >& histX,
+    const std::vector< std::vector<double> >& histG,
+    const std::vector<double>& weight, double beta)
+{
+    const unsigned int m = histX.size()-1, size = weight.size();
+    const std::vector<double> &xk = histX[m], &gk = histG[m];
+    std::vector<double> fk(size), result(size);
+    for(size_t n=0; n<size; n++) {
+        fk[n] = gk[n] - xk[n];
+        result[n] = xk[n] + beta * fk[n];
+    }
+    if(m == 0)
+        return result;
+
+    // differences of residuals and states between consecutive iterations
+    std::vector< std::vector<double> > dF(m, std::vector<double>(size)), dX(dF);
+    for(unsigned int j=0; j<m; j++)
+        for(size_t n=0; n<size; n++) {
+            dX[j][n] = histX[j+1][n] - histX[j][n];
+            dF[j][n] = histG[j+1][n] - histX[j+1][n] - histG[j][n] + histX[j][n];
+        }
+
+    // solve the (slightly regularized) normal equations of the weighted least-squares problem
+    math::Matrix<double> A(m, m, 0.);
+    std::vector<double> b(m, 0.);
+    double trace = 0;
+    for(unsigned int i=0; i<m; i++) {
+        for(unsigned int j=0; j<=i; j++) {
+            double sum = 0;
+            for(size_t n=0; n<size; n++)
+                sum += weight[n] * dF[i][n] * dF[j][n];
+            A(i, j) = A(j, i) = sum;
+        }
+        for(size_t n=0; n<size; n++)
+            b[i] += weight[n] * dF[i][n] * fk[n];
+        trace += A(i, i);
+    }
+    if(!(trace > 0))  // no change between iterations
+        return result;
+    for(unsigned int i=0; i<m; i++)
+        A(i, i) += 1e-10 * trace;
+    std::vector<double> gamma;
+    try{
+        gamma = math::CholeskyDecomp(A).solve(b);
+    }
+    catch(std::exception&) {  // degenerate history: fall back to the simple mixing
+        return result;
+    }
+    for(unsigned int j=0; j<m; j++)
+        for(size_t n=0; n<size; n++)
+            result[n] -= gamma[j] * (dX[j][n] + beta * dF[j][n]);
+    return result;
+}
+
 } // anonymous namespace
 
 //--------- Components with DF ---------//
 
+void BaseComponentWithDF::update(
+    const potential::BasePotential& totalPotential,
+    const actions::BaseActionFinder& actionFinder)
+{
+    density = createDensity(
+        DensityFromDF(totalPotential, actionFinder, *distrFunc, relError, maxNumEval));
+}
+
+void BaseComponentWithDF::updateIncremental(
+    const potential::BasePotential& totalPotential,
+    const actions::BaseActionFinder& actionFinder,
+    double tolerance)
+{
+    if(!density || !(tolerance > 0))
+        return update(totalPotential, actionFinder);
+    PtrDensity previous = density;
+    density = createDensity(DensityFromDF(totalPotential, actionFinder, *distrFunc,
+        relError, maxNumEval, previous.get(), tolerance));
+}
+
 ComponentWithSpheroidalDF::ComponentWithSpheroidalDF(
     const df::PtrDistributionFunction& df,
     const potential::PtrDensity& initDensity,
@@ -70,12 +597,9 @@ ComponentWithSpheroidalDF::ComponentWithSpheroidalDF(
     lmax(_lmax), mmax(_mmax), gridSizeR(_gridSizeR), rmin(_rmin), rmax(_rmax)
 {}
 
-void ComponentWithSpheroidalDF::update(
-    const potential::BasePotential& totalPotential,
-    const actions::BaseActionFinder& actionFinder)
+PtrDensity ComponentWithSpheroidalDF::createDensity(const potential::BaseDensity& dens) const
 {
-    density = potential::DensitySphericalHarmonic::create(
-        DensityFromDF(totalPotential, actionFinder, *distrFunc, relError, maxNumEval),
+    return potential::DensitySphericalHarmonic::create(dens,
         lmax, mmax, gridSizeR, rmin, rmax, false /*use exactly the requested order*/);
 }
 
@@ -92,12 +616,9 @@ ComponentWithDisklikeDF::ComponentWithDisklikeDF(
     gridSizez(_gridSizez), zmin(_zmin), zmax(_zmax)
 {}
 
-void ComponentWithDisklikeDF::update(
-    const potential::BasePotential& totalPotential,
-    const actions::BaseActionFinder& actionFinder)
+PtrDensity ComponentWithDisklikeDF::createDensity(const potential::BaseDensity& dens) const
 {
-    density = potential::DensityAzimuthalHarmonic::create(
-        DensityFromDF(totalPotential, actionFinder, *distrFunc, relError, maxNumEval),
+    return potential::DensityAzimuthalHarmonic::create(dens,
         mmax, gridSizeR, Rmin, Rmax, gridSizez, zmin, zmax, false /*respect the expansion order*/);
 }
 
@@ -110,19 +631,72 @@ void doIteration(SelfConsistentModel& model)
     if(!model.totalPotential)
         updateTotalPotential(model);
 
-    for(unsigned int index=0; index<model.components.size(); index++) {
-        // update the density of each component (this may be a no-op if the component is 'dead',
-        // i.e. provides only a fixed density or potential, but does not possess a DF) -- 
-        // the implementation is at the discretion of each component individually.
-        std::cout << "Computing density for component "<<index<<"..."<<std::flush;
-        model.components[index]->update(*model.totalPotential, *model.actionFinder);
-        std::cout << "done"<<std::endl;
-    }
+    updateComponents(model);
 
     // now update the overall potential and reinit the action finder
     updateTotalPotential(model);
 }
 
+unsigned int iterateToConvergence(SelfConsistentModel& model,
+    unsigned int maxNumIter, double tolerance, unsigned int historySize, double mixing)
+{
+    if(maxNumIter == 0 || !(tolerance > 0) || !(mixing > 0 && mixing <= 1))
+        throw std::invalid_argument("iterateToConvergence: invalid parameters");
+    // densities that changed by less than incrementalTolerance are not recomputed,
+    // so the convergence could not be detected reliably if it exceeds the required tolerance
+    if(model.incrementalTolerance >= tolerance)
+        throw std::invalid_argument(
+            "iterateToConvergence: incrementalTolerance must be smaller than tolerance");
+    if(!model.totalPotential)
+        updateTotalPotential(model);
+    const ComponentGrids grids(getComponentsWithDF(model));
+    const size_t size = grids.offsets.back();
+    std::vector< std::vector<double> > histX, histG;
+    for(unsigned int iter=1; iter<=maxNumIter; iter++) {
+        std::vector<double> x = grids.evalDensities();
+        updateComponents(model);
+        std::vector<double> g = grids.evalDensities();
+
+        // relative change of density at each grid point, and the weights for the mixing procedure
+        std::vector<double> weight(size, 0.);
+        double maxChange = 0;
+        for(unsigned int c=0; c<grids.components.size(); c++) {
+            double sumsq = 0;
+            size_t count = 0;
+            for(size_t n=grids.offsets[c]; n<grids.offsets[c+1]; n++) {
+                double sum = fabs(g[n]) + fabs(x[n]);
+                if(sum == 0) continue;
+                weight[n] = pow_2(2 / sum);
+                sumsq += weight[n] * pow_2(g[n] - x[n]);
+                count++;
+            }
+            if(count > 0)
+                maxChange = fmax(maxChange, sqrt(sumsq / count));
+        }
+        std::cout << "Iteration "<<iter<<": relative change in density "<<maxChange<<std::endl;
+        bool converged = maxChange <= tolerance;
+
+        // if not yet converged, replace the densities by the Anderson-mixed ones
+        if(!converged && (historySize > 0 || mixing < 1)) {
+            histX.push_back(x);
+            histG.push_back(g);
+            if(histX.size() > historySize+1) {
+                histX.erase(histX.begin());
+                histG.erase(histG.begin());
+            }
+            std::vector<double> mixed = andersonMix(histX, histG, weight, mixing);
+            for(size_t n=0; n<size; n++)
+                mixed[n] = fmax(mixed[n], 0.);  // density must remain non-negative
+            grids.setDensities(mixed);
+        }
+
+        updateTotalPotential(model);
+        if(converged)
+            return iter;
+    }
+    return maxNumIter;
+}
+
 void updateTotalPotential(SelfConsistentModel& model)
 {
     std::cout << "Updating potential..."<<std::flush;
@@ -156,13 +730,6 @@ void updateTotalPotential(SelfConsistentModel& model)
         totalDensitySph = compDensSph[0];
     // otherwise don't use multipole expansion at all
 
-    // construct potential expansion from the total density
-    // and add it as one of potential components (possibly the only one)
-    if(totalDensitySph != NULL)
-        compPot.push_back(potential::Multipole::create(*totalDensitySph,
-            model.lmaxAngularSph, model.mmaxAngularSph,
-            model.sizeRadialSph, model.rminSph, model.rmaxSph));
-
     // now the same for the total density to be used in CylSpline for the flattened components
     PtrDensity totalDensityDisk;
     if(compDensDisk.size()>1)
@@ -170,10 +737,25 @@ void updateTotalPotential(SelfConsistentModel& model)
     else if(compDensDisk.size()>0)
         totalDensityDisk = compDensDisk[0];
 
+    // construct potential expansions from the total densities (either one after another,
+    // or simultaneously in the concurrent mode)
+    // and add them as potential components (possibly the only ones)
+    PotentialExpansionJob jobSph (model, totalDensitySph,  false);
+    PotentialExpansionJob jobDisk(model, totalDensityDisk, true);
+    std::vector<ConcurrentJob*> jobs;
+    if(totalDensitySph != NULL)
+        jobs.push_back(&jobSph);
     if(totalDensityDisk != NULL)
-        compPot.push_back(potential::CylSpline::create(*totalDensityDisk, model.mmaxAngularCyl,
-            model.sizeRadialCyl,   model.RminCyl, model.RmaxCyl,
-            model.sizeVerticalCyl, model.zminCyl, model.zmaxCyl, true /*use derivs*/));
+        jobs.push_back(&jobDisk);
+    if(model.concurrentTasks)
+        runConcurrently(jobs);
+    else
+        for(unsigned int j=0; j<jobs.size(); j++)
+            jobs[j]->run();
+    if(jobSph.result)
+        compPot.push_back(jobSph.result);
+    if(jobDisk.result)
+        compPot.push_back(jobDisk.result);
 
     // now check if the total potential is elementary or composite
     if(compPot.size()==0)
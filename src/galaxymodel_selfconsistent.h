@@ -52,8 +52,10 @@ and the action finder as arguments.
 an instance of SelfConsistentModel structure.
 Alternatively, steps 3 and 4 together (and optionally step 2 if it hasn't been done before)
 are performed by another function `doIteration`.
-There are presently no methods for testing the convergence (step 5), so the end-user
-may simply repeat the loop a few times and hope that it converged.
+The end-user may simply repeat the loop a few times and hope that it converged, or use
+the function `iterateToConvergence`, which performs step 5 automatically, monitoring
+the change in density profiles between iterations and accelerating the convergence
+by mixing the densities from several previous iterations.
 Steps 1 and 6 are left at the discretion of the end-user.
 
 A technical note on the potential expansions, in particular the Multipole.
@@ -164,12 +166,52 @@ public:
     BaseComponent(_isDensityDisklike), distrFunc(df), density(initDensity),
     relError(_relError), maxNumEval(_maxNumEval) {}
 
+    /** reinitialize the density profile by recomputing the values of density at a set of
+        grid points determined by the parameters of the component (using the DF integrated
+        over velocities), and then constructing the intermediate representation from these values.
+    */
+    virtual void update(const potential::BasePotential& pot, const actions::BaseActionFinder& af);
+
+    /** same as `update`, but in the incremental mode, which is much cheaper when the density
+        changes only slightly (e.g., in the late stages of the iterative procedure):
+        at each grid point, the density is first estimated with a reduced accuracy and compared
+        with its previous value; if the relative change is below the tolerance, the previous value
+        is kept, otherwise the density is recomputed with the full accuracy (unless the preliminary
+        estimate happens to be accurate enough already).
+        If the previous density profile is absent, this is equivalent to `update`.
+        \param[in]  pot, af  are the total potential and the action finder;
+        \param[in]  tolerance  is the relative change of density below which it is not recomputed;
+        it should be larger than relError (otherwise no computations will be saved).
+    */
+    void updateIncremental(const potential::BasePotential& pot, const actions::BaseActionFinder& af,
+        double tolerance);
+
+    /** construct the intermediate representation of the density profile from the given density
+        model, which is evaluated at the grid points of this component (the set of these points
+        depends only on the parameters of the component, not on the density values).
+        This is used by `update` with the density computed from the DF, and also by `doIteration`,
+        which evaluates the densities of several components at once.
+    */
+    virtual potential::PtrDensity createDensity(const potential::BaseDensity& dens) const = 0;
+
     /** return the pointer to the internal density profile */
     virtual potential::PtrDensity   getDensity()   const { return density; }
 
+    /** replace the internal density profile (e.g., with the one returned by `createDensity`) */
+    void setDensity(const potential::PtrDensity& dens) { density = dens; }
+
     /** no additional potential component is provided, i.e., an empty pointer is returned */
     virtual potential::PtrPotential getPotential() const { return potential::PtrPotential(); }
 
+    /** return the distribution function of this component */
+    const df::PtrDistributionFunction& getDF() const { return distrFunc; }
+
+    /** return the required relative error in density computation */
+    double getRelError() const { return relError; }
+
+    /** return the maximum number of DF evaluations for computing density at a single point */
+    unsigned int getMaxNumEval() const { return maxNumEval; }
+
 protected:
     /// shared pointer to the action-based distribution function (remains unchanged)
     const df::PtrDistributionFunction distrFunc;
@@ -209,11 +251,10 @@ public:
         unsigned int lmax, unsigned int mmax, unsigned int gridSizeR, double rmin, double rmax,
         double relError=1e-3, unsigned int maxNumEval=1e5);
 
-    /** reinitialize the density profile by recomputing the values of density at a set of 
-        grid points in the meridional plane, and then constructing a spherical-harmonic
-        density expansion from these values.
+    /** construct a spherical-harmonic density expansion from the values of the given density
+        at a set of grid points in the meridional plane.
     */
-    virtual void update(const potential::BasePotential& pot, const actions::BaseActionFinder& af);
+    virtual potential::PtrDensity createDensity(const potential::BaseDensity& dens) const;
 
 private:
     /// definition of spatial grid for computing the density profile:
@@ -247,10 +288,10 @@ public:
         unsigned int gridSizez, double zmin, double zmax,
         double relError=1e-3, unsigned int maxNumEval=1e5);
 
-    /** reinitialize the density profile by recomputing the values of density at a set of 
-        grid points in the meridional plane, and then constructing a density interpolator.
+    /** construct a density interpolator from the values of the given density
+        at a set of grid points in the meridional plane.
     */
-    virtual void update(const potential::BasePotential& pot, const actions::BaseActionFinder& af);
+    virtual potential::PtrDensity createDensity(const potential::BaseDensity& dens) const;
 private:
     const unsigned int mmax;       ///< order of Fourier expansion
     const unsigned int gridSizeR;  ///< size of the grid in cylindrical radius
@@ -291,6 +332,26 @@ public:
     /// whether to use the interpolated action finder (faster but less accurate)
     bool useActionInterpolation;
 
+    /// whether to compute the densities of all components with DF in a single pass
+    /// (see `doIteration`), or separately for each component
+    bool fuseDensityComputation;
+
+    /// if positive, the densities of components with DF are updated in the incremental mode
+    /// (see `BaseComponentWithDF::updateIncremental`) with this tolerance
+    double incrementalTolerance;
+
+    /// max number of consecutive incremental updates, after which the densities are recomputed
+    /// in full (otherwise the changes below the tolerance could accumulate over many iterations)
+    unsigned int maxIncrementalUpdates;
+
+    /// number of incremental updates since the last full one (maintained by `doIteration`)
+    unsigned int numIncrementalUpdates;
+
+    /// whether to run independent tasks concurrently: the update of components that are not
+    /// handled by the fused density computation, and the construction of Multipole and CylSpline
+    /// potential expansions; the available OpenMP threads are split between the tasks
+    bool concurrentTasks;
+
     /** parameters of grid for computing the multipole expansion of the combined
         density profile of spheroidal components;
         in general, these parameters should encompass the range of analogous parameters 
@@ -315,7 +376,9 @@ public:
 
     /// assign default values
     SelfConsistentModel() :
-        useActionInterpolation(true),
+        useActionInterpolation(true), fuseDensityComputation(true),
+        incrementalTolerance(0), maxIncrementalUpdates(4), numIncrementalUpdates(0),
+        concurrentTasks(false),
         lmaxAngularSph(0), mmaxAngularSph(0), sizeRadialSph(25), rminSph(0), rmaxSph(0),
         mmaxAngularCyl(0), sizeRadialCyl(20), RminCyl(0), RmaxCyl(0),
         sizeVerticalCyl(20), zminCyl(0), zmaxCyl(0)
@@ -331,7 +394,45 @@ void updateTotalPotential(SelfConsistentModel& model);
 /** Main iteration step: recompute the densities of all components, and then call 
     `updateTotalPotential`; if no potential is present at the beginning, it is initialized
     by a call to the same `updateTotalPotential` before recomputing the densities.
+    If `model.fuseDensityComputation` is set and there are several components with DF,
+    their densities are computed in a single pass: the union of grid points of all these
+    components is collected, and at each point the velocity integration is performed
+    for all DFs at once, so that the actions (the most expensive part of the computation)
+    are evaluated only once for each velocity sample instead of once per component.
+    The accuracy of integration is the highest among all components, and the integration
+    at each point continues until the density of each component has converged.
+    Components of other types are updated individually by calling their `update` method.
 */
 void doIteration(SelfConsistentModel& model);
 
+/** Repeat the iteration steps until the density profiles of all components with DF converge,
+    using the Anderson acceleration of the fixed-point iteration.
+    The state of the model is described by the values of density of each component with DF
+    at the grid points of its density representation (these are in one-to-one correspondence
+    with the expansion coefficients). At each iteration, the densities are recomputed from
+    the DFs in the current potential (same as in `doIteration`), and then replaced by
+    the linear combination of the current and several previous input and output densities,
+    which minimizes the residual (the difference between output and input) in the least-squares
+    sense; the total potential is then computed from these mixed densities.
+    This typically reduces the number of iterations by a factor of two or more compared
+    to the simple iteration; setting historySize=0 and mixing=1 reproduces the latter.
+    \param[in,out] model  is the self-consistent model, which is modified by this routine.
+    \param[in]  maxNumIter  is the maximum number of iterations.
+    \param[in]  tolerance  is the required accuracy: the iterations stop when the root-mean-square
+    relative change of density between the input and output of an iteration step is below
+    this value for all components; it should be larger than the accuracy of density computation
+    (relError parameter of the components), otherwise the iterations may never converge,
+    and also larger than `model.incrementalTolerance` (otherwise the densities that are not
+    recomputed in the incremental mode would make the iterations appear converged prematurely).
+    \param[in]  historySize  is the number of previous iterations used in the mixing.
+    \param[in]  mixing  is the fraction (0<mixing<=1) of the output density used at each step
+    (smaller values make the procedure more robust but slower).
+    \return  the number of performed iterations (if it equals maxNumIter, the convergence
+    may not have been achieved).
+    \throw  std::invalid_argument if the parameters are incorrect, or any exception
+    that arises in the computation of densities or potentials.
+*/
+unsigned int iterateToConvergence(SelfConsistentModel& model,
+    unsigned int maxNumIter=20, double tolerance=1e-2, unsigned int historySize=4, double mixing=1.);
+
 }  // namespace
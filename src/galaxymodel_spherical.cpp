@@ -911,12 +911,16 @@ double SphericalModel::cumulEtotal(const double h) const
 
 //---- Extended spherical model with 2d interpolation for position-dependent quantities ----//
 
-void SphericalModelLocal::init(const math::IFunction& df, const std::vector<double>& gridh)
+void SphericalModelLocal::init(const math::IFunction& df, const std::vector<double>& gridh,
+    const SphericalModelLocal* prev, double tolerance)
 {
     // 1. determine the range of h that covers the region of interest
     // and construct the grid in X = log[h(Phi)] and Y = log[h(E)/h(Phi)]
+    // (in case of an incremental update, the grid is taken from the previous model)
     std::vector<double> gridLogH;
-    if(gridh.empty())
+    if(prev)
+        gridLogH = prev->intJ1.xvalues();
+    else if(gridh.empty())
         gridLogH = math::createInterpolationGrid(math::LogLogScaledFnc(df), EPSDER2);
     else {
         gridLogH.resize(gridh.size());
@@ -925,6 +929,11 @@ void SphericalModelLocal::init(const math::IFunction& df, const std::vector<doub
     }
     while(!gridLogH.empty() && df(exp(gridLogH.back())) <= MIN_VALUE_ROUNDOFF)  // ensure that f(hmax)>0
         gridLogH.pop_back();
+    if(prev && gridLogH.size() != prev->intJ1.xvalues().size()) {
+        // the grid of the previous model does not suit the new DF: start from scratch
+        init(df, gridh);
+        return;
+    }
     if(gridLogH.size() < 3)
         throw std::runtime_error("SphericalModelLocal: f(h) is nowhere positive");
     const double logHmin        = gridLogH.front(),  logHmax = gridLogH.back();
@@ -933,6 +942,47 @@ void SphericalModelLocal::init(const math::IFunction& df, const std::vector<doub
     const double mindeltaY      = fmin(0.1, (logHmax-logHmin)/npointsY);
     std::vector<double> gridY   = math::createNonuniformGrid(npointsY, mindeltaY, logHmax-logHmin, true);
 
+    // 2. tabulate the DF and the energy on a uniform grid in log(h) covering the entire range
+    // spanned by the 2d grid, and determine the regions where the DF has changed since the previous model
+    checkLogHmin = logHmin;
+    checkStep    = 0.5 * mindeltaY;
+    const unsigned int npointsCheck = static_cast<unsigned int>((logHmax-logHmin) * 2 / checkStep) + 2;
+    checkF.resize(npointsCheck);
+    checkE.resize(npointsCheck);
+    for(unsigned int k=0; k<npointsCheck; k++) {
+        double h  = exp(checkLogHmin + k * checkStep);
+        checkF[k] = df(h);
+        checkE[k] = phasevol.E(h);
+    }
+    // cumulative number of intervals between adjacent points of this grid where the DF has changed
+    std::vector<unsigned int> numChanged(npointsCheck, 0);
+    if(prev) {
+        bool sameGrid = prev->checkF.size() == npointsCheck &&
+            prev->checkLogHmin == checkLogHmin && prev->checkStep == checkStep;
+        for(unsigned int k=0; sameGrid && k<npointsCheck; k++)
+            if(fabs(checkE[k] - prev->checkE[k]) > MIN_REL_DIFFERENCE * fabs(checkE[k]))
+                sameGrid = false;   // the potential has changed
+        if(!sameGrid) {
+            utils::msg(utils::VL_DEBUG, "SphericalModelLocal",
+                "Potential has changed, the previous model cannot be reused");
+            prev = NULL;            // all integrals need to be recomputed
+        }
+        else {
+            bool prevPointChanged = false;
+            for(unsigned int k=0; k<npointsCheck; k++) {
+                bool pointChanged = fabs(checkF[k] - prev->checkF[k]) >
+                    tolerance * fmax(fabs(checkF[k]), fabs(prev->checkF[k]));
+                numChanged[k] = (k>0 ? numChanged[k-1] : 0) +
+                    (k>0 && (pointChanged || prevPointChanged) ? 1 : 0);
+                prevPointChanged = pointChanged;
+                // keep the reference value of the DF at the unchanged points, so that a slow drift
+                // of the DF over several updates, each one below tolerance, is eventually detected
+                if(!pointChanged)
+                    checkF[k] = prev->checkF[k];
+            }
+        }
+    }
+
     // 3. determine the asymptotic behaviour of f(h) and g(h):
     // f(h) ~ h^outerFslope as h-->inf and  g(h) ~ h^(1-outerEslope)
     double outerH = exp(gridLogH.back()), outerG;
@@ -961,9 +1011,17 @@ void SphericalModelLocal::init(const math::IFunction& df, const std::vector<doub
     double outerJ1 = 0.5*M_SQRTPI * math::gamma(2 + outerRatio) / math::gamma(2.5 + outerRatio);
     double outerJ3 = outerJ1 * 1.5 / (2.5 + outerRatio);
 
-    // 5b. compute the values of J1/J0 and J3/J0 at nodes of 2d grid in X=log(h(Phi)), Y=log(h(E)/h(Phi))
+    // 5b. compute the values of J1/J0 and J3/J0 at nodes of 2d grid in X=log(h(Phi)), Y=log(h(E)/h(Phi));
+    // each row in X is independent of others, so they are processed in parallel
     math::Matrix<double> gridJ1(npoints, npointsY), gridJ3(npoints, npointsY);
-    for(unsigned int i=0; i<npoints; i++)
+    segJ0 = math::Matrix<double>(npoints, npointsY, 0.);
+    segJ1 = math::Matrix<double>(npoints, npointsY, 0.);
+    segJ3 = math::Matrix<double>(npoints, npointsY, 0.);
+    int numReused = 0;  // number of segments where the integrals were taken from the previous model
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:numReused)
+#endif
+    for(int i=0; i<(int)npoints; i++)
     {
         // The first coordinate of the grid is X = log(h(Phi)), the second is Y = log(h(E)) - X.
         // For each pair of values of X and Y, we compute the following integrals:
@@ -984,22 +1042,39 @@ void SphericalModelLocal::init(const math::IFunction& df, const std::vector<doub
         for(unsigned int j=1; j<npointsY; j++) {
             double logHprev = gridLogH[i] + gridY[j-1];
             double logHcurr = gridLogH[i] + gridY[j];
-            if(j==1) {
+            // the integrals over this segment may be taken from the previous model
+            // if the DF has not changed anywhere in the segment
+            bool reuse = false;
+            if(prev) {
+                int kmin = std::max<int>(0, static_cast<int>(floor((logHprev - checkLogHmin) / checkStep)));
+                int kmax = std::min<int>(npointsCheck-1,
+                    static_cast<int>(ceil((logHcurr - checkLogHmin) / checkStep)));
+                reuse = kmax > kmin && numChanged[kmax] == numChanged[kmin];
+            }
+            if(reuse) {
+                numReused++;
+                segJ0(i, j) = prev->segJ0(i, j);
+                segJ1(i, j) = prev->segJ1(i, j);
+                segJ3(i, j) = prev->segJ3(i, j);
+            } else if(j==1) {
                 // integration over the first segment uses a more accurate quadrature rule
                 // to accounting for a possible endpoint singularity at Phi=E
                 math::ScalingCub scaling(logHprev, logHcurr);
-                J0acc = math::integrateGL(
+                segJ0(i, j) = math::integrateGL(
                     math::ScaledIntegrand<math::ScalingCub>(scaling, intJ0), 0, 1, GLORDER);
-                J1acc = math::integrateGL(
+                segJ1(i, j) = math::integrateGL(
                     math::ScaledIntegrand<math::ScalingCub>(scaling, intJ1), 0, 1, GLORDER);
-                J3acc = math::integrateGL(
+                segJ3(i, j) = math::integrateGL(
                     math::ScaledIntegrand<math::ScalingCub>(scaling, intJ3), 0, 1, GLORDER);
             } else {
-                J0acc += math::integrateGL(intJ0, logHprev, logHcurr, GLORDER);
-                J1acc += math::integrateGL(intJ1, logHprev, logHcurr, GLORDER);
-                J3acc += math::integrateGL(intJ3, logHprev, logHcurr, GLORDER);
+                segJ0(i, j) = math::integrateGL(intJ0, logHprev, logHcurr, GLORDER);
+                segJ1(i, j) = math::integrateGL(intJ1, logHprev, logHcurr, GLORDER);
+                segJ3(i, j) = math::integrateGL(intJ3, logHprev, logHcurr, GLORDER);
             }
-            if(i==npoints-1) {
+            J0acc += segJ0(i, j);
+            J1acc += segJ1(i, j);
+            J3acc += segJ3(i, j);
+            if(i==(int)npoints-1) {
                 // last row: analytic limiting values for Phi-->0 and any E/Phi
                 double EoverPhi = exp(gridY[j] * outerEslope);  // strictly < 1
                 double oneMinusJ0overI0 = std::pow(EoverPhi, 1+outerRatio);  // < 1
@@ -1033,6 +1108,11 @@ void SphericalModelLocal::init(const math::IFunction& df, const std::vector<doub
         }
     }
 
+    if(prev)
+        utils::msg(utils::VL_DEBUG, "SphericalModelLocal", "Reused the integrals over " +
+            utils::toString(numReused) + " out of " + utils::toString(npoints * (npointsY-1)) +
+            " segments from the previous model");
+
     // debugging output
     if(utils::verbosityLevel >= utils::VL_VERBOSE) {
         std::ofstream strm("SphericalModelLocal.log");
@@ -1052,6 +1132,41 @@ void SphericalModelLocal::init(const math::IFunction& df, const std::vector<doub
     // 5c. construct the 2d splines
     intJ1 = math::CubicSpline2d(gridLogH, gridY, gridJ1);
     intJ3 = math::CubicSpline2d(gridLogH, gridY, gridJ3);
+
+    // 5d. collect the values and derivatives of both splines at grid nodes into the packed table
+    packedJ.resize(npoints * npointsY * 8);
+    for(unsigned int i=0; i<npoints; i++) {
+        for(unsigned int j=0; j<npointsY; j++) {
+            double* node = &packedJ[(i * npointsY + j) * 8];
+            intJ1.evalDeriv(gridLogH[i], gridY[j], node+0, node+1, node+2, NULL, node+3);
+            intJ3.evalDeriv(gridLogH[i], gridY[j], node+4, node+5, node+6, NULL, node+7);
+        }
+    }
+}
+
+void SphericalModelLocal::evalJ(double X, double Y, double& logJ1, double& logJ3) const
+{
+    const std::vector<double>& xval = intJ1.xvalues(), &yval = intJ1.yvalues();
+    const int nx = xval.size(), ny = yval.size(),
+    xi = std::min<int>(std::max<int>(math::binSearch(X, &xval.front(), nx), 0), nx-2),
+    yi = std::min<int>(std::max<int>(math::binSearch(Y, &yval.front(), ny), 0), ny-2);
+    const double
+    dx = xval[xi+1] - xval[xi], t = (X - xval[xi]) / dx,
+    dy = yval[yi+1] - yval[yi], u = (Y - yval[yi]) / dy;
+    // cubic Hermite basis functions for the value and the derivative at both ends of the segment,
+    // the latter multiplied by the segment length
+    const double
+    hx[2] = { (1+2*t) * pow_2(1-t), t*t * (3-2*t) }, hxd[2] = { t * pow_2(1-t) * dx, t*t * (t-1) * dx },
+    hy[2] = { (1+2*u) * pow_2(1-u), u*u * (3-2*u) }, hyd[2] = { u * pow_2(1-u) * dy, u*u * (u-1) * dy };
+    logJ1 = logJ3 = 0;
+    for(int a=0; a<2; a++) {
+        for(int b=0; b<2; b++) {
+            const double* node = &packedJ[((xi+a) * ny + yi+b) * 8];
+            double w = hx[a] * hy[b], wx = hxd[a] * hy[b], wy = hx[a] * hyd[b], wxy = hxd[a] * hyd[b];
+            logJ1 += w * node[0] + wx * node[1] + wy * node[2] + wxy * node[3];
+            logJ3 += w * node[4] + wx * node[5] + wy * node[6] + wxy * node[7];
+        }
+    }
 }
 
 void SphericalModelLocal::evalLocal(
@@ -1068,9 +1183,11 @@ void SphericalModelLocal::evalLocal(
     // restrict the arguments of 2d interpolators to the range covered by their grids
     double X  = math::clamp(log(hPhi),    intJ1.xmin(), intJ1.xmax());
     double Y  = math::clamp(log(hE/hPhi), intJ1.ymin(), intJ1.ymax());
-    // compute the 2d interpolators for J1, J3
-    double J1 = exp(intJ1.value(X, Y)) * J0;
-    double J3 = exp(intJ3.value(X, Y)) * J0;
+    // compute the 2d interpolators for J1, J3 (both at once from the packed table)
+    double logJ1, logJ3;
+    evalJ(X, Y, logJ1, logJ3);
+    double J1 = exp(logJ1) * J0;
+    double J3 = exp(logJ3) * J0;
     if(E>=0) {  // in this case, the coefficients were computed for E=0, need to scale them to E>0
         double corr = 1 / sqrt(1 - E / Phi);  // correction factor <1
         J1 *= corr;
@@ -115,8 +115,30 @@ class SphericalModelLocal: public SphericalModel {
     /// 2d interpolators for scaled integrals over distribution function
     math::CubicSpline2d intJ1, intJ3;
 
-    /// perform actual initialization of interpolators
-    void init(const math::IFunction& df, const std::vector<double>& gridh);
+    /// values and derivatives of both 2d interpolators at the nodes of their common grid, packed
+    /// together (8 numbers per node: J1, dJ1/dX, dJ1/dY, d2J1/dXdY, and the same for J3),
+    /// so that `evalLocal` needs a single cell lookup and touches a contiguous block of memory
+    std::vector<double> packedJ;
+
+    /// integrals over the DF on each segment of the grid in Y for each node of the grid in X,
+    /// retained for the incremental update of interpolators after a change of the DF
+    math::Matrix<double> segJ0, segJ1, segJ3;
+
+    /// log(h) of the first point and the step of a uniform grid in log(h), at which the values of
+    /// the DF and the energy are stored to detect the changes in the DF and in the potential
+    double checkLogHmin, checkStep;
+
+    /// values of the DF and the energy at the nodes of this grid
+    std::vector<double> checkF, checkE;
+
+    /// perform actual initialization of interpolators;
+    /// if the previous model is provided, reuse the integrals over the parts of the grid where the DF
+    /// has changed by less than the relative tolerance (the potential must also stay the same)
+    void init(const math::IFunction& df, const std::vector<double>& gridh,
+        const SphericalModelLocal* prev=NULL, double tolerance=0);
+
+    /// evaluate both 2d interpolators at the given point from the packed table
+    void evalJ(double X, double Y, double& logJ1, double& logJ3) const;
 
 public:
 
@@ -149,6 +171,28 @@ public:
     :
         SphericalModel(model) { init(*this, gridh); }
 
+    /** Construct the interpolators for a new DF by updating those of a previously constructed model.
+        The integrals over the DF that enter the 2d interpolators are recomputed only in the regions
+        of phase volume where the DF has changed, while the rest are copied from the previous model.
+        If the potential (i.e., the mapping between E and h) differs from that of the previous model,
+        or the grid is not suitable for the new DF, all interpolators are constructed from scratch.
+        \param[in]  phasevol  is the object providing the correspondence between E and h.
+        \param[in]  df  is the new distribution function expressed in terms of h.
+        \param[in]  prev  is the previously constructed model.
+        \param[in]  tolerance  is the relative change in the DF below which it is considered unchanged;
+        the change is measured with respect to the DF that was used to compute the reused integrals,
+        so the error does not accumulate over many updates. For a DF fitted to a finite number of
+        samples, a value comparable to the statistical noise of the fit is appropriate.
+        \throw std::runtime_error in case of inconsistencies in the input data.
+    */
+    SphericalModelLocal(
+        const potential::PhaseVolume& phasevol,
+        const math::IFunction& df,
+        const SphericalModelLocal& prev,
+        double tolerance = 1e-8)
+    :
+        SphericalModel(phasevol, df) { init(df, std::vector<double>(), &prev, tolerance); }
+
     /** Compute the local drift and diffusion coefficients in velocity,
         as defined, e.g., by eq.7.88 or L.26 in Binney&Tremaine(2008);
         the returned values should be multiplied by  \f$ N^{-1} \ln\Lambda \f$.
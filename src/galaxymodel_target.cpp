@@ -0,0 +1,139 @@
+#include "galaxymodel_target.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace galaxymodel{
+
+namespace{
+
+/// number of particles sorted and processed together by each thread
+static const size_t PARTICLE_BLOCK_SIZE = 65536;
+
+/// number of bits per dimension in the Morton index (3*21 bits fit into a 64-bit integer)
+static const int MORTON_BITS = 21;
+
+/// interleave the lowest 21 bits of the input number with two zero bits after each one
+inline unsigned long long spreadBits(unsigned long long v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v <<  8) & 0x100f00f00f00f00full;
+    v = (v | v <<  4) & 0x10c30c30c30c30c3ull;
+    v = (v | v <<  2) & 0x1249249249249249ull;
+    return v;
+}
+
+/// convert a coordinate into an integer in the range [0 .. 2^MORTON_BITS-1]
+inline unsigned long long quantize(double x, double xmin, double scale)
+{
+    const double maxval = (1 << MORTON_BITS) - 1;
+    double val = (x - xmin) * scale;
+    return val >= 0 ? static_cast<unsigned long long>(fmin(val, maxval)) : 0;  // also handles NAN
+}
+
+}  // internal ns
+
+std::vector<double> computeTargetFromParticles(const BaseTarget& target,
+    const particles::ParticleArrayCar& particles)
+{
+    const ptrdiff_t numParticles = particles.size();
+    const size_t numCoefs = target.numCoefs();
+    std::vector<double> result(numCoefs, 0.);
+    if(numParticles == 0)
+        return result;
+
+    // bounding box of all particles, which defines the mapping of positions onto the Morton curve
+    double xmin[3] = {INFINITY, INFINITY, INFINITY}, xmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for(ptrdiff_t i=0; i<numParticles; i++) {
+        const coord::PosVelCar& point = particles.point(i);
+        xmin[0] = fmin(xmin[0], point.x);  xmax[0] = fmax(xmax[0], point.x);
+        xmin[1] = fmin(xmin[1], point.y);  xmax[1] = fmax(xmax[1], point.y);
+        xmin[2] = fmin(xmin[2], point.z);  xmax[2] = fmax(xmax[2], point.z);
+    }
+    double scale[3];
+    for(int d=0; d<3; d++)
+        scale[d] = xmax[d] > xmin[d] ? ((1 << MORTON_BITS) - 1) / (xmax[d] - xmin[d]) : 0;
+
+    const ptrdiff_t numBlocks = (numParticles + PARTICLE_BLOCK_SIZE - 1) / PARTICLE_BLOCK_SIZE;
+    std::string errorMsg;
+    volatile bool fail = false;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        // thread-local storage: the datacube, the finalized output, and the sorting keys of one block
+        math::Matrix<double> datacube;
+        std::vector<StorageNumT> output(numCoefs);
+        std::vector< std::pair<unsigned long long, ptrdiff_t> > order;
+        bool used = false;   // whether this thread has processed any particles
+        try{
+            datacube = target.newDatacube();
+            order.reserve(std::min<ptrdiff_t>(numParticles, PARTICLE_BLOCK_SIZE));
+        }
+        catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(computeTargetFromParticles)
+#endif
+            errorMsg = e.what();
+            fail = true;
+        }
+        // contiguous ranges of blocks are assigned to each thread, as in the original order
+        // the adjacent particles are more likely to be close in space (e.g., in a sorted snapshot)
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for(ptrdiff_t b=0; b<numBlocks; b++) {
+            if(fail) continue;
+            used = true;
+            try{
+                const ptrdiff_t first = b * PARTICLE_BLOCK_SIZE,
+                    last = std::min<ptrdiff_t>(first + PARTICLE_BLOCK_SIZE, numParticles);
+                order.clear();
+                for(ptrdiff_t i=first; i<last; i++) {
+                    const coord::PosVelCar& point = particles.point(i);
+                    order.push_back(std::make_pair(
+                        spreadBits(quantize(point.x, xmin[0], scale[0]))      |
+                        spreadBits(quantize(point.y, xmin[1], scale[1])) << 1 |
+                        spreadBits(quantize(point.z, xmin[2], scale[2])) << 2, i));
+                }
+                std::sort(order.begin(), order.end());
+                for(size_t k=0; k<order.size(); k++) {
+                    double xv[6];
+                    particles.point(order[k].second).unpack_to(xv);
+                    target.addPoint(xv, particles.mass(order[k].second), datacube.data());
+                }
+            }
+            catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(computeTargetFromParticles)
+#endif
+                errorMsg = e.what();
+                fail = true;
+            }
+        }
+        // convert the datacube of this thread into the output values and add them to the result
+        if(used && !fail) {
+            try{
+                target.finalizeDatacube(datacube, numCoefs ? &output[0] : NULL);
+#ifdef _OPENMP
+#pragma omp critical(computeTargetFromParticles)
+#endif
+                for(size_t c=0; c<numCoefs; c++)
+                    result[c] += output[c];
+            }
+            catch(std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(computeTargetFromParticles)
+#endif
+                errorMsg = e.what();
+                fail = true;
+            }
+        }
+    }
+    if(fail)
+        throw std::runtime_error("computeTargetFromParticles: " + errorMsg);
+    return result;
+}
+
+}  // namespace
@@ -4,17 +4,20 @@
     \author  Eugene Vasiliev
 
     This file defines the base class for all target objects.
-    This is a header-only file.
 */
 #pragma once
 #include "orbit.h"
+#include "particles_base.h"
 #include "smart.h"
 #include "math_linalg.h"
 #include <string>
+#include <algorithm>
 
 namespace galaxymodel{
 
-/// numerical type for storing the matrix elements (choose float to save memory)
+/// numerical type for storing the matrix elements (choose float to save memory);
+/// the rows of the orbit library produced by `finalizeDatacube` may be further compressed
+/// with `math::CompressedMatrixWriter`, since most of their elements are typically zeros
 typedef float StorageNumT;
 
 struct GalaxyModel;  // forward declaration
@@ -52,14 +55,23 @@ public:
 
     /// allocate an empty matrix for internal storage of the datacube;
     /// its overall size is numValues(), but shape may vary between descendant classes
+    /// (and it may contain additional bookkeeping data beyond the first numValues() elements)
     virtual math::Matrix<double> newDatacube() const {
         return math::Matrix<double>(1, numValues(), 0.);
     }
 
+    /// reset the datacube allocated by newDatacube() to its initial (empty) state after
+    /// it has been used in finalizeDatacube(), so that it can be reused for another orbit;
+    /// descendant classes that keep track of the modified elements may do it more efficiently
+    virtual void clearDatacube(math::Matrix<double> &datacube) const {
+        std::fill(datacube.data(), datacube.data() + datacube.size(), 0.);
+    }
+
     /** convert the intermediate datacube into array of output values;
         \param[in] datacube  is the matrix allocated by newDatacube() and filled by repeated calls
         to addPoint();
-        it is allowed to be modified inside this routine, but is supposed to be discarded afterwards.
+        it is allowed to be modified inside this routine, but is supposed to be discarded afterwards
+        or reset by clearDatacube().
         \param[out]  output  must point to an existing array of length numCoefs(),
         which will be filled with suitably converted values from the datacube;
         default implementation is just to copy the internal datacube, but descendant classes
@@ -75,7 +87,10 @@ public:
         accumulate the contribution of the given point to the internal datacube, weighted with 'mult';
         \param[in]  point is the position and (optionally) velocity in cartesian coordinates;
         \param[in]  mult  is the weigth of the point in the output datacube;
-        \param[in,out] datacube must point to an array of length numValues(), allocated by newDatacube()
+        \param[in,out] datacube must point to the array allocated by newDatacube(), which contains
+        at least numValues() elements (descendant classes that store additional bookkeeping data
+        after these elements must also override `eval()`, which by default provides an array of
+        exactly numValues() elements to addPoint())
     */
     virtual void addPoint(const double point[], const double mult, double datacube[]) const = 0;
 
@@ -155,4 +170,82 @@ public:
     }
 };
 
+
+/** Orbit runtime function that collects the data for several targets at once:
+    the points on the trajectory are computed only once for each sub-step and passed to all targets.
+    The datacubes are provided externally and may be reused for many orbits: `finalize()` converts
+    them into the output arrays and resets them to zero for the next orbit.
+*/
+class RuntimeFncTargets: public orbit::BaseRuntimeFnc {
+
+    /// the functions that collect the data for a given point
+    const std::vector<PtrTarget>& targets;
+
+    /// intermediate storage for the data collected during orbit integration (one per target),
+    /// allocated by each target's newDatacube() and initially filled with zeros
+    std::vector< math::Matrix<double> >& datacubes;
+
+    /// total integration time
+    double time;
+
+    /// number of points taken from the trajectory during each timestep of the ODE solver
+    const int numSamplesPerStep;
+
+public:
+    /// default number of points taken from the trajectory during each timestep
+    static const int NUM_SAMPLES_PER_STEP = 10;
+
+    RuntimeFncTargets(const std::vector<PtrTarget>& _targets,
+        std::vector< math::Matrix<double> >& _datacubes,
+        const int _numSamplesPerStep = NUM_SAMPLES_PER_STEP) :
+        targets(_targets), datacubes(_datacubes), time(0.), numSamplesPerStep(_numSamplesPerStep) {}
+
+    /// convert the datacubes into the output arrays (one per target, each of length numCoefs()),
+    /// normalize them by the total integration time, and reset the datacubes to zero
+    void finalize(StorageNumT* const outputs[])
+    {
+        const StorageNumT invtime = static_cast<StorageNumT>(time>0 ? 1./time : 1.);
+        for(size_t t=0; t<targets.size(); t++) {
+            targets[t]->finalizeDatacube(datacubes[t], outputs[t]);
+            for(size_t i=0, size = targets[t]->numCoefs(); i<size; i++)
+                outputs[t][i] *= invtime;
+            targets[t]->clearDatacube(datacubes[t]);
+        }
+        time = 0;
+    }
+
+    /// compute the points at each sub-step of the current timestep, and pass them to all targets
+    virtual orbit::StepResult processTimestep(
+        const math::BaseOdeSolver& solver, const double tbegin, const double tend, double[])
+    {
+        time += tend-tbegin;
+        double substep = (tend-tbegin) / numSamplesPerStep;  // duration of each sub-step
+        for(int s=0; s<numSamplesPerStep; s++) {
+            double tsubstep = tbegin + substep * (s+0.5);  // equally-spaced samples in time
+            double point[6];  // position and velocity in cartesian coordinates at the current sub-step
+            for(int c=0; c<6; c++)
+                point[c] = solver.getSol(tsubstep, c);
+            for(size_t t=0; t<targets.size(); t++)
+                targets[t]->addPoint(point, substep, datacubes[t].data());
+        }
+        return orbit::SR_CONTINUE;
+    }
+};
+
+/** Compute the values of constraints of a target for an array of particles (e.g., an N-body
+    snapshot), i.e., the sum of contributions of all particles weighted by their masses.
+    The particles are distributed between threads, each one accumulating its own datacube,
+    which is finalized at the end, and the results of all threads are summed up.
+    Within each thread, particles are processed in blocks, and each block is sorted by the index
+    along the Morton (Z-order) curve in the 3d position space, so that consecutive particles
+    typically touch the same or adjacent elements of the datacube, which greatly improves
+    the cache locality for large datacubes and randomly ordered input particles.
+    \param[in]  target  is the target object;
+    \param[in]  particles  is the array of particles (position/velocity in cartesian coordinates);
+    \return  the array of length target.numCoefs().
+    \throw  any exception that occurred in processing particles (after all threads are finished).
+*/
+std::vector<double> computeTargetFromParticles(const BaseTarget& target,
+    const particles::ParticleArrayCar& particles);
+
 }  // namespace
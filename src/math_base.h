@@ -180,6 +180,8 @@ public:
     /// \param[in,out]  output  points to the external array that accumulates the data;
     /// all its elements that have a contribution from the input point are incremented by
     /// the appropriate amount, multiplied by the input factor 'mult'.
+    /// The array has length numValues(), unless a descendant class documents that it needs
+    /// extra space for bookkeeping data; such a class must also override `eval()`.
     virtual void addPoint(const double vars[], const double mult, double output[]) const = 0;
 
     virtual void eval(const double vars[], double values[]) const
@@ -10,6 +10,7 @@
 #include <cassert>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 
 #if not defined(GSL_MAJOR_VERSION) || (GSL_MAJOR_VERSION == 1) && (GSL_MINOR_VERSION < 15)
 #error "GSL version is too old (need at least 1.15)"
@@ -416,6 +417,142 @@ double quasiRandomHalton(size_t ind, unsigned int base)
     return val;
 }
 
+namespace {
+
+/// primitive polynomials and initial direction numbers for the Sobol sequence (Joe & Kuo 2008)
+/// for dimensions 2..MAX_SOBOL_DIM: degree s, coefficients a, and s initial numbers m_1..m_s
+static const int SOBOL_INIT[MAX_SOBOL_DIM-1][9] = {
+    {1,  0, 1},
+    {2,  1, 1, 3},
+    {3,  1, 1, 3, 1},
+    {3,  2, 1, 1, 1},
+    {4,  1, 1, 1, 3, 3},
+    {4,  4, 1, 3, 5, 13},
+    {5,  2, 1, 1, 5, 5, 17},
+    {5,  4, 1, 1, 5, 5, 5},
+    {5,  7, 1, 1, 7, 11, 19},
+    {5, 11, 1, 1, 5, 1, 1},
+    {5, 13, 1, 1, 1, 3, 11},
+    {5, 14, 1, 3, 5, 5, 31},
+    {6,  1, 1, 3, 3, 9, 7, 49},
+    {6, 13, 1, 1, 1, 15, 21, 21},
+    {6, 16, 1, 3, 1, 13, 27, 49},
+    {6, 19, 1, 1, 1, 15, 7, 5},
+    {6, 22, 1, 3, 1, 15, 13, 25},
+    {6, 25, 1, 1, 5, 5, 19, 61},
+    {7,  1, 1, 3, 7, 11, 23, 15, 103},
+    {7,  4, 1, 3, 7, 13, 13, 15, 69} };
+
+/// table of 32-bit direction numbers of the Sobol sequence for all dimensions,
+/// initialized at program startup (it does not depend on any other static variables)
+class SobolDirections {
+public:
+    uint32_t dir[MAX_SOBOL_DIM][32];
+    SobolDirections() {
+        // the first dimension is the van der Corput sequence in base 2
+        for(int b=0; b<32; b++)
+            dir[0][b] = 1u << (31-b);
+        for(int d=1; d<MAX_SOBOL_DIM; d++) {
+            const int* init = SOBOL_INIT[d-1];
+            int s = init[0];
+            uint32_t a = init[1];
+            for(int b=0; b<s; b++)
+                dir[d][b] = static_cast<uint32_t>(init[b+2]) << (31-b);
+            for(int b=s; b<32; b++) {
+                uint32_t v = dir[d][b-s] ^ (dir[d][b-s] >> s);
+                for(int k=1; k<s; k++)
+                    if((a >> (s-1-k)) & 1)
+                        v ^= dir[d][b-k];
+                dir[d][b] = v;
+            }
+        }
+    }
+};
+static const SobolDirections sobolDirections;
+
+/// 64-bit hash function (finalizer of the SplitMix64 generator)
+inline uint64_t hash64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/// reverse the order of bits in a 32-bit integer
+inline uint32_t reverseBits(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+/// nested uniform (Owen) scrambling of a 32-bit fixed-point number:
+/// each bit is flipped depending on the key and all preceding (more significant) bits.
+/// This is achieved by a hash function (Laine-Karras permutation) applied to the bit-reversed
+/// number, which has the property that each bit affects only the more significant ones.
+inline uint32_t owenScramble(uint32_t x, uint32_t key)
+{
+    x = reverseBits(x);
+    x += key;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+}  // internal namespace
+
+QuasiRandomSequence::QuasiRandomSequence(unsigned int numDim, QuasiRandomMethod method, size_t _seed) :
+    ndim(numDim), meth(method), seed(_seed)
+{
+    if(meth == QR_CUBATURE)
+        throw std::invalid_argument("QuasiRandomSequence: invalid method");
+    if( (meth == QR_HALTON && ndim > (unsigned int)MAX_PRIMES) ||
+        ((meth == QR_SOBOL || meth == QR_SOBOL_OWEN) && ndim > (unsigned int)MAX_SOBOL_DIM) )
+        throw std::invalid_argument("QuasiRandomSequence: more than " +
+            utils::toString(meth == QR_HALTON ? MAX_PRIMES : MAX_SOBOL_DIM) +
+            " dimensions is not supported");
+    for(int d=0; d<MAX_SOBOL_DIM; d++)
+        scramble[d] = static_cast<uint32_t>(hash64(seed * MAX_SOBOL_DIM + d + 1) >> 32);
+}
+
+double QuasiRandomSequence::operator()(size_t index, unsigned int dim) const
+{
+    assert(dim < ndim);
+    switch(meth) {
+        case QR_HALTON:
+        {   // random shift modulo 1 (Cranley-Patterson rotation) of the deterministic sequence,
+            // so that different seeds produce statistically independent replicas
+            double val = quasiRandomHalton(index, PRIMES[dim]) + scramble[dim] * (1./4294967296.);
+            return val < 1 ? val : val - 1;
+        }
+        case QR_SOBOL:
+        case QR_SOBOL_OWEN: {
+            uint32_t x = 0, ind = static_cast<uint32_t>(index);
+            for(const uint32_t* dir = sobolDirections.dir[dim]; ind; ind >>= 1, dir++)
+                if(ind & 1)
+                    x ^= *dir;
+            x = meth == QR_SOBOL ? x ^ scramble[dim] : owenScramble(x, scramble[dim]);
+            // place the point in the middle of the elementary interval of width 2^-32
+            return (x + 0.5) * (1./4294967296.);
+        }
+        default: {
+            // a stateless pseudo-random number determined by the seed, index and dimension
+            uint64_t r = hash64(hash64(seed + 0x9e3779b97f4a7c15ull * (index+1)) + dim);
+            return (r >> 11) * (1./9007199254740992.);  // 53-bit number in [0,1)
+        }
+    }
+}
+
+void QuasiRandomSequence::point(size_t index, double values[]) const
+{
+    for(unsigned int d=0; d<ndim; d++)
+        values[d] = operator()(index, d);
+}
+
 
 /* ------ algebraic transformations of functions ------- */
 
@@ -1070,41 +1207,188 @@ int integrandNdimWrapperCubature(unsigned int ndim, unsigned int npoints, const
 {
     CubatureParams* param = static_cast<CubatureParams*>(v_param);
     assert(ndim == param->F.numVars() && fdim == param->F.numValues());
+    // this function may be called from several OpenMP threads for different blocks of points
+    std::string error;
     try {
         param->F.evalmany(npoints, xval, fval);
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
         param->numEval += npoints;
         // check if the result is not finite (only performed in debug mode)
         if(utils::verbosityLevel >= utils::VL_WARNING) {
-            for(unsigned int i=0; i<npoints; i++)
+            for(unsigned int i=0; i<npoints && error.empty(); i++)
                 for(unsigned int f=0; f<fdim; f++)
                     if(!isFinite(fval[f + i*fdim])) {
-                        param->error = "integrateNdim: invalid function value encountered at";
+                        error = "integrateNdim: invalid function value encountered at";
                         for(unsigned int d=0; d<ndim; d++)
-                            param->error += ' ' + utils::toString(xval[d + i*ndim], 15);
-                        param->error += '\n' + utils::stacktrace();
-                        return -1;
+                            error += ' ' + utils::toString(xval[d + i*ndim], 15);
+                        error += '\n' + utils::stacktrace();
+                        break;
                     }
         }
-        return 0;   // success
     }
     catch(std::exception& e) {
-        param->error = std::string("integrateNdim: ") + e.what() + '\n' + utils::stacktrace();
-        return -1;  // signal of error
+        error = std::string("integrateNdim: ") + e.what() + '\n' + utils::stacktrace();
     }
+    if(error.empty())
+        return 0;   // success
+#ifdef _OPENMP
+#pragma omp critical(integrateNdim)
+#endif
+    if(param->error.empty())
+        param->error = error;
+    return -1;  // signal of error
 }
 #endif
+
+/// number of independently randomized replicas of the quasi-random sequence in the RQMC integration
+static const int QMC_NUM_REPLICAS = 8;
+
+/// initial number of points in each replica (doubled on each iteration)
+static const size_t QMC_INITIAL_POINTS = 256;
+
+/// number of points evaluated in a single call to F.evalmany, which is also a unit of work
+/// for OpenMP threads (the partial sums are combined in a fixed order, so the result does not
+/// depend on the number of threads)
+static const size_t QMC_BLOCK_SIZE = 256;
+
+/// restricts the OpenMP parallel regions started by the calling thread to a single thread
+/// for the lifetime of this object (if the flag is set), and restores the previous setting
+/// afterwards, even if an exception is thrown
+class SerialExecutionGuard {
+#ifdef _OPENMP
+    const bool serial;
+    const int prevThreads;
+public:
+    explicit SerialExecutionGuard(bool _serial) :
+        serial(_serial), prevThreads(omp_get_max_threads())
+    {
+        if(serial)
+            omp_set_num_threads(1);
+    }
+    ~SerialExecutionGuard()
+    {
+        if(serial)
+            omp_set_num_threads(prevThreads);
+    }
+#else
+public:
+    explicit SerialExecutionGuard(bool) {}
+#endif
+};
+
+/// randomized quasi-Monte Carlo integration (the arguments have the same meaning as in integrateNdim)
+void integrateNdimQMC(const IFunctionNdim& F, const double xlower[], const double xupper[],
+    const double relToler, const unsigned int maxNumEval, QuasiRandomMethod method,
+    double result[], double error[], int* numEval)
+{
+    const unsigned int numVars = F.numVars();
+    const unsigned int numValues = F.numValues();
+    double volume = 1;
+    for(unsigned int d=0; d<numVars; d++)
+        volume *= xupper[d] - xlower[d];
+    // the replicas use different fixed seeds, so that the result is reproducible
+    std::vector<QuasiRandomSequence> seq;
+    for(int r=0; r<QMC_NUM_REPLICAS; r++)
+        seq.push_back(QuasiRandomSequence(numVars, method, (r+1) * 1000003));
+    // sums of function values over all points of each replica
+    std::vector<double> sums(QMC_NUM_REPLICAS * numValues, 0.);
+    size_t numPoints = 0, nextPoints = QMC_INITIAL_POINTS;  // number of points per replica
+    while(nextPoints > 1 && nextPoints * QMC_NUM_REPLICAS > maxNumEval)
+        nextPoints /= 2;
+    while(true) {
+        // add points with indices numPoints..nextPoints-1 to each replica
+        const size_t blocksPerReplica = (nextPoints - numPoints - 1) / QMC_BLOCK_SIZE + 1;
+        const ptrdiff_t numBlocks = blocksPerReplica * QMC_NUM_REPLICAS;
+        std::vector<double> blockSums(numBlocks * numValues);
+        std::string errorMsg;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for(ptrdiff_t b=0; b<numBlocks; b++) {
+            if(!errorMsg.empty())
+                continue;
+            int replica = b / blocksPerReplica;
+            size_t first = numPoints + (b % blocksPerReplica) * QMC_BLOCK_SIZE;
+            size_t count = std::min(QMC_BLOCK_SIZE, nextPoints - first);
+            std::vector<double> xval(count * numVars), fval(count * numValues);
+            for(size_t i=0; i<count; i++) {
+                seq[replica].point(first + i, &xval[i * numVars]);
+                for(unsigned int d=0; d<numVars; d++)
+                    xval[i * numVars + d] = xlower[d] + (xupper[d] - xlower[d]) * xval[i * numVars + d];
+            }
+            // guard against possible exceptions, since they must not leave the OpenMP parallel section
+            try {
+                F.evalmany(count, &xval[0], &fval[0]);
+            }
+            catch(std::exception& e) {
+                errorMsg = e.what();
+                continue;
+            }
+            double* sum = &blockSums[b * numValues];
+            for(unsigned int m=0; m<numValues; m++)
+                sum[m] = 0;
+            for(size_t i=0; i<count; i++)
+                for(unsigned int m=0; m<numValues; m++) {
+                    double val = fval[i * numValues + m];
+                    if(!isFinite(val)) {
+                        errorMsg = "invalid function value encountered at";
+                        for(unsigned int d=0; d<numVars; d++)
+                            errorMsg += ' ' + utils::toString(xval[i * numVars + d], 15);
+                    }
+                    sum[m] += val;
+                }
+        }
+        if(!errorMsg.empty())
+            throw std::runtime_error("integrateNdim: " + errorMsg);
+        for(ptrdiff_t b=0; b<numBlocks; b++)
+            for(unsigned int m=0; m<numValues; m++)
+                sums[(b / blocksPerReplica) * numValues + m] += blockSums[b * numValues + m];
+        numPoints = nextPoints;
+        nextPoints *= 2;
+        // the estimate of the integral is the mean of all replicas,
+        // and its error is the standard error of the mean
+        bool converged = true;
+        for(unsigned int m=0; m<numValues; m++) {
+            double mean = 0, disp = 0;
+            for(int r=0; r<QMC_NUM_REPLICAS; r++)
+                mean += sums[r * numValues + m];
+            mean /= QMC_NUM_REPLICAS;
+            for(int r=0; r<QMC_NUM_REPLICAS; r++)
+                disp += pow_2(sums[r * numValues + m] - mean);
+            double err = sqrt(disp / (QMC_NUM_REPLICAS * (QMC_NUM_REPLICAS-1.)));
+            result[m] = mean * volume / numPoints;
+            error [m] = err  * volume / numPoints;
+            if(err > relToler * fabs(mean))
+                converged = false;
+        }
+        if(converged || nextPoints * QMC_NUM_REPLICAS > maxNumEval)
+            break;
+    }
+    if(numEval!=NULL)
+        *numEval = numPoints * QMC_NUM_REPLICAS;
+}
+
 }  // namespace
 
 void integrateNdim(const IFunctionNdim& F, const double xlower[], const double xupper[], 
     const double relToler, const unsigned int maxNumEval, 
-    double result[], double outError[], int* numEval)
+    double result[], double outError[], int* numEval, QuasiRandomMethod method, bool parallel)
 {
+    // the OpenMP parallel loops over blocks of points (in integrateNdimQMC and in hcubature_v)
+    // are executed by a single thread if parallel evaluation of F is not allowed
+    SerialExecutionGuard guard(!parallel);
     const unsigned int numVars = F.numVars();
     const unsigned int numValues = F.numValues();
     const double absToler = 0;  // the only possible way to stay invariant under scaling transformations
     // storage for errors in the case that user doesn't need them
     std::vector<double> tempError(numValues);
     double* error = outError!=NULL ? outError : &tempError.front();
+    if(method != QR_CUBATURE) {
+        integrateNdimQMC(F, xlower, xupper, relToler, maxNumEval, method, result, error, numEval);
+        return;
+    }
 #ifdef HAVE_CUBA
     CubaParams param(F, xlower, xupper);
     std::vector<double> tempProb(numValues);  // unused
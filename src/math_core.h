@@ -70,6 +70,30 @@ void sincos(double x, double& s, double& c);
 template<typename NumT>
 ptrdiff_t binSearch(const NumT x, const NumT arr[], const size_t size);
 
+/** Same as binSearch, but first checks whether the point lies in the bin `hint` or one of its
+    immediate neighbours, before resorting to the full search.
+    This is useful when the function is called for a sequence of nearby or sorted points,
+    in which case the result of the previous call serves as a hint for the next one.
+    \param[in]  hint  is the guessed index of the bin (any value, including -1, is acceptable);
+    other arguments and the return value are the same as for binSearch.
+*/
+template<typename NumT>
+inline ptrdiff_t binSearchHint(const NumT x, const NumT arr[], const size_t size, const ptrdiff_t hint)
+{
+    const ptrdiff_t last = static_cast<ptrdiff_t>(size) - 1;
+    if(hint >= 0 && hint < last) {
+        if(x >= arr[hint]) {
+            if(x < arr[hint+1])
+                return hint;
+            // the next bin is the most likely outcome for an increasing sequence of points
+            if(hint+1 < last && x < arr[hint+2])
+                return hint+1;
+        } else if(hint > 0 && x >= arr[hint-1])
+            return hint-1;
+    }
+    return binSearch(x, arr, size);
+}
+
 /** linearly interpolate the value y(x) between y1 and y2, for x between x1 and x2 */
 inline double linearInterp(double x, double x1, double x2, double y1, double y2) {
     return ((x-x1)*y2 + (x2-x)*y1) / (x2-x1); }
@@ -172,6 +196,71 @@ double quasiRandomHalton(size_t index, unsigned int base);
 static const int MAX_PRIMES = 10;  // not that there aren't more!
 static const int PRIMES[MAX_PRIMES] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29 };
 
+/** methods for generating sequences of uniformly distributed points in a multidimensional cube */
+enum QuasiRandomMethod {
+    /// pseudo-random numbers
+    QR_NONE       = 0,
+    /// Halton sequence with prime bases (at most MAX_PRIMES dimensions),
+    /// randomized by a random shift modulo 1 in each dimension (Cranley-Patterson rotation)
+    QR_HALTON     = 1,
+    /// Sobol sequence randomized by a digital shift (XOR of all numbers in each dimension
+    /// with a random 32-bit mask), at most MAX_SOBOL_DIM dimensions
+    QR_SOBOL      = 2,
+    /// Sobol sequence with the nested uniform (Owen) scrambling, at most MAX_SOBOL_DIM dimensions
+    QR_SOBOL_OWEN = 3,
+    /// not a sequence: in `integrateNdim`, selects the deterministic adaptive cubature
+    /// instead of the Monte Carlo integration (cannot be used in `QuasiRandomSequence`)
+    QR_CUBATURE   = 4
+};
+
+/** maximum number of dimensions supported by the Sobol sequence */
+static const int MAX_SOBOL_DIM = 21;
+
+/** A randomized low-discrepancy (quasi-random) sequence of points in the N-dimensional unit cube.
+    The randomization is determined by the seed, so that sequences with different seeds
+    can be used as independent replicas in randomized quasi-Monte Carlo (RQMC) integration,
+    and the scatter between their results provides an error estimate.
+    The Sobol sequence uses the direction numbers of Joe & Kuo (2008) and has 32 bits of precision,
+    i.e. it repeats itself after 2^32 points; its best uniformity properties are achieved
+    when the number of points is a power of two.
+    The Owen scrambling is implemented with the hash-based approach of Burley (2020).
+    The points are computed directly from their index (without any internal state),
+    so the object may be used concurrently from several threads.
+*/
+class QuasiRandomSequence {
+public:
+    /** create the sequence.
+        \param[in]  numDim  is the number of dimensions;
+        \param[in]  method  is the type of the sequence;
+        \param[in]  seed  determines the randomization of the sequence.
+        \throw  std::invalid_argument if the number of dimensions is not supported by the method,
+        or the method is QR_CUBATURE.
+    */
+    QuasiRandomSequence(unsigned int numDim, QuasiRandomMethod method, size_t seed=0);
+
+    /** return the given coordinate of a point with the given index in the sequence.
+        \param[in]  index  is the index of the point;
+        \param[in]  dim  is the index of the coordinate (0 <= dim < numDim);
+        \return  a number between 0 and 1.
+    */
+    double operator()(size_t index, unsigned int dim) const;
+
+    /** fill all coordinates of a point with the given index (an array of length numDim) */
+    void point(size_t index, double values[]) const;
+
+    /// return the number of dimensions
+    unsigned int numDim() const { return ndim; }
+
+    /// return the type of the sequence
+    QuasiRandomMethod method() const { return meth; }
+
+private:
+    unsigned int ndim;                    ///< number of dimensions
+    QuasiRandomMethod meth;               ///< type of the sequence
+    size_t seed;                          ///< randomization seed
+    unsigned int scramble[MAX_SOBOL_DIM]; ///< scrambling keys (random masks or shifts) for each dimension
+};
+
 ///@}
 /// \name  ----- algebraic transformations of functions -----
 ///@{
@@ -527,11 +616,30 @@ extern const double * const GLWEIGHTS[MAX_GL_ORDER+1];
     \param[out] error  is the vector of length M, containing error estimates of the computed values,
                 if this argument is set to NULL then no error information is stored;
     \param[out] numEval  is the actual number of function calls
-                (if set to NULL, this information is not stored).
+                (if set to NULL, this information is not stored);
+    \param[in]  method  determines the integration method: the default choice QR_CUBATURE corresponds
+                to the deterministic adaptive cubature, and the other options select the randomized
+                quasi-Monte Carlo (RQMC) integration with the given type of quasi-random sequence
+                (or the ordinary Monte Carlo integration with pseudo-random numbers for QR_NONE).
+                In the latter case, the integral is computed with several independently randomized
+                replicas of the sequence, the number of points in each replica is doubled until
+                the scatter between replicas (which serves as the error estimate) drops below
+                the required relative tolerance or the number of function calls reaches maxNumEval.
+                RQMC is typically more efficient than the adaptive cubature for smooth integrands
+                in three or more dimensions;
+    \param[in]  parallel  (optional, default true) whether to evaluate blocks of points
+                in parallel: in both methods, F.evalmany() may then be called simultaneously
+                from several OpenMP threads (each with its own blocks of input and output arrays),
+                so the function F must be thread-safe; if it is not, this flag should be set
+                to false, and all calls are made from the calling thread.
+                In either case, the result and the error estimate do not depend on the number
+                of threads, since the blocks of points are processed independently and combined
+                in a fixed order.
 */
 void integrateNdim(const IFunctionNdim& F, const double xlower[], const double xupper[],
     const double relToler, const unsigned int maxNumEval,
-    double result[], double error[]=NULL, int* numEval=NULL);
+    double result[], double error[]=NULL, int* numEval=NULL, QuasiRandomMethod method=QR_CUBATURE,
+    bool parallel=true);
 
 ///@}
 
@@ -1,6 +1,9 @@
 #include "math_geometry.h"
 #include "math_core.h"
+#include "utils.h"
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 
 namespace math{
 
@@ -170,14 +173,21 @@ Polygon clipPolygonByRectangle(const Polygon& polygon, const Rectangle& rect)
 }
 
 
+namespace{  // internal
+
+/// common implementation of computeBsplineIntegralsOverPolygon(s), which also returns
+/// the range of grid cells touched by the polygon: `indXmin <= ix < indXmax`, same for y
+/// (the corresponding range of basis functions is `indXmin <= ix < indXmax+N`)
 template<int N>
-bool computeBsplineIntegralsOverPolygon(const Polygon& polygon,
-    const BsplineInterpolator1d<N>& bsplx, const BsplineInterpolator1d<N>& bsply, double output[])
+bool integrateBsplinesOverPolygon(const Polygon& polygon,
+    const BsplineInterpolator1d<N>& bsplx, const BsplineInterpolator1d<N>& bsply, double output[],
+    int& indXmin, int& indXmax, int& indYmin, int& indYmax)
 {
     const std::vector<double> &gridx = bsplx.xvalues(), &gridy = bsply.xvalues();
     const size_t
         gridSizeX   = gridx.size(),  gridSizeY = gridy.size(),
         numVertices = polygon.size();
+    indXmin = indXmax = indYmin = indYmax = 0;
     if(numVertices <= 2)  // no further action needed
         return false;
 
@@ -194,10 +204,10 @@ bool computeBsplineIntegralsOverPolygon(const Polygon& polygon,
     }
 
     // determine the range of grid cells that enclose the bounding box
-    int indXmin = binSearch(xmin,  &gridx.front(), gridSizeX);
-    int indXmax = binSearch(xmax,  &gridx.front(), gridSizeX)+1;
-    int indYmin = binSearch(ymin,  &gridy.front(), gridSizeY);
-    int indYmax = binSearch(ymax,  &gridy.front(), gridSizeY)+1;
+    indXmin = binSearch(xmin,  &gridx.front(), gridSizeX);
+    indXmax = binSearch(xmax,  &gridx.front(), gridSizeX)+1;
+    indYmin = binSearch(ymin,  &gridy.front(), gridSizeY);
+    indYmax = binSearch(ymax,  &gridy.front(), gridSizeY)+1;
     if(indXmin < 0) { indXmin = 0; outOfBounds = true; }
     if(indYmin < 0) { indYmin = 0; outOfBounds = true; }
     if(indXmax > (int)gridSizeX-1) { indXmax = gridSizeX-1; outOfBounds = true; }
@@ -208,17 +218,220 @@ bool computeBsplineIntegralsOverPolygon(const Polygon& polygon,
     const Polygon& newpoly = polygonArea >= 0 ? polygon :     // use the original polygon or
         (tmp.assign(polygon.rbegin(), polygon.rend()), tmp);  // create and use the reversed copy
 
-    // loop over the cells that potentially could lie within this polygon
+    // scanline approach: clip the polygon by each horizontal strip of the grid only once,
+    // and then clip the (usually much smaller) intersection of the polygon with this strip
+    // by the cells that lie within the bounding box of this intersection, rather than
+    // clipping the entire polygon by all cells within the overall bounding box
     for(int iy = indYmin; iy < indYmax; iy++) {
-        for(int ix = indXmin; ix < indXmax; ix++) {
+        // the clipping in x is a no-op, since the entire polygon lies between xmin and xmax
+        const Polygon strip =
+            clipPolygonByRectangle(newpoly, Rectangle(xmin, gridy[iy], xmax, gridy[iy+1]));
+        const size_t stripSize = strip.size();
+        if(stripSize <= 2)
+            continue;
+        double sxmin = INFINITY, sxmax = -INFINITY;
+        for(size_t i=0; i<stripSize; i++) {
+            sxmin = std::min(sxmin, strip[i].x);
+            sxmax = std::max(sxmax, strip[i].x);
+        }
+        int ixmin = std::max<int>(indXmin, binSearch(sxmin, &gridx.front(), gridSizeX));
+        int ixmax = std::min<int>(indXmax, binSearch(sxmax, &gridx.front(), gridSizeX)+1);
+        for(int ix = ixmin; ix < ixmax; ix++) {
             integrateOverPolygon(
-                clipPolygonByRectangle(newpoly, Rectangle(gridx[ix], gridy[iy], gridx[ix+1], gridy[iy+1])),
+                clipPolygonByRectangle(strip, Rectangle(gridx[ix], gridy[iy], gridx[ix+1], gridy[iy+1])),
                 bsplx, bsply, output);
         }
     }
     return outOfBounds;
 }
 
+/// signature at the beginning of the file with a cached matrix of B-spline integrals over polygons
+static const char FILE_MAGIC[8] = {'A','G','A','M','A','B','P','1'};
+
+/// accumulate the 64-bit FNV-1a hash of a block of memory
+inline void hashBytes(const void* data, size_t size, unsigned long long& hash)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for(size_t i=0; i<size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+/// compute the hash of all input data that determine the matrix of integrals over polygons
+template<int N>
+unsigned long long hashBsplinePolygons(const std::vector<Polygon>& polygons,
+    const BsplineInterpolator1d<N>& bsplx, const BsplineInterpolator1d<N>& bsply)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    const int degree = N;
+    hashBytes(&degree, sizeof(degree), hash);
+    const std::vector<double> &gridx = bsplx.xvalues(), &gridy = bsply.xvalues();
+    unsigned long long size = gridx.size();
+    hashBytes(&size, sizeof(size), hash);
+    hashBytes(&gridx[0], size * sizeof(double), hash);
+    size = gridy.size();
+    hashBytes(&size, sizeof(size), hash);
+    hashBytes(&gridy[0], size * sizeof(double), hash);
+    size = polygons.size();
+    hashBytes(&size, sizeof(size), hash);
+    for(size_t p=0; p<polygons.size(); p++) {
+        size = polygons[p].size();
+        hashBytes(&size, sizeof(size), hash);
+        for(size_t v=0; v<size; v++) {
+            hashBytes(&polygons[p][v].x, sizeof(double), hash);
+            hashBytes(&polygons[p][v].y, sizeof(double), hash);
+        }
+    }
+    return hash;
+}
+
+/// read the matrix from the cache file, return false if it does not exist or does not match the input
+bool readBsplinePolygonsCache(const std::string& fileName, unsigned long long key,
+    size_t nRows, size_t nCols, std::vector<Triplet>& values, bool& outOfBounds)
+{
+    std::FILE* file = std::fopen(fileName.c_str(), "rb");
+    if(!file)
+        return false;
+    char magic[sizeof(FILE_MAGIC)];
+    unsigned long long header[4];  // key, nRows, nCols, numValues
+    int flag = 0;
+    bool ok = std::fread(magic, sizeof(magic), 1, file) == 1 &&
+        std::memcmp(magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 &&
+        std::fread(header, sizeof(header), 1, file) == 1 &&
+        header[0] == key && header[1] == nRows && header[2] == nCols &&
+        header[3] <= nRows * nCols &&
+        std::fread(&flag, sizeof(flag), 1, file) == 1;
+    if(ok) {
+        values.resize(header[3]);
+        ok = values.empty() ||
+            std::fread(&values[0], sizeof(Triplet), values.size(), file) == values.size();
+        for(size_t i=0; ok && i<values.size(); i++)
+            ok = values[i].i < nRows && values[i].j < nCols;
+    }
+    std::fclose(file);
+    if(!ok)
+        values.clear();
+    outOfBounds = flag != 0;
+    return ok;
+}
+
+/// write the matrix into the cache file, return false in case of errors
+bool writeBsplinePolygonsCache(const std::string& fileName, unsigned long long key,
+    size_t nRows, size_t nCols, const std::vector<Triplet>& values, bool outOfBounds)
+{
+    // write into a temporary file first, so that a partially written file is never used
+    std::string tmpName = fileName + ".tmp";
+    std::FILE* file = std::fopen(tmpName.c_str(), "wb");
+    if(!file)
+        return false;
+    unsigned long long header[4] = { key, nRows, nCols, values.size() };
+    int flag = outOfBounds;
+    bool ok = std::fwrite(FILE_MAGIC, sizeof(FILE_MAGIC), 1, file) == 1 &&
+        std::fwrite(header, sizeof(header), 1, file) == 1 &&
+        std::fwrite(&flag, sizeof(flag), 1, file) == 1 &&
+        (values.empty() ||
+        std::fwrite(&values[0], sizeof(Triplet), values.size(), file) == values.size());
+    ok &= std::fclose(file) == 0;
+    if(!ok || std::rename(tmpName.c_str(), fileName.c_str()) != 0) {
+        std::remove(tmpName.c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // internal ns
+
+template<int N>
+bool computeBsplineIntegralsOverPolygon(const Polygon& polygon,
+    const BsplineInterpolator1d<N>& bsplx, const BsplineInterpolator1d<N>& bsply, double output[])
+{
+    int indXmin, indXmax, indYmin, indYmax;
+    return integrateBsplinesOverPolygon(polygon, bsplx, bsply, output,
+        indXmin, indXmax, indYmin, indYmax);
+}
+
+template<int N>
+SparseMatrix<double> computeBsplineIntegralsOverPolygons(const std::vector<Polygon>& polygons,
+    const BsplineInterpolator1d<N>& bsplx, const BsplineInterpolator1d<N>& bsply,
+    bool* outOfBounds, const std::string& cacheDir)
+{
+    const size_t
+        numPolygons = polygons.size(),
+        numBasisFncX = bsplx.numValues(),
+        numBasisFnc = numBasisFncX * bsply.numValues();
+    std::vector<Triplet> values;
+    bool anyOutOfBounds = false;
+
+    // check if the matrix for the same input data has been computed before
+    std::string fileName;
+    unsigned long long key = 0;
+    if(!cacheDir.empty()) {
+        key = hashBsplinePolygons(polygons, bsplx, bsply);
+        char name[32];
+        std::snprintf(name, sizeof(name), "bsplpoly_%016llx.bin", key);
+        fileName = cacheDir + "/" + name;
+        if(readBsplinePolygonsCache(fileName, key, numPolygons, numBasisFnc, values, anyOutOfBounds)) {
+            utils::msg(utils::VL_DEBUG, "computeBsplineIntegralsOverPolygons",
+                "Loaded the matrix from " + fileName);
+            if(outOfBounds)
+                *outOfBounds = anyOutOfBounds;
+            return SparseMatrix<double>(numPolygons, numBasisFnc, values);
+        }
+    }
+
+    // each polygon covers only a small fraction of the grid, so the integrals are accumulated
+    // in a per-thread dense array, but only its part corresponding to the bounding box of
+    // the polygon is scanned for nonzero values and then reset, instead of the entire array
+    std::vector< std::vector<Triplet> > rows(numPolygons);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<double> output(numBasisFnc, 0.);
+        bool threadOutOfBounds = false;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for(int p = 0; p < (int)numPolygons; p++) {
+            int indXmin, indXmax, indYmin, indYmax;
+            threadOutOfBounds |= integrateBsplinesOverPolygon(polygons[p], bsplx, bsply, &output[0],
+                indXmin, indXmax, indYmin, indYmax);
+            if(indXmax <= indXmin || indYmax <= indYmin)
+                continue;
+            for(int iy = indYmin; iy < indYmax+N; iy++) {
+                for(int ix = indXmin; ix < indXmax+N; ix++) {
+                    double& val = output[iy * numBasisFncX + ix];
+                    if(val != 0) {
+                        rows[p].push_back(Triplet(p, iy * numBasisFncX + ix, val));
+                        val = 0;
+                    }
+                }
+            }
+        }
+#ifdef _OPENMP
+#pragma omp critical(computeBsplineIntegralsOverPolygons)
+#endif
+        anyOutOfBounds |= threadOutOfBounds;
+    }
+
+    // concatenate the rows in the order of polygons
+    size_t numValues = 0;
+    for(size_t p=0; p<numPolygons; p++)
+        numValues += rows[p].size();
+    values.reserve(numValues);
+    for(size_t p=0; p<numPolygons; p++)
+        values.insert(values.end(), rows[p].begin(), rows[p].end());
+
+    if(!fileName.empty() &&
+        !writeBsplinePolygonsCache(fileName, key, numPolygons, numBasisFnc, values, anyOutOfBounds))
+        utils::msg(utils::VL_WARNING, "computeBsplineIntegralsOverPolygons",
+            "Cannot write file " + fileName);
+    if(outOfBounds)
+        *outOfBounds = anyOutOfBounds;
+    return SparseMatrix<double>(numPolygons, numBasisFnc, values);
+}
+
 // template instantiations
 template bool computeBsplineIntegralsOverPolygon(
     const Polygon&, const BsplineInterpolator1d<0>&, const BsplineInterpolator1d<0>&, double[]);
@@ -228,6 +441,14 @@ template bool computeBsplineIntegralsOverPolygon(
     const Polygon&, const BsplineInterpolator1d<2>&, const BsplineInterpolator1d<2>&, double[]);
 template bool computeBsplineIntegralsOverPolygon(
     const Polygon&, const BsplineInterpolator1d<3>&, const BsplineInterpolator1d<3>&, double[]);
+template SparseMatrix<double> computeBsplineIntegralsOverPolygons(const std::vector<Polygon>&,
+    const BsplineInterpolator1d<0>&, const BsplineInterpolator1d<0>&, bool*, const std::string&);
+template SparseMatrix<double> computeBsplineIntegralsOverPolygons(const std::vector<Polygon>&,
+    const BsplineInterpolator1d<1>&, const BsplineInterpolator1d<1>&, bool*, const std::string&);
+template SparseMatrix<double> computeBsplineIntegralsOverPolygons(const std::vector<Polygon>&,
+    const BsplineInterpolator1d<2>&, const BsplineInterpolator1d<2>&, bool*, const std::string&);
+template SparseMatrix<double> computeBsplineIntegralsOverPolygons(const std::vector<Polygon>&,
+    const BsplineInterpolator1d<3>&, const BsplineInterpolator1d<3>&, bool*, const std::string&);
 
 
 double polygonArea(const Polygon& polygon)
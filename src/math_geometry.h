@@ -6,6 +6,7 @@
 */
 #pragma once
 #include "math_spline.h"
+#include <string>
 
 namespace math{
 
@@ -59,6 +60,28 @@ template<int N>
 bool computeBsplineIntegralsOverPolygon(const Polygon& polygon,
     const BsplineInterpolator1d<N>& bsplx, const BsplineInterpolator1d<N>& bsply, double output[]);
 
+/** Compute the integrals of 2d tensor-product B-spline basis functions over each of the polygons,
+    i.e., the matrix of the rebinning operator from the B-spline representation of an image
+    onto a set of apertures.
+    The matrix is sparse, since each polygon usually covers only a small part of the grid.
+    Because its construction may be expensive for a large number of polygons (e.g., Voronoi bins
+    of an IFU dataset), it may be stored in a cache file and reused on subsequent calls.
+    \param[in]  polygons  is the array of input polygons;
+    \param[in]  bsplx, bsply  are two 1d B-spline basis sets of degree N, which form the 2d basis;
+    \tparam     N is the degree of B-splines;
+    \param[out] outOfBounds  if not NULL, will be set to true if any of the polygons extends
+    beyond the 2d grid;
+    \param[in]  cacheDir  if not empty, the matrix is loaded from a file in this directory, whose name
+    is derived from the hash of the grids and polygons, or, if it does not exist yet, is computed and
+    written into this file (failure to write is reported as a warning, but is not fatal);
+    \return  the matrix with one row per polygon and `bsplx.numValues() * bsply.numValues()` columns,
+    using the same indexing scheme as `computeBsplineIntegralsOverPolygon`.
+*/
+template<int N>
+SparseMatrix<double> computeBsplineIntegralsOverPolygons(const std::vector<Polygon>& polygons,
+    const BsplineInterpolator1d<N>& bsplx, const BsplineInterpolator1d<N>& bsply,
+    bool* outOfBounds=NULL, const std::string& cacheDir="");
+
 
 /** construct a 3d rotation matrix from three angles:
     \param[in]  theta, phi, chi are three rotation angles;
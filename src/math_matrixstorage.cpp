@@ -0,0 +1,641 @@
+#include "math_matrixstorage.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+namespace math{
+
+namespace{
+
+/// signature at the beginning of the file
+static const char FILE_MAGIC[8] = {'A','G','A','M','A','C','S','R'};
+
+/// version of the file format
+static const unsigned int FILE_VERSION = 1;
+
+/// fixed-size header of the file; all offsets are in bytes from the beginning of the file,
+/// and all arrays are aligned at 8-byte boundaries. The numbers are stored in the native
+/// byte order, i.e., the files are not portable between little- and big-endian machines
+struct FileHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int precision;
+    unsigned long long numRows, numCols, numNonzero;
+    unsigned long long offsetRowPtr, offsetColInd, offsetValues;
+};
+
+/// size of a single value in bytes for the given storage format
+inline size_t valueSize(StoragePrecision prec)
+{
+    return prec == SP_FLOAT16 ? sizeof(unsigned short) : sizeof(float);
+}
+
+/// round up the offset to a multiple of 8 bytes
+inline unsigned long long align8(unsigned long long offset)
+{
+    return (offset + 7) & ~7ULL;
+}
+
+/// index of the current OpenMP thread (0 in the serial case)
+inline int threadIndex()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/// maximum number of OpenMP threads (1 in the serial case)
+inline int maxThreads()
+{
+#ifdef _OPENMP
+    return std::max(1, omp_get_max_threads());
+#else
+    return 1;
+#endif
+}
+
+/// read the header of the file (return a zero-filled header if the file cannot be read)
+FileHeader readHeader(const std::string& filename)
+{
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if(file) {
+        if(std::fread(&header, sizeof(header), 1, file) != 1)
+            std::memset(&header, 0, sizeof(header));
+        std::fclose(file);
+    }
+    return header;
+}
+
+/// check that the header has the correct signature, and that the arrays described by it
+/// are properly aligned and fit into the file without overlapping
+bool isValidHeader(const FileHeader& header, size_t fileSize)
+{
+    if( fileSize < sizeof(header) ||
+        std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+        header.version != FILE_VERSION ||
+        (header.precision != SP_FLOAT32 && header.precision != SP_FLOAT16) ||
+        header.numCols > 0xffffffffu)
+        return false;
+    // compare the array lengths with the file size before computing the array sizes in bytes,
+    // so that the latter cannot overflow
+    const unsigned long long size = fileSize;
+    if( header.numRows >= size / sizeof(unsigned long long) ||
+        header.numNonzero > size / sizeof(unsigned int) ||
+        header.offsetRowPtr > size || header.offsetColInd > size || header.offsetValues > size)
+        return false;
+    return
+        header.offsetRowPtr >= sizeof(header) &&
+        header.offsetRowPtr % 8 == 0 && header.offsetColInd % 8 == 0 && header.offsetValues % 8 == 0 &&
+        header.offsetRowPtr + (header.numRows+1) * sizeof(unsigned long long) <= header.offsetColInd &&
+        header.offsetColInd + header.numNonzero * sizeof(unsigned int) <= header.offsetValues &&
+        header.offsetValues + header.numNonzero *
+            valueSize(static_cast<StoragePrecision>(header.precision)) <= size;
+}
+
+/// check that the row pointers start at zero, are non-decreasing and end at the number of
+/// nonzero elements, and that the column indices in each row are increasing and within range
+bool isValidStorage(const unsigned long long rowPtr[], const unsigned int colInd[],
+    size_t numRows, size_t numCols, size_t numNonzero)
+{
+    if(rowPtr[0] != 0 || rowPtr[numRows] != numNonzero)
+        return false;
+    for(size_t r=0; r<numRows; r++) {
+        if(rowPtr[r+1] < rowPtr[r])
+            return false;
+        for(unsigned long long k=rowPtr[r]; k<rowPtr[r+1]; k++)
+            if(colInd[k] >= numCols || (k>rowPtr[r] && colInd[k] <= colInd[k-1]))
+                return false;
+    }
+    return true;
+}
+
+/// append the contents of one file to another
+void copyFile(std::FILE* src, std::FILE* dest)
+{
+    std::rewind(src);
+    std::vector<char> buffer(1<<20);
+    size_t count;
+    while((count = std::fread(&buffer[0], 1, buffer.size(), src)) > 0)
+        if(std::fwrite(&buffer[0], 1, count, dest) != count)
+            throw std::runtime_error("CompressedMatrixWriter: error writing file");
+}
+
+/// write zero bytes to pad the file to a multiple of 8 bytes
+void padFile(std::FILE* file, unsigned long long& offset)
+{
+    static const char zeros[8] = {0};
+    size_t pad = align8(offset) - offset;
+    if(pad>0 && std::fwrite(zeros, 1, pad, file) != pad)
+        throw std::runtime_error("CompressedMatrixWriter: error writing file");
+    offset += pad;
+}
+
+}  // internal namespace
+
+//---- conversion between single and half precision ----//
+
+unsigned short floatToHalf(float value)
+{
+    unsigned int f;
+    std::memcpy(&f, &value, sizeof(f));
+    unsigned int sign = (f >> 16) & 0x8000;
+    unsigned int fexp = (f >> 23) & 0xff;
+    unsigned int mant = f & 0x7fffff;
+    if(fexp == 0xff)   // infinity or NaN
+        return static_cast<unsigned short>(sign | 0x7c00 | (mant ? 0x200 : 0));
+    int exp = static_cast<int>(fexp) - 127 + 15;
+    if(exp >= 31)      // overflow - convert to infinity
+        return static_cast<unsigned short>(sign | 0x7c00);
+    if(exp <= 0) {     // subnormal numbers or underflow
+        if(exp < -10)
+            return static_cast<unsigned short>(sign);
+        mant |= 0x800000;
+        unsigned int shift = 14 - exp;
+        unsigned int half = mant >> shift;
+        unsigned int rem  = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if(rem > halfway || (rem == halfway && (half & 1)))
+            half++;
+        return static_cast<unsigned short>(sign | half);
+    }
+    unsigned int half = sign | (exp << 10) | (mant >> 13);
+    unsigned int rem  = mant & 0x1fff;
+    if(rem > 0x1000 || (rem == 0x1000 && (half & 1)))
+        half++;        // a carry into the exponent is handled correctly
+    return static_cast<unsigned short>(half);
+}
+
+float halfToFloat(unsigned short value)
+{
+    unsigned int sign = (value & 0x8000u) << 16;
+    unsigned int exp  = (value >> 10) & 0x1f;
+    unsigned int mant = value & 0x3ff;
+    unsigned int f;
+    if(exp == 0) {     // zero or subnormal number
+        float result = std::ldexp(static_cast<float>(mant), -24);
+        return sign ? -result : result;
+    }
+    if(exp == 31)      // infinity or NaN
+        f = sign | 0x7f800000 | (mant << 13);
+    else
+        f = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    float result;
+    std::memcpy(&result, &f, sizeof(f));
+    return result;
+}
+
+//---- CompressedMatrix ----//
+
+template<typename NumT>
+CompressedMatrix<NumT>::CompressedMatrix(const IMatrix<NumT>& src, bool _transposed,
+    double threshold, StoragePrecision precision)
+:
+    IMatrix<NumT>(_transposed ? src.cols() : src.rows(), _transposed ? src.rows() : src.cols()),
+    numStoredRows(src.rows()), numStoredCols(src.cols()), numNonzero(0),
+    transposed(_transposed), prec(precision), mappedAddr(NULL), mappedSize(0)
+{
+    if(numStoredCols > 0xffffffffu)
+        throw std::invalid_argument("CompressedMatrix: too many columns");
+    // first pass: count the number of elements in each row
+    const size_t size = src.size();
+    ownRowPtr.assign(numStoredRows+1, 0);
+    for(size_t i=0; i<size; i++) {
+        size_t row, col;
+        double val = src.elem(i, row, col);
+        if(fabs(val) > threshold && (prec != SP_FLOAT16 || (floatToHalf(val) & 0x7fff) != 0))
+            ownRowPtr[row+1]++;
+    }
+    for(size_t r=0; r<numStoredRows; r++)
+        ownRowPtr[r+1] += ownRowPtr[r];
+    numNonzero = ownRowPtr[numStoredRows];
+    // second pass: fill in the elements
+    ownColInd.resize(numNonzero);
+    std::vector<float> vals(numNonzero);
+    std::vector<unsigned long long> pos(ownRowPtr.begin(), ownRowPtr.end()-1);
+    for(size_t i=0; i<size; i++) {
+        size_t row, col;
+        double val = src.elem(i, row, col);
+        if(fabs(val) > threshold && (prec != SP_FLOAT16 || (floatToHalf(val) & 0x7fff) != 0)) {
+            ownColInd[pos[row]] = col;
+            vals[pos[row]++] = val;
+        }
+    }
+    // sort the elements in each row by column index, if the source did not provide them in this order
+    for(size_t r=0; r<numStoredRows; r++) {
+        size_t beg = ownRowPtr[r], end = ownRowPtr[r+1];
+        bool sorted = true;
+        for(size_t k=beg+1; k<end && sorted; k++)
+            sorted = ownColInd[k-1] < ownColInd[k];
+        if(sorted)
+            continue;
+        std::vector<std::pair<unsigned int, float> > tmp(end-beg);
+        for(size_t k=beg; k<end; k++)
+            tmp[k-beg] = std::make_pair(ownColInd[k], vals[k]);
+        std::sort(tmp.begin(), tmp.end());
+        for(size_t k=beg; k<end; k++) {
+            ownColInd[k] = tmp[k-beg].first;
+            vals[k] = tmp[k-beg].second;
+        }
+    }
+    if(prec == SP_FLOAT16) {
+        ownValuesH.resize(numNonzero);
+        for(size_t k=0; k<numNonzero; k++)
+            ownValuesH[k] = floatToHalf(vals[k]);
+        values = numNonzero ? &ownValuesH[0] : NULL;
+    } else {
+        ownValuesF.swap(vals);
+        values = numNonzero ? &ownValuesF[0] : NULL;
+    }
+    rowPtr = &ownRowPtr[0];
+    colInd = numNonzero ? &ownColInd[0] : NULL;
+}
+
+template<typename NumT>
+CompressedMatrix<NumT>::CompressedMatrix(const std::string& filename, bool _transposed)
+:
+    // the dimensions of the matrix are taken from the file header, and checked again below
+    IMatrix<NumT>(
+        _transposed ? readHeader(filename).numCols : readHeader(filename).numRows,
+        _transposed ? readHeader(filename).numRows : readHeader(filename).numCols),
+    numStoredRows(0), numStoredCols(0), numNonzero(0), transposed(_transposed), prec(SP_FLOAT32),
+    rowPtr(NULL), colInd(NULL), values(NULL), mappedAddr(NULL), mappedSize(0)
+{
+    const char* base = NULL;
+    size_t fileSize = 0;
+#ifdef HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0) {
+        if(fd >= 0)
+            close(fd);
+        throw std::runtime_error("CompressedMatrix: cannot open file " + filename);
+    }
+    fileSize = st.st_size;
+    if(fileSize >= sizeof(FileHeader)) {
+        mappedAddr = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if(mappedAddr == MAP_FAILED)
+            mappedAddr = NULL;
+    }
+    close(fd);  // the mapping remains valid after the file descriptor is closed
+    if(!mappedAddr)
+        throw std::runtime_error("CompressedMatrix: cannot map file " + filename);
+    mappedSize = fileSize;
+    base = static_cast<const char*>(mappedAddr);
+#else
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if(!file)
+        throw std::runtime_error("CompressedMatrix: cannot open file " + filename);
+    std::fseek(file, 0, SEEK_END);
+    fileSize = std::ftell(file);
+    std::rewind(file);
+    fileBuffer.resize(fileSize);
+    bool ok = fileSize>0 && std::fread(&fileBuffer[0], 1, fileSize, file) == fileSize;
+    std::fclose(file);
+    if(!ok)
+        throw std::runtime_error("CompressedMatrix: cannot read file " + filename);
+    base = &fileBuffer[0];
+#endif
+    // check the header and the consistency of array sizes and contents
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    if(fileSize >= sizeof(header))
+        std::memcpy(&header, base, sizeof(header));
+    bool valid = isValidHeader(header, fileSize);
+    if(valid) {
+        prec = static_cast<StoragePrecision>(header.precision);
+        numStoredRows = header.numRows;
+        numStoredCols = header.numCols;
+        numNonzero    = header.numNonzero;
+        rowPtr = reinterpret_cast<const unsigned long long*>(base + header.offsetRowPtr);
+        colInd = reinterpret_cast<const unsigned int*>(base + header.offsetColInd);
+        values = base + header.offsetValues;
+        valid  = isValidStorage(rowPtr, colInd, numStoredRows, numStoredCols, numNonzero);
+    }
+    // the file might have been replaced between reading the header and mapping it
+    valid &= rows() == (transposed ? numStoredCols : numStoredRows) &&
+        cols() == (transposed ? numStoredRows : numStoredCols);
+    if(!valid) {
+#ifdef HAVE_MMAP
+        munmap(mappedAddr, mappedSize);
+#endif
+        throw std::runtime_error("CompressedMatrix: invalid file format in " + filename);
+    }
+}
+
+template<typename NumT>
+CompressedMatrix<NumT>::~CompressedMatrix()
+{
+#ifdef HAVE_MMAP
+    if(mappedAddr)
+        munmap(mappedAddr, mappedSize);
+#endif
+}
+
+template<typename NumT>
+size_t CompressedMatrix<NumT>::bytes() const
+{
+    return (numStoredRows+1) * sizeof(unsigned long long) +
+        numNonzero * (sizeof(unsigned int) + valueSize(prec));
+}
+
+template<typename NumT>
+NumT CompressedMatrix<NumT>::at(const size_t row, const size_t col) const
+{
+    size_t r = transposed ? col : row, c = transposed ? row : col;
+    matrixRangeCheck(r < numStoredRows && c < numStoredCols);
+    const unsigned int *beg = colInd + rowPtr[r], *end = colInd + rowPtr[r+1];
+    const unsigned int *pos = std::lower_bound(beg, end, static_cast<unsigned int>(c));
+    return pos != end && *pos == c ? value(pos - colInd) : 0;
+}
+
+template<typename NumT>
+NumT CompressedMatrix<NumT>::elem(const size_t index, size_t &row, size_t &col) const
+{
+    matrixRangeCheck(index < numNonzero);
+    // the last row whose starting index does not exceed the requested index
+    size_t r = std::upper_bound(rowPtr, rowPtr + numStoredRows + 1,
+        static_cast<unsigned long long>(index)) - rowPtr - 1;
+    row = transposed ? colInd[index] : r;
+    col = transposed ? r : colInd[index];
+    return value(index);
+}
+
+template<typename NumT>
+void CompressedMatrix<NumT>::gather(const std::vector<double>& in, std::vector<double>& out) const
+{
+    const ptrdiff_t nrows = numStoredRows;
+    out.assign(nrows, 0.);
+    // rows may have very different numbers of elements, hence the dynamic scheduling
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for(ptrdiff_t r=0; r<nrows; r++) {
+        double sum = 0;
+        if(prec == SP_FLOAT16) {
+            const unsigned short* val = static_cast<const unsigned short*>(values);
+            for(unsigned long long k=rowPtr[r]; k<rowPtr[r+1]; k++)
+                sum += halfToFloat(val[k]) * in[colInd[k]];
+        } else {
+            const float* val = static_cast<const float*>(values);
+            for(unsigned long long k=rowPtr[r]; k<rowPtr[r+1]; k++)
+                sum += val[k] * in[colInd[k]];
+        }
+        out[r] = sum;
+    }
+}
+
+template<typename NumT>
+void CompressedMatrix<NumT>::scatter(const std::vector<double>& in, std::vector<double>& out) const
+{
+    const ptrdiff_t nrows = numStoredRows, ncols = numStoredCols;
+    out.assign(ncols, 0.);
+    // each thread accumulates the result in its own buffer, and then they are summed up
+    std::vector< std::vector<double> > buffers(maxThreads());
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<double>& buf = buffers[threadIndex()];
+        buf.assign(ncols, 0.);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 64)
+#endif
+        for(ptrdiff_t r=0; r<nrows; r++) {
+            double mult = in[r];
+            if(mult == 0)
+                continue;
+            if(prec == SP_FLOAT16) {
+                const unsigned short* val = static_cast<const unsigned short*>(values);
+                for(unsigned long long k=rowPtr[r]; k<rowPtr[r+1]; k++)
+                    buf[colInd[k]] += halfToFloat(val[k]) * mult;
+            } else {
+                const float* val = static_cast<const float*>(values);
+                for(unsigned long long k=rowPtr[r]; k<rowPtr[r+1]; k++)
+                    buf[colInd[k]] += val[k] * mult;
+            }
+        }
+    }
+    const size_t nbuf = buffers.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(ptrdiff_t c=0; c<ncols; c++) {
+        double sum = 0;
+        for(size_t t=0; t<nbuf; t++)
+            if(!buffers[t].empty())
+                sum += buffers[t][c];
+        out[c] = sum;
+    }
+}
+
+template<typename NumT>
+void CompressedMatrix<NumT>::multiply(const std::vector<double>& x, std::vector<double>& y) const
+{
+    if(x.size() != cols())
+        throw std::length_error("CompressedMatrix::multiply: invalid size of input vector");
+    if(transposed)
+        scatter(x, y);
+    else
+        gather(x, y);
+}
+
+template<typename NumT>
+void CompressedMatrix<NumT>::multiplyTransposed(
+    const std::vector<double>& y, std::vector<double>& x) const
+{
+    if(y.size() != rows())
+        throw std::length_error("CompressedMatrix::multiplyTransposed: invalid size of input vector");
+    if(transposed)
+        gather(y, x);
+    else
+        scatter(y, x);
+}
+
+template class CompressedMatrix<float>;
+template class CompressedMatrix<double>;
+
+//---- CompressedMatrixWriter ----//
+
+CompressedMatrixWriter::CompressedMatrixWriter(const std::string& _filename,
+    size_t _numRows, size_t _numCols, double _threshold, StoragePrecision precision)
+:
+    filename(_filename), numRows(_numRows), numCols(_numCols), threshold(_threshold),
+    prec(precision), numWritten(0), finalized(false), rowPtr(1, 0), fileCol(NULL), fileVal(NULL)
+{
+    if(numCols > 0xffffffffu)
+        throw std::invalid_argument("CompressedMatrixWriter: too many columns");
+    fileCol = std::fopen((filename + ".col.tmp").c_str(), "wb+");
+    fileVal = std::fopen((filename + ".val.tmp").c_str(), "wb+");
+    if(!fileCol || !fileVal) {
+        if(fileCol)
+            std::fclose(fileCol);
+        if(fileVal)
+            std::fclose(fileVal);
+        throw std::runtime_error("CompressedMatrixWriter: cannot create temporary files for " + filename);
+    }
+    rowPtr.reserve(numRows+1);
+}
+
+CompressedMatrixWriter::~CompressedMatrixWriter()
+{
+    try{
+        finalize();
+    }
+    catch(std::exception&) {}
+}
+
+void CompressedMatrixWriter::addRow(size_t index, const float* data)
+{
+    addRowImpl(index, data);
+}
+
+void CompressedMatrixWriter::addRow(size_t index, const double* data)
+{
+    addRowImpl(index, data);
+}
+
+template<typename T>
+void CompressedMatrixWriter::addRowImpl(size_t index, const T* data)
+{
+    // compress the row in the calling thread
+    Row row;
+    for(size_t c=0; c<numCols; c++) {
+        if(!(fabs(data[c]) > threshold) ||
+            (prec == SP_FLOAT16 && (floatToHalf(data[c]) & 0x7fff) == 0))
+            continue;
+        row.cols.push_back(c);
+        row.vals.push_back(static_cast<float>(data[c]));
+    }
+    std::string errorMsg;
+    bool badIndex = false;
+    // then write it to the file or put into the queue
+#ifdef _OPENMP
+#pragma omp critical(CompressedMatrixWriter)
+#endif
+    {
+        badIndex = finalized || index >= numRows || index < numWritten || pending.count(index);
+        if(!badIndex) {
+            try{
+                if(index == numWritten) {
+                    writeRow(row);
+                    // flush all subsequent rows that were waiting in the queue
+                    std::map<size_t, Row>::iterator iter = pending.begin();
+                    while(iter != pending.end() && iter->first == numWritten) {
+                        writeRow(iter->second);
+                        pending.erase(iter++);
+                    }
+                    if(numWritten == numRows)
+                        finalize();
+                } else {
+                    Row& dest = pending[index];
+                    dest.cols.swap(row.cols);
+                    dest.vals.swap(row.vals);
+                }
+            }
+            catch(std::exception& e) {
+                errorMsg = e.what();
+            }
+        }
+    }
+    if(badIndex)
+        throw std::out_of_range("CompressedMatrixWriter: invalid or duplicate row index");
+    if(!errorMsg.empty())
+        throw std::runtime_error(errorMsg);
+}
+
+void CompressedMatrixWriter::writeRow(const Row& row)
+{
+    size_t count = row.cols.size();
+    bool ok = count == 0 ||
+        std::fwrite(&row.cols[0], sizeof(unsigned int), count, fileCol) == count;
+    if(ok && count > 0) {
+        if(prec == SP_FLOAT16) {
+            std::vector<unsigned short> vals(count);
+            for(size_t k=0; k<count; k++)
+                vals[k] = floatToHalf(row.vals[k]);
+            ok = std::fwrite(&vals[0], sizeof(unsigned short), count, fileVal) == count;
+        } else
+            ok = std::fwrite(&row.vals[0], sizeof(float), count, fileVal) == count;
+    }
+    if(!ok)
+        throw std::runtime_error("CompressedMatrixWriter: error writing temporary files for " + filename);
+    rowPtr.push_back(rowPtr.back() + count);
+    numWritten++;
+}
+
+void CompressedMatrixWriter::finalize()
+{
+    if(finalized)
+        return;
+    finalized = true;
+    // write out the rows that are still in the queue, and fill the missing ones with zeros
+    Row empty;
+    while(numWritten < numRows) {
+        std::map<size_t, Row>::iterator iter = pending.find(numWritten);
+        if(iter != pending.end()) {
+            writeRow(iter->second);
+            pending.erase(iter);
+        } else
+            writeRow(empty);
+    }
+    // assemble the final file from the header, the row pointers and the two temporary files
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version      = FILE_VERSION;
+    header.precision    = prec;
+    header.numRows      = numRows;
+    header.numCols      = numCols;
+    header.numNonzero   = rowPtr.back();
+    header.offsetRowPtr = align8(sizeof(header));
+    header.offsetColInd = align8(header.offsetRowPtr + rowPtr.size() * sizeof(unsigned long long));
+    header.offsetValues = align8(header.offsetColInd + header.numNonzero * sizeof(unsigned int));
+    std::FILE* file = std::fopen(filename.c_str(), "wb");
+    bool ok = file != NULL;
+    try{
+        if(!ok)
+            throw std::runtime_error("CompressedMatrixWriter: cannot create file " + filename);
+        unsigned long long offset = sizeof(header);
+        if(std::fwrite(&header, sizeof(header), 1, file) != 1)
+            throw std::runtime_error("CompressedMatrixWriter: error writing file " + filename);
+        padFile(file, offset);
+        if(std::fwrite(&rowPtr[0], sizeof(unsigned long long), rowPtr.size(), file) != rowPtr.size())
+            throw std::runtime_error("CompressedMatrixWriter: error writing file " + filename);
+        offset += rowPtr.size() * sizeof(unsigned long long);
+        padFile(file, offset);
+        std::fflush(fileCol);
+        copyFile(fileCol, file);
+        offset += header.numNonzero * sizeof(unsigned int);
+        padFile(file, offset);
+        std::fflush(fileVal);
+        copyFile(fileVal, file);
+    }
+    catch(std::exception&) {
+        ok = false;
+    }
+    if(file && std::fclose(file) != 0)
+        ok = false;
+    std::fclose(fileCol);
+    std::fclose(fileVal);
+    std::remove((filename + ".col.tmp").c_str());
+    std::remove((filename + ".val.tmp").c_str());
+    rowPtr.clear();
+    if(!ok)
+        throw std::runtime_error("CompressedMatrixWriter: error writing file " + filename);
+}
+
+}  // namespace
@@ -0,0 +1,212 @@
+/** \file   math_matrixstorage.h
+    \brief  compact storage of large read-only sparse matrices (e.g., orbit libraries)
+    \date   2018
+    \author Eugene Vasiliev
+
+    The matrix of orbit contributions to the observational constraints in Schwarzschild models
+    (rows are orbits, columns are elements of the datacube of a Target) may easily exceed
+    the available memory when stored as a dense array, even in single precision.
+    On the other hand, most of its elements are zeros: each orbit contributes only to a small
+    fraction of density cells or LOSVD apertures.
+    This module provides a read-only matrix class that stores only the nonzero elements
+    in the compressed-sparse-row (CSR) format, with values kept either in single precision (float32)
+    or quantized to IEEE half precision (float16), which reduces the memory by another factor of two
+    at the expense of a relative precision ~5e-4 (sufficient for most applications, since the orbit
+    library is itself a noisy Monte Carlo estimate).
+    The matrix implements the `IMatrix` interface and hence can be passed directly to the
+    optimization solvers, and additionally provides parallelized matrix-vector multiplication
+    kernels, which are used by the built-in first-order solver `quadraticOptimizationSolveFirstOrder`.
+
+    The matrix can be constructed in memory from any other matrix, or written to a file
+    row by row using the `CompressedMatrixWriter` class (without ever keeping the entire matrix
+    in memory) and then memory-mapped from this file, so that the libraries larger than
+    the physical memory can be used in the fitting procedure (the operating system loads the
+    pages of the file on demand and evicts them when necessary).
+*/
+#pragma once
+#include "math_linalg.h"
+#include <string>
+#include <map>
+#include <cstdio>
+
+namespace math{
+
+/// precision of values stored in a CompressedMatrix
+enum StoragePrecision {
+    SP_FLOAT32 = 0,  ///< IEEE single precision (4 bytes per value)
+    SP_FLOAT16 = 1   ///< IEEE half precision (2 bytes per value, relative accuracy ~5e-4)
+};
+
+/// convert a single-precision number into the IEEE half-precision format (round to nearest even)
+unsigned short floatToHalf(float value);
+
+/// convert a half-precision number back to single precision
+float halfToFloat(unsigned short value);
+
+
+/** Read-only sparse matrix in the CSR format with single- or half-precision values,
+    which may reside either in memory or in a memory-mapped file.
+    The nonzero elements of each row are stored contiguously in the order of increasing column index.
+    The matrix may be presented to the user in the transposed form (i.e., the CSR storage of
+    the original matrix serves as a CSC storage of the transposed one): the orbit library is
+    naturally assembled row by row (one row per orbit), whereas the optimization solvers
+    need the matrix with orbits in columns.
+    Element access by `at()` and `elem()` costs a binary search and is intended for generic
+    routines; the matrix-vector multiplication routines are much more efficient.
+*/
+template<typename NumT>
+class CompressedMatrix: public IMatrix<NumT> {
+public:
+    using IMatrix<NumT>::rows;
+    using IMatrix<NumT>::cols;
+
+    /** construct the matrix in memory from another matrix, keeping only elements with
+        absolute value exceeding the threshold.
+        \param[in]  src  is the source matrix (accessed through the element-wise interface,
+        so it may be a proxy object or a dense matrix);
+        \param[in]  transposed  if true, the stored matrix is `src`, but it is presented as
+        its transpose to the users of the `IMatrix` interface;
+        \param[in]  threshold  is the minimum absolute value of elements to be kept (default 0,
+        i.e., only exact zeros are dropped);
+        \param[in]  precision  is the storage format of values.
+    */
+    CompressedMatrix(const IMatrix<NumT>& src, bool transposed=false,
+        double threshold=0, StoragePrecision precision=SP_FLOAT32);
+
+    /** memory-map the matrix from a file created by `CompressedMatrixWriter`.
+        \param[in]  filename  is the name of the file;
+        \param[in]  transposed  if true, the matrix is presented to the user in a transposed form.
+        The contents of the file are validated: the arrays must fit into the file, the row pointers
+        must be non-decreasing and end at the number of nonzero elements, and the column indices
+        must be increasing within each row and less than the number of columns
+        (this requires one pass over the index arrays, but not over the values).
+        \throw  std::runtime_error if the file cannot be opened or has a wrong format.
+    */
+    explicit CompressedMatrix(const std::string& filename, bool transposed=false);
+
+    ~CompressedMatrix();
+
+    /// number of nonzero elements
+    virtual size_t size() const { return numNonzero; }
+
+    /// return the element at the given position (zero if it is not stored)
+    /// \throw std::out_of_range if row or col are larger than the respective matrix dimension
+    virtual NumT at(const size_t row, const size_t col) const;
+
+    /// return the nonzero element with the given index (0 <= index < size()),
+    /// together with its row and column indices
+    virtual NumT elem(const size_t index, size_t &row, size_t &col) const;
+
+    /// compute y = M x, where M is the matrix as seen by the user (possibly transposed);
+    /// the computation is parallelized over rows or columns
+    void multiply(const std::vector<double>& x, std::vector<double>& y) const;
+
+    /// compute x = M^T y (the product of the transposed matrix and a vector)
+    void multiplyTransposed(const std::vector<double>& y, std::vector<double>& x) const;
+
+    /// return the storage format of values
+    StoragePrecision precision() const { return prec; }
+
+    /// return the number of bytes occupied by the matrix data (in memory or in the file)
+    size_t bytes() const;
+
+private:
+    size_t numStoredRows;   ///< number of rows in the stored CSR matrix
+    size_t numStoredCols;   ///< number of columns in the stored CSR matrix
+    size_t numNonzero;      ///< number of stored elements
+    bool transposed;        ///< whether the user sees the transposed stored matrix
+    StoragePrecision prec;  ///< storage format of values
+    const unsigned long long* rowPtr;  ///< start of each stored row in the element arrays (Nrows+1)
+    const unsigned int* colInd;        ///< column indices of stored elements
+    const void* values;                ///< values of stored elements (float or unsigned short)
+    std::vector<unsigned long long> ownRowPtr;  ///< storage for the in-memory matrix
+    std::vector<unsigned int> ownColInd;
+    std::vector<float> ownValuesF;
+    std::vector<unsigned short> ownValuesH;
+    void* mappedAddr;       ///< start of the memory-mapped file (NULL if the matrix is in memory)
+    size_t mappedSize;      ///< size of the memory-mapped region
+    std::vector<char> fileBuffer;  ///< file contents, if memory mapping is not available
+
+    /// value of the stored element with the given index
+    inline NumT value(size_t index) const {
+        return static_cast<NumT>(prec == SP_FLOAT16 ?
+            halfToFloat(static_cast<const unsigned short*>(values)[index]) :
+            static_cast<const float*>(values)[index]);
+    }
+
+    /// out[r] = sum_c S[r,c] in[c], where S is the stored matrix
+    void gather(const std::vector<double>& in, std::vector<double>& out) const;
+
+    /// out[c] = sum_r S[r,c] in[r]
+    void scatter(const std::vector<double>& in, std::vector<double>& out) const;
+
+    // copying is not allowed (the object may hold a memory-mapped file)
+    CompressedMatrix(const CompressedMatrix&);
+    CompressedMatrix& operator=(const CompressedMatrix&);
+};
+
+
+/** Writer of a compressed matrix to a file, which may be subsequently memory-mapped by
+    the `CompressedMatrix` constructor.
+    Rows are provided one at a time in a dense form and converted into the sparse format on the fly,
+    so that the entire matrix never needs to be kept in memory.
+    The rows may be added from multiple threads and in an arbitrary order: each row is
+    compressed in the calling thread, and then it is either written to the file, or temporarily
+    kept in a buffer until all preceding rows are received.
+    The file is completed when the last row is added, or when `finalize()` is called explicitly
+    (in the latter case the missing rows are filled with zeros).
+*/
+class CompressedMatrixWriter {
+public:
+    /** create the file and prepare for writing the rows.
+        \param[in]  filename  is the name of the output file;
+        \param[in]  numRows  is the total number of rows (e.g., orbits);
+        \param[in]  numCols  is the length of each row (e.g., size of the datacube);
+        \param[in]  threshold  is the minimum absolute value of elements to be kept;
+        \param[in]  precision  is the storage format of values.
+        \throw  std::runtime_error if the file cannot be created.
+    */
+    CompressedMatrixWriter(const std::string& filename, size_t numRows, size_t numCols,
+        double threshold=0, StoragePrecision precision=SP_FLOAT32);
+
+    /// finalize the file if it was not done before (errors are not reported in this case)
+    ~CompressedMatrixWriter();
+
+    /// add a single row of the matrix with the given index (thread-safe);
+    /// \throw std::out_of_range if the index is invalid or this row was already provided
+    void addRow(size_t index, const float* data);
+
+    /// same for the input data in double precision
+    void addRow(size_t index, const double* data);
+
+    /// write all remaining data and close the file; called automatically after the last row
+    /// \throw std::runtime_error in case of i/o errors
+    void finalize();
+
+private:
+    /// a single compressed row
+    struct Row {
+        std::vector<unsigned int> cols;
+        std::vector<float> vals;
+    };
+    const std::string filename;
+    const size_t numRows, numCols;
+    const double threshold;
+    const StoragePrecision prec;
+    size_t numWritten;        ///< number of rows already written to the temporary files
+    bool finalized;
+    std::vector<unsigned long long> rowPtr;  ///< row pointers (accumulated in memory)
+    std::map<size_t, Row> pending;           ///< rows received out of order
+    std::FILE *fileCol, *fileVal;  ///< temporary files for column indices and values
+
+    /// compress a dense row in the calling thread and add it to the queue
+    template<typename T> void addRowImpl(size_t index, const T* data);
+
+    /// append a compressed row to the temporary files
+    void writeRow(const Row& row);
+
+    CompressedMatrixWriter(const CompressedMatrixWriter&);
+    CompressedMatrixWriter& operator=(const CompressedMatrixWriter&);
+};
+
+}  // namespace
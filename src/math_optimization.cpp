@@ -16,8 +16,14 @@
 
 #include "math_optimization.h"
 #include "math_core.h"
+#include "math_matrixstorage.h"
+#include "utils.h"
 #include <stdexcept>
+#include <algorithm>
 #include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace math{
 
@@ -125,7 +131,11 @@ std::vector<double> linearOptimizationSolve(const IMatrix<NumT>& A,
 #ifdef HAVE_CVXOPT
     return quadraticOptimizationSolve(A, rhs, L, BandMatrix<NumT>(std::vector<NumT>()), xmin, xmax);
 #else
-    throw std::runtime_error("linearOptimizationSolve not implemented");
+    // use the built-in solver (slow for purely linear problems, but better than nothing)
+    std::vector<double> result, multipliers;
+    quadraticOptimizationSolveFirstOrder(A, rhs, L, BandMatrix<NumT>(),
+        std::vector<NumT>(), xmin, xmax, result, multipliers);
+    return result;
 #endif
 }
 #endif
@@ -304,11 +314,12 @@ std::vector<double> quadraticOptimizationSolve(
 #ifdef HAVE_GLPK
     if(Q.size()==0)  // linear problems will be redirected to the appropriate solver
         return linearOptimizationSolve(A, rhs, L, xmin, xmax);
-    else
-        throw std::runtime_error("quadraticOptimizationSolve not implemented");
-#else
-    throw std::runtime_error("quadraticOptimizationSolve not implemented");
 #endif
+    // otherwise use the built-in first-order solver with all constraints being exact
+    std::vector<double> result, multipliers;
+    quadraticOptimizationSolveFirstOrder(A, rhs, L, Q,
+        std::vector<NumT>(), xmin, xmax, result, multipliers);
+    return result;
 }
 #endif
 
@@ -440,6 +451,16 @@ std::vector<double> quadraticOptimizationSolveApprox(
         (!consPenaltyQuad.empty() && consPenaltyQuad.size()!=numConstraints) ||
         (!L.empty() && L.size()!=numVariables) )
         throw std::invalid_argument("quadraticOptimizationSolveApprox: invalid size of input arrays");
+#ifndef HAVE_CVXOPT
+    // without an external QP solver, problems with only quadratic penalties for constraint violation
+    // are handled directly by the built-in solver, avoiding the augmentation with slack variables
+    if(consPenaltyLin.empty() || allZeros(consPenaltyLin)) {
+        std::vector<double> result, multipliers;
+        quadraticOptimizationSolveFirstOrder(A, rhs, L, Q, consPenaltyQuad, xmin, xmax,
+            result, multipliers);
+        return result;
+    }
+#endif
 
     // check which constraints are 'loose', i.e. penalty is not infinite,
     // and add an extra pair of penalized variables for each loose constraint
@@ -482,6 +503,403 @@ std::vector<double> quadraticOptimizationSolveApprox(
     return result;
 }
 
+//------- built-in first-order solver for bound-constrained quadratic problems -------//
+namespace{
+
+/// index of the current OpenMP thread (0 in the serial case)
+inline int threadIndex()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/** Helper class for computing the products of a matrix and its transpose with a vector
+    in parallel, without creating a temporary dense or transposed copy of the matrix.
+    Dense row-major matrices are traversed directly, compressed sparse matrices use their own
+    parallel multiplication routines, and other matrices are accessed via
+    the IMatrix::elem() interface, and in both cases the products with the transposed matrix
+    are accumulated in per-thread buffers, which are then summed up.
+*/
+template<typename NumT>
+class ParallelMatVec {
+    const IMatrix<NumT>& M;                ///< the matrix
+    const IMatrixDense<NumT>* dense;        ///< the same matrix if it is dense, otherwise NULL
+    const CompressedMatrix<NumT>* compressed;  ///< same if it is a compressed sparse matrix
+    mutable std::vector< std::vector<double> > buffers;  ///< per-thread accumulators
+public:
+    explicit ParallelMatVec(const IMatrix<NumT>& _M) :
+        M(_M), dense(dynamic_cast<const IMatrixDense<NumT>*>(&_M)),
+        compressed(dynamic_cast<const CompressedMatrix<NumT>*>(&_M)),
+#ifdef _OPENMP
+        buffers(std::max(1, omp_get_max_threads()))
+#else
+        buffers(1)
+#endif
+    {}
+
+    /// compute y = M x
+    void mul(const std::vector<double>& x, std::vector<double>& y) const
+    {
+        if(compressed) {
+            compressed->multiply(x, y);
+            return;
+        }
+        const ptrdiff_t nrows = M.rows(), ncols = M.cols();
+        y.assign(nrows, 0.);
+        if(!dense) {
+            accumulate(x, y, false);
+            return;
+        }
+        const NumT* data = dense->data();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for(ptrdiff_t r=0; r<nrows; r++) {
+            const NumT* row = data + r * ncols;
+            double sum = 0;
+            for(ptrdiff_t c=0; c<ncols; c++)
+                sum += row[c] * x[c];
+            y[r] = sum;
+        }
+    }
+
+    /// compute x = M^T y
+    void mulT(const std::vector<double>& y, std::vector<double>& x) const
+    {
+        if(compressed) {
+            compressed->multiplyTransposed(y, x);
+            return;
+        }
+        const ptrdiff_t nrows = M.rows(), ncols = M.cols();
+        x.assign(ncols, 0.);
+        if(!dense) {
+            accumulate(y, x, true);
+            return;
+        }
+        const NumT* data = dense->data();
+        for(size_t t=0; t<buffers.size(); t++)
+            buffers[t].clear();
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            std::vector<double>& buf = buffers[threadIndex()];
+            buf.assign(ncols, 0.);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+            for(ptrdiff_t r=0; r<nrows; r++) {
+                double val = y[r];
+                if(val == 0)
+                    continue;
+                const NumT* row = data + r * ncols;
+                for(ptrdiff_t c=0; c<ncols; c++)
+                    buf[c] += row[c] * val;
+            }
+        }
+        reduce(x);
+    }
+
+private:
+    /// generic code path: loop over all elements of the matrix, accumulating the result
+    /// in per-thread buffers, and then sum them up
+    void accumulate(const std::vector<double>& in, std::vector<double>& out, bool transpose) const
+    {
+        const ptrdiff_t size = M.size(), nout = out.size();
+        for(size_t t=0; t<buffers.size(); t++)
+            buffers[t].clear();
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            std::vector<double>& buf = buffers[threadIndex()];
+            buf.assign(nout, 0.);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+            for(ptrdiff_t i=0; i<size; i++) {
+                size_t row, col;
+                double val = M.elem(i, row, col);
+                if(transpose)
+                    buf[col] += val * in[row];
+                else
+                    buf[row] += val * in[col];
+            }
+        }
+        reduce(out);
+    }
+
+    /// sum up the buffers of all threads that took part in the computation
+    void reduce(std::vector<double>& out) const
+    {
+        const ptrdiff_t nout = out.size();
+        const size_t nbuf = buffers.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for(ptrdiff_t k=0; k<nout; k++) {
+            double sum = 0;
+            for(size_t t=0; t<nbuf; t++)
+                if((ptrdiff_t)buffers[t].size() == nout)
+                    sum += buffers[t][k];
+            out[k] = sum;
+        }
+    }
+};
+
+/// compute y = Q x for a (typically sparse and small) matrix of quadratic penalties
+template<typename NumT>
+void mulQuad(const IMatrix<NumT>& Q, const std::vector<double>& x, std::vector<double>& y)
+{
+    y.assign(x.size(), 0.);
+    for(size_t i=0, size=Q.size(); i<size; i++) {
+        size_t row, col;
+        double val = Q.elem(i, row, col);
+        y[row] += val * x[col];
+    }
+}
+
+/** The quadratic part of the cost function for the first-order solver:
+    H = Q + A^T W A, where W is the diagonal matrix of weights of each constraint
+    (finite penalties for approximate constraints and the penalty parameter rho for the exact ones);
+    the two parts of W are kept separately, so that rho can be changed between the outer iterations.
+*/
+template<typename NumT>
+class FirstOrderProblem {
+public:
+    const ParallelMatVec<NumT> A;      ///< the matrix of constraints
+    const IMatrix<NumT>& Q;            ///< the matrix of quadratic penalties for variables
+    const std::vector<double> b;      ///< the rhs of constraints
+    const std::vector<double> Lin;    ///< linear penalties for variables (possibly empty)
+    const std::vector<double> weight; ///< quadratic penalties for constraints (0 for exact ones)
+    const std::vector<char>   exact;  ///< flags for exact constraints
+    const std::vector<double> lower, upper;  ///< bounds on the variables
+
+    FirstOrderProblem(const IMatrix<NumT>& _A, const std::vector<double>& _b,
+        const std::vector<double>& _Lin, const IMatrix<NumT>& _Q,
+        const std::vector<double>& _weight, const std::vector<char>& _exact,
+        const std::vector<double>& _lower, const std::vector<double>& _upper) :
+        A(_A), Q(_Q), b(_b), Lin(_Lin), weight(_weight), exact(_exact), lower(_lower), upper(_upper) {}
+
+    /** compute the residual r = A x - b and the gradient of the augmented Lagrangian
+        g = Lin + Q x + A^T (W r + E (lambda + rho r)), where E selects exact constraints */
+    void gradient(const std::vector<double>& x, const std::vector<double>& lambda, double rho,
+        std::vector<double>& grad, std::vector<double>& resid, std::vector<double>& tmp) const
+    {
+        A.mul(x, resid);
+        const ptrdiff_t nc = b.size(), nv = x.size();
+        tmp.resize(nc);
+        for(ptrdiff_t c=0; c<nc; c++) {
+            resid[c] -= b[c];
+            tmp[c] = exact[c] ? lambda[c] + rho * resid[c] : weight[c] * resid[c];
+        }
+        A.mulT(tmp, grad);
+        if(Q.size() > 0) {
+            mulQuad(Q, x, tmp);
+            for(ptrdiff_t v=0; v<nv; v++)
+                grad[v] += tmp[v];
+        }
+        if(!Lin.empty())
+            for(ptrdiff_t v=0; v<nv; v++)
+                grad[v] += Lin[v];
+    }
+
+    /** estimate the largest eigenvalue of the quadratic form A^T W A (+Q) by power iterations;
+        if useExact==true, W contains ones for exact constraints and zeros otherwise,
+        and Q is not used; if useExact==false, W contains penalties for approximate constraints */
+    double maxEigenvalue(bool useExact) const
+    {
+        const size_t nc = b.size(), nv = lower.size();
+        std::vector<double> x(nv), y(nc), z(nv), tmp;
+        // start from a vector that is unlikely to be orthogonal to the leading eigenvector
+        for(size_t v=0; v<nv; v++)
+            x[v] = 1. + 0.5 * sin(v+1.);
+        double norm = 0, eigen = 0;
+        for(size_t v=0; v<nv; v++)
+            norm += pow_2(x[v]);
+        norm = sqrt(norm);
+        for(int iter=0; iter<30 && norm>0; iter++) {
+            for(size_t v=0; v<nv; v++)
+                x[v] /= norm;
+            A.mul(x, y);
+            for(size_t c=0; c<nc; c++)
+                y[c] *= useExact ? (exact[c] ? 1. : 0.) : weight[c];
+            A.mulT(y, z);
+            if(!useExact && Q.size() > 0) {
+                mulQuad(Q, x, tmp);
+                for(size_t v=0; v<nv; v++)
+                    z[v] += tmp[v];
+            }
+            // Rayleigh quotient, then the new iterate
+            eigen = 0;
+            norm  = 0;
+            for(size_t v=0; v<nv; v++) {
+                eigen += x[v] * z[v];
+                norm  += pow_2(z[v]);
+            }
+            norm = sqrt(norm);
+            x.swap(z);
+        }
+        // power iterations underestimate the eigenvalue, so add some safety margin
+        return fmax(eigen, norm) * 1.1;
+    }
+
+    /** minimize the augmented Lagrangian for fixed lambda and rho by the accelerated projected
+        gradient method with adaptive restarts (O'Donoghue&Candes 2015).
+        \param[in,out] x  is the initial guess and the result;
+        \param[in]  lipschitz  is the Lipschitz constant of the gradient;
+        \param[in]  tolerance  is the relative tolerance on the change of x between iterations;
+        \param[in]  maxIter  is the maximum number of iterations;
+        \return  the number of iterations performed.
+    */
+    unsigned int minimize(std::vector<double>& x, const std::vector<double>& lambda, double rho,
+        double lipschitz, double tolerance, unsigned int maxIter) const
+    {
+        const ptrdiff_t nv = x.size();
+        std::vector<double> z(x), xnew(nv), grad, resid, tmp;
+        double t = 1., step = 1. / lipschitz;
+        unsigned int iter = 0;
+        while(iter < maxIter) {
+            gradient(z, lambda, rho, grad, resid, tmp);
+            iter++;
+            double restart = 0, delta = 0, xnorm = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(+:restart)
+#endif
+            for(ptrdiff_t v=0; v<nv; v++) {
+                xnew[v] = fmin(fmax(z[v] - step * grad[v], lower[v]), upper[v]);
+                restart += grad[v] * (xnew[v] - x[v]);
+            }
+            double tnew = 0.5 * (1 + sqrt(1 + 4*t*t));
+            if(restart > 0)   // the momentum points uphill: reset the acceleration
+                t = tnew = 1.;
+            double mom = (t-1) / tnew;
+            for(ptrdiff_t v=0; v<nv; v++) {
+                double dx = xnew[v] - x[v];
+                delta = fmax(delta, fabs(dx));
+                xnorm = fmax(xnorm, fabs(xnew[v]));
+                z[v]  = fmin(fmax(xnew[v] + mom * dx, lower[v]), upper[v]);
+            }
+            x.swap(xnew);
+            t = tnew;
+            if(delta <= tolerance * xnorm)
+                break;
+        }
+        return iter;
+    }
+};
+
+}  // internal namespace
+
+template<typename NumT>
+unsigned int quadraticOptimizationSolveFirstOrder(
+    const IMatrix<NumT>& A, const std::vector<NumT>& rhs,
+    const std::vector<NumT>& L, const IMatrix<NumT>& Q,
+    const std::vector<NumT>& consPenaltyQuad,
+    const std::vector<NumT>& xmin, const std::vector<NumT>& xmax,
+    std::vector<double>& x, std::vector<double>& multipliers,
+    const FirstOrderSolverParams& params)
+{
+    const size_t numVariables = A.cols(), numConstraints = A.rows();
+    if( rhs.size()!=numConstraints ||
+        (!consPenaltyQuad.empty() && consPenaltyQuad.size()!=numConstraints) ||
+        (!L.empty()    && L.size()   !=numVariables) ||
+        (!xmin.empty() && xmin.size()!=numVariables) ||
+        (!xmax.empty() && xmax.size()!=numVariables) ||
+        (Q.size()!=0   && (Q.rows()!=numVariables || Q.cols()!=numVariables)) )
+        throw std::invalid_argument("quadraticOptimizationSolveFirstOrder: invalid size of input arrays");
+    if(!(params.tolerance > 0))
+        throw std::invalid_argument("quadraticOptimizationSolveFirstOrder: tolerance must be positive");
+
+    // convert the input data to double precision, and split the constraints into exact and approximate
+    std::vector<double> b(rhs.begin(), rhs.end()), Lin(L.begin(), L.end()),
+        weight(numConstraints, 0.), lower(numVariables, 0.), upper(numVariables, INFINITY);
+    std::vector<char> exact(numConstraints, true);
+    size_t numExact = 0;
+    double bnorm = 0;
+    for(size_t c=0; c<numConstraints; c++) {
+        double pen = consPenaltyQuad.empty() ? INFINITY : consPenaltyQuad[c];
+        if(pen < 0)
+            throw std::invalid_argument(
+                "quadraticOptimizationSolveFirstOrder: constraint penalties must be non-negative");
+        exact[c] = !isFinite(pen);
+        if(exact[c]) {
+            numExact++;
+            bnorm = fmax(bnorm, fabs(b[c]));
+        } else
+            weight[c] = pen;
+    }
+    for(size_t v=0; v<numVariables; v++) {
+        if(!xmin.empty())
+            lower[v] = xmin[v];
+        if(!xmax.empty())
+            upper[v] = xmax[v];
+        if(lower[v] > upper[v])
+            throw std::invalid_argument(
+                "quadraticOptimizationSolveFirstOrder: lower bound exceeds upper bound");
+    }
+    FirstOrderProblem<NumT> problem(A, b, Lin, Q, weight, exact, lower, upper);
+
+    // initial guess: the provided vector projected onto the feasible box, or the point nearest to zero
+    if(x.size() != numVariables)
+        x.assign(numVariables, 0.);
+    for(size_t v=0; v<numVariables; v++)
+        x[v] = fmin(fmax(isFinite(x[v]) ? x[v] : 0., lower[v]), upper[v]);
+    if(multipliers.size() != numConstraints)
+        multipliers.assign(numConstraints, 0.);
+    for(size_t c=0; c<numConstraints; c++)
+        if(!exact[c] || !isFinite(multipliers[c]))
+            multipliers[c] = 0;
+
+    // Lipschitz constants of the gradient for the approximate and exact parts of the problem;
+    // the penalty parameter for exact constraints initially makes the two parts comparable
+    double lipPen = problem.maxEigenvalue(false);
+    double lipExact = numExact>0 ? problem.maxEigenvalue(true) : 0;
+    if(numExact>0 && !(lipExact > 0))
+        throw std::invalid_argument(
+            "quadraticOptimizationSolveFirstOrder: matrix of exact constraints is zero");
+    if(numExact==0 && !(lipPen > 0))
+        throw std::invalid_argument(
+            "quadraticOptimizationSolveFirstOrder: problem has no quadratic part");
+    double rho = numExact>0 ? (lipPen > 0 ? lipPen / lipExact : 1. / lipExact) : 0;
+
+    // outer loop of the augmented Lagrangian method (only one iteration without exact constraints)
+    std::vector<double> resid;
+    double prevViol = INFINITY;
+    unsigned int numIter = 0;
+    while(true) {
+        numIter += problem.minimize(x, multipliers, rho, lipPen + rho * lipExact,
+            params.tolerance, params.maxIter - numIter);
+        if(numExact==0)
+            break;
+        problem.A.mul(x, resid);
+        double viol = 0;
+        for(size_t c=0; c<numConstraints; c++) {
+            if(!exact[c])
+                continue;
+            resid[c] -= b[c];
+            viol = fmax(viol, fabs(resid[c]));
+            multipliers[c] += rho * resid[c];
+        }
+        if(viol <= params.tolerance * (bnorm>0 ? bnorm : 1.))
+            break;
+        if(numIter >= params.maxIter)
+            throw std::runtime_error(
+                "quadraticOptimizationSolveFirstOrder: constraints could not be satisfied, violation=" +
+                utils::toString(viol));
+        if(viol > 0.25 * prevViol)  // insufficient progress: increase the penalty parameter
+            rho *= 10;
+        prevViol = viol;
+    }
+    if(numIter >= params.maxIter)
+        utils::msg(utils::VL_WARNING, "quadraticOptimizationSolveFirstOrder",
+            "did not converge in " + utils::toString(numIter) + " iterations");
+    return numIter;
+}
+
 // explicit instantiations for NumT = float and double
 template std::vector<double> linearOptimizationSolve(const IMatrix<float>&,
     const std::vector<float>&, const std::vector<float>&,
@@ -516,4 +934,14 @@ template std::vector<double> quadraticOptimizationSolveApprox(const IMatrix<doub
     const std::vector<double>&, const std::vector<double>&, const IMatrix<double>&,
     const std::vector<double>&, const std::vector<double>&,
     const std::vector<double>&, const std::vector<double>&);
+
+template unsigned int quadraticOptimizationSolveFirstOrder(const IMatrix<float>&,
+    const std::vector<float>&, const std::vector<float>&, const IMatrix<float>&,
+    const std::vector<float>&, const std::vector<float>&, const std::vector<float>&,
+    std::vector<double>&, std::vector<double>&, const FirstOrderSolverParams&);
+
+template unsigned int quadraticOptimizationSolveFirstOrder(const IMatrix<double>&,
+    const std::vector<double>&, const std::vector<double>&, const IMatrix<double>&,
+    const std::vector<double>&, const std::vector<double>&, const std::vector<double>&,
+    std::vector<double>&, std::vector<double>&, const FirstOrderSolverParams&);
 }
@@ -142,4 +142,66 @@ std::vector<double> quadraticOptimizationSolveApprox(
     const std::vector<NumT>& xmin = std::vector<NumT>(),
     const std::vector<NumT>& xmax = std::vector<NumT>());
 
+/** Parameters of the built-in first-order solver `quadraticOptimizationSolveFirstOrder()` */
+struct FirstOrderSolverParams {
+    /// maximum total number of iterations (matrix-vector multiplications) of the solver
+    unsigned int maxIter;
+
+    /// relative tolerance on the change of the solution between iterations
+    /// and on the violation of constraints that must be satisfied exactly
+    double tolerance;
+
+    FirstOrderSolverParams() : maxIter(20000), tolerance(1e-6) {}
+};
+
+/** Solve a quadratic optimization problem with quadratic penalties for constraint violation
+    using a built-in first-order method, which does not depend on external libraries and
+    never creates a dense copy of the matrix.
+    The task is to minimize the cost function
+    F(x) = L x + (1/2) x^T Q x + (1/2) sum_c consPenaltyQuad[c] (A x - rhs)_c^2
+    subject to constraints  xmin <= x <= xmax, and additionally the constraints with infinite
+    penalties (or all of them, if consPenaltyQuad is empty) must be satisfied exactly.
+    This is the same problem as solved by `quadraticOptimizationSolveApprox()` without linear
+    penalties for constraint violation, and it is used as a fallback in that routine and in
+    `quadraticOptimizationSolve()` / `linearOptimizationSolve()` when external solvers are not available.
+    The method is the accelerated projected gradient descent (FISTA with adaptive restarts);
+    exact constraints are handled with the augmented Lagrangian method.
+    The two matrix-vector multiplications per iteration are performed in parallel, and the matrix
+    is accessed through the `IMatrix` interface (dense row-major matrices use a faster code path).
+    The solution and the Lagrange multipliers are provided on input as the initial guess
+    (warm start), which considerably speeds up the solution of a sequence of similar problems,
+    e.g., when refitting a model after a small change in the regularization parameters.
+    \param[in]  A  is the matrix of the linear system (N_c x N_v);
+    \param[in]  rhs  is its right-hand side (N_c);
+    \param[in]  L  is the vector of linear penalties for N_v variables (may be empty);
+    \param[in]  Q  is the matrix of quadratic penalties for N_v variables (may be empty);
+    \param[in]  consPenaltyQuad  is the vector of non-negative quadratic penalties for violating
+    each of N_c constraints (infinite values mean exact constraints, empty vector means that
+    all constraints are exact);
+    \param[in]  xmin  is the vector of lower bounds on the solution (N_v or empty, meaning zeros);
+    \param[in]  xmax  is the vector of upper bounds (N_v or empty, meaning no upper bounds);
+    \param[in,out]  x  on input, the initial guess for the solution (if it has a wrong size,
+    the solver starts from the point nearest to zero within bounds); on output, the solution;
+    \param[in,out]  multipliers  on input, the initial guess for the Lagrange multipliers of
+    the exact constraints (if it has a wrong size, they are initialized with zeros);
+    on output, their final values (N_c elements, zero for the non-exact constraints);
+    \param[in]  params  are the parameters of the solver.
+    \return  the number of iterations performed.
+    \throw   std::invalid_argument if the sizes of input vectors/matrices are inconsistent,
+    or std::runtime_error if the exact constraints could not be satisfied.
+    \tparam  NumT  is the numerical type of the input arrays (float or double).
+*/
+template<typename NumT>
+unsigned int quadraticOptimizationSolveFirstOrder(
+    const     IMatrix<NumT>& A,
+    const std::vector<NumT>& rhs,
+    const std::vector<NumT>& L,
+    const     IMatrix<NumT>& Q,
+    const std::vector<NumT>& consPenaltyQuad,
+    const std::vector<NumT>& xmin,
+    const std::vector<NumT>& xmax,
+    /*in/out*/ std::vector<double>& x,
+    /*in/out*/ std::vector<double>& multipliers,
+    const FirstOrderSolverParams& params = FirstOrderSolverParams());
+
 }  // namespace
@@ -7,19 +7,17 @@
 #include <map>
 #include <algorithm>
 #include <alloca.h>
+#include <stdint.h>
 
 namespace math{
 
 namespace {  // internal namespace for Sampler class
 
-/// choose between pseudo-random (PRNG) and quasi-random (QRNG) number generators in the sampling routine
-#define USE_QRNG
-
 class Sampler {
 public:
     /** Construct an N-dimensional sampler object */
     Sampler(const IFunctionNdim& fnc, const double xlower[], const double xupper[],
-        const size_t numOutputSamples);
+        const size_t numOutputSamples, const size_t seed, QuasiRandomMethod method=QR_HALTON);
 
     /** Create the internal array of sampling points sufficiently large for the requested output size */
     void run();
@@ -36,6 +34,13 @@ public:
     /** Return the total number of function evaluations */
     size_t numCalls() const { return fncValues.size(); }
 
+    /** Return the boundaries of all leaf cells and the maximum function value in each of them.
+        \param[out] bounds  will contain 2*Ndim numbers (lower and upper boundaries) for each cell;
+        \param[out] maxFncValues  will contain the maximum value of function among the points
+        of each cell (zero if the cell has no points).
+    */
+    void getLeafCells(std::vector<double>& bounds, std::vector<double>& maxFncValues) const;
+
 private:
     /// signed integral type large enough to enumerate all cells in the tree
     typedef ptrdiff_t CellEnum;
@@ -103,9 +108,10 @@ private:
     /// estimate of the error in the integral, divided by the volume
     double integError;
 
-    /// offset (seed value) of the quasi-random number generator,
-    /// assigned randomly to avoid repetition when the same sampling routine is called twice
-    const size_t qrngOffset;
+    /// generator of point coordinates within cells (pseudo- or quasi-random),
+    /// its seed is provided by the caller (sampleNdim assigns it randomly to avoid repetition
+    /// when the same sampling routine is called twice, SampleGenerator derives it from its own seed)
+    const QuasiRandomSequence qrng;
 
     /** list of cells that need to be populated with more points on this iteration:
         the first element of the pair is the index of the cell,
@@ -117,25 +123,60 @@ private:
     */
     std::vector<std::pair<CellEnum, PointEnum> > cellsQueue;
 
+    /** The outcome of refinement of a contiguous range of existing cells, which is produced
+        independently from other ranges (in parallel), and then merged into the tree.
+        The new cells created by splitting are stored in a local array, and references to them
+        (in the parent/child indices and in the queue) are encoded as negative numbers
+        by `localIndex()`, until the local arrays are merged into the global one;
+        references to existing cells are ordinary non-negative indices.
+        Each thread modifies only the existing cells in its range and the `nextPoint` entries
+        of points belonging to these cells, so no locking is needed.
+    */
+    struct Refinement {
+        /// new cells created by splitting the existing cells or their descendants
+        std::vector<Cell> newCells;
+        /// existing cells that were split (their childIndex refers to the local array)
+        std::vector<CellEnum> splitCells;
+        /// cells to be populated with more points and the number of new points in each one
+        std::vector<std::pair<CellEnum, PointEnum> > queue;
+    };
+
+    /// convert the index in the local array of new cells into the encoded form and vice versa
+    static CellEnum localIndex(CellEnum index) { return -2 - index; }
+
+    /// access a cell by its index, which is either global or encoded local (in the given refinement)
+    Cell& cellRef(CellEnum cellIndex, Refinement& ref) {
+        return cellIndex >= 0 ? cells[cellIndex] : ref.newCells[localIndex(cellIndex)];
+    }
+
     /** split a cell and repartition the existing sampling points in this cell between
         its children, keeping track of all associated indices/pointers.
-        \param[in]  cellIndex  is the cell to split;
+        \param[in]  cellIndex  is the cell to split (global or encoded local index);
         \param[in]  splitDim   is the index of dimension along which to split;
         \param[in]  boundary   is the absolute coordinate along the selected dimension
         that will be the new boundary between the two child cells, used to split the list
-        of points between the child cells.
+        of points between the child cells;
+        \param[in,out]  ref    is the refinement record where the child cells are stored.
+        \return  the encoded local index of the first child cell (the second one follows it).
     */
-    void splitCell(CellEnum cellIndex, int splitDim, double boundary);
+    CellEnum splitCell(CellEnum cellIndex, int splitDim, double boundary, Refinement& ref);
 
-    /** choose the best dimension and boundary to split a given cell and perform the division;
-        the dimension along which the function varies most significantly will be split.
+    /** choose the best dimension to split a given cell: the one along which the function
+        varies most significantly.
+        \param[in]  cellIndex  is the cell (global or encoded local index);
+        \param[in]  cellXlower, cellXupper  are its boundaries;
+        \param[in]  ref  is the refinement record containing the local cells.
     */
-    void decideHowToSplitCell(CellEnum cellIndex);
+    int decideHowToSplitCell(CellEnum cellIndex,
+        const double cellXlower[], const double cellXupper[], Refinement& ref);
 
     /** append the given cell to the queue of cells that will be populated with new points;
         the number of points in this cell will be doubled.
+        \param[in]  cellIndex  is the cell (global or encoded local index);
+        \param[in]  depth  is its level in the tree (0 for the root cell);
+        \param[in,out]  ref  is the refinement record.
     */
-    void addCellToQueue(CellEnum cellIndex);
+    void addCellToQueue(CellEnum cellIndex, int depth, Refinement& ref);
 
     /** determine the cell boundaries by recursively traversing the tree upwards.
         \param[in]  cellIndex is the index of the cell;
@@ -162,9 +203,20 @@ private:
         the weight of one output sample, then either split this cell in a suitable place,
         while repartitioning its existing points among the two child cells
         (if it contained enough points already to make a motivated choice),
+        and then process both child cells recursively,
         or add this cell to the queue of cells that will be populated with new points.
+        \param[in]  cellIndex  is the cell (global or encoded local index);
+        \param[in]  depth  is its level in the tree, or -1 if not known yet (for existing cells);
+        \param[in]  bounds  is the array of 2*Ndim lower and upper boundaries of the cell,
+        or NULL if not known yet (for existing cells);
+        \param[in,out]  ref  is the refinement record where the new cells and the queue are stored.
     */
-    void processCell(CellEnum cellIndex);
+    void processCell(CellEnum cellIndex, int depth, const double bounds[], Refinement& ref);
+
+    /** process all existing cells of the tree (in parallel), and merge the results:
+        append the new cells created by splitting to the tree and rebuild the cellsQueue.
+    */
+    void refineCells();
 
     /** evaluate the value of function f(x) for the points whose coordinates are stored 
         in the pointCoords array, parallelizing the loop and guarding against exceptions.
@@ -189,21 +241,20 @@ static const int numBinsEntropy = 16;
 /// limit the number of iterations in the recursive refinement loop
 static const int maxNumIter = 50;
 
+/// number of existing cells processed as a single unit of work in the refinement phase;
+/// the results do not depend on the number of threads, since the units are merged in a fixed order
+static const ptrdiff_t numCellsInChunk = 64;
+
 Sampler::Sampler(const IFunctionNdim& _fnc, const double _xlower[], const double _xupper[],
-    size_t _numOutputSamples) :
+    size_t _numOutputSamples, size_t seed, QuasiRandomMethod method) :
     fnc(_fnc),
     Ndim(fnc.numVars()),
     xlower(_xlower, _xlower+Ndim),
     xupper(_xupper, _xupper+Ndim),
     numOutputSamples(_numOutputSamples),
     cells(1),  // create the root cell
-    qrngOffset(random() * 1e6)  // starting value for the quasi-random number sequence
+    qrng(Ndim, method, seed)  // throws if Ndim is too large for the chosen sequence
 {
-#ifdef USE_QRNG
-    if(Ndim > MAX_PRIMES)  // this is only a limitation of the quasi-random number generator
-        throw std::runtime_error("sampleNdim: more than "+utils::toString(MAX_PRIMES)+
-            " dimensions is not supported");
-#endif
     volume = 1;
     for(int d=0; d<Ndim; d++) {
         if(xupper[d] > xlower[d])
@@ -319,20 +370,19 @@ void Sampler::getCellBoundaries(CellEnum cellIndex, double cellXlower[], double
     }
 }
 
-void Sampler::addCellToQueue(CellEnum cellIndex)
+void Sampler::addCellToQueue(CellEnum cellIndex, int depth, Refinement& ref)
 {
-    // get the number of samples in the cell (same number of new samples will be added)
-    PointEnum numPoints = static_cast<PointEnum>(round(1. / cells[cellIndex].weight));
-    for(CellEnum index = cellIndex; index>0; index = cells[index].parentIndex)
-        numPoints >>= 1;   // each division halves the cell volume and hence the number of points
+    Cell& cell = cellRef(cellIndex, ref);
+    // get the number of samples in the cell (same number of new samples will be added):
+    // each division halves the cell volume and hence the number of points
+    PointEnum numPoints = static_cast<PointEnum>(round(1. / cell.weight)) >> depth;
 
     // halve the weight of each sample point in this cell
-    cells[cellIndex].weight *= 0.5;
+    cell.weight *= 0.5;
 
     // schedule this cell for adding more points in the next iteration;
     // the coordinates of these new points will be assigned later, once this queue is completed.
-    PointEnum numPrev = cellsQueue.empty() ? 0 : cellsQueue.back().second;
-    cellsQueue.push_back(std::pair<CellEnum, PointEnum>(cellIndex, numPoints + numPrev));
+    ref.queue.push_back(std::pair<CellEnum, PointEnum>(cellIndex, numPoints));
 }
 
 void Sampler::addPointsToCell(CellEnum cellIndex, PointEnum firstPointIndex, PointEnum lastPointIndex)
@@ -347,12 +397,7 @@ void Sampler::addPointsToCell(CellEnum cellIndex, PointEnum firstPointIndex, Poi
         // assign coordinates of the new point
         for(int d=0; d<Ndim; d++) {
             pointCoords[ pointIndex * Ndim + d ] = cellXlower[d] +
-                (cellXupper[d] - cellXlower[d]) *
-#ifdef USE_QRNG
-                quasiRandomHalton(pointIndex + qrngOffset, PRIMES[d]);
-#else
-                random();
-#endif
+                (cellXupper[d] - cellXlower[d]) * qrng(pointIndex, d);
         }
         // update the linked list of points in the cell
         nextPoint[pointIndex] = nextPointInList;
@@ -361,27 +406,32 @@ void Sampler::addPointsToCell(CellEnum cellIndex, PointEnum firstPointIndex, Poi
     cells[cellIndex].headPointIndex = nextPointInList;  // store the new head of the list for this cell
 }
 
-void Sampler::splitCell(CellEnum cellIndex, int splitDim, const double boundary)
+Sampler::CellEnum Sampler::splitCell(CellEnum cellIndex, int splitDim, const double boundary, Refinement& ref)
 {
-    CellEnum childIndex = cells.size();  // the two new cells will be added at the end of the existing list
-    cells.resize(childIndex + 2);
-    cells[childIndex  ].parentIndex = cellIndex;
-    cells[childIndex+1].parentIndex = cellIndex;
-    cells[childIndex  ].weight      = cells[cellIndex].weight;
-    cells[childIndex+1].weight      = cells[cellIndex].weight;
-    cells[cellIndex   ].splitDim    = splitDim;
-    cells[cellIndex   ].childIndex  = childIndex;
-    PointEnum pointIndex = cells[cellIndex].headPointIndex;
+    // the two new cells will be added at the end of the local list
+    CellEnum childLocal = ref.newCells.size();
+    ref.newCells.resize(childLocal + 2);
+    Cell* children = &ref.newCells[childLocal];  // not invalidated until the next call
+    Cell& parent   = cellRef(cellIndex, ref);
+    children[0].parentIndex = cellIndex;
+    children[1].parentIndex = cellIndex;
+    children[0].weight      = parent.weight;
+    children[1].weight      = parent.weight;
+    parent.splitDim         = splitDim;
+    parent.childIndex       = localIndex(childLocal);
+    if(cellIndex >= 0)
+        ref.splitCells.push_back(cellIndex);
+    PointEnum pointIndex = parent.headPointIndex;
     assert(pointIndex >= 0);  // it must have some points, otherwise why split?
-    cells[cellIndex].headPointIndex = -1;  // all its points are moved to child cells
+    parent.headPointIndex = -1;  // all its points are moved to child cells
     // traverse the list of points belonged to the cellIndex, and distribute them between child cells
     do {
         // memorize the successor point index
         // of the original list of points of the cellIndex that is being split
         PointEnum next = nextPoint[pointIndex];
         // determine which of the two child cells this points belongs to
-        CellEnum child = pointCoords[pointIndex * Ndim + splitDim] < boundary ? childIndex : childIndex+1;
-        if(cells[child].headPointIndex < 0) {
+        Cell& child = children[pointCoords[pointIndex * Ndim + splitDim] < boundary ? 0 : 1];
+        if(child.headPointIndex < 0) {
             // this is the first point in the child cell,
             // thus it will be marked as the end of the list (no successors)
             nextPoint[pointIndex] = -1;
@@ -389,26 +439,25 @@ void Sampler::splitCell(CellEnum cellIndex, int splitDim, const double boundary)
             // this child cell already contained points:
             // set the index of successor point to be equal to the previous head of the list
             // (i.e. we reverse the original order of points)
-            nextPoint[pointIndex] = cells[child].headPointIndex;
+            nextPoint[pointIndex] = child.headPointIndex;
         }
         // assign the new head of the list of points belonging to this child cell
-        cells[child].headPointIndex = pointIndex;
+        child.headPointIndex = pointIndex;
         // move to the successor point of the original list
         pointIndex = next;
     } while(pointIndex>=0);
+    return localIndex(childLocal);
 }
 
-void Sampler::decideHowToSplitCell(CellEnum cellIndex)
+int Sampler::decideHowToSplitCell(CellEnum cellIndex,
+    const double cellXlower[], const double cellXupper[], Refinement& ref)
 {
-    // allocate temporary array on stack, to store the cell boundaries
-    // and the histogram of the projection of the function in each dimension
-    double *cellXlower = static_cast<double*>(alloca( (2+numBinsEntropy) * Ndim * sizeof(double)));
-    double *cellXupper = cellXlower + Ndim;    // space within the array allocated above
-    double *histogram  = cellXlower + 2*Ndim;
+    // allocate temporary array on stack, to store
+    // the histogram of the projection of the function in each dimension
+    double *histogram  = static_cast<double*>(alloca(numBinsEntropy * Ndim * sizeof(double)));
     std::fill(histogram, histogram + Ndim*numBinsEntropy, 0.);
-    getCellBoundaries(cellIndex, cellXlower, cellXupper);
 
-    PointEnum pointIndex   = cells[cellIndex].headPointIndex;
+    PointEnum pointIndex   = cellRef(cellIndex, ref).headPointIndex;
     assert(pointIndex >= 0);
     // loop over the list of points belonging to this cell
     while(pointIndex >= 0) {
@@ -439,17 +488,14 @@ void Sampler::decideHowToSplitCell(CellEnum cellIndex)
         }
     }
     assert(splitDim>=0);
-
-    // split in the given direction into two equal halves
-    double coord = 0.5 * (cellXlower[splitDim] + cellXupper[splitDim]);
-    splitCell(cellIndex, splitDim, coord);
+    return splitDim;
 }
 
-void Sampler::processCell(CellEnum cellIndex)
+void Sampler::processCell(CellEnum cellIndex, int depth, const double bounds[], Refinement& ref)
 {
     double maxFncValueCell = 0;
     size_t numPointsInCell = 0;
-    for(PointEnum pointIndex = cells[cellIndex].headPointIndex;
+    for(PointEnum pointIndex = cellRef(cellIndex, ref).headPointIndex;
         pointIndex >= 0;
         pointIndex = nextPoint[pointIndex])
     {
@@ -459,15 +505,89 @@ void Sampler::processCell(CellEnum cellIndex)
     if(numPointsInCell==0)
         return;  // this is a non-leaf cell
 
-    double refineFactor = maxFncValueCell * cells[cellIndex].weight * numOutputSamples / integValue;
+    double refineFactor = maxFncValueCell * cellRef(cellIndex, ref).weight * numOutputSamples / integValue;
 
     if(refineFactor < 1)
         return;
 
-    if(numPointsInCell > 2*minNumPointsInCell)
-        decideHowToSplitCell(cellIndex);
+    if(depth < 0) {  // an existing cell: determine its level by traversing the tree upwards
+        depth = 0;
+        for(CellEnum index = cellIndex; index>0; index = cells[index].parentIndex)
+            depth++;
+    }
+    if(numPointsInCell <= 2*minNumPointsInCell) {
+        addCellToQueue(cellIndex, depth, ref);
+        return;
+    }
+
+    // allocate temporary array on stack, to store the boundaries of this cell and its children
+    double *cellXlower = static_cast<double*>(alloca(4*Ndim * sizeof(double)));
+    double *cellXupper = cellXlower + Ndim;
+    double *childBounds= cellXlower + 2*Ndim;
+    if(bounds)
+        std::copy(bounds, bounds + 2*Ndim, cellXlower);
     else
-        addCellToQueue(cellIndex);
+        getCellBoundaries(cellIndex, cellXlower, cellXupper);
+
+    // split in the chosen direction into two equal halves
+    int splitDim = decideHowToSplitCell(cellIndex, cellXlower, cellXupper, ref);
+    double coord = 0.5 * (cellXlower[splitDim] + cellXupper[splitDim]);
+    CellEnum childIndex = splitCell(cellIndex, splitDim, coord, ref);
+
+    // process both child cells immediately (in the serial version, they were appended
+    // to the end of the list and processed later in the same pass, with the same outcome)
+    std::copy(cellXlower, cellXlower + 2*Ndim, childBounds);
+    childBounds[Ndim + splitDim] = coord;  // upper boundary of the lower child
+    processCell(childIndex, depth+1, childBounds, ref);
+    childBounds[splitDim] = coord;         // lower boundary of the upper child
+    childBounds[Ndim + splitDim] = cellXupper[splitDim];
+    processCell(localIndex(localIndex(childIndex) + 1), depth+1, childBounds, ref);
+}
+
+void Sampler::refineCells()
+{
+    // process the existing cells in chunks, which may be done in parallel
+    const CellEnum numCellsExisting = cells.size();
+    const ptrdiff_t numChunks = (numCellsExisting - 1) / numCellsInChunk + 1;
+    std::vector<Refinement> refinements(numChunks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(ptrdiff_t chunk=0; chunk<numChunks; chunk++) {
+        CellEnum end = std::min<CellEnum>((chunk+1) * numCellsInChunk, numCellsExisting);
+        for(CellEnum cellIndex = chunk * numCellsInChunk; cellIndex < end; cellIndex++)
+            processCell(cellIndex, /*depth not known*/ -1, /*bounds not known*/ NULL, refinements[chunk]);
+    }
+
+    // merge the results in the order of chunks: append the new cells to the end of the list
+    // and convert the local indices into global ones
+    cellsQueue.clear();
+    CellEnum base = numCellsExisting;  // global index of the first new cell of the current chunk
+    for(ptrdiff_t chunk=0; chunk<numChunks; chunk++) {
+        Refinement& ref = refinements[chunk];
+        for(size_t i=0; i<ref.splitCells.size(); i++) {
+            Cell& cell = cells[ref.splitCells[i]];
+            cell.childIndex = base + localIndex(cell.childIndex);
+        }
+        for(size_t i=0; i<ref.newCells.size(); i++) {
+            Cell cell = ref.newCells[i];
+            if(cell.parentIndex < 0)
+                cell.parentIndex = base + localIndex(cell.parentIndex);
+            if(cell.childIndex  < 0 && cell.childIndex != -1)
+                cell.childIndex  = base + localIndex(cell.childIndex);
+            cells.push_back(cell);
+        }
+        for(size_t i=0; i<ref.queue.size(); i++) {
+            CellEnum cellIndex = ref.queue[i].first;
+            PointEnum numPrev  = cellsQueue.empty() ? 0 : cellsQueue.back().second;
+            cellsQueue.push_back(std::pair<CellEnum, PointEnum>(
+                cellIndex >= 0 ? cellIndex : base + localIndex(cellIndex),
+                ref.queue[i].second + numPrev));
+        }
+        base += ref.newCells.size();
+        // release the memory as soon as possible
+        std::vector<Cell>().swap(ref.newCells);
+    }
 }
 
 void Sampler::run()
@@ -492,11 +612,9 @@ void Sampler::run()
             throw std::runtime_error("Keyboard interrupt");
         // Loop over all cells and check if there are enough sample points in the cell;
         // if not, either split the cell in two halves or schedule this cell for adding more points later.
-        // The newly added cells (after splitting) are appended to the end of the cell list,
-        // therefore the list is gradually growing, and this loop must be done sequentially.
-        cellsQueue.clear();
-        for(CellEnum cellIndex=0; cellIndex < static_cast<CellEnum>(cells.size()); cellIndex++)
-            processCell(cellIndex);
+        // The newly added cells (after splitting) are processed recursively, so that each existing
+        // cell is refined independently and the loop is parallelized.
+        refineCells();
         assert(!cellsQueue.empty());
         // find out how many new samples do we need to add, and extend the relevant arrays
         PointEnum numPointsExisting = fncValues.size();
@@ -558,15 +676,160 @@ void Sampler::drawSamples(Matrix<double>& outputSamples) const
     assert(outputIndex == numOutputSamples);
 }
 
+void Sampler::getLeafCells(std::vector<double>& bounds, std::vector<double>& maxFncValues) const
+{
+    bounds.clear();
+    maxFncValues.clear();
+    std::vector<double> cellBounds(2*Ndim);
+    for(CellEnum cellIndex = 0; cellIndex < static_cast<CellEnum>(cells.size()); cellIndex++) {
+        if(cells[cellIndex].childIndex >= 0)
+            continue;  // not a leaf cell
+        double maxFncValueCell = 0;
+        for(PointEnum pointIndex = cells[cellIndex].headPointIndex;
+            pointIndex >= 0;
+            pointIndex = nextPoint[pointIndex])
+            maxFncValueCell = std::max(maxFncValueCell, fncValues[pointIndex]);
+        getCellBoundaries(cellIndex, &cellBounds[0], &cellBounds[Ndim]);
+        bounds.insert(bounds.end(), cellBounds.begin(), cellBounds.end());
+        maxFncValues.push_back(maxFncValueCell);
+    }
+}
+
+/// multiplicative safety factor for the envelope function in SampleGenerator
+static const double envelopeFactor = 2.0;
+
+/// upper limit on the total envelope mass assigned to cells in which the function was zero
+/// at all exploration points, relative to the envelope mass of all other cells
+static const double envelopeFloorFraction = 0.01;
+
+/// number of candidate points evaluated at once in SampleGenerator
+static const size_t numCandidatesInBlock = 1024;
+
+/// pseudo-random number generator with an explicit 64-bit state (SplitMix64), used to create
+/// reproducible independent streams of random numbers for each chunk in SampleGenerator;
+/// returns a number uniformly distributed in [0:1)
+inline double randomStream(uint64_t& state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1. / 9007199254740992.);  // 53 random bits times 2^-53
+}
+
 }  // unnamed namespace
 
+SampleGenerator::SampleGenerator(const IFunctionNdim& _fnc,
+    const double xlower[], const double xupper[], const size_t numExploreSamples, const size_t _seed)
+:
+    fnc(_fnc), Ndim(fnc.numVars()), seed(_seed)
+{
+    if(fnc.numValues() != 1)
+        throw std::invalid_argument("SampleGenerator: function must provide one value");
+    // the seed of the exploration phase is derived from the base seed, so that the envelope
+    // (and hence all chunks) is fully determined by the seed
+    uint64_t state = seed;
+    Sampler sampler(fnc, xlower, xupper, numExploreSamples,
+        static_cast<size_t>(randomStream(state) * 1e6));
+    sampler.run();
+    sampler.integral(integValue, integError);
+    numCalls = sampler.numCalls();
+    std::vector<double> maxFncValues;
+    sampler.getLeafCells(cellBounds, maxFncValues);
+    // cells in which the function was zero at all exploration points may still contain regions
+    // where it is positive, so they are assigned a floor envelope value: the smallest envelope
+    // among other cells, reduced if necessary so that the total envelope mass in these cells
+    // does not exceed a small fraction of the total mass in all other cells
+    size_t numCells = maxFncValues.size();
+    std::vector<double> cellVolume(numCells, 1.);
+    double minEnvelope = INFINITY, nonzeroMass = 0, zeroVolume = 0;
+    cellFloored.assign(numCells, false);
+    numFloored = 0;
+    for(size_t c=0; c<numCells; c++) {
+        for(int d=0; d<Ndim; d++)
+            cellVolume[c] *= cellBounds[c * 2*Ndim + Ndim + d] - cellBounds[c * 2*Ndim + d];
+        if(maxFncValues[c] > 0) {
+            minEnvelope = std::min(minEnvelope, envelopeFactor * maxFncValues[c]);
+            nonzeroMass += envelopeFactor * maxFncValues[c] * cellVolume[c];
+        } else {
+            zeroVolume  += cellVolume[c];
+            cellFloored[c] = true;
+            numFloored++;
+        }
+    }
+    if(!(nonzeroMass > 0))
+        throw std::runtime_error("SampleGenerator: function is identically zero in the region");
+    floorEnvelope = numFloored > 0 ?
+        std::min(minEnvelope, envelopeFloorFraction * nonzeroMass / zeroVolume) : 0;
+    // construct the cumulative distribution of envelope mass over cells
+    cellEnvelope.resize(numCells);
+    cumulMass.assign(numCells+1, 0.);
+    for(size_t c=0; c<numCells; c++) {
+        cellEnvelope[c] = cellFloored[c] ? floorEnvelope : envelopeFactor * maxFncValues[c];
+        cumulMass[c+1]  = cumulMass[c] + cellEnvelope[c] * cellVolume[c];
+    }
+    utils::msg(utils::VL_VERBOSE, "SampleGenerator",
+        "Constructed envelope with " + utils::toString(numCells) + " cells, of which " +
+        utils::toString(numFloored) + " have the floor value " + utils::toString(floorEnvelope) +
+        "; expected acceptance rate " + utils::toString(integValue / cumulMass.back()));
+}
+
+size_t SampleGenerator::generateChunk(const size_t chunkIndex, const size_t chunkSize,
+    Matrix<double>& samples, size_t* numClipped, size_t* numInFloor) const
+{
+    samples = Matrix<double>(chunkSize, Ndim);
+    // initialize the random number stream for this chunk from the seed and the chunk index
+    uint64_t state = seed;
+    state = static_cast<uint64_t>(randomStream(state) * 9007199254740992.) ^
+        (static_cast<uint64_t>(chunkIndex) * 0xd1b54a32d192ed03ULL);
+    const size_t numCells = cellEnvelope.size();
+    const double totalMass = cumulMass.back();
+    std::vector<double> points(numCandidatesInBlock * Ndim), values(numCandidatesInBlock);
+    std::vector<size_t> cellIndices(numCandidatesInBlock);
+    size_t numAccepted = 0, numEvals = 0, numExceed = 0, numPositiveInFloor = 0;
+    while(numAccepted < chunkSize) {
+        // draw a block of candidate points from the envelope distribution
+        for(size_t b=0; b<numCandidatesInBlock; b++) {
+            size_t c = std::min<size_t>(binSearch(randomStream(state) * totalMass,
+                &cumulMass[0], numCells+1), numCells-1);
+            const double* bounds = &cellBounds[c * 2*Ndim];
+            for(int d=0; d<Ndim; d++)
+                points[b * Ndim + d] = bounds[d] + (bounds[Ndim + d] - bounds[d]) * randomStream(state);
+            cellIndices[b] = c;
+        }
+        fnc.evalmany(numCandidatesInBlock, &points[0], &values[0]);
+        numEvals += numCandidatesInBlock;
+        // accept or reject them
+        for(size_t b=0; b<numCandidatesInBlock && numAccepted < chunkSize; b++) {
+            double val = values[b], env = cellEnvelope[cellIndices[b]];
+            if(val<0 || !isFinite(val))
+                throw std::runtime_error("Error in SampleGenerator: "
+                    "function value is negative or not finite");
+            if(val > env)
+                numExceed++;
+            if(val > 0 && cellFloored[cellIndices[b]])
+                numPositiveInFloor++;
+            if(randomStream(state) * env < val) {
+                std::copy(&points[b * Ndim], &points[(b+1) * Ndim], &samples(numAccepted, 0));
+                numAccepted++;
+            }
+        }
+    }
+    if(numClipped)
+        *numClipped = numExceed;
+    if(numInFloor)
+        *numInFloor = numPositiveInFloor;
+    return numEvals;
+}
+
 void sampleNdim(const IFunctionNdim& fnc, const double xlower[], const double xupper[], 
     const size_t numSamples,
-    Matrix<double>& samples, size_t* numTrialPoints, double* integral, double* interror)
+    Matrix<double>& samples, size_t* numTrialPoints, double* integral, double* interror,
+    QuasiRandomMethod method)
 {
     if(fnc.numValues() != 1)
         throw std::invalid_argument("sampleNdim: function must provide one value");
-    Sampler sampler(fnc, xlower, xupper, numSamples);
+    Sampler sampler(fnc, xlower, xupper, numSamples, random() * 1e6, method);
     sampler.run();
     sampler.drawSamples(samples);
     // statistics
@@ -6,6 +6,7 @@
 #pragma once
 #include "math_base.h"
 #include "math_linalg.h"
+#include "math_core.h"
 
 namespace math{
 
@@ -17,6 +18,10 @@ namespace math{
     It is far more efficient to draw many samples in a single call rather than repeatedly sample
     the same function, because a significant amount of effort is spent on exploring the region
     (determining the portions where the value of the function is highest).
+    The function is evaluated and the cells are refined in parallel (F must be thread-safe);
+    the random numbers are drawn only from the calling thread, so that the output is fully
+    determined by the state of its random number generator (see `randomize()`)
+    and does not depend on the number of threads.
 
     \param[in]  F  is the probability distribution, the dimensionality N of the problem
                 is given by F.numVars();
@@ -31,9 +36,91 @@ namespace math{
                 of F over the given region (this could be compared with the exact value, if known,
                 to estimate the bias/error in sampling scheme);
     \param[out] interror (optional) if not NULL, will store the error estimate of the integral;
+    \param[in]  method  (optional) is the type of pseudo- or quasi-random sequence used to place
+                the points in cells during the exploration of the region (default is the Halton
+                sequence, which is limited to MAX_PRIMES dimensions; the Sobol sequence supports
+                up to MAX_SOBOL_DIM dimensions, and QR_NONE selects pseudo-random numbers).
  */
 void sampleNdim(const IFunctionNdim& F, const double xlower[], const double xupper[],
     const size_t numSamples,
-    Matrix<double>& samples, size_t* numTrialPoints=NULL, double* integral=NULL, double* interror=NULL);
+    Matrix<double>& samples, size_t* numTrialPoints=NULL, double* integral=NULL, double* interror=NULL,
+    QuasiRandomMethod method=QR_HALTON);
+
+
+/** Generator of samples from an N-dimensional probability distribution function F,
+    which produces the output in chunks of a fixed size, so that an arbitrarily large number
+    of samples can be drawn without keeping all of them in memory at once.
+    The constructor explores the region with the same adaptive algorithm as `sampleNdim`,
+    using a moderate number of exploration samples, and records the resulting partition
+    of the region into rectangular cells, together with the maximum value of F in each cell.
+    These cells serve as a piecewise-constant envelope for the rejection sampling of output
+    points: a cell is chosen with the probability proportional to its envelope mass, then
+    a point is drawn uniformly within it and accepted with the probability F(x) / envelope.
+    If the function exceeds the envelope (which was estimated from a finite number of points),
+    the point is accepted unconditionally, introducing a small bias; the number of such events
+    is reported by `generateChunk()`. Cells in which F was zero at all exploration points
+    receive a small floor envelope value rather than zero, so that they are not excluded from
+    sampling altogether; positive values of F encountered in these cells are reported likewise.
+    The exploration phase and each chunk use their own streams of pseudo-random numbers derived
+    from the seed (for chunks, also from the chunk index), so the content of any chunk does not
+    depend on the number of threads or on the order in which the chunks are generated,
+    and different chunks may be produced in parallel (the function F must then be thread-safe,
+    as in `sampleNdim`).
+*/
+class SampleGenerator {
+public:
+    /** explore the function and construct the envelope.
+        \param[in]  F  is the probability distribution of N variables;
+        \param[in]  xlower, xupper  are the boundaries of the sampling region (arrays of length N);
+        \param[in]  numExploreSamples  determines the resolution of the envelope (it has the same
+        meaning as the number of output samples in `sampleNdim`);
+        \param[in]  seed  is the base seed for random number streams of all chunks.
+        \throw  std::runtime_error if the function is negative, not finite or identically zero.
+    */
+    SampleGenerator(const IFunctionNdim& F, const double xlower[], const double xupper[],
+        const size_t numExploreSamples, const size_t seed=0);
+
+    /** generate a chunk of samples (may be called in parallel for different chunks).
+        \param[in]  chunkIndex  is the index of the chunk, which determines its random number stream;
+        \param[in]  chunkSize   is the number of samples in this chunk;
+        \param[out] samples     will be filled with the matrix of chunkSize rows and N columns;
+        \param[out] numClipped  (optional) if not NULL, will store the number of function values
+        that exceeded the envelope;
+        \param[out] numInFloor  (optional) if not NULL, will store the number of positive function
+        values in cells where the function was zero at all exploration points: these cells
+        are assigned a small floor envelope, so that such values indicate that the envelope
+        (and hence the resulting distribution of samples) is likely inaccurate in these regions;
+        \return  the number of function evaluations.
+    */
+    size_t generateChunk(const size_t chunkIndex, const size_t chunkSize,
+        Matrix<double>& samples, size_t* numClipped=NULL, size_t* numInFloor=NULL) const;
+
+    /** return the Monte Carlo estimate of the integral of F over the region
+        and its error, computed in the exploration phase */
+    void integral(double& value, double& error) const {
+        value = integValue;
+        error = integError;
+    }
+
+    /** return the number of function evaluations in the exploration phase */
+    size_t numExploreCalls() const { return numCalls; }
+
+    /** return the number of cells with a floor envelope value (where the function was zero
+        at all exploration points) */
+    size_t numFlooredCells() const { return numFloored; }
+
+private:
+    const IFunctionNdim& fnc;  ///< the function to be sampled
+    const int Ndim;            ///< number of dimensions
+    const size_t seed;         ///< base seed for random number streams
+    std::vector<double> cellBounds;    ///< lower and upper boundaries of all cells (flattened)
+    std::vector<double> cellEnvelope;  ///< envelope value of the function in each cell
+    std::vector<double> cumulMass;     ///< cumulative envelope mass (length: numCells+1)
+    std::vector<bool> cellFloored;     ///< whether each cell has the floor envelope value
+    double floorEnvelope;              ///< envelope value in cells where the function was zero
+    size_t numFloored;                 ///< number of such cells
+    double integValue, integError;     ///< integral of F over the region and its error
+    size_t numCalls;                   ///< number of function calls in the exploration phase
+};
 
 }  // namespace
\ No newline at end of file
@@ -619,6 +619,13 @@ BaseInterpolator1d::BaseInterpolator1d(const std::vector<double>& xv, const std:
                 utils::stacktrace());
 }
 
+void BaseInterpolator1d::evalmany(const size_t npoints, const double x[],
+    double values[], double derivs[], double derivs2[]) const
+{
+    for(size_t p=0; p<npoints; p++)
+        evalDeriv(x[p], values ? values+p : NULL, derivs ? derivs+p : NULL, derivs2 ? derivs2+p : NULL);
+}
+
 LinearInterpolator::LinearInterpolator(const std::vector<double>& xv, const std::vector<double>& yv) :
     BaseInterpolator1d(xv, yv)
 {
@@ -637,6 +644,23 @@ void LinearInterpolator::evalDeriv(const double x, double* value, double* deriv,
         *deriv2 = 0;
 }
 
+void LinearInterpolator::evalmany(const size_t npoints, const double x[],
+    double values[], double derivs[], double derivs2[]) const
+{
+    const ptrdiff_t size = xval.size();
+    ptrdiff_t index = -1;
+    for(size_t p=0; p<npoints; p++) {
+        index = binSearchHint(x[p], &xval[0], size, index);
+        ptrdiff_t i = std::max<ptrdiff_t>(0, std::min<ptrdiff_t>(size-2, index));
+        if(values)
+            values[p] = linearInterp(x[p], xval[i], xval[i+1], fval[i], fval[i+1]);
+        if(derivs)
+            derivs[p] = (fval[i+1]-fval[i]) / (xval[i+1]-xval[i]);
+        if(derivs2)
+            derivs2[p] = 0;
+    }
+}
+
 
 //-------------- CUBIC SPLINE --------------//
 
@@ -727,6 +751,26 @@ void CubicSpline::evalDeriv(const double x, double* val, double* deriv, double*
         /*output*/ val, deriv, deriv2);
 }
 
+void CubicSpline::evalmany(const size_t npoints, const double x[],
+    double values[], double derivs[], double derivs2[]) const
+{
+    const ptrdiff_t size = xval.size();
+    if(size == 0)
+        throw std::length_error("Empty spline");
+    ptrdiff_t index = -1;
+    for(size_t p=0; p<npoints; p++) {
+        index = binSearchHint(x[p], &xval[0], size, index);
+        double *val = values ? values+p : NULL, *der = derivs ? derivs+p : NULL,
+            *der2 = derivs2 ? derivs2+p : NULL;
+        if(index < 0 || index >= size-1)  // extrapolation is handled by the ordinary routine
+            evalDeriv(x[p], val, der, der2);
+        else
+            evalCubicSplines<1> (x[p], xval[index], xval[index+1],
+                &fval[index], &fval[index+1], &fder[index], &fder[index+1],
+                /*output*/ val, der, der2);
+    }
+}
+
 bool CubicSpline::isMonotonic() const
 {
     if(fval.empty())
@@ -857,6 +901,27 @@ void QuinticSpline::evalDeriv(const double x, double* val, double* deriv, double
         /*output*/ val, deriv, deriv2);
 }
 
+void QuinticSpline::evalmany(const size_t npoints, const double x[],
+    double values[], double derivs[], double derivs2[]) const
+{
+    const ptrdiff_t size = xval.size();
+    if(size == 0)
+        throw std::length_error("Empty spline");
+    ptrdiff_t index = -1;
+    for(size_t p=0; p<npoints; p++) {
+        index = binSearchHint(x[p], &xval[0], size, index);
+        double *val = values ? values+p : NULL, *der = derivs ? derivs+p : NULL,
+            *der2 = derivs2 ? derivs2+p : NULL;
+        if(index < 0 || index >= size-1)
+            evalDeriv(x[p], val, der, der2);
+        else
+            evalQuinticSplines<1> (x[p], xval[index], xval[index+1],
+                &fval[index], &fval[index+1], &fder[index], &fder[index+1],
+                &fder2[index], &fder2[index+1],
+                /*output*/ val, der, der2);
+    }
+}
+
 
 // ------ Doubly-log-scaled spline ------ //
 
@@ -998,10 +1063,28 @@ LogLogSpline::LogLogSpline(const std::vector<double>& xvalues, const std::vector
 
 void LogLogSpline::evalDeriv(const double x, double* value, double* deriv, double* deriv2) const
 {
-    int size = xval.size();
-    if(size == 0)
+    if(xval.empty())
         throw std::length_error("Empty spline");
-    int index = binSearch(x, &xval[0], size);
+    evalSegment(x, binSearch(x, &xval[0], xval.size()), value, deriv, deriv2);
+}
+
+void LogLogSpline::evalmany(const size_t npoints, const double x[],
+    double values[], double derivs[], double derivs2[]) const
+{
+    if(xval.empty())
+        throw std::length_error("Empty spline");
+    ptrdiff_t index = -1;
+    for(size_t p=0; p<npoints; p++) {
+        index = binSearchHint(x[p], &xval[0], xval.size(), index);
+        evalSegment(x[p], index, values ? values+p : NULL,
+            derivs ? derivs+p : NULL, derivs2 ? derivs2+p : NULL);
+    }
+}
+
+void LogLogSpline::evalSegment(const double x, ptrdiff_t index,
+    double* value, double* deriv, double* deriv2) const
+{
+    const ptrdiff_t size = xval.size();
     double logx = log(x);
 
     if(index < 0 || index >= size-1) {
@@ -1759,11 +1842,30 @@ QuinticSpline2d::QuinticSpline2d(const std::vector<double>& xgrid, const std::ve
     }
 }
 
+inline void QuinticSpline2d::nodeValues(const size_t index, double values[9]) const
+{
+    if(!packed.empty()) {
+        const float* node = &packed[index * 9];
+        for(int k=0; k<9; k++)
+            values[k] = node[k];
+        return;
+    }
+    values[0] = fval [index];
+    values[1] = fx   [index];
+    values[2] = fy   [index];
+    values[3] = fxx  [index];
+    values[4] = fxy  [index];
+    values[5] = fyy  [index];
+    values[6] = fxxy [index];
+    values[7] = fxyy [index];
+    values[8] = fxxyy[index];
+}
+
 void QuinticSpline2d::evalDeriv(const double x, const double y,
     double* z, double* z_x, double* z_y,
     double* z_xx, double* z_xy, double* z_yy) const
 {
-    if(fval.empty())
+    if(xval.empty())
         throw std::length_error("Empty 2d spline");
     const int
         nx = xval.size(),
@@ -1793,6 +1895,12 @@ void QuinticSpline2d::evalDeriv(const double x, const double y,
     }
     bool der  = z_y!=NULL || z_xy!=NULL;
     bool der2 = z_yy!=NULL;
+    // values and derivatives at the corners of the cell: f, fx, fy, fxx, fxy, fyy, fxxy, fxyy, fxxyy
+    double cll[9], clu[9], cul[9], cuu[9];
+    nodeValues(ill, cll);
+    nodeValues(ilu, clu);
+    nodeValues(iul, cul);
+    nodeValues(iuu, cuu);
     const double
         // coordinates of corner points
         xlow = xval[xi],
@@ -1801,18 +1909,14 @@ void QuinticSpline2d::evalDeriv(const double x, const double y,
         yupp = yval[yi+1],
         // shift the four corner points by the same offset (pick up one of the four corner values),
         // to avoid roundoff errors in intermediate calculations; add it back to final output
-        f_offset = x==xupp ? (y==yupp ? fval[iuu] : fval[iul]) : (y==yupp ? fval[ilu] : fval[ill]),
-        fval_ill = fval[ill] - f_offset,
-        fval_iul = fval[iul] - f_offset,
-        fval_ilu = fval[ilu] - f_offset,
-        fval_iuu = fval[iuu] - f_offset,
+        f_offset = x==xupp ? (y==yupp ? cuu[0] : cul[0]) : (y==yupp ? clu[0] : cll[0]),
         // values and derivatives for the intermediate splines
-        fl [6] = { fval_ill , fval_iul , fx  [ill], fx  [iul], fxx  [ill], fxx  [iul] },
-        fu [6] = { fval_ilu , fval_iuu , fx  [ilu], fx  [iuu], fxx  [ilu], fxx  [iuu] },
-        f1l[6] = { fy  [ill], fy  [iul], fxy [ill], fxy [iul], fxxy [ill], fxxy [iul] },
-        f1u[6] = { fy  [ilu], fy  [iuu], fxy [ilu], fxy [iuu], fxxy [ilu], fxxy [iuu] },
-        f2l[6] = { fyy [ill], fyy [iul], fxyy[ill], fxyy[iul], fxxyy[ill], fxxyy[iul] },
-        f2u[6] = { fyy [ilu], fyy [iuu], fxyy[ilu], fxyy[iuu], fxxyy[ilu], fxxyy[iuu] };
+        fl [6] = { cll[0]-f_offset, cul[0]-f_offset, cll[1], cul[1], cll[3], cul[3] },
+        fu [6] = { clu[0]-f_offset, cuu[0]-f_offset, clu[1], cuu[1], clu[3], cuu[3] },
+        f1l[6] = { cll[2], cul[2], cll[4], cul[4], cll[6], cul[6] },
+        f1u[6] = { clu[2], cuu[2], clu[4], cuu[4], clu[6], cuu[6] },
+        f2l[6] = { cll[5], cul[5], cll[7], cul[7], cll[8], cul[8] },
+        f2u[6] = { clu[5], cuu[5], clu[7], cuu[7], clu[8], cuu[8] };
     // compute intermediate splines
     double
         F  [6],  // {   f    (xlow/upp, y),  df/dx   (xl/u, y), d2f/dx2   (xl/u, y) }
@@ -1833,6 +1937,44 @@ void QuinticSpline2d::evalDeriv(const double x, const double y,
             /*output*/ z_yy, NULL, NULL);
 }
 
+double QuinticSpline2d::convertToSinglePrecision()
+{
+    if(xval.empty() || !packed.empty())
+        return 0;
+    const size_t nx = xval.size(), ny = yval.size(), nnodes = nx * ny;
+    // reference values at the centres of grid cells, computed with the original tables
+    std::vector<double> before((nx-1) * (ny-1));
+    for(size_t i=0; i<nx-1; i++)
+        for(size_t j=0; j<ny-1; j++)
+            evalDeriv(0.5 * (xval[i] + xval[i+1]), 0.5 * (yval[j] + yval[j+1]), &before[i * (ny-1) + j]);
+    double maxval = 0;
+    std::vector<float> tmp(nnodes * 9);
+    for(size_t n=0; n<nnodes; n++) {
+        double node[9];
+        nodeValues(n, node);
+        for(int k=0; k<9; k++)
+            tmp[n * 9 + k] = static_cast<float>(node[k]);
+        maxval = fmax(maxval, fabs(node[0]));
+    }
+    // switch to the new storage and release the old one
+    packed.swap(tmp);
+    std::vector<double>().swap(fval);
+    std::vector<double>().swap(fx);
+    std::vector<double>().swap(fy);
+    std::vector<double>().swap(fxx);
+    std::vector<double>().swap(fxy);
+    std::vector<double>().swap(fyy);
+    std::vector<double>().swap(fxxy);
+    std::vector<double>().swap(fxyy);
+    std::vector<double>().swap(fxxyy);
+    double maxdif = 0;
+    for(size_t i=0; i<nx-1; i++)
+        for(size_t j=0; j<ny-1; j++)
+            maxdif = fmax(maxdif, fabs(before[i * (ny-1) + j] -
+                value(0.5 * (xval[i] + xval[i+1]), 0.5 * (yval[j] + yval[j+1]))));
+    return maxval>0 ? maxdif / maxval : maxdif;
+}
+
 
 // ------- Interpolation in 3d ------- //
 
@@ -2015,6 +2157,24 @@ CubicSpline3d::CubicSpline3d(const std::vector<double>& xnodes, const std::vecto
         }
 }
 
+inline void CubicSpline3d::nodeValues(const size_t index, double values[8]) const
+{
+    if(!packed.empty()) {
+        const float* node = &packed[index * 8];
+        for(int k=0; k<8; k++)
+            values[k] = node[k];
+        return;
+    }
+    values[0] = fval[index];
+    values[1] = fx  [index];
+    values[2] = fy  [index];
+    values[3] = fz  [index];
+    values[4] = fxy [index];
+    values[5] = fxz [index];
+    values[6] = fyz [index];
+    values[7] = fxyz[index];
+}
+
 double CubicSpline3d::value(double x, double y, double z) const
 {
     const int
@@ -2044,24 +2204,32 @@ double CubicSpline3d::value(double x, double y, double z) const
     ylow = yval[yi],
     yupp = yval[yi+1],
     zlow = zval[zi],
-    zupp = zval[zi+1],
-    // 1st stage: interpolate along x axis to obtain  f, f_y, f_z, f_yz  at four corners of the y-z cell
-    fl [16] = { fval[illl], fval[illu], fz  [illl], fz  [illu],
-                fval[ilul], fval[iluu], fz  [ilul], fz  [iluu],
-                fy  [illl], fy  [illu], fyz [illl], fyz [illu],
-                fy  [ilul], fy  [iluu], fyz [ilul], fyz [iluu] },
-    fu [16] = { fval[iull], fval[iulu], fz  [iull], fz  [iulu],
-                fval[iuul], fval[iuuu], fz  [iuul], fz  [iuuu],
-                fy  [iull], fy  [iulu], fyz [iull], fyz [iulu],
-                fy  [iuul], fy  [iuuu], fyz [iuul], fyz [iuuu] },
-    fxl[16] = { fx  [illl], fx  [illu], fxz [illl], fxz [illu],
-                fx  [ilul], fx  [iluu], fxz [ilul], fxz [iluu],
-                fxy [illl], fxy [illu], fxyz[illl], fxyz[illu],
-                fxy [ilul], fxy [iluu], fxyz[ilul], fxyz[iluu] },
-    fxu[16] = { fx  [iull], fx  [iulu], fxz [iull], fxz [iulu],
-                fx  [iuul], fx  [iuuu], fxz [iuul], fxz [iuuu],
-                fxy [iull], fxy [iulu], fxyz[iull], fxyz[iulu],
-                fxy [iuul], fxy [iuuu], fxyz[iuul], fxyz[iuuu] };
+    zupp = zval[zi+1];
+    // values and derivatives at the corners of the cell: f, fx, fy, fz, fxy, fxz, fyz, fxyz
+    double c[8][8];
+    nodeValues(illl, c[0]);
+    nodeValues(illu, c[1]);
+    nodeValues(ilul, c[2]);
+    nodeValues(iluu, c[3]);
+    nodeValues(iull, c[4]);
+    nodeValues(iulu, c[5]);
+    nodeValues(iuul, c[6]);
+    nodeValues(iuuu, c[7]);
+    // 1st stage: interpolate along x axis to obtain  f, f_y, f_z, f_yz  at four corners of the y-z cell;
+    // the input arrays for the lower and upper x nodes are assembled from corners 0-3 and 4-7,
+    // taking either the function and its y,z-derivatives, or their x-derivatives
+    double fl[16], fu[16], fxl[16], fxu[16];
+    for(int h=0; h<2; h++) {
+        const double (*C)[8] = c + 4*h;
+        for(int d=0; d<2; d++) {
+            double* out = h ? (d ? fxu : fu) : (d ? fxl : fl);
+            const int F = d ? 1 : 0, FZ = d ? 5 : 3, FY = d ? 4 : 2, FYZ = d ? 7 : 6;
+            out[ 0] = C[0][F ];  out[ 1] = C[1][F ];  out[ 2] = C[0][FZ ];  out[ 3] = C[1][FZ ];
+            out[ 4] = C[2][F ];  out[ 5] = C[3][F ];  out[ 6] = C[2][FZ ];  out[ 7] = C[3][FZ ];
+            out[ 8] = C[0][FY];  out[ 9] = C[1][FY];  out[10] = C[0][FYZ];  out[11] = C[1][FYZ];
+            out[12] = C[2][FY];  out[13] = C[3][FY];  out[14] = C[2][FYZ];  out[15] = C[3][FYZ];
+        }
+    }
     double F[16];
     evalCubicSplines<16>(x, xlow, xupp, fl, fu, fxl, fxu, /*output*/ F, NULL, NULL);
     // 2nd stage: interpolate along y axis to obtain f(x,y,zlow), f(x,y,zupp), fz(x,y,zlow), fz(x,y,zupp)
@@ -2073,6 +2241,47 @@ double CubicSpline3d::value(double x, double y, double z) const
     return val;
 }
 
+double CubicSpline3d::convertToSinglePrecision()
+{
+    if(xval.empty() || !packed.empty())
+        return 0;
+    const size_t nx = xval.size(), ny = yval.size(), nz = zval.size(), nnodes = nx * ny * nz;
+    // reference values at the centres of grid cells, computed with the original tables
+    std::vector<double> before((nx-1) * (ny-1) * (nz-1));
+    for(size_t i=0; i<nx-1; i++)
+        for(size_t j=0; j<ny-1; j++)
+            for(size_t k=0; k<nz-1; k++)
+                before[(i * (ny-1) + j) * (nz-1) + k] = value(0.5 * (xval[i] + xval[i+1]),
+                    0.5 * (yval[j] + yval[j+1]), 0.5 * (zval[k] + zval[k+1]));
+    double maxval = 0;
+    std::vector<float> tmp(nnodes * 8);
+    for(size_t n=0; n<nnodes; n++) {
+        double node[8];
+        nodeValues(n, node);
+        for(int k=0; k<8; k++)
+            tmp[n * 8 + k] = static_cast<float>(node[k]);
+        maxval = fmax(maxval, fabs(node[0]));
+    }
+    // switch to the new storage and release the old one
+    packed.swap(tmp);
+    std::vector<double>().swap(fval);
+    std::vector<double>().swap(fx);
+    std::vector<double>().swap(fy);
+    std::vector<double>().swap(fz);
+    std::vector<double>().swap(fxy);
+    std::vector<double>().swap(fxz);
+    std::vector<double>().swap(fyz);
+    std::vector<double>().swap(fxyz);
+    double maxdif = 0;
+    for(size_t i=0; i<nx-1; i++)
+        for(size_t j=0; j<ny-1; j++)
+            for(size_t k=0; k<nz-1; k++)
+                maxdif = fmax(maxdif, fabs(before[(i * (ny-1) + j) * (nz-1) + k] -
+                    value(0.5 * (xval[i] + xval[i+1]),
+                    0.5 * (yval[j] + yval[j+1]), 0.5 * (zval[k] + zval[k+1]))));
+    return maxval>0 ? maxdif / maxval : maxdif;
+}
+
 
 // ------ 3d B-spline interpolator ------ //
 
@@ -2342,6 +2551,94 @@ template std::vector<double> createBsplineInterpolator3dArrayFromSamples<3>(
 
 //-------------- PENALIZED SPLINE APPROXIMATION ---------------//
 
+namespace{
+
+/// minimum number of data points processed as a single unit in the accumulation of normal equations
+static const ptrdiff_t SPLINEAPPROX_MIN_CHUNK = 16384;
+
+/// maximum number of such units (determines the size of temporary storage for partial sums)
+static const ptrdiff_t SPLINEAPPROX_MAX_CHUNKS = 256;
+
+/** Accumulate the contributions of data points to the system of normal equations for SplineApprox:
+    the banded symmetric matrix  C = B^T W B  (only its upper triangle, stored as numKnots rows
+    of 4 elements:  band[k*4+d] = C(k, k+d) ),  the r.h.s. vector  z = B^T W y,  and the weighted
+    norm  y^T W y,  where B is the matrix of basis function values at data points (not stored).
+    The loop is parallelized over chunks of data points, each one producing its own partial sums,
+    which are then combined in a fixed order, so that the result does not depend on the number
+    of threads.
+    \param[in]  knots  is the array of knots defining the basis functions;
+    \param[in]  numKnots  is its length;
+    \param[in]  npoints  is the number of data points;
+    \param[in]  x  is the array of their coordinates;
+    \param[in]  y  is the array of data values (if NULL, zRHS and ynorm2 are not computed);
+    \param[in]  w  is the array of weights (if NULL, weights are unity);
+    \param[in,out]  band  if not NULL, the elements of matrix C are added to this array;
+    \param[in,out]  zRHS  the elements of z are added to this array (if y is not NULL);
+    \param[in,out]  ynorm2  the norm of y is added to this variable (if y is not NULL).
+*/
+void accumulateNormalEquations(const double knots[], const unsigned int numKnots,
+    const ptrdiff_t npoints, const double x[], const double y[], const double w[],
+    double band[], double zRHS[], double& ynorm2)
+{
+    if(npoints <= 0)
+        return;
+    const ptrdiff_t
+        chunk     = std::max(SPLINEAPPROX_MIN_CHUNK, (npoints-1) / SPLINEAPPROX_MAX_CHUNKS + 1),
+        numChunks = (npoints-1) / chunk + 1;
+    // layout of partial sums for each chunk: band (4 per knot), then z (1 per knot), then ynorm2
+    const ptrdiff_t stride = numKnots * 5 + 1;
+    std::vector<double> partial(numChunks * stride, 0.);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(ptrdiff_t c=0; c<numChunks; c++) {
+        double *pband = &partial[c * stride], *pz = pband + numKnots * 4, *pnorm = pz + numKnots;
+        const ptrdiff_t end = std::min(npoints, (c+1) * chunk);
+        for(ptrdiff_t i = c * chunk; i < end; i++) {
+            // for each input point, at most 4 basis functions are non-zero, starting from index 'ind'
+            double Bspl[4], weight = w ? w[i] : 1.;
+            int ind = bsplineNaturalCubicValues(x[i], knots, numKnots, Bspl);
+            assert(ind>=0 && ind<=(int)numKnots-2);
+            unsigned int nvals = std::min<unsigned int>(4, numKnots-ind);
+            if(band)
+                for(unsigned int p=0; p<nvals; p++)
+                    for(unsigned int q=p; q<nvals; q++)
+                        pband[(ind+p) * 4 + q-p] += weight * Bspl[p] * Bspl[q];
+            if(y) {
+                double wy = weight * y[i];
+                for(unsigned int p=0; p<nvals; p++)
+                    pz[ind+p] += wy * Bspl[p];
+                *pnorm += wy * y[i];
+            }
+        }
+    }
+    for(ptrdiff_t c=0; c<numChunks; c++) {
+        const double *pband = &partial[c * stride], *pz = pband + numKnots * 4;
+        if(band)
+            for(unsigned int k=0; k<numKnots*4; k++)
+                band[k] += pband[k];
+        if(y) {
+            for(unsigned int k=0; k<numKnots; k++)
+                zRHS[k] += pz[k];
+            ynorm2 += pz[numKnots];
+        }
+    }
+}
+
+/// check that the weights are non-negative and return their sum
+double sumOfWeights(const std::vector<double>& weights)
+{
+    double sum = 0;
+    for(size_t i=0; i<weights.size(); i++) {
+        if(weights[i] < 0)
+            throw std::invalid_argument("SplineApprox: weights must be non-negative");
+        sum += weights[i];
+    }
+    return sum;
+}
+
+}  // internal namespace
+
 /// Implementation of penalized spline approximation
 class SplineApproxImpl {
 public:
@@ -2349,22 +2646,26 @@ public:
     const unsigned int numKnots;
 
     /// number of x[i],y[i] pairs (original data, can be large)
-    const ptrdiff_t numDataPoints;
+    ptrdiff_t numDataPoints;
 
     /// sum of weights of all point weights, or their total number if weights not provided
     double sumWeights;
 
+    /// whether the object operates in the streaming mode (data points are added by addPoints)
+    const bool streaming;
+
 private:
     const std::vector<double> knots;   ///< b-spline knots  X[k], k=0..numKnots-1
-    const std::vector<double> xvalues; ///< x[i], i=0..numDataPoints-1
-    const std::vector<double> weights; ///< w[i], i=0..numDataPoints-1
+    const std::vector<double> xvalues; ///< x[i], i=0..numDataPoints-1 (empty in the streaming mode)
+    const std::vector<double> weights; ///< w[i], i=0..numDataPoints-1 (empty in the streaming mode)
 
-    /// sparse matrix  B  containing the values of each basis function at each data point:
-    /// (size: numDataPoints rows, numBasisFnc columns, with only 4 nonzero values in each row)
-    SparseMatrixSpecial<4> BMatrix;
+    /// in the streaming mode, the accumulated upper band of the matrix  C = B^T W B  (numKnots*4),
+    /// the r.h.s. of the normal equations  z = B^T W y,  and the weighted norm  y^T W y
+    std::vector<double> accBand, accZ;
+    double accYnorm2;
 
-    /// an intermediate matrix  B^T W B  describes the system of normal equations (where W=diag(w)),
-    /// and the lower triangular matrix L contains its Cholesky decomposition (size: numBasisFnc^2)
+    /// the lower triangular matrix L contains the Cholesky decomposition of the matrix of
+    /// normal equations  C = B^T W B,  where W=diag(w) (size: numBasisFnc^2)
     Matrix<double> LMatrix;
 
     /// matrix "M" is the transformed version of roughness matrix R, which contains
@@ -2393,26 +2694,42 @@ public:
         const std::vector<double>& xvalues,
         const std::vector<double>& weights);
 
+    /** Create an empty object in the streaming mode */
+    explicit SplineApproxImpl(const std::vector<double>& knots);
+
+    /** Add data points in the streaming mode and update the internal tables */
+    void addPoints(const std::vector<double>& xvalues, const std::vector<double>& yvalues,
+        const std::vector<double>& weights);
+
+    /** Initialize temporary arrays used in the fitting process for the provided data vector y,
+        in the case that the normal equations are not singular.
+        \param[in]  yvalues is the vector of data values `y` at each data point;
+        \returns    the data structure used by other methods later in the fitting process
+    */
+    FitData initFit(const std::vector<double>& yvalues) const;
+
+    /** Same as above, for the data values accumulated in the streaming mode */
+    FitData initFit() const;
+
     /** find the amplitudes of basis functions that provide the best fit to the data points `y`
         for the given value of smoothing parameter `lambda`, determined indirectly by EDF.
-        \param[in]  yvalues  are the data values corresponding to x-coordinates
-        that were provided to the constructor;
+        \param[in]  fitData  contains the pre-initialized auxiliary arrays constructed by `initFit()`;
         \param[in]  EDF  is the equivalent number of degrees of freedom (2<=EDF<=numBasisFnc);
         \param[out] ampl  will contain the computed amplitudes of basis functions;
         \param[out] RSS  will contain the residual sum of squared differences between data and appxox;
     */
-    void solveForAmplitudesWithEDF(const std::vector<double>& yvalues, double EDF,
+    void solveForAmplitudesWithEDF(const FitData& fitData, double EDF,
         std::vector<double>& ampl, double& RSS) const;
 
     /** find the amplitudes of basis functions that provide the best fit to the data points `y`
         with the Akaike information criterion (AIC) being offset by deltaAIC from its minimum value
         (the latter corresponding to the case of optimal smoothing).
-        \param[in]  yvalues  are the data values;
+        \param[in]  fitData  contains the pre-initialized auxiliary arrays;
         \param[in]  deltaAIC is the offset of AIC (0 means the optimally smoothed spline);
         \param[out] ampl  will contain the computed amplitudes of basis functions;
         \param[out] RSS,EDF  same as in the previous function;
     */
-    void solveForAmplitudesWithAIC(const std::vector<double>& yvalues, double deltaAIC,
+    void solveForAmplitudesWithAIC(const FitData& fitData, double deltaAIC,
         std::vector<double>& ampl, double& RSS, double& EDF) const;
 
     /** Obtain the best-fit solution for the given value of smoothing parameter lambda
@@ -2426,12 +2743,13 @@ public:
         std::vector<double>& ampl, double& RSS, double& EDF) const;
 
 private:
-    /** Initialize temporary arrays used in the fitting process for the provided data vector y,
-        in the case that the normal equations are not singular.
-        \param[in]  yvalues is the vector of data values `y` at each data point;
-        \returns    the data structure used by other methods later in the fitting process
+    /** Compute the decomposition of the matrix of normal equations and the roughness matrix
+        (matrices L, M and the array of singular values), given the upper band of the former.
     */
-    FitData initFit(const std::vector<double>& yvalues) const;
+    void initDecomposition(const std::vector<double>& band);
+
+    /** Initialize the matrix A and check the validity of knots */
+    void initKnots();
 };
 
 SplineApproxImpl::SplineApproxImpl(const std::vector<double> &_knots,
@@ -2439,10 +2757,11 @@ SplineApproxImpl::SplineApproxImpl(const std::vector<double> &_knots,
 :
     numKnots(_knots.size()),
     numDataPoints(_xvalues.size()),
+    streaming(false),
     knots(_knots),
     xvalues(_xvalues),
     weights(_weights),
-    BMatrix(numDataPoints, numKnots)
+    accYnorm2(0)
 {
     if(numKnots <= 1 || numDataPoints < 4)
         throw std::invalid_argument("SplineApprox: incorrect size of the problem");
@@ -2452,34 +2771,62 @@ SplineApproxImpl::SplineApproxImpl(const std::vector<double> &_knots,
     } else {
         if(weights.size()!=(size_t)numDataPoints)
             throw std::length_error("SplineApprox: xvalues and weights must have equal length");
-        sumWeights = 0;
-        for(ptrdiff_t i=0; i<numDataPoints; i++) {
-            if(weights[i] < 0)
-                throw std::invalid_argument("SplineApprox: weights must be non-negative");
-            sumWeights += weights[i];
-        }
+        sumWeights = sumOfWeights(weights);
         if(sumWeights == 0)
             throw std::invalid_argument("SplineApprox: sum of all weights must positive");
     }
+    initKnots();
+
+    // compute the symmetric matrix  C = B^T diag(w) B  in a single pass over data points
+    std::vector<double> band(numKnots * 4, 0.);
+    double unused = 0;
+    accumulateNormalEquations(&knots[0], numKnots, numDataPoints, &xvalues[0], /*y*/ NULL,
+        weights.empty() ? NULL : &weights[0], /*output*/ &band[0], NULL, unused);
+    initDecomposition(band);
+}
 
+SplineApproxImpl::SplineApproxImpl(const std::vector<double> &_knots)
+:
+    numKnots(_knots.size()),
+    numDataPoints(0),
+    sumWeights(0),
+    streaming(true),
+    knots(_knots),
+    accBand(numKnots * 4, 0.),
+    accZ(numKnots, 0.),
+    accYnorm2(0)
+{
+    if(numKnots <= 1)
+        throw std::invalid_argument("SplineApprox: incorrect size of the problem");
+    initKnots();
+}
+
+void SplineApproxImpl::initKnots()
+{
     for(unsigned int k=1; k<numKnots; k++)
         if(!(knots[k] > knots[k-1]))
             throw std::invalid_argument("SplineApprox: knots must be in ascending order");
 
-    // initialize b-spline matrix B
-#ifdef _OPENMP
-#pragma omp parallel for schedule(static)
-#endif
-    for(ptrdiff_t i=0; i<numDataPoints; i++) {
-        // for each input point, at most 4 basis functions are non-zero, starting from index 'ind'
+    // initialize the auxiliary matrix A that converts amplitudes of B-spline representation
+    // of the fitted function into the values of interpolated function at grid knots;
+    // there are at most 3 nonzero basis functions at each node, arranged into a tridiagonal matrix
+    AMatrix = BandMatrix<double>(numKnots, 1, 0.);
+    for(unsigned int k=0; k<numKnots; k++) {
         double Bspl[4];
-        int ind = bsplineNaturalCubicValues(xvalues[i], &knots[0], numKnots, Bspl);
-        assert(ind>=0 && ind<=(int)numKnots-2);
-        BMatrix.assignRow(i, ind, Bspl);
+        int ind = bsplineNaturalCubicValues(knots[k], &knots[0], numKnots, Bspl);
+        for(int j=0; j<=3; j++)
+            if(Bspl[j]!=0)  // the entries outside the main and two adjacent diagonals must be zero
+                AMatrix(k, j+ind) = Bspl[j];
     }
+}
 
-    // compute the symmetric matrix  C = B^T diag(w) B
-    Matrix<double> CMatrix(BMatrix.multiplyByTransposed(weights));
+void SplineApproxImpl::initDecomposition(const std::vector<double>& band)
+{
+    // unpack the symmetric banded matrix C from its upper band
+    Matrix<double> CMatrix(numKnots, numKnots, 0.);
+    for(unsigned int k=0; k<numKnots; k++)
+        for(unsigned int d=0; d<4 && k+d<numKnots; d++)
+            CMatrix(k, k+d) = CMatrix(k+d, k) = band[k * 4 + d];
 
     // compute the roughness matrix R (integrals over products of second derivatives of basis functions)
     //Matrix<double> RMatrix(computeOverlapMatrix<3,2>(knots));
@@ -2511,39 +2858,62 @@ SplineApproxImpl::SplineApproxImpl(const std::vector<double> &_knots,
     blas_dtrsm(CblasLeft, CblasLower, CblasTrans, CblasNonUnit, 1, LMatrix, MMatrix);
     // now M is finally in place, and the amplitudes for any lambda are given by
     // M (I + lambda * diag(singValues))^{-1} M^T  z
+}
 
-    // initialize the auxiliary matrix A that converts amplitudes of B-spline representation
-    // of the fitted function into the values of interpolated function at grid knots;
-    // there are at most 3 nonzero basis functions at each node, arranged into a tridiagonal matrix
-    AMatrix = BandMatrix<double>(numKnots, 1, 0.);
-    for(unsigned int k=0; k<numKnots; k++) {
-        double Bspl[4];
-        int ind = bsplineNaturalCubicValues(knots[k], &knots[0], numKnots, Bspl);
-        for(int j=0; j<=3; j++)
-            if(Bspl[j]!=0)  // the entries outside the main and two adjacent diagonals must be zero
-                AMatrix(k, j+ind) = Bspl[j];
-    }
+void SplineApproxImpl::addPoints(const std::vector<double>& xval, const std::vector<double>& yval,
+    const std::vector<double>& wval)
+{
+    if(!streaming)
+        throw std::runtime_error("SplineApprox: data points may only be added in the streaming mode");
+    if(xval.size() != yval.size() || (!wval.empty() && wval.size() != xval.size()))
+        throw std::length_error("SplineApprox: input array sizes do not match");
+    if(xval.empty())
+        return;
+    double sumw = wval.empty() ? xval.size() : sumOfWeights(wval);
+    accumulateNormalEquations(&knots[0], numKnots, xval.size(), &xval[0], &yval[0],
+        wval.empty() ? NULL : &wval[0], /*output*/ &accBand[0], &accZ[0], accYnorm2);
+    numDataPoints += xval.size();
+    sumWeights    += sumw;
+    // the decomposition costs O(numKnots^3) operations, negligible compared to the accumulation
+    // step for any reasonably large batch of points; it is performed only when the problem
+    // becomes well-defined
+    if(numDataPoints >= 4 && sumWeights > 0)
+        initDecomposition(accBand);
 }
 
 // initialize the temporary arrays used in the fitting process for the given vector of values 'y'
 SplineApproxImpl::FitData SplineApproxImpl::initFit(const std::vector<double> &yvalues) const
 {
+    if(streaming)
+        throw std::runtime_error("SplineApprox: in the streaming mode, data values must be provided "
+            "by addPoints()");
     if(yvalues.size() != (size_t)numDataPoints)
         throw std::length_error("SplineApprox: input array sizes do not match");
     FitData fitData;
     fitData.ynorm2 = 0;
-    if(weights.empty())
-        for(ptrdiff_t i=0; i<numDataPoints; i++)
-            fitData.ynorm2 += pow_2(yvalues[i]);
-    else
-        for(ptrdiff_t i=0; i<numDataPoints; i++)
-            fitData.ynorm2 += weights[i] * pow_2(yvalues[i]);
-    fitData.zRHS = BMatrix.multiplyByVector(yvalues, weights);   // precompute z = B^T diag(w) y
+    fitData.zRHS.assign(numKnots, 0.);
+    // precompute z = B^T diag(w) y  and  y^T diag(w) y
+    accumulateNormalEquations(&knots[0], numKnots, numDataPoints, &xvalues[0], &yvalues[0],
+        weights.empty() ? NULL : &weights[0], /*band*/ NULL, /*output*/ &fitData.zRHS[0], fitData.ynorm2);
     fitData.MTz.resize(numKnots);
     blas_dgemv(CblasTrans, 1, MMatrix, fitData.zRHS, 0, fitData.MTz); // precompute M^T z
     return fitData;
 }
 
+SplineApproxImpl::FitData SplineApproxImpl::initFit() const
+{
+    if(!streaming)
+        throw std::runtime_error("SplineApprox: data values must be provided for fitting");
+    if(numDataPoints < 4 || sumWeights == 0)
+        throw std::invalid_argument("SplineApprox: incorrect size of the problem");
+    FitData fitData;
+    fitData.ynorm2 = accYnorm2;
+    fitData.zRHS   = accZ;
+    fitData.MTz.resize(numKnots);
+    blas_dgemv(CblasTrans, 1, MMatrix, fitData.zRHS, 0, fitData.MTz);
+    return fitData;
+}
+
 namespace{  // a few helper routines and classes
 
 // compute the number of equivalent degrees of freedom
@@ -2599,6 +2969,9 @@ public:
 
 /// relative tolerance for finding the appropriate value of smoothing parameter
 static const double EPS_LAMBDA = 1e-6;
+
+/// number of intervals in the preliminary scan of AIC as a function of scaled smoothing parameter
+static const int NUM_SCAN_LAMBDA = 64;
 }  // internal namespace
 
 // obtain solution of linear system for the given smoothing parameter,
@@ -2630,7 +3003,7 @@ void SplineApproxImpl::computeAmplitudes(const FitData &fitData, double lambda,
     blas_dgemv(CblasNoTrans, 1, AMatrix, ampl, 0, result);
 }
 
-void SplineApproxImpl::solveForAmplitudesWithEDF(const std::vector<double> &yvalues, double EDF,
+void SplineApproxImpl::solveForAmplitudesWithEDF(const FitData &fitData, double EDF,
     std::vector<double> &ampl, double &RSS) const
 {
     if(EDF==0)
@@ -2640,19 +3013,36 @@ void SplineApproxImpl::solveForAmplitudesWithEDF(const std::vector<double> &yval
             "(requested "+utils::toString(EDF)+", valid range is 2-"+utils::toString(numKnots)+")");
     // find root using a log-scaling for lambda
     double lambda = findRoot(SplineEDFRootFinder(singValues, EDF), ScalingSemiInf(), EPS_LAMBDA);
-    computeAmplitudes(initFit(yvalues), lambda, ampl, RSS, EDF);
+    computeAmplitudes(fitData, lambda, ampl, RSS, EDF);
 }
 
-void SplineApproxImpl::solveForAmplitudesWithAIC(const std::vector<double> &yvalues, double deltaAIC,
+void SplineApproxImpl::solveForAmplitudesWithAIC(const FitData &fitData, double deltaAIC,
     std::vector<double> &ampl, double &RSS, double &EDF) const
 {
     if(deltaAIC < 0)
         throw std::invalid_argument("SplineApprox: deltaAIC must be non-negative");
-    FitData fitData = initFit(yvalues);
-    // find the value of lambda corresponding to the optimal fit
+    // find the value of lambda corresponding to the optimal fit:
+    // first scan the values of AIC on a coarse grid in the scaled variable (in parallel),
+    // then refine the location of the lowest point with a local minimizer in the adjacent interval;
+    // this also guards against the local minimizer picking up a shallower local minimum
     ScalingSemiInf scaling;  // log-scaling for lambda
-    double lambda = findMin(SplineAICRootFinder(*this, fitData, 0),
-        scaling, NAN /*no initial guess*/, EPS_LAMBDA);
+    SplineAICRootFinder fncAIC(*this, fitData, 0);
+    double scanAIC[NUM_SCAN_LAMBDA+1];
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int i=0; i<=NUM_SCAN_LAMBDA; i++)
+        scanAIC[i] = fncAIC.value(unscale(scaling, i * 1. / NUM_SCAN_LAMBDA));
+    int imin = -1;
+    for(int i=0; i<=NUM_SCAN_LAMBDA; i++)
+        if(isFinite(scanAIC[i]) && (imin<0 || scanAIC[i] < scanAIC[imin]))
+            imin = i;
+    double lambda = NAN;
+    if(imin >= 0)
+        lambda = unscale(scaling, findMin(ScaledFnc<ScalingSemiInf>(scaling, fncAIC),
+            std::max(imin-1, 0) * 1. / NUM_SCAN_LAMBDA,
+            std::min(imin+1, NUM_SCAN_LAMBDA) * 1. / NUM_SCAN_LAMBDA,
+            imin>0 && imin<NUM_SCAN_LAMBDA ? imin * 1. / NUM_SCAN_LAMBDA : NAN, EPS_LAMBDA));
     if(!isFinite(lambda)) {
         utils::msg(utils::VL_DEBUG, "SplineApprox", "Can't find optimal smoothing parameter lambda");
         lambda = 0;  // no smoothing in case of weird problems
@@ -2677,18 +3067,42 @@ SplineApprox::SplineApprox(const std::vector<double> &grid,
     const std::vector<double> &xvalues, const std::vector<double> &weights) :
     impl(new SplineApproxImpl(grid, xvalues, weights)) {}
 
+SplineApprox::SplineApprox(const std::vector<double> &grid) :
+    impl(new SplineApproxImpl(grid)) {}
+
 SplineApprox::~SplineApprox()
 {
     delete impl;
 }
 
+void SplineApprox::addPoints(const std::vector<double> &xvalues,
+    const std::vector<double> &yvalues, const std::vector<double> &weights)
+{
+    impl->addPoints(xvalues, yvalues, weights);
+}
+
+size_t SplineApprox::numPoints() const
+{
+    return impl->numDataPoints;
+}
+
 std::vector<double> SplineApprox::fit(
     const std::vector<double> &yvalues, const double edf,
     double *rms) const
 {
     std::vector<double> ampl;
     double RSS;
-    impl->solveForAmplitudesWithEDF(yvalues, edf, ampl, RSS);
+    impl->solveForAmplitudesWithEDF(impl->initFit(yvalues), edf, ampl, RSS);
+    if(rms)
+        *rms = sqrt(RSS / impl->sumWeights);
+    return ampl;
+}
+
+std::vector<double> SplineApprox::fit(const double edf, double *rms) const
+{
+    std::vector<double> ampl;
+    double RSS;
+    impl->solveForAmplitudesWithEDF(impl->initFit(), edf, ampl, RSS);
     if(rms)
         *rms = sqrt(RSS / impl->sumWeights);
     return ampl;
@@ -2700,7 +3114,19 @@ std::vector<double> SplineApprox::fitOversmooth(
 {
     std::vector<double> ampl;
     double RSS, EDF;
-    impl->solveForAmplitudesWithAIC(yvalues, deltaAIC, ampl, RSS, EDF);
+    impl->solveForAmplitudesWithAIC(impl->initFit(yvalues), deltaAIC, ampl, RSS, EDF);
+    if(rms)
+        *rms = sqrt(RSS / impl->sumWeights);
+    if(edf)
+        *edf = EDF;
+    return ampl;
+}
+
+std::vector<double> SplineApprox::fitOversmooth(const double deltaAIC, double *rms, double* edf) const
+{
+    std::vector<double> ampl;
+    double RSS, EDF;
+    impl->solveForAmplitudesWithAIC(impl->initFit(), deltaAIC, ampl, RSS, EDF);
     if(rms)
         *rms = sqrt(RSS / impl->sumWeights);
     if(edf)
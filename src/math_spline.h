@@ -104,6 +104,20 @@ public:
     /** return the number of derivatives that the interpolator provides */
     virtual unsigned int numDerivs() const { return 2; }
 
+    /** compute the values and optionally the derivatives of the interpolator at several points.
+        The result is identical to calling evalDeriv() for each point, but the derived classes may
+        implement it more efficiently: in particular, the points may come in any order, but if they
+        are sorted or nearby, the grid segment of the previous point serves as a hint for the next
+        one, avoiding most of the binary searches.
+        \param[in]  npoints  is the number of points;
+        \param[in]  x  is the array of npoints input coordinates;
+        \param[out] values  will contain the values of the interpolator (if not NULL);
+        \param[out] derivs  will contain its first derivatives (if not NULL);
+        \param[out] derivs2 will contain its second derivatives (if not NULL).
+    */
+    virtual void evalmany(const size_t npoints, const double x[],
+        double values[], double derivs[]=NULL, double derivs2[]=NULL) const;
+
     /** return the lower end of definition interval */
     double xmin() const { return xval.size()? xval.front() : NAN; }
 
@@ -132,6 +146,10 @@ public:
         if the input location is outside the definition interval, a linear extrapolation is performed. */
     virtual void evalDeriv(const double x,
         double* value=NULL, double* deriv=NULL, double* deriv2=NULL) const;
+
+    /** evaluate the interpolator at several points, using the hinted search for grid segments */
+    virtual void evalmany(const size_t npoints, const double x[],
+        double values[], double derivs[]=NULL, double derivs2[]=NULL) const;
 };
 
 
@@ -218,6 +236,10 @@ public:
     virtual void evalDeriv(const double x,
         double* value=NULL, double* deriv=NULL, double* deriv2=NULL) const;
 
+    /** evaluate the interpolator at several points, using the hinted search for grid segments */
+    virtual void evalmany(const size_t npoints, const double x[],
+        double values[], double derivs[]=NULL, double derivs2[]=NULL) const;
+
     /** return the integral of spline function times x^n on the interval [x1..x2] */
     virtual double integrate(double x1, double x2, int n=0) const;
 
@@ -256,6 +278,10 @@ public:
     virtual void evalDeriv(const double x,
         double* value=NULL, double* deriv=NULL, double* deriv2=NULL) const;
 
+    /** evaluate the interpolator at several points, using the hinted search for grid segments */
+    virtual void evalmany(const size_t npoints, const double x[],
+        double values[], double derivs[]=NULL, double derivs2[]=NULL) const;
+
 private:
     std::vector<double> fder;  ///< first  derivatives of function at grid nodes
     std::vector<double> fder2; ///< second derivatives of function at grid nodes
@@ -285,6 +311,10 @@ public:
     virtual void evalDeriv(const double x,
         double* value=NULL, double* deriv=NULL, double* deriv2=NULL) const;
 
+    /** evaluate the interpolator at several points, using the hinted search for grid segments */
+    virtual void evalmany(const size_t npoints, const double x[],
+        double values[], double derivs[]=NULL, double derivs2[]=NULL) const;
+
     virtual unsigned int numDerivs() const { return 2; }
 
 private:
@@ -294,6 +324,10 @@ private:
     std::vector<double> logfder;  ///< first derivatives of log-log scaled function at grid nodes
     std::vector<double> logfder2; ///< second derivatives of log-log function at grid nodes
 
+    /// evaluate the function in the given grid segment, as returned by binSearch
+    void evalSegment(const double x, ptrdiff_t index,
+        double* value, double* deriv, double* deriv2) const;
+
 };
 
 
@@ -580,7 +614,7 @@ public:
     double ymax() const { return yval.size()? yval.back() : NAN; }
 
     /** check if the interpolator is initialized */
-    bool empty() const { return fval.empty(); }
+    bool empty() const { return xval.empty(); }
 
     /** return the array of grid nodes in x-coordinate */
     const std::vector<double>& xvalues() const { return xval; }
@@ -670,9 +704,30 @@ public:
         double* value=NULL, double* deriv_x=NULL, double* deriv_y=NULL,
         double* deriv_xx=NULL, double* deriv_xy=NULL, double* deriv_yy=NULL) const;
 
+    /** convert the tables of values and derivatives into a compact single-precision storage
+        (an opt-in feature for large grids). All nine quantities at each node are kept next
+        to each other in one float array, which reduces the memory footprint by a factor of two,
+        and, more importantly, the number of cache lines touched in each evaluation by a factor
+        of several, at the expense of the relative precision of the interpolated function ~1e-7.
+        \return  the maximum deviation between the interpolated values before and after conversion,
+        measured at the centres of all grid cells, relative to the maximum absolute value
+        of the function at grid nodes.
+    */
+    double convertToSinglePrecision();
+
+    /** check whether the spline uses the single-precision storage */
+    bool singlePrecision() const { return !packed.empty(); }
+
 private:
-    /// flattened 2d arrays of various derivatives
+    /// flattened 2d arrays of various derivatives (empty in the single-precision mode)
     std::vector<double> fx, fy, fxx, fxy, fyy, fxxy, fxyy, fxxyy;
+
+    /// single-precision storage: values and 8 derivatives at each node
+    /// (f, fx, fy, fxx, fxy, fyy, fxxy, fxyy, fxxyy), or empty in the default mode
+    std::vector<float> packed;
+
+    /// retrieve the value and derivatives at a given node from either of the two storages
+    inline void nodeValues(const size_t index, double values[9]) const;
 };
 
 
@@ -748,7 +803,18 @@ public:
     double value(double x, double y, double z) const;
 
     /** check if the interpolator is initialized */
-    bool empty() const { return fval.empty(); }
+    bool empty() const { return xval.empty(); }
+
+    /** convert the tables of values and derivatives into a compact single-precision storage,
+        with all eight quantities at each node kept together (see QuinticSpline2d for discussion).
+        \return  the maximum deviation between the interpolated values before and after conversion,
+        measured at the centres of all grid cells, relative to the maximum absolute value
+        of the function at grid nodes.
+    */
+    double convertToSinglePrecision();
+
+    /** check whether the interpolator uses the single-precision storage */
+    bool singlePrecision() const { return !packed.empty(); }
 
     // IFunctionNdim interface
     virtual void eval(const double point[3], double *val) const
@@ -759,7 +825,15 @@ public:
 private:
     std::vector<double> xval, yval, zval;  ///< grid nodes in x, y and z directions
     /// values and various derivatives of the function at 3d grid nodes
+    /// (empty in the single-precision mode)
     std::vector<double> fval, fx, fy, fz, fxy, fxz, fyz, fxyz;
+
+    /// single-precision storage: values and 7 derivatives at each node
+    /// (f, fx, fy, fz, fxy, fxz, fyz, fxyz), or empty in the default mode
+    std::vector<float> packed;
+
+    /// retrieve the value and derivatives at a given node from either of the two storages
+    inline void nodeValues(const size_t index, double values[8]) const;
 };
 
 
@@ -1003,6 +1077,15 @@ class SplineApproxImpl;
     z = B^T W y, where y[i] is the vector of original data points;
     R is the roughness penalty matrix:  \f$ R_pq = \int B''_p(x) B''_q(x) dx \f$.
 
+    The matrix B is never stored explicitly: the banded matrix C and the vector z are accumulated
+    in a single parallel pass over the data points, so the memory cost does not depend on
+    numDataPoints (apart from the input arrays themselves).
+    The object may be used in two modes. In the default mode, it is initialized with the arrays
+    of x and w, and then may be used to fit several arrays of y values.
+    In the streaming mode, it is created with only the array of knots, and the data points
+    (x, y, w) are added in one or more batches by `addPoints()`; the normal equations are updated
+    incrementally, so that the data points need not be kept in memory, and the fit may be
+    repeated after adding more points.
 */
 class SplineApprox {
 public: 
@@ -1016,8 +1099,26 @@ public:
         const std::vector<double>& xvalues,
         const std::vector<double>& weights = std::vector<double>());
 
+    /** construct an empty object in the streaming mode for the given grid of knots;
+        data points should be added by `addPoints()` before fitting.
+    */
+    explicit SplineApprox(const std::vector<double>& grid);
+
     ~SplineApprox();
 
+    /** add a batch of data points to the fitting problem in the streaming mode.
+        \param[in]  xvalues, yvalues  are the coordinates and values of data points;
+        \param[in]  weights  are their weights (optional, default is unity);
+        \throw  std::length_error if the array sizes do not match,
+        std::invalid_argument if weights are negative,
+        std::runtime_error if the object was not created in the streaming mode.
+    */
+    void addPoints(const std::vector<double>& xvalues, const std::vector<double>& yvalues,
+        const std::vector<double>& weights = std::vector<double>());
+
+    /** the total number of data points in the fitting problem */
+    size_t numPoints() const;
+
     /** perform actual fitting for the array of y values with the given smoothing parameter.
         \param[in]  yvalues is the array of data points corresponding to x values
         that were passed to the constructor;
@@ -1033,6 +1134,9 @@ public:
     std::vector<double> fit(const std::vector<double> &yvalues, const double edf=0, 
         double *rmserror=NULL) const;
 
+    /** same as above, for the data points accumulated in the streaming mode */
+    std::vector<double> fit(const double edf=0, double *rmserror=NULL) const;
+
     /** perform fitting with adaptive choice of smoothing parameter that minimizes
         the value of AIC (Akaike information criterion), defined as 
           log(rmserror^2 * numDataPoints) + 2 * (EDF+1) / (numDataPoints-EDF-2) .
@@ -1045,6 +1149,11 @@ public:
         return fitOversmooth(yvalues, 0., rmserror, edf);
     }
 
+    /** same as above, for the data points accumulated in the streaming mode */
+    std::vector<double> fitOptimal(double *rmserror=NULL, double* edf=NULL) const {
+        return fitOversmooth(0., rmserror, edf);
+    }
+
     /** perform an 'oversmooth' fitting with adaptive choice of smoothing parameter.
         deltaAIC>=0 determines the difference in AIC (Akaike information criterion) between
         the solution with optimal smoothing and the returned solution which is smoothed more than
@@ -1054,8 +1163,12 @@ public:
     std::vector<double> fitOversmooth(const std::vector<double> &yvalues, const double deltaAIC, 
         double *rmserror=NULL, double* edf=NULL) const;
 
+    /** same as above, for the data points accumulated in the streaming mode */
+    std::vector<double> fitOversmooth(const double deltaAIC,
+        double *rmserror=NULL, double* edf=NULL) const;
+
 private:
-    const SplineApproxImpl* impl;   ///< internal object hiding the implementation details
+    SplineApproxImpl* impl;   ///< internal object hiding the implementation details
     SplineApprox& operator= (const SplineApprox&);  ///< assignment operator forbidden
     SplineApprox(const SplineApprox&);              ///< copy constructor forbidden
 };
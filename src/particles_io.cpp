@@ -3,12 +3,20 @@
 #include <uns.h>
 #endif
 #include <fstream>
+#include <cstdio>
 #include <cassert>
 #include <stdexcept>
 #include "utils.h"
 
 namespace particles {
 
+void BaseIOSnapshot::writeSnapshotPart(const ParticleArrayCar& points, size_t offset, size_t total) const
+{
+    if(offset != 0 || total != points.size())
+        throw std::runtime_error("This snapshot format does not support writing in parts");
+    writeSnapshot(points);
+}
+
 ParticleArrayCar IOSnapshotText::readSnapshot() const
 {
     std::ifstream strm(fileName.c_str(), std::ios::in);
@@ -39,10 +47,17 @@ ParticleArrayCar IOSnapshotText::readSnapshot() const
 
 void IOSnapshotText::writeSnapshot(const ParticleArrayCar& points) const
 {
-    std::ofstream strm(fileName.c_str(), std::ios::out);
+    writeSnapshotPart(points, 0, points.size());
+}
+
+void IOSnapshotText::writeSnapshotPart(const ParticleArrayCar& points, size_t offset, size_t) const
+{
+    // the first portion creates the file, and the subsequent ones are appended to it
+    std::ofstream strm(fileName.c_str(), offset==0 ? std::ios::out : std::ios::out | std::ios::app);
     if(!strm) 
         throw std::runtime_error("IOSnapshotText: cannot write to file "+fileName);
-    strm << "#x\ty\tz\tvx\tvy\tvz\tm" << std::endl;
+    if(offset==0)
+        strm << "#x\ty\tz\tvx\tvy\tvz\tm" << std::endl;
     for(size_t indx=0; indx<points.size(); indx++)
     {
         const coord::PosVelCar& pt = points.point(indx);
@@ -156,6 +171,8 @@ public:
     }
     /// close file
     ~NemoSnapshotWriter() { snap.close(); }
+    /// set the index of current level when continuing to write a partially written snapshot
+    void setLevel(int _level) { level = _level; }
     /// return a letter corresponding to the given type
     template<typename T> char typeLetter();
     /// store a named quantity
@@ -168,6 +185,14 @@ public:
     };
     /// write array of T; ndim - number of dimensions, dim - length of array for each dimension
     template<typename T> void putArray(const std::string &name, int ndim, const int dim[], const T* data) {
+        startArray<T>(name, ndim, dim);
+        size_t size=1;
+        for(int i=0; i<ndim; i++)
+            size *= dim[i];   // compute the array size
+        putArrayData(size, data);
+    };
+    /// write the header of an array of T, which should be followed by its data (possibly in parts)
+    template<typename T> void startArray(const std::string &name, int ndim, const int dim[]) {
         snap.put(-110);
         snap.put(11);
         snap.put(typeLetter<T>());
@@ -175,11 +200,15 @@ public:
         snap.write(reinterpret_cast<const char*>(dim), ndim*sizeof(int));
         int buf=0;
         snap.write(reinterpret_cast<const char*>(&buf), sizeof(int));
-        size_t size=1;
-        for(int i=0; i<ndim; i++)
-            size *= dim[i];   // compute the array size
+    }
+    /// write a portion of the array data
+    template<typename T> void putArrayData(size_t size, const T* data) {
         snap.write(reinterpret_cast<const char*>(data), size*sizeof(T));
-    };
+    }
+    /// copy the entire content of another stream (e.g., a temporary file with array data)
+    void putStream(std::istream& src) {
+        snap << src.rdbuf();
+    }
     /// begin a new nested array
     void startLevel(const std::string &name) {
         level++;
@@ -253,6 +282,48 @@ public:
         endLevel();
         endLevel();
     }
+    /// write the beginning of a snapshot with the phase-space data to be provided in parts
+    /// by `writePhasePart()`; the masses are written after the phase-space coordinates
+    void startPhase(int nbody, double time) {
+        startLevel("SnapShot");
+        startLevel("Parameters");
+        putVal("Nobj", nbody);
+        putVal("Time", time);
+        endLevel();
+        startLevel("Particles");
+        putVal("CoordSystem", COORDSYS);
+        int tmp_dim[3] = {nbody, 2, 3};
+        startArray<float>("PhaseSpace", 3, tmp_dim);
+    }
+    /// write a portion of phase-space coordinates, and their masses into a separate stream
+    void writePhasePart(const ParticleArrayCar& points, const units::ExternalUnits& conv,
+        std::ostream& massStream)
+    {
+        size_t nbody = points.size();
+        std::vector<float> phase(nbody * 6);
+        std::vector<float> mass(nbody);
+        for(size_t i = 0 ; i < nbody ; i++) {
+            mass [i]     = static_cast<float>(points.mass(i)     / conv.massUnit);
+            phase[i*6  ] = static_cast<float>(points.point(i).x  / conv.lengthUnit);
+            phase[i*6+1] = static_cast<float>(points.point(i).y  / conv.lengthUnit);
+            phase[i*6+2] = static_cast<float>(points.point(i).z  / conv.lengthUnit);
+            phase[i*6+3] = static_cast<float>(points.point(i).vx / conv.velocityUnit);
+            phase[i*6+4] = static_cast<float>(points.point(i).vy / conv.velocityUnit);
+            phase[i*6+5] = static_cast<float>(points.point(i).vz / conv.velocityUnit);
+        }
+        if(nbody>0) {
+            putArrayData(nbody * 6, &phase[0]);
+            massStream.write(reinterpret_cast<const char*>(&mass[0]), nbody * sizeof(float));
+        }
+    }
+    /// finish the snapshot started by `startPhase()`, copying the masses from the temporary stream
+    void finishPhase(int nbody, std::istream& massStream) {
+        startArray<float>("Mass", 1, &nbody);
+        if(nbody>0)
+            putStream(massStream);
+        endLevel();
+        endLevel();
+    }
     /// check if any i/o errors occured
     bool ok() const { return snap.good(); }
 };
@@ -275,6 +346,41 @@ void IOSnapshotNemo::writeSnapshot(const ParticleArrayCar& points) const
         throw std::runtime_error("IOSnapshotNEMO: cannot write to file "+fileName);
 };
 
+void IOSnapshotNemo::writeSnapshotPart(const ParticleArrayCar& points, size_t offset, size_t total) const
+{
+    if(offset + points.size() > total || total > 0x7fffffff)
+        throw std::runtime_error("IOSnapshotNEMO: invalid size of snapshot portion");
+    // masses are accumulated in a temporary file until the last portion is written
+    const std::string massFileName = fileName + ".mass.tmp";
+    bool result;
+    {
+        NemoSnapshotWriter snapshotWriter(fileName, offset==0 ? append : true);
+        std::ofstream massStream(massFileName.c_str(), std::ios::binary |
+            (offset==0 ? std::ios_base::trunc : std::ios_base::app));
+        result = snapshotWriter.ok() && massStream.good();
+        if(result) {
+            if(offset==0) {
+                snapshotWriter.writeHistory(header);
+                snapshotWriter.startPhase(static_cast<int>(total), time);
+            } else
+                snapshotWriter.setLevel(2);  // we are inside the "Particles" set
+            snapshotWriter.writePhasePart(points, conv, massStream);
+            massStream.close();
+            if(offset + points.size() == total) {
+                std::ifstream massInput(massFileName.c_str(), std::ios::binary);
+                snapshotWriter.finishPhase(static_cast<int>(total), massInput);
+            }
+            result = snapshotWriter.ok() && !massStream.fail();
+        }
+    }
+    // the temporary file is no longer needed after the last portion, or if the writing failed
+    // (the snapshot is then incomplete anyway)
+    if(offset + points.size() == total || !result)
+        std::remove(massFileName.c_str());
+    if(!result) 
+        throw std::runtime_error("IOSnapshotNEMO: cannot write to file "+fileName);
+}
+
 
 // creates an instance of appropriate snapshot reader, according to the file format 
 // determined by reading first few bytes, or throw an exception if a file doesn't exist
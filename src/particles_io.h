@@ -38,6 +38,17 @@ public:
         \throws  std::runtime_error in case of error (e.g., file is not writable)
     */
     virtual void writeSnapshot(const ParticleArrayCar& particles) const=0;
+    /** write a snapshot that is too large to be kept in memory, in several consecutive portions.
+        \param[in] particles is the next portion of particles;
+        \param[in] offset is the index of the first particle of this portion in the entire snapshot:
+        the portions must be written in order, and the first one (offset=0) creates the file;
+        \param[in] total is the total number of particles in the snapshot
+        (some formats need to know it in advance), the same in all calls.
+        The default implementation only supports writing the entire snapshot at once
+        (offset=0 and total=particles.size()).
+        \throws  std::runtime_error in case of error, or if the format does not support writing in parts.
+    */
+    virtual void writeSnapshotPart(const ParticleArrayCar& particles, size_t offset, size_t total) const;
 };
 
 /// Text file with three coordinates, possibly three velocities and mass, space or tab-separated.
@@ -47,6 +58,7 @@ public:
         fileName(_fileName), conv(unitConverter) {};
     virtual ParticleArrayCar readSnapshot() const;
     virtual void writeSnapshot(const ParticleArrayCar& particles) const;
+    virtual void writeSnapshotPart(const ParticleArrayCar& particles, size_t offset, size_t total) const;
 private:
     const std::string fileName;
     const units::ExternalUnits conv;
@@ -65,6 +77,9 @@ public:
         fileName(_fileName), conv(unitConverter), header(_header), time(_time), append(_append) {};
     virtual ParticleArrayCar readSnapshot() const;
     virtual void writeSnapshot(const ParticleArrayCar& particles) const;
+    /// when writing in parts, the phase-space coordinates of all portions are streamed into
+    /// the file, while the masses are kept in a temporary file and appended after the last portion
+    virtual void writeSnapshotPart(const ParticleArrayCar& particles, size_t offset, size_t total) const;
 private:
     const std::string fileName;
     const units::ExternalUnits conv;
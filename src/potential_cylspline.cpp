@@ -927,7 +927,8 @@ CylSpline::CylSpline(
     const std::vector<double> &gridz_orig,
     const std::vector< math::Matrix<double> > &Phi,
     const std::vector< math::Matrix<double> > &dPhidR,
-    const std::vector< math::Matrix<double> > &dPhidz)
+    const std::vector< math::Matrix<double> > &dPhidz,
+    bool singlePrecision)
 {
     unsigned int sizeR = gridR_orig.size(), sizez = gridz_orig.size(), sizez_orig = sizez;
     bool haveDerivs = dPhidR.size() > 0 && dPhidz.size() > 0;
@@ -1033,9 +1034,17 @@ CylSpline::CylSpline(
             derz0 = derz;
         }
         if(nontrivial || mm==mmax) {  // only construct splines if they are not identically zero or m=0
-            spl[mm] = haveDerivs ? 
-                math::PtrInterpolator2d(new math::QuinticSpline2d(gridR, gridz, val, derR, derz)) :
-                math::PtrInterpolator2d(new math::CubicSpline2d(gridR, gridz, val, 0, NAN, NAN, NAN));
+            if(haveDerivs) {
+                math::QuinticSpline2d* spline = new math::QuinticSpline2d(gridR, gridz, val, derR, derz);
+                spl[mm] = math::PtrInterpolator2d(spline);
+                if(singlePrecision) {
+                    double loss = spline->convertToSinglePrecision();
+                    if(utils::verbosityLevel >= utils::VL_DEBUG)
+                        utils::msg(utils::VL_DEBUG, "CylSpline", "Harmonic m=" + utils::toString(mm-mmax) +
+                            " converted to single precision, relative error: " + utils::toString(loss));
+                }
+            } else
+                spl[mm] = math::PtrInterpolator2d(new math::CubicSpline2d(gridR, gridz, val, 0, NAN, NAN, NAN));
             // check if this non-trivial harmonic breaks any symmetry
             int m = mm-mmax;
             if(m!=0)  // no z-rotation symmetry because m!=0 coefs are non-zero
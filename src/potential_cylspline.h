@@ -188,13 +188,18 @@ public:
         of Phi at grid nodes, employing 2d cubic spline interpolation for each m term.
         If derivatives are provided, then the interpolation is based on quintic splines,
         improving the accuracy.
+        \param[in]  singlePrecision  if true (and the derivatives are provided), the tables
+        of quintic splines are stored in single precision, reducing the memory footprint and
+        the memory traffic during evaluation, at the expense of a relative error ~1e-7
+        in the potential (the measured precision loss is reported in the debug log).
     */
     CylSpline(
         const std::vector<double> &gridR,
         const std::vector<double> &gridz, 
         const std::vector< math::Matrix<double> > &Phi,
         const std::vector< math::Matrix<double> > &dPhidR = std::vector< math::Matrix<double> >(),
-        const std::vector< math::Matrix<double> > &dPhidz = std::vector< math::Matrix<double> >() );
+        const std::vector< math::Matrix<double> > &dPhidz = std::vector< math::Matrix<double> >(),
+        bool singlePrecision = false);
 
     virtual const char* name() const { return myName(); }
     static const char* myName() { static const char* text = "CylSpline"; return text; }
@@ -36,6 +36,7 @@
 #include "df_interpolated.h"
 #include "df_quasiisotropic.h"
 #include "galaxymodel_base.h"
+#include "galaxymodel_cache.h"
 #include "galaxymodel_densitygrid.h"
 #include "galaxymodel_losvd.h"
 #include "galaxymodel_selfconsistent.h"
@@ -2612,6 +2613,8 @@ typedef struct {
     PotentialObject* pot_obj;
     DistributionFunctionObject* df_obj;
     ActionFinderObject* af_obj;
+    galaxymodel::IntegralCache* cache;  ///< optional cache of computed moments (NULL if not used)
+    unsigned long long cacheKey;        ///< identifier of the model in the cache
 } GalaxyModelObject;
 /// \endcond
 
@@ -2620,6 +2623,7 @@ void GalaxyModel_dealloc(GalaxyModelObject* self)
     Py_XDECREF(self->pot_obj);
     Py_XDECREF(self->df_obj);
     Py_XDECREF(self->af_obj);
+    delete self->cache;  // the cache is saved to the file, if one was provided
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -2649,17 +2653,33 @@ static const char* docstringGalaxyModel =
     "  potential - a Potential object;\n"
     "  df  - a DistributionFunction object;\n"
     "  af (optional) - an ActionFinder object; "
-    "if not provided then the action finder is created internally.\n";
+    "if not provided then the action finder is created internally;\n"
+    "  cache (optional) - a string that uniquely identifies the model (e.g., the concatenated "
+    "parameters of the potential and the DF); if provided, the results of moments(), "
+    "projectedMoments() and projectedDF() are cached, and repeated calls with the same "
+    "arguments return the stored values without recomputing them;\n"
+    "  cacheFile (optional) - the name of the file where the cache is stored between sessions "
+    "(it is loaded at construction and saved when the GalaxyModel object is destroyed); "
+    "the file may be shared between different models, as long as their cache strings differ;\n"
+    "  cacheSize (optional, default 100000) - the maximum number of entries in the cache, "
+    "after which the least recently used ones are discarded.\n";
 
 int GalaxyModel_init(GalaxyModelObject* self, PyObject* args, PyObject* namedArgs)
 {
-    static const char* keywords[] = {"potential", "df", "af", NULL};
+    static const char* keywords[] = {"potential", "df", "af", "cache", "cacheFile", "cacheSize", NULL};
     PyObject *pot_obj = NULL, *df_obj = NULL, *af_obj = NULL;
-    if(!PyArg_ParseTupleAndKeywords(args, namedArgs, "OO|O", const_cast<char**>(keywords),
-        &pot_obj, &df_obj, &af_obj))
+    const char *cacheStr = NULL, *cacheFile = NULL;
+    int cacheSize = 100000;
+    if(!PyArg_ParseTupleAndKeywords(args, namedArgs, "OO|Ossi", const_cast<char**>(keywords),
+        &pot_obj, &df_obj, &af_obj, &cacheStr, &cacheFile, &cacheSize))
     {
         PyErr_SetString(PyExc_ValueError,
-            "GalaxyModel constructor takes two or three arguments: potential, df, [af]");
+            "GalaxyModel constructor takes two or three arguments: potential, df, [af], "
+            "and optionally cache, cacheFile, cacheSize");
+        return -1;
+    }
+    if(cacheSize <= 0) {
+        PyErr_SetString(PyExc_ValueError, "Argument 'cacheSize' must be positive");
         return -1;
     }
 
@@ -2712,6 +2732,26 @@ int GalaxyModel_init(GalaxyModelObject* self, PyObject* args, PyObject* namedArg
         self->af_obj = (ActionFinderObject*)af_obj;
     }
 
+    // create the cache if requested; the key of the model includes the units,
+    // since the cached values are stored in internal units
+    delete self->cache;
+    self->cache = NULL;
+    self->cacheKey = 0;
+    if(cacheStr != NULL) {
+        try{
+            self->cache = new galaxymodel::IntegralCache(cacheSize, cacheFile ? cacheFile : "");
+        }
+        catch(std::exception& e) {
+            PyErr_SetString(PyExc_RuntimeError,
+                (std::string("Error in creating GalaxyModel cache: ")+e.what()).c_str());
+            return -1;
+        }
+        self->cacheKey = galaxymodel::hashString(std::string(cacheStr) +
+            " lengthUnit=" + utils::toString(conv->lengthUnit, 16) +
+            " velocityUnit=" + utils::toString(conv->velocityUnit, 16) +
+            " massUnit=" + utils::toString(conv->massUnit, 16));
+    }
+
     assert(GalaxyModel_isCorrect(self));
     return 0;
 }
@@ -2761,8 +2801,9 @@ struct GalaxyModelParams{
         const potential::BasePotential& pot,
         const actions::BaseActionFinder& af,
         const df::BaseDistributionFunction& df,
+        galaxymodel::IntegralCache* cache=NULL, unsigned long long cacheKey=0,
         bool dens=true, bool vel=false, bool vel2=true) :
-        model(pot, af, df), needDens(dens), needVel(vel), needVel2(vel2) {};
+        model(pot, af, df, cache, cacheKey), needDens(dens), needVel(vel), needVel2(vel2) {};
 };
 /// \endcond
 
@@ -2817,7 +2858,7 @@ PyObject* GalaxyModel_moments(GalaxyModelObject* self, PyObject* args, PyObject*
     }
     try{
         GalaxyModelParams params(*self->pot_obj->pot, *self->af_obj->af, *self->df_obj->df,
-            toBool(dens_flag, true), toBool(vel_flag, false), toBool(vel2_flag, true) );
+            self->cache, self->cacheKey, toBool(dens_flag, true), toBool(vel_flag, false), toBool(vel2_flag, true) );
         if(params.needDens) {
             if(params.needVel) {
                 if(params.needVel2)
@@ -2894,7 +2935,8 @@ PyObject* GalaxyModel_projectedMoments(GalaxyModelObject* self, PyObject* args)
         return NULL;
     }
     try{
-        GalaxyModelParams params(*self->pot_obj->pot, *self->af_obj->af, *self->df_obj->df);
+        GalaxyModelParams params(*self->pot_obj->pot, *self->af_obj->af, *self->df_obj->df,
+            self->cache, self->cacheKey);
         return callAnyFunctionOnArray<INPUT_VALUE_SINGLE, OUTPUT_VALUE_SINGLE_AND_SINGLE_AND_SINGLE>
             (&params, points_obj, fncGalaxyModelProjectedMoments);
     }
@@ -2933,7 +2975,8 @@ PyObject* GalaxyModel_projectedDF(GalaxyModelObject* self, PyObject* args, PyObj
         return NULL;
     }
     try{
-        GalaxyModelParams params(*self->pot_obj->pot, *self->af_obj->af, *self->df_obj->df);
+        GalaxyModelParams params(*self->pot_obj->pot, *self->af_obj->af, *self->df_obj->df,
+            self->cache, self->cacheKey);
         params.vz_error = vz_error * conv->velocityUnit;
         PyObject* result = callAnyFunctionOnArray<INPUT_VALUE_TRIPLET, OUTPUT_VALUE_SINGLE>
             (&params, points_obj, fncGalaxyModelProjectedDF);
@@ -3443,6 +3486,11 @@ typedef struct {
     ActionFinderObject* af;
     /// members of galaxymodel::SelfConsistentModel structure listed here
     bool useActionInterpolation;  ///< whether to use the interpolated action finder
+    bool fuseDensityComputation;  ///< whether to compute the densities of all DF components at once
+    double incrementalTolerance;  ///< tolerance for the incremental update of densities (0 - off)
+    unsigned int maxIncrementalUpdates;  ///< max number of consecutive incremental updates
+    unsigned int numIncrementalUpdates;  ///< number of incremental updates since the last full one
+    bool concurrentTasks;         ///< whether to run independent tasks concurrently
     double rminSph, rmaxSph;      ///< range of radii for the logarithmic grid
     unsigned int sizeRadialSph;   ///< number of grid points in radius
     unsigned int lmaxAngularSph;  ///< maximum order of angular-harmonic expansion (l_max)
@@ -3490,6 +3538,11 @@ int SelfConsistentModel_init(SelfConsistentModelObject* self, PyObject* args, Py
     self->pot         = NULL;
     self->af          = NULL;
     self->useActionInterpolation = toBool(getItemFromPyDict(namedArgs, "useActionInterpolation"), false);
+    self->fuseDensityComputation = toBool(getItemFromPyDict(namedArgs, "fuseDensityComputation"), true);
+    self->incrementalTolerance = toDouble(getItemFromPyDict(namedArgs, "incrementalTolerance"), 0);
+    self->maxIncrementalUpdates = toInt(getItemFromPyDict(namedArgs, "maxIncrementalUpdates"), 4);
+    self->numIncrementalUpdates = 0;
+    self->concurrentTasks = toBool(getItemFromPyDict(namedArgs, "concurrentTasks"), false);
     self->rminSph     = toDouble(getItemFromPyDict(namedArgs, "rminSph"), -2);
     self->rmaxSph     = toDouble(getItemFromPyDict(namedArgs, "rmaxSph"), -2);
     self->sizeRadialSph  = toInt(getItemFromPyDict(namedArgs, "sizeRadialSph"), -1);
@@ -3503,15 +3556,15 @@ int SelfConsistentModel_init(SelfConsistentModelObject* self, PyObject* args, Py
     return 0;
 }
 
-PyObject* SelfConsistentModel_iterate(SelfConsistentModelObject* self)
+/// fill the C++ model from the Python object; return false and set the Python exception on error
+bool SelfConsistentModel_assemble(SelfConsistentModelObject* self, galaxymodel::SelfConsistentModel& model)
 {
-    galaxymodel::SelfConsistentModel model;
     // parse the Python list of components
     if(self->components==NULL || !PyList_Check(self->components) || PyList_Size(self->components)==0)
     {
         PyErr_SetString(PyExc_ValueError,
             "SelfConsistentModel.components should be a non-empty list of Component objects");
-        return NULL;
+        return false;
     }
     int numComp = PyList_Size(self->components);
     for(int i=0; i<numComp; i++)
@@ -3520,11 +3573,16 @@ PyObject* SelfConsistentModel_iterate(SelfConsistentModelObject* self)
         if(!PyObject_TypeCheck(elem, &ComponentType)) {
             PyErr_SetString(PyExc_ValueError,
                 "SelfConsistentModel.components should contain only Component objects");
-            return NULL;
+            return false;
         }
         model.components.push_back(((ComponentObject*)elem)->comp);
     }
     model.useActionInterpolation = self->useActionInterpolation;
+    model.fuseDensityComputation = self->fuseDensityComputation;
+    model.incrementalTolerance = self->incrementalTolerance;
+    model.maxIncrementalUpdates = self->maxIncrementalUpdates;
+    model.numIncrementalUpdates = self->numIncrementalUpdates;
+    model.concurrentTasks = self->concurrentTasks;
     model.rminSph = self->rminSph * conv->lengthUnit;
     model.rmaxSph = self->rmaxSph * conv->lengthUnit;
     model.sizeRadialSph = self->sizeRadialSph;
@@ -3539,14 +3597,30 @@ PyObject* SelfConsistentModel_iterate(SelfConsistentModelObject* self)
         model.totalPotential = ((PotentialObject*)self->pot)->pot;
     if(self->af!=NULL && PyObject_TypeCheck(self->af, &ActionFinderType))
         model.actionFinder = ((ActionFinderObject*)self->af)->af;
+    return true;
+}
+
+/// update the total potential and action finder by copying the C++ smart pointers into
+/// Python objects, and the counter of incremental updates of densities;
+/// old Python objects are released (and destroyed if no one else uses them)
+void SelfConsistentModel_storePotential(SelfConsistentModelObject* self,
+    const galaxymodel::SelfConsistentModel& model)
+{
+    Py_XDECREF(self->pot);
+    Py_XDECREF(self->af);
+    self->numIncrementalUpdates = model.numIncrementalUpdates;
+    self->pot = (PotentialObject*)createPotentialObject(model.totalPotential);
+    self->af  = (ActionFinderObject*)createActionFinderObject(model.actionFinder);
+}
+
+PyObject* SelfConsistentModel_iterate(SelfConsistentModelObject* self)
+{
+    galaxymodel::SelfConsistentModel model;
+    if(!SelfConsistentModel_assemble(self, model))
+        return NULL;
     try {
         doIteration(model);
-        // update the total potential and action finder by copying the C++ smart pointers into
-        // Python objects; old Python objects are released (and destroyed if no one else uses them)
-        Py_XDECREF(self->pot);
-        Py_XDECREF(self->af);
-        self->pot = (PotentialObject*)createPotentialObject(model.totalPotential);
-        self->af  = (ActionFinderObject*)createActionFinderObject(model.actionFinder);
+        SelfConsistentModel_storePotential(self, model);
         Py_INCREF(Py_None);
         return Py_None;
     }
@@ -3557,6 +3631,34 @@ PyObject* SelfConsistentModel_iterate(SelfConsistentModelObject* self)
     }
 }
 
+PyObject* SelfConsistentModel_iterateToConvergence(SelfConsistentModelObject* self,
+    PyObject* args, PyObject* namedArgs)
+{
+    static const char* keywords[] = {"maxNumIter", "tolerance", "historySize", "mixing", NULL};
+    int maxNumIter = 20, historySize = 4;
+    double tolerance = 1e-2, mixing = 1.;
+    if(!PyArg_ParseTupleAndKeywords(args, namedArgs, "|idid", const_cast<char**>(keywords),
+        &maxNumIter, &tolerance, &historySize, &mixing))
+        return NULL;
+    if(maxNumIter <= 0 || historySize < 0) {
+        PyErr_SetString(PyExc_ValueError, "maxNumIter must be positive and historySize non-negative");
+        return NULL;
+    }
+    galaxymodel::SelfConsistentModel model;
+    if(!SelfConsistentModel_assemble(self, model))
+        return NULL;
+    try {
+        unsigned int numIter = iterateToConvergence(model, maxNumIter, tolerance, historySize, mixing);
+        SelfConsistentModel_storePotential(self, model);
+        return Py_BuildValue("i", numIter);
+    }
+    catch(std::exception& e) {
+        PyErr_SetString(PyExc_ValueError,
+            (std::string("Error in SelfConsistentModel.iterateToConvergence(): ")+e.what()).c_str());
+        return NULL;
+    }
+}
+
 static PyMemberDef SelfConsistentModel_members[] = {
     { const_cast<char*>("components"), T_OBJECT_EX, offsetof(SelfConsistentModelObject, components), 0,
       const_cast<char*>("List of Component objects (may be modified by the user, but should be "
@@ -3568,6 +3670,25 @@ static PyMemberDef SelfConsistentModel_members[] = {
     { const_cast<char*>("useActionInterpolation"), T_BOOL,
       offsetof(SelfConsistentModelObject, useActionInterpolation), 0,
       const_cast<char*>("Whether to use interpolated action finder (faster but less accurate)") },
+    { const_cast<char*>("fuseDensityComputation"), T_BOOL,
+      offsetof(SelfConsistentModelObject, fuseDensityComputation), 0,
+      const_cast<char*>("Whether to compute the densities of all components with DF in a single pass, "
+      "evaluating actions only once for all of them (default true)") },
+    { const_cast<char*>("incrementalTolerance"), T_DOUBLE,
+      offsetof(SelfConsistentModelObject, incrementalTolerance), 0,
+      const_cast<char*>("If positive, the density at each grid point is first estimated with "
+      "a reduced accuracy and recomputed in full only if it changed by more than this relative "
+      "amount since the previous iteration (default 0, i.e. always recompute in full); "
+      "makes the late iterations much cheaper, and should exceed the accuracy of components") },
+    { const_cast<char*>("maxIncrementalUpdates"), T_INT,
+      offsetof(SelfConsistentModelObject, maxIncrementalUpdates), 0,
+      const_cast<char*>("Max number of consecutive incremental updates of densities, after which "
+      "they are recomputed in full (default 4)") },
+    { const_cast<char*>("concurrentTasks"), T_BOOL,
+      offsetof(SelfConsistentModelObject, concurrentTasks), 0,
+      const_cast<char*>("Whether to update independent components and to construct Multipole and "
+      "CylSpline potentials concurrently, splitting the available threads between them "
+      "(default false)") },
     { const_cast<char*>("rminSph"), T_DOUBLE, offsetof(SelfConsistentModelObject, rminSph), 0,
       const_cast<char*>("Spherical radius of innermost grid node for Multipole potential") },
     { const_cast<char*>("rmaxSph"), T_DOUBLE, offsetof(SelfConsistentModelObject, rmaxSph), 0,
@@ -3596,6 +3717,19 @@ static PyMethodDef SelfConsistentModel_methods[] = {
       "Perform one iteration of self-consistent modelling procedure, "
       "recomputing density profiles of all DF-based components, "
       "and then updating the total potential.\n" },
+    { "iterateToConvergence", (PyCFunction)SelfConsistentModel_iterateToConvergence,
+      METH_VARARGS | METH_KEYWORDS,
+      "Perform iterations of self-consistent modelling procedure until the density profiles "
+      "of all DF-based components converge, accelerating the convergence by Anderson mixing "
+      "of densities from several previous iterations.\n"
+      "Arguments (all optional):\n"
+      "  maxNumIter -- maximum number of iterations (default 20).\n"
+      "  tolerance -- required root-mean-square relative change of density between iterations "
+      "(default 1e-2); should be larger than the accuracy of density computation in components.\n"
+      "  historySize -- number of previous iterations used in mixing (default 4; 0 means "
+      "simple iteration).\n"
+      "  mixing -- fraction of the new density used at each step (0<mixing<=1, default 1).\n"
+      "Returns: the number of iterations performed.\n" },
     { NULL }
 };
 
@@ -3736,7 +3870,11 @@ static const char* docstringTarget =
     "velpsf - width of the velocity-space smoothing kernel (a single Gaussian);\n"
     "apertures - array of polygons describing the boundaries of each aperture: "
     "each element of this array is a 2d array with x',y' coordinates of the polygon vertices, "
-    "and of course the number of vertices may be different for each polygon (but greater than two).\n\n"
+    "and of course the number of vertices may be different for each polygon (but greater than two);\n"
+    "cacheDir (optional) - directory for storing the matrix of integrals of basis functions over "
+    "apertures, which is expensive to compute for a large number of apertures: if a file for "
+    "the same grids and apertures already exists in this directory, the matrix is loaded from it, "
+    "otherwise it is computed and saved there for subsequent use.\n\n"
     "The role of a Target object is to collect data during the construction of an orbit library: "
     "several instances of them could be provided as a 'targets=[t1,t2,...]' argument of "
     "the 'orbit()' routine, and each one will produce a matrix with Norbit rows and Ncoef columns, "
@@ -3880,6 +4018,7 @@ int Target_init(TargetObject* self, PyObject* args, PyObject* namedArgs)
                 }
                 Py_DECREF(ap_arr);
             }
+            params.apertureCacheDir = toString(getItemFromPyDict(namedArgs, "cacheDir"));
             // degree of B-splines
             int degree = toInt(getItemFromPyDict(namedArgs, "degree"), -1);
             switch(degree) {
@@ -3912,7 +4051,6 @@ PyObject* Target_value(TargetObject* self, PyObject* args, PyObject* /*namedArgs
         return NULL;
     }
     PyObject* arg = PyTuple_GET_ITEM(args, 0);
-    particles::ParticleArrayCar particles;
     try{
         // check if we have a density object as input
         potential::PtrDensity dens = getDensity(arg);
@@ -3922,57 +4060,21 @@ PyObject* Target_value(TargetObject* self, PyObject* args, PyObject* /*namedArgs
             return toPyArray(result);
         }
         // otherwise this must be a particle object
-        particles = convertParticles<coord::PosVelCar>(arg);
+        std::vector<double> values = galaxymodel::computeTargetFromParticles(
+            *self->target, convertParticles<coord::PosVelCar>(arg));
+        npy_intp size = values.size();
+        PyObject* result = PyArray_SimpleNew(1, &size, STORAGE_NUM_T);
+        if(!result)
+            return NULL;
+        for(npy_intp i=0; i<size; i++)
+            pyArrayElem<galaxymodel::StorageNumT>(result, i) =
+                static_cast<galaxymodel::StorageNumT>(values[i] / conv->massUnit);
+        return result;
     }
     catch(std::exception& e) {
         PyErr_SetString(PyExc_ValueError, e.what());
         return NULL;
     }
-    npy_intp size = self->target->numCoefs();
-    PyObject* result = PyArray_ZEROS(1, &size, STORAGE_NUM_T, 0);
-    if(!result)
-        return NULL;
-    bool fail = false;
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-    {
-        try{
-            // define thread-local intermediate matrices
-            math::Matrix<double> datacube = self->target->newDatacube();
-            std::vector<galaxymodel::StorageNumT> tmpresult(size);
-            const double mult = 1./conv->massUnit;
-#ifdef _OPENMP
-#pragma omp for schedule(static)
-#endif
-            for(int i=0; i<(int)particles.size(); i++) {
-                double xv[6];
-                particles.point(i).unpack_to(xv);
-                self->target->addPoint(xv, particles.mass(i), datacube.data());
-            }
-            self->target->finalizeDatacube(datacube, &tmpresult[0]);
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-            {
-                for(npy_intp i=0; i<size; i++)
-                    pyArrayElem<galaxymodel::StorageNumT>(result, i) += mult * tmpresult[i];
-            }
-        }
-        catch(std::exception& e) {
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-            PyErr_SetString(PyExc_ValueError, e.what());
-            fail = true;
-        }
-    }
-
-    if(fail) {
-        Py_DECREF(result);
-        return NULL;
-    }
-    return result;
 }
 
 PyObject* Target_name(TargetObject* self)
@@ -4067,7 +4169,8 @@ static const char* docstringGhmoments =
     "(gamma, mean v and sigma), followed by GH moments h_0..h_M, where M is the order "
     "of expansion - in total M+4 numbers for each aperture (grouped together), "
     "of which the first three can be later used as the 'ghexp' argument for computing the moments "
-    "in a multi-component model.\n"
+    "in a multi-component model; for LOSVDs that are identically zero (e.g., an orbit that never "
+    "visits the given aperture), gamma is zero and the remaining values are NaN.\n"
     "In the opposite case when 'ghexp' is provided, the output for each aperture contains M+1 "
     "moments h_0..h_M.\n";
 
@@ -4107,7 +4210,8 @@ PyObject* ghmoments(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
     // matrix of B-spline amplitudes of LOSVD in each aperture (columns)
     // for each element of the model (e.g. an orbit) (rows)
     PyArrayObject *mat_arr = mat_obj?
-        (PyArrayObject*) PyArray_FROM_OTF(mat_obj, STORAGE_NUM_T, NPY_ARRAY_FORCECAST) : NULL;
+        (PyArrayObject*) PyArray_FROM_OTF(mat_obj, STORAGE_NUM_T,
+        NPY_ARRAY_FORCECAST | NPY_ARRAY_IN_ARRAY) : NULL;
     npy_intp numApertures = -1;
     if(mat_arr && (PyArray_NDIM(mat_arr) == 1 || PyArray_NDIM(mat_arr) == 2))
         numApertures = PyArray_DIM(mat_arr, PyArray_NDIM(mat_arr)-1) / numBasisFnc;
@@ -4143,103 +4247,39 @@ PyObject* ghmoments(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
         return NULL;
     }
 
-    volatile bool fail = false;
     // the procedure is different depending on whether the parameters of GH expansion are provided or not
-    if(gh_arr) {
-        // compute the GH moments for known (provided) parameters of expansion (gamma, meanv and sigma)
-#ifdef _OPENMP
-#pragma omp parallel for schedule(static)
-#endif
-        for(npy_intp a=0; a<numApertures; a++) {
-            if(fail) continue;
-            try{
-                // obtain the matrix that converts the B-spline amplitudes into Gauss-Hermite moments
-                math::Matrix<double> ghmat(galaxymodel::computeGaussHermiteMatrix(degree, gridv, ghorder,
-                    /*gamma*/ pyArrayElem<double>(gh_arr, a, 0) /* conv->massUnit*/,
-                    /*meanv*/ pyArrayElem<double>(gh_arr, a, 1) * conv->velocityUnit,
-                    /*sigma*/ pyArrayElem<double>(gh_arr, a, 2) * conv->velocityUnit));
-                std::vector<double> srcrow(numBasisFnc), dstrow(ghorder+1);  // temp storage
-                // loop over all rows of the input matrix (e.g. orbits)
-                for(npy_intp r=0; r<numComponents; r++) {
-                    // convert the section of one row of the input array, corresponding to
-                    // one aperture and one orbit, from StorageNumT to double
-                    for(int b=0; b<numBasisFnc; b++)
-                        srcrow[b] = ndim==1 ?
-                            pyArrayElem<galaxymodel::StorageNumT>(mat_arr,    a * numBasisFnc + b) :
-                            pyArrayElem<galaxymodel::StorageNumT>(mat_arr, r, a * numBasisFnc + b);
-                    // multiply the array of amplitudes by the conversion matrix
-                    math::blas_dgemv(math::CblasNoTrans, 1., ghmat, srcrow, 0., dstrow);
-                    // convert back to StorageNumT and write
-                    // to a section of one row of the result array
-                    for(int m=0; m<=ghorder; m++)
-                        (ndim==1 ?
-                        pyArrayElem<galaxymodel::StorageNumT>(output_arr,    a * (ghorder+1) + m) :
-                        pyArrayElem<galaxymodel::StorageNumT>(output_arr, r, a * (ghorder+1) + m) ) =
-                            static_cast<galaxymodel::StorageNumT>(dstrow[m]);
-                }
-            }
-            catch(std::exception& e) {
-#ifdef _OPENMP
-#pragma omp critical(PythonAPI)
-#endif
-                PyErr_SetString(PyExc_ValueError, e.what());
-                fail = true;
-            }
-        }
-    } else {
-        // construct best-fit GH expansion (find gamma,meanv,sigma) for each aperture and component,
-        // and then compute GH moments using these best-fit values
-        const npy_intp count = numApertures * numComponents;
-#ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic,1)
-#endif
-        for(npy_intp ar=0; ar < count; ar++) {
-            if(fail) continue;
-            try{
-                int r = ar / numApertures, a = ar % numApertures;  // row and aperture indices
-                std::vector<double> srcrow(numBasisFnc);
-                for(int b=0; b<numBasisFnc; b++)
-                    srcrow[b] = ndim == 1 ?
-                        pyArrayElem<galaxymodel::StorageNumT>(mat_arr,    a * numBasisFnc + b) :
-                        pyArrayElem<galaxymodel::StorageNumT>(mat_arr, r, a * numBasisFnc + b);
-                math::PtrFunction fnc;
-                switch(degree) {
-                    case 0: fnc.reset(new math::BsplineWrapper<0>(
-                        math::BsplineInterpolator1d<0>(gridv), srcrow));
-                        break;
-                    case 1: fnc.reset(new math::BsplineWrapper<1>(
-                        math::BsplineInterpolator1d<1>(gridv), srcrow));
-                        break;
-                    case 2: fnc.reset(new math::BsplineWrapper<2>(
-                        math::BsplineInterpolator1d<2>(gridv), srcrow));
-                        break;
-                    case 3: fnc.reset(new math::BsplineWrapper<3>(
-                        math::BsplineInterpolator1d<3>(gridv), srcrow));
-                        break;
-                    default:  // shouldn't occur, we've checked degree beforehand
-                        assert(false);
-                }
-                galaxymodel::GaussHermiteExpansion ghexp(*fnc, ghorder);
-                std::vector<double> dstrow(ghorder+4);
-                dstrow[0] = ghexp.gamma()  /* conv->massUnit*/;      // overall normalization
-                dstrow[1] = ghexp.center() / conv->velocityUnit;  // center of expansion
-                dstrow[2] = ghexp.sigma()  / conv->velocityUnit;  // width of expansion
-                std::copy(ghexp.coefs().begin(), ghexp.coefs().end(), dstrow.begin()+3);
-                for(int m=0; m<=ghorder+3; m++)
-                    (ndim==1 ?
-                    pyArrayElem<galaxymodel::StorageNumT>(output_arr,    a * (ghorder+4) + m) :
-                    pyArrayElem<galaxymodel::StorageNumT>(output_arr, r, a * (ghorder+4) + m) ) =
-                        static_cast<galaxymodel::StorageNumT>(dstrow[m]);
+    bool fail = false;
+    try{
+        const galaxymodel::StorageNumT* input =
+            static_cast<const galaxymodel::StorageNumT*>(PyArray_DATA(mat_arr));
+        galaxymodel::StorageNumT* output =
+            static_cast<galaxymodel::StorageNumT*>(PyArray_DATA((PyArrayObject*)output_arr));
+        if(gh_arr) {
+            // compute the GH moments for known (provided) parameters of expansion (gamma, meanv and sigma)
+            std::vector<double> ghparams(numApertures * 3);
+            for(npy_intp a=0; a<numApertures; a++) {
+                ghparams[a*3  ] = pyArrayElem<double>(gh_arr, a, 0) /* conv->massUnit*/;
+                ghparams[a*3+1] = pyArrayElem<double>(gh_arr, a, 1) * conv->velocityUnit;
+                ghparams[a*3+2] = pyArrayElem<double>(gh_arr, a, 2) * conv->velocityUnit;
             }
-            catch(std::exception& e) {
-#ifdef _OPENMP
-#pragma omp critical(PythonAPI)
-#endif
-                PyErr_SetString(PyExc_ValueError, e.what());
-                fail = true;
+            galaxymodel::computeGaussHermiteMomentsBatch(degree, gridv, ghorder,
+                numComponents, numApertures, &ghparams[0], input, output);
+        } else {
+            // construct best-fit GH expansion (find gamma,meanv,sigma) for each aperture and component,
+            // and then compute GH moments using these best-fit values
+            const npy_intp count = numApertures * numComponents;
+            galaxymodel::fitGaussHermiteBatch(degree, gridv, ghorder, count, input, output);
+            // convert the center and width of expansion to external units
+            for(npy_intp ar=0; ar < count; ar++) {
+                output[ar * (ghorder+4) + 1] /= conv->velocityUnit;
+                output[ar * (ghorder+4) + 2] /= conv->velocityUnit;
             }
         }
     }
+    catch(std::exception& e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        fail = true;
+    }
     Py_XDECREF(gh_arr);
     Py_DECREF(mat_arr);
     if(fail) {
@@ -4466,107 +4506,136 @@ PyObject* orbit(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
             (const math::IOdeSystem*) new orbit::OrbitIntegratorRot  (*pot, Omega / conv->timeUnit) );
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic, 1)
+#pragma omp parallel
 #endif
-        for(npy_intp orb = 0; orb < numOrbits; orb++) {
-            if(fail || cbrk.triggered()) continue;
+        {
+            // intermediate datacubes of all targets, allocated once per thread and reused
+            // for all orbits processed by this thread (they are reset after each orbit)
+            std::vector<math::Matrix<double> > datacubes(numTargets);
             try{
-                double integrTime = integrTimes.at(orb);
-                // slightly reduce the output interval for trajectory to ensure that
-                // the last point is stored (otherwise it may be left out due to roundoff)
-                double trajStep = haveTraj && trajSizes[orb]>0 ?
-                    integrTime / (trajSizes[orb]-1+1e-10) : INFINITY;
-                std::vector<coord::PosVelCar> traj;  // stores the trajectory
-
-                // construct runtime functions for each target that store the collected data
-                // in the respective row of each target's matrix,
-                // plus optionally the trajectory and Lyapunov exponent recording functions
-                orbit::RuntimeFncArray fncs(numTargets + haveTraj + haveLyap);
-                for(size_t t=0; t<numTargets; t++) {
-                    PyObject* storage_arr = PyTuple_GET_ITEM(result, t);
-                    galaxymodel::StorageNumT* output = singleOrbit ?
-                        &pyArrayElem<galaxymodel::StorageNumT>(storage_arr, 0) :
-                        &pyArrayElem<galaxymodel::StorageNumT>(storage_arr, orb, 0);
-                    fncs[t].reset(new galaxymodel::RuntimeFncTarget(*targets[t], output));
-                }
-                if(haveTraj)
-                    fncs[numTargets].reset(new orbit::RuntimeTrajectory<coord::Car>(trajStep, traj));
-                if(haveLyap) {
-                    double samplingInterval = 0.1 * T_circ(*pot, totalEnergy(*pot, initCond.at(orb)));
-                    PyObject* elem = PyTuple_GET_ITEM(result, numTargets + haveTraj);  // output array
-                    double& output = singleOrbit ?
-                        pyArrayElem<double>(elem, 0) :
-                        pyArrayElem<double>(elem, orb, 0);
-                    if(Omega == 0)  // UseInternalVarEqSolver
-                        fncs[numTargets + haveTraj].reset(
-                            new orbit::RuntimeLyapunov<true> (*pot, samplingInterval, output));
-                    else
-                        fncs[numTargets + haveTraj].reset(
-                            new orbit::RuntimeLyapunov<false>(*pot, samplingInterval, output));
-                }
-
-                // integrate the orbit
-                orbit::integrate(initCond.at(orb), integrTime, *orbitIntegrator, fncs, params);
-
-                // if the trajectory was recorded, store it in the corresponding item of the output tuple
-                if(haveTraj) {
-                    const npy_intp size = traj.size();
-                    npy_intp dims[] = {size, 6};
-                    PyObject *time_arr, *traj_arr;
+                for(size_t t=0; t<numTargets; t++)
+                    datacubes[t] = targets[t]->newDatacube();
+            }
+            catch(std::exception& e) {
 #ifdef _OPENMP
 #pragma omp critical(PythonAPI)
 #endif
-                    {   // avoid concurrent non-readonly access to Python C API
-                        time_arr = PyArray_SimpleNew(1, dims, STORAGE_NUM_T);
-                        traj_arr = PyArray_SimpleNew(2, dims, STORAGE_NUM_T);
+                PyErr_SetString(PyExc_ValueError, (std::string("Error in orbit(): ")+e.what()).c_str());
+                fail = true;
+            }
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+            for(npy_intp orb = 0; orb < numOrbits; orb++) {
+                if(fail || cbrk.triggered()) continue;
+                try{
+                    double integrTime = integrTimes.at(orb);
+                    // slightly reduce the output interval for trajectory to ensure that
+                    // the last point is stored (otherwise it may be left out due to roundoff)
+                    double trajStep = haveTraj && trajSizes[orb]>0 ?
+                        integrTime / (trajSizes[orb]-1+1e-10) : INFINITY;
+                    std::vector<coord::PosVelCar> traj;  // stores the trajectory
+
+                    // construct a single runtime function for all targets that collects the data
+                    // into temporary datacubes, which are converted into the respective row of each
+                    // target's matrix after the integration is finished,
+                    // plus optionally the trajectory and Lyapunov exponent recording functions
+                    const size_t haveTargets = numTargets>0 ? 1 : 0;
+                    orbit::RuntimeFncArray fncs(haveTargets + haveTraj + haveLyap);
+                    std::vector<galaxymodel::StorageNumT*> outputs(numTargets);
+                    for(size_t t=0; t<numTargets; t++) {
+                        PyObject* storage_arr = PyTuple_GET_ITEM(result, t);
+                        outputs[t] = singleOrbit ?
+                            &pyArrayElem<galaxymodel::StorageNumT>(storage_arr, 0) :
+                            &pyArrayElem<galaxymodel::StorageNumT>(storage_arr, orb, 0);
                     }
-                    if(!time_arr || !traj_arr) {
-                        fail = true;
-                        continue;
+                    galaxymodel::RuntimeFncTargets* fncTargets = NULL;
+                    if(haveTargets) {
+                        fncTargets = new galaxymodel::RuntimeFncTargets(targets, datacubes);
+                        fncs[0].reset(fncTargets);
                     }
-
-                    // convert the units and numerical type
-                    for(npy_intp index=0; index<size; index++) {
-                        double point[6];
-                        unconvertPosVel(traj[index], point);
-                        for(int c=0; c<6; c++)
-                            pyArrayElem<galaxymodel::StorageNumT>(traj_arr, index, c) =
-                            static_cast<galaxymodel::StorageNumT>(point[c]);
-                        pyArrayElem<galaxymodel::StorageNumT>(time_arr, index) =
-                        static_cast<galaxymodel::StorageNumT>(trajStep * index / conv->timeUnit);
+                    if(haveTraj)
+                        fncs[haveTargets].reset(new orbit::RuntimeTrajectory<coord::Car>(trajStep, traj));
+                    if(haveLyap) {
+                        double samplingInterval = 0.1 * T_circ(*pot, totalEnergy(*pot, initCond.at(orb)));
+                        PyObject* elem = PyTuple_GET_ITEM(result, numTargets + haveTraj);  // output array
+                        double& output = singleOrbit ?
+                            pyArrayElem<double>(elem, 0) :
+                            pyArrayElem<double>(elem, orb, 0);
+                        if(Omega == 0)  // UseInternalVarEqSolver
+                            fncs[haveTargets + haveTraj].reset(
+                                new orbit::RuntimeLyapunov<true> (*pot, samplingInterval, output));
+                        else
+                            fncs[haveTargets + haveTraj].reset(
+                                new orbit::RuntimeLyapunov<false>(*pot, samplingInterval, output));
                     }
 
-                    // store these arrays in the corresponding element of the output tuple
-                    PyObject* elem = PyTuple_GET_ITEM(result, numTargets);
-                    if(singleOrbit) {
-                        pyArrayElem<PyObject*>(elem, 0) = time_arr;
-                        pyArrayElem<PyObject*>(elem, 1) = traj_arr;
-                    } else {
-                        pyArrayElem<PyObject*>(elem, orb, 0) = time_arr;
-                        pyArrayElem<PyObject*>(elem, orb, 1) = traj_arr;
+                    // integrate the orbit
+                    orbit::integrate(initCond.at(orb), integrTime, *orbitIntegrator, fncs, params);
+                    if(fncTargets)
+                        fncTargets->finalize(&outputs[0]);
+
+                    // if the trajectory was recorded, store it in the corresponding item of the output tuple
+                    if(haveTraj) {
+                        const npy_intp size = traj.size();
+                        npy_intp dims[] = {size, 6};
+                        PyObject *time_arr, *traj_arr;
+#ifdef _OPENMP
+#pragma omp critical(PythonAPI)
+#endif
+                        {   // avoid concurrent non-readonly access to Python C API
+                            time_arr = PyArray_SimpleNew(1, dims, STORAGE_NUM_T);
+                            traj_arr = PyArray_SimpleNew(2, dims, STORAGE_NUM_T);
+                        }
+                        if(!time_arr || !traj_arr) {
+                            fail = true;
+                            continue;
+                        }
+
+                        // convert the units and numerical type
+                        for(npy_intp index=0; index<size; index++) {
+                            double point[6];
+                            unconvertPosVel(traj[index], point);
+                            for(int c=0; c<6; c++)
+                                pyArrayElem<galaxymodel::StorageNumT>(traj_arr, index, c) =
+                                static_cast<galaxymodel::StorageNumT>(point[c]);
+                            pyArrayElem<galaxymodel::StorageNumT>(time_arr, index) =
+                            static_cast<galaxymodel::StorageNumT>(trajStep * index / conv->timeUnit);
+                        }
+
+                        // store these arrays in the corresponding element of the output tuple
+                        PyObject* elem = PyTuple_GET_ITEM(result, numTargets);
+                        if(singleOrbit) {
+                            pyArrayElem<PyObject*>(elem, 0) = time_arr;
+                            pyArrayElem<PyObject*>(elem, 1) = traj_arr;
+                        } else {
+                            pyArrayElem<PyObject*>(elem, orb, 0) = time_arr;
+                            pyArrayElem<PyObject*>(elem, orb, 1) = traj_arr;
+                        }
                     }
-                }
 
-                // status update
+                    // status update
 #ifdef _OPENMP
 #pragma omp atomic
 #endif
-                ++numComplete;
-                if(numOrbits != 1) {
-                    time_t tnow = time(NULL);
-                    if(difftime(tnow, tprint)>=1.) {
-                        tprint = tnow;
-                        printf("%li orbits complete\r", (long int)numComplete);
-                        fflush(stdout);
+                    ++numComplete;
+                    if(numOrbits != 1) {
+                        time_t tnow = time(NULL);
+                        if(difftime(tnow, tprint)>=1.) {
+                            tprint = tnow;
+                            printf("%li orbits complete\r", (long int)numComplete);
+                            fflush(stdout);
+                        }
                     }
                 }
-            }
-            catch(std::exception& e) {
+                catch(std::exception& e) {
 #ifdef _OPENMP
 #pragma omp critical(PythonAPI)
 #endif
-                PyErr_SetString(PyExc_ValueError, (std::string("Error in orbit(): ")+e.what()).c_str());
-                fail = true;
+                    PyErr_SetString(PyExc_ValueError, (std::string("Error in orbit(): ")+e.what()).c_str());
+                    fail = true;
+                }
             }
         }
     }
@@ -4912,18 +4981,33 @@ static const char* docstringSolveOpt =
     "if not provided, it implies a vector of zeros, i.e. the solution must be nonnegative).\n"
     "  xmax:    1d vector of length C - maximum allowed values for the solution x (optional - "
     "if not provided, it implies no upper limit).\n"
+    "  x0:      1d vector of length C - initial guess for the solution (optional). "
+    "If provided, the problem is solved by the built-in first-order method (accelerated projected "
+    "gradient) starting from this point, which is efficient when solving a sequence of similar "
+    "problems, e.g., when scanning the regularization parameters; in this case linear penalties "
+    "for constraint violation (rpenl) are not supported. "
+    "The built-in solver is also used when no external LP/QP solvers are available.\n"
+    "  lambda0: 1d vector of length R, or a tuple of vectors R1,R2,... - initial guess for "
+    "the Lagrange multipliers of the constraints that must be satisfied exactly (optional, "
+    "used only together with x0; if not provided, the multipliers start from zero, and "
+    "the warm start is less efficient for problems with exact constraints).\n"
     "Returns:\n"
     "  the vector x solving the above system; if it cannot be solved exactly and no penalties "
-    "for constraint violation were provided, then raise an exception.";
+    "for constraint violation were provided, then raise an exception. "
+    "If lambda0 was provided, return a tuple of two vectors: the solution x and the final values of "
+    "Lagrange multipliers (zero for constraints with finite penalties), which may be used as x0 "
+    "and lambda0 in the next call.";
 ///
 PyObject* solveOpt(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
 {
     static const char* keywords[] =
-        {"matrix", "rhs", "xpenl", "xpenq", "rpenl", "rpenq", "xmin", "xmax", NULL};
+        {"matrix", "rhs", "xpenl", "xpenq", "rpenl", "rpenq", "xmin", "xmax", "x0", "lambda0", NULL};
     PyObject *matrix_obj = NULL, *rhs_obj = NULL, *xpenl_obj = NULL, *xpenq_obj = NULL,
-        *rpenl_obj = NULL, *rpenq_obj = NULL, *xmin_obj = NULL, *xmax_obj = NULL;
-    if(!PyArg_ParseTupleAndKeywords(args, namedArgs, "OO|OOOOOO", const_cast<char**>(keywords),
-        &matrix_obj, &rhs_obj, &xpenl_obj, &xpenq_obj, &rpenl_obj, &rpenq_obj, &xmin_obj, &xmax_obj))
+        *rpenl_obj = NULL, *rpenq_obj = NULL, *xmin_obj = NULL, *xmax_obj = NULL, *x0_obj = NULL,
+        *lambda0_obj = NULL;
+    if(!PyArg_ParseTupleAndKeywords(args, namedArgs, "OO|OOOOOOOO", const_cast<char**>(keywords),
+        &matrix_obj, &rhs_obj, &xpenl_obj, &xpenq_obj, &rpenl_obj, &rpenq_obj, &xmin_obj, &xmax_obj,
+        &x0_obj, &lambda0_obj))
     {
         return NULL;
     }
@@ -4949,7 +5033,7 @@ PyObject* solveOpt(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
     }
 
     // check and stack other input vectors
-    std::vector<double> rhs, xpenl, xpenq, rpenl, rpenq, xmin, xmax, result;
+    std::vector<double> rhs, xpenl, xpenq, rpenl, rpenq, xmin, xmax, result, multipliers;
     if(!stackVectors(rhs_obj, nRow, rhs) || rhs.empty()) {
         PyErr_SetString(PyExc_ValueError, "Argument 'rhs' must be a 1d array "
             "or a tuple of such arrays matching the number of rows in 'matrix'");
@@ -4990,12 +5074,46 @@ PyObject* solveOpt(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
         return NULL;
     }
 
+    if(x0_obj != NULL && x0_obj != Py_None) {
+        result = toDoubleArray(x0_obj);
+        if((int)result.size() != nCol) {
+            PyErr_SetString(PyExc_ValueError, "Argument 'x0', if provided, must be a 1d array "
+                "with length matching the number of columns in 'matrix'");
+            return NULL;
+        }
+        if(!rpenl.empty() && !math::allZeros(rpenl)) {
+            PyErr_SetString(PyExc_ValueError,
+                "Argument 'rpenl' is not supported when the initial guess 'x0' is provided");
+            return NULL;
+        }
+        if(rpenq.empty() && !rpenl.empty())  // zero linear penalties mean unconstrained rows
+            rpenq.assign(rpenl.size(), 0.);
+    }
+    bool haveMultipliers = lambda0_obj != NULL && lambda0_obj != Py_None;
+    if(haveMultipliers) {
+        if(result.empty()) {
+            PyErr_SetString(PyExc_ValueError,
+                "Argument 'lambda0' may only be provided together with the initial guess 'x0'");
+            return NULL;
+        }
+        if(!stackVectors(lambda0_obj, nRow, multipliers) || multipliers.empty()) {
+            PyErr_SetString(PyExc_ValueError, "Argument 'lambda0' must be a 1d array "
+                "or a tuple of such arrays matching the number of rows in 'matrix'");
+            return NULL;
+        }
+    }
+
     // construct an interface layer for matrix stacking
     StackedMatrix matrix(matrixStack, nRowTotal, nCol, nRow);
 
     // call the appropriate solver
     try {
-        if(rpenl.empty() && rpenq.empty()) {
+        if(!result.empty()) {
+            // warm start with the built-in first-order solver
+            math::quadraticOptimizationSolveFirstOrder(
+                matrix, rhs, xpenl, math::BandMatrix<double>(xpenq), rpenq, xmin, xmax,
+                result, multipliers);
+        } else if(rpenl.empty() && rpenq.empty()) {
             if(xpenq.empty())
                 result = math::linearOptimizationSolve(
                     matrix, rhs, xpenl, xmin, xmax);
@@ -5015,6 +5133,8 @@ PyObject* solveOpt(PyObject* /*self*/, PyObject* args, PyObject* namedArgs)
         PyErr_SetString(PyExc_ValueError, (std::string("Error in solveOpt(): ")+e.what()).c_str());
         return NULL;
     }
+    if(haveMultipliers)
+        return Py_BuildValue("NN", toPyArray(result), toPyArray(multipliers));
     return toPyArray(result);
 }
 
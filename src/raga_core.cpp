@@ -5,66 +5,13 @@
 #include "potential_multipole.h"
 #include "potential_factory.h"
 #include "math_core.h"
+#include <algorithm>
 #include <fstream>
 #include <stdexcept>
 #include <ctime>
 
 namespace raga {
 
-void computeTotalEnergyModel(
-    const potential::BasePotential& pot,
-    const BHParams& bh,
-    const particles::ParticleArrayCar& particles,
-    double time, double& resultEtot, double& resultEsum)
-{
-    double Etot=0, Esum=0;
-    // potential at origin excluding BH
-    double stellarPotentialCenter = pot.value(coord::PosCyl(0,0,0));
-    // add the energy of BH in the stellar potential 
-    Etot += bh.mass * stellarPotentialCenter * 0.5;
-    Esum += bh.mass * stellarPotentialCenter;
-    // add the internal energy of binary BH
-    if(bh.sma>0) {
-        double Ebin = 0.5 * pow_2(bh.mass) / bh.sma *
-            bh.q / pow_2(1+bh.q);
-        Etot -= Ebin;
-        Esum -= Ebin*2;
-    }
-    // add energies of all particles
-    ptrdiff_t nbody = particles.size();
-#ifdef _OPENMP
-#pragma omp parallel for schedule(static) reduction(+:Etot,Esum)
-#endif
-    for(ptrdiff_t ip=0; ip<nbody; ip++) {
-        const coord::PosVelCar& point = particles.point(ip);
-        double Epot = pot.value(point) + bh.potential(time, point);
-        double Ekin = (pow_2(point.vx) + pow_2(point.vy) + pow_2(point.vz)) * 0.5;
-        Etot += particles.mass(ip) * (Ekin+Epot*0.5);
-        Esum += particles.mass(ip) * (Ekin+Epot);
-    }
-    resultEtot = Etot;
-    resultEsum = Esum;
-}
-
-std::string printLog(
-    const potential::BasePotential& pot,
-    const BHParams& bh,
-    const particles::ParticleArrayCar& particles,
-    const double time,
-    const std::string& taskName)
-{
-    double Etot, Esum;
-    computeTotalEnergyModel(pot, bh, particles, 0, Etot, Esum);
-    utils::msg(utils::VL_MESSAGE, "RagaEpisode",
-        taskName + " done at t=" + utils::toString(time)+
-        ", total energy=" + utils::toString(Etot) + ", sumE=" + utils::toString(Esum));
-    return
-        utils::pp(time, 10) + '\t' + taskName + '\t' +
-        utils::pp(Etot, 12) + '\t' +
-        utils::pp(Esum, 12) + '\t' +
-        utils::pp(pot.value(coord::PosCar(0,0,0)), 12) + '\n';
-}
-
 RagaCore::RagaCore(const utils::KeyValueMap& config)
 {
     // parse the configuration and check the validity of parameters
@@ -78,6 +25,9 @@ RagaCore::RagaCore(const utils::KeyValueMap& config)
     ptrPot = potential::Multipole::create(particles, paramsPotential.symmetry,
         paramsPotential.lmax, paramsPotential.lmax, paramsPotential.gridSizeR);
 
+    // the diagnostic output keeps references to the particles, potential and black hole(s)
+    diagnostics.reset(new RagaDiagnostics(paramsDiagnostics, particles, ptrPot, bh));
+
     // initialize various tasks, depending on the parameters
     // Order *IS* important!
     if(paramsLosscone.captureRadius[0]>0 && bh.mass>0) 
@@ -109,11 +59,11 @@ RagaCore::RagaCore(const utils::KeyValueMap& config)
 
 void RagaCore::run()
 {
-    if(!paramsRaga.fileLog.empty()) {
-        std::ofstream strmLog(paramsRaga.fileLog.c_str());
-        strmLog << "#Time   \tTaskName\tTotalEnergy\tSumEnergy\tPhi_star(0)\n" +
-            printLog(*ptrPot, bh, particles, paramsRaga.timeCurr, "Initialization");
+    if(!paramsDiagnostics.outputFilename.empty()) {
+        std::ofstream strmLog(paramsDiagnostics.outputFilename.c_str());
+        strmLog << diagnostics->header();
     }
+    diagnostics->printLog(paramsRaga.timeCurr, "Initialization");
     while(paramsRaga.timeCurr < paramsRaga.timeEnd)
         doEpisode();
 }
@@ -149,6 +99,8 @@ void RagaCore::doEpisode()
                 particles.point(index), episodeLength,
                 RagaOrbitIntegrator(*ptrPot, bh),
                 timestepFncs, orbitIntParams);
+            // the potential at the new position is stored for the diagnostic output
+            diagnostics->updateParticle(index);
         }
     }   // end parallel for
 
@@ -157,17 +109,15 @@ void RagaCore::doEpisode()
         utils::toString(nbody) + " particles, " +
         utils::toString(nbody / wallClockDurationEpisode) + " orbits/s");
 
-    std::ofstream strmLog;
-    if(!paramsRaga.fileLog.empty())
-        strmLog.open(paramsRaga.fileLog.c_str(), std::ios::app);
-
+    diagnostics->finishEpisode();
     paramsRaga.timeCurr += episodeLength;
-    strmLog << printLog(*ptrPot, bh, particles, paramsRaga.timeCurr, "Episode ");
+    // unless logEveryTask is set, the log is written only at the end of the entire episode
+    diagnostics->printLog(paramsRaga.timeCurr, "Episode ", /*force*/ numtasks==0);
 
     // finish episode by calling corresponding function for each task
     for(int task=0; task<numtasks; task++) {
         tasks[task]->finishEpisode();
-        strmLog << printLog(*ptrPot, bh, particles, paramsRaga.timeCurr, tasks[task]->name());
+        diagnostics->printLog(paramsRaga.timeCurr, tasks[task]->name(), /*force*/ task==numtasks-1);
     }
 }
 
@@ -191,7 +141,13 @@ void RagaCore::loadSettings(const utils::KeyValueMap& config)
     if(paramsRaga.fileInput=="" || !utils::fileExists(paramsRaga.fileInput))
         throw std::runtime_error("Input file "+paramsRaga.fileInput+" does not exist ([Raga]/fileInput)");
     paramsRaga.integratorAccuracy  = config.getDouble("accuracy", 1e-8);
-    paramsRaga.fileLog  = config.getString("fileLog", paramsRaga.fileInput+".log");
+    paramsDiagnostics.outputFilename = config.getString("fileLog", paramsRaga.fileInput+".log");
+    paramsDiagnostics.logEveryTask   = config.getBool("logEveryTask", true);
+    std::string lagrangeRadii = config.getString("lagrangeRadii");
+    if(!lagrangeRadii.empty())
+        paramsDiagnostics.lagrangeFractions =
+            utils::toDoubleVector(utils::splitString(lagrangeRadii, ",; "));
+    std::sort(paramsDiagnostics.lagrangeFractions.begin(), paramsDiagnostics.lagrangeFractions.end());
     paramsRaga.timeEnd  = config.getDouble("timeTotal");
     paramsRaga.timeCurr = config.getDouble("timeInit");
     paramsRaga.episodeLength = config.getDouble("episodeLength", paramsRaga.timeEnd-paramsRaga.timeCurr);
@@ -219,6 +175,8 @@ void RagaCore::loadSettings(const utils::KeyValueMap& config)
         std::max(1, config.getInt("numSamplesPerEpisode", 1));
     paramsRelaxation.relaxationRate   = config.getDouble("relaxationRate", 0);
     paramsRelaxation.gridSizeDF       = config.getInt("gridSizeDF", 25);
+    paramsRelaxation.updateToleranceDF= config.getDouble("updateToleranceDF", -1);
+    paramsRelaxation.maxIncrementalUpdates = std::max(0, config.getInt("maxIncrementalUpdates", 10));
     paramsLosscone.captureRadius[0]   = config.getDoubleAlt("captureRadius", "captureRadius1", 0);
     paramsLosscone.captureRadius[1]   = config.getDouble("captureRadius2", paramsLosscone.captureRadius[0]);
     paramsLosscone.captureMassFraction= config.getDouble("captureMassFraction", 1);
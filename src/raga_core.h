@@ -42,6 +42,7 @@
 #pragma once
 #include "raga_base.h"
 #include "raga_binary.h"
+#include "raga_diagnostics.h"
 #include "raga_losscone.h"
 #include "raga_potential.h"
 #include "raga_relaxation.h"
@@ -58,7 +59,6 @@ struct ParamsRaga {
     double timeEnd;             ///< total (maximum) simulation time
     double episodeLength;       ///< duration of one episode
     std::string fileInput;      ///< input file name (initial conditions for the simulation)
-    std::string fileLog;        ///< file name for logging the global parameters of the simulation
 };
 
 /// the driver class performing the actual simulation
@@ -69,10 +69,12 @@ class RagaCore {
     ParamsTrajectory paramsTrajectory;     ///< parameters of trajectory output
     ParamsLosscone   paramsLosscone;       ///< parameters of loss-cone treatment
     ParamsBinary     paramsBinary;         ///< parameters of the binary BH evolution
+    ParamsDiagnostics paramsDiagnostics;   ///< parameters of the diagnostic output
     potential::PtrPotential ptrPot;        ///< stellar potential used in orbit integration
     BHParams bh;                           ///< parameters of the central black hole(s)
     particles::ParticleArrayCar particles; ///< particles (masses and phase-space coordinates)
     std::vector<PtrRagaTask> tasks;        ///< array of runtime tasks
+    shared_ptr<RagaDiagnostics> diagnostics; ///< cached global properties for the log file
 
     /** parse the configuration parameters stored in the key=value dictionary */
     void loadSettings(const utils::KeyValueMap& config);
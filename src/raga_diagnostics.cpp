@@ -0,0 +1,199 @@
+#include "raga_diagnostics.h"
+#include "potential_base.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace raga {
+
+namespace {
+
+/// check whether two sets of black hole parameters are identical
+inline bool sameBH(const BHParams& bh1, const BHParams& bh2)
+{
+    return bh1.mass == bh2.mass && bh1.q == bh2.q && bh1.sma == bh2.sma &&
+        bh1.ecc == bh2.ecc && bh1.phase == bh2.phase;
+}
+
+/// helper class for sorting the particle indices in radius
+class RadiusComparator {
+    const particles::ParticleArrayCar& particles;
+public:
+    explicit RadiusComparator(const particles::ParticleArrayCar& _particles) :
+        particles(_particles) {}
+    bool operator()(size_t i, size_t j) const {
+        const coord::PosVelCar& pi = particles.point(i);
+        const coord::PosVelCar& pj = particles.point(j);
+        return pow_2(pi.x) + pow_2(pi.y) + pow_2(pi.z) < pow_2(pj.x) + pow_2(pj.y) + pow_2(pj.z);
+    }
+};
+
+}  // internal namespace
+
+RagaDiagnostics::RagaDiagnostics(
+    const ParamsDiagnostics& _params,
+    const particles::ParticleArrayCar& _particles,
+    const potential::PtrPotential& _ptrPot,
+    const BHParams& _bh)
+:
+    params(_params),
+    particles(_particles),
+    ptrPot(_ptrPot),
+    bh(_bh),
+    needSort(true),
+    cachedPhi0(NAN)
+{
+    // the cache is empty and will be filled upon the first call to compute()
+    cachedBH.mass = NAN;
+}
+
+void RagaDiagnostics::updateParticle(size_t index)
+{
+    // the arrays have been allocated in the previous call to compute(), and the potential
+    // has not been changed since then (it stays fixed during the orbit integration)
+    if(index >= phiStar.size() || index >= phiBH.size())
+        return;
+    const coord::PosVelCar& point = particles.point(index);
+    if(ptrPot == cachedPot)
+        phiStar[index] = ptrPot->value(point);
+    if(sameBH(bh, cachedBH))
+        phiBH[index] = bh.potential(0, point);
+}
+
+void RagaDiagnostics::finishEpisode()
+{
+    needSort = true;
+}
+
+void RagaDiagnostics::refreshPotential()
+{
+    ptrdiff_t nbody = particles.size();
+    if(ptrPot == cachedPot && (ptrdiff_t)phiStar.size() == nbody)
+        return;
+    phiStar.resize(nbody);
+    const potential::BasePotential& pot = *ptrPot;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(ptrdiff_t ip=0; ip<nbody; ip++)
+        phiStar[ip] = pot.value(particles.point(ip));
+    cachedPhi0 = pot.value(coord::PosCar(0,0,0));
+    cachedPot  = ptrPot;
+}
+
+void RagaDiagnostics::refreshBH()
+{
+    ptrdiff_t nbody = particles.size();
+    if(sameBH(bh, cachedBH) && (ptrdiff_t)phiBH.size() == nbody)
+        return;
+    phiBH.resize(nbody);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(ptrdiff_t ip=0; ip<nbody; ip++)
+        phiBH[ip] = bh.potential(0, particles.point(ip));
+    cachedBH = bh;
+}
+
+void RagaDiagnostics::computeLagrangeRadii(std::vector<double>& result)
+{
+    size_t nbody = particles.size(), numFrac = params.lagrangeFractions.size();
+    result.assign(numFrac, NAN);
+    if(numFrac == 0)
+        return;
+    if(needSort || sortedIndices.size() != nbody) {
+        sortedIndices.resize(nbody);
+        for(size_t ip=0; ip<nbody; ip++)
+            sortedIndices[ip] = ip;
+        std::sort(sortedIndices.begin(), sortedIndices.end(), RadiusComparator(particles));
+        needSort = false;
+    }
+    // masses may have changed since the last sorting, so the cumulative profile is recomputed
+    double totalMass = 0;
+    for(size_t ip=0; ip<nbody; ip++)
+        totalMass += particles.mass(ip);
+    double cumulMass = 0;
+    size_t frac = 0;
+    for(size_t i=0; i<nbody && frac<numFrac; i++) {
+        size_t ip = sortedIndices[i];
+        cumulMass += particles.mass(ip);
+        const coord::PosVelCar& point = particles.point(ip);
+        while(frac<numFrac && cumulMass >= params.lagrangeFractions[frac] * totalMass) {
+            result[frac] = sqrt(pow_2(point.x) + pow_2(point.y) + pow_2(point.z));
+            frac++;
+        }
+    }
+}
+
+DiagnosticsData RagaDiagnostics::compute()
+{
+    refreshPotential();
+    refreshBH();
+    DiagnosticsData result;
+    double Etot=0, Esum=0, Ekin=0;
+    // add the energy of BH in the stellar potential
+    Etot += bh.mass * cachedPhi0 * 0.5;
+    Esum += bh.mass * cachedPhi0;
+    // add the internal energy of binary BH
+    if(bh.sma>0) {
+        double Ebin = 0.5 * pow_2(bh.mass) / bh.sma *
+            bh.q / pow_2(1+bh.q);
+        Etot -= Ebin;
+        Esum -= Ebin*2;
+    }
+    // add energies of all particles, using the cached values of potential
+    ptrdiff_t nbody = particles.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) reduction(+:Etot,Esum,Ekin)
+#endif
+    for(ptrdiff_t ip=0; ip<nbody; ip++) {
+        const coord::PosVelCar& point = particles.point(ip);
+        double mass = particles.mass(ip);
+        double Epot = phiStar[ip] + phiBH[ip];
+        double Ek   = (pow_2(point.vx) + pow_2(point.vy) + pow_2(point.vz)) * 0.5;
+        Etot += mass * (Ek+Epot*0.5);
+        Esum += mass * (Ek+Epot);
+        Ekin += mass * Ek;
+    }
+    result.Etot   = Etot;
+    result.Esum   = Esum;
+    result.Ekin   = Ekin;
+    result.Epot   = Etot - Ekin;
+    result.virial = result.Epot != 0 ? 2 * Ekin / fabs(result.Epot) : NAN;
+    result.Phi0   = cachedPhi0;
+    computeLagrangeRadii(result.lagrangeRadii);
+    return result;
+}
+
+std::string RagaDiagnostics::header() const
+{
+    std::string result = "#Time   \tTaskName\tTotalEnergy\tSumEnergy\tPhi_star(0)\tVirialRatio";
+    for(size_t i=0; i<params.lagrangeFractions.size(); i++)
+        result += "\tR(" + utils::toString(params.lagrangeFractions[i]) + ")";
+    return result + '\n';
+}
+
+void RagaDiagnostics::printLog(double time, const std::string& taskName, bool force)
+{
+    if(!force && !params.logEveryTask)
+        return;
+    DiagnosticsData data = compute();
+    utils::msg(utils::VL_MESSAGE, "RagaEpisode",
+        taskName + " done at t=" + utils::toString(time)+
+        ", total energy=" + utils::toString(data.Etot) + ", sumE=" + utils::toString(data.Esum));
+    if(params.outputFilename.empty())
+        return;
+    std::string line =
+        utils::pp(time, 10) + '\t' + taskName + '\t' +
+        utils::pp(data.Etot, 12) + '\t' +
+        utils::pp(data.Esum, 12) + '\t' +
+        utils::pp(data.Phi0, 12) + '\t' +
+        utils::pp(data.virial, 8);
+    for(size_t i=0; i<data.lagrangeRadii.size(); i++)
+        line += '\t' + utils::pp(data.lagrangeRadii[i], 8);
+    std::ofstream strmLog(params.outputFilename.c_str(), std::ios::app);
+    strmLog << line << '\n';
+}
+
+}  // namespace
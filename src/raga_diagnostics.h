@@ -0,0 +1,143 @@
+/** \file    raga_diagnostics.h
+    \brief   Global diagnostics of the simulation (part of the Raga code)
+    \author  Eugene Vasiliev
+    \date    2013-2018
+
+    This module computes and writes out the global properties of the system after each episode
+    and optionally after each task: total energy, virial ratio and Lagrange radii.
+
+    A straightforward evaluation of the total energy requires computing the potential at
+    the location of every particle, and if this is done after the episode and after
+    each of the tasks, the cost of logging alone may become comparable to a sizeable fraction
+    of the orbit integration itself. Instead, the RagaDiagnostics class keeps a cache of
+    the stellar and black-hole potentials at the position of each particle, and updates it
+    only when something has actually changed:
+    - the positions of particles change only during the orbit integration phase, and the cached
+    potential for each particle is updated by the main loop in RagaCore right after its orbit
+    has been computed, which costs only one extra potential evaluation per orbit;
+    - the stellar potential may be replaced by the PotentialUpdate task, in which case the cache
+    is recomputed for all particles (this happens at most once per episode);
+    - the parameters of the black hole(s) may be changed by the Binary or Losscone tasks,
+    in which case only the (cheap) black-hole contribution is recomputed;
+    - the masses of particles may be set to zero by the Losscone task, which does not require
+    any potential evaluations at all.
+    The radii of particles needed for the Lagrange radii are sorted once per episode, and later
+    only the cumulative mass profile is recomputed (which is linear in the number of particles).
+*/
+#pragma once
+#include "raga_base.h"
+#include "particles_base.h"
+#include <string>
+#include <vector>
+
+namespace raga {
+
+/** Fixed global parameters of the diagnostic output */
+struct ParamsDiagnostics {
+    /// file name for logging the global parameters of the simulation (empty means no logging)
+    std::string outputFilename;
+
+    /// whether to write out the diagnostic information after each task (true), or only
+    /// at the end of the episode and after the last task (false), which reduces the overhead
+    bool logEveryTask;
+
+    /// fractions of the total mass enclosing the Lagrange radii (may be empty)
+    std::vector<double> lagrangeFractions;
+};
+
+/** Cached global properties of the system computed by RagaDiagnostics */
+struct DiagnosticsData {
+    double Etot;      ///< total energy of the system (each pair of interacting particles counted once)
+    double Esum;      ///< sum of energies of all particles (in the stellar and black-hole potential)
+    double Ekin;      ///< total kinetic energy of the particles
+    double Epot;      ///< total potential energy of the system, including the black hole(s)
+    double virial;    ///< virial ratio 2 Ekin / |Epot|
+    double Phi0;      ///< stellar potential at origin
+    std::vector<double> lagrangeRadii;  ///< radii enclosing the given fractions of the total mass
+};
+
+/** The class that maintains the cache of particle potentials and computes the diagnostic output */
+class RagaDiagnostics {
+public:
+    /** create the diagnostics object and initialize the cache for the current state of the system.
+        \param[in] params  are the fixed parameters of the diagnostic output;
+        \param[in] particles  is the read-only reference to the array of particles
+        owned by RagaCore (positions and masses may change during the simulation);
+        \param[in] ptrPot  is the read-only reference to the shared pointer to the stellar potential,
+        which may be re-assigned by other tasks;
+        \param[in] bh  is the read-only reference to the parameters of the central black hole(s).
+    */
+    RagaDiagnostics(
+        const ParamsDiagnostics& params,
+        const particles::ParticleArrayCar& particles,
+        const potential::PtrPotential& ptrPot,
+        const BHParams& bh);
+
+    /** update the cached potential for a single particle after its position has changed;
+        this routine is thread-safe as long as different threads work on different particles,
+        and is intended to be called from the parallel loop over orbits in each episode.
+    */
+    void updateParticle(size_t index);
+
+    /** inform the cache that the positions of all particles have been updated
+        by the calls to updateParticle (should be invoked after the orbit integration loop) */
+    void finishEpisode();
+
+    /** compute the global properties of the system, refreshing the cache if necessary */
+    DiagnosticsData compute();
+
+    /** return the header line of the log file */
+    std::string header() const;
+
+    /** write a line to the log file and print the total energy to the console.
+        \param[in] time  is the current simulation time;
+        \param[in] taskName  is the name of the task that was just completed;
+        \param[in] force  if true, the line is always printed, otherwise only if logEveryTask
+        is set in the parameters.
+    */
+    void printLog(double time, const std::string& taskName, bool force=true);
+
+private:
+    /// fixed parameters of the diagnostic output
+    const ParamsDiagnostics params;
+
+    /// read-only reference to the array of particles
+    const particles::ParticleArrayCar& particles;
+
+    /// read-only reference to the global shared pointer containing the stellar potential
+    const potential::PtrPotential& ptrPot;
+
+    /// read-only reference to the parameters of the black hole(s)
+    const BHParams& bh;
+
+    /// the stellar potential for which the cache is valid; a copy of the shared pointer is kept
+    /// so that this instance is not deallocated before the cache is updated, hence a new potential
+    /// can be reliably detected by comparing the pointers
+    potential::PtrPotential cachedPot;
+
+    /// the black hole parameters for which the cache is valid
+    BHParams cachedBH;
+
+    /// cached stellar and black-hole potentials at the positions of all particles
+    std::vector<double> phiStar, phiBH;
+
+    /// indices of particles sorted in radius (only if Lagrange radii are requested)
+    std::vector<size_t> sortedIndices;
+
+    /// whether the particle positions have changed since the last sorting
+    bool needSort;
+
+    /// stellar potential at origin for the cached potential
+    double cachedPhi0;
+
+    /// recompute the stellar potential for all particles if it was changed
+    void refreshPotential();
+
+    /// recompute the black-hole potential for all particles if the parameters have changed
+    void refreshBH();
+
+    /// compute the Lagrange radii, sorting the particles in radius if necessary
+    void computeLagrangeRadii(std::vector<double>& result);
+};
+
+}  // namespace
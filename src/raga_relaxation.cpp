@@ -201,12 +201,16 @@ potential::PtrPotential createSphericalPotential(
     return potential::PtrPotential(new potential::Multipole(rad, Phi, dPhi));
 }
 
-// prepare the relaxation model (diffusion coefficients) for the spherical potential
+// prepare the relaxation model (diffusion coefficients) for the spherical potential;
+// if the previous model is provided, its tables are reused in the regions where the DF
+// has changed by less than the given relative tolerance (the potential must be the same)
 galaxymodel::PtrSphericalModelLocal createRelaxationModel(
     const potential::BasePotential& sphPot,
     std::vector<double>& particle_h,
     std::vector<double>& particle_m,
-    const unsigned int numbins)
+    const unsigned int numbins,
+    const galaxymodel::SphericalModelLocal* prevModel = NULL,
+    const double tolerance = 0)
 {
     // establish the correspondence between phase volume <=> energy
     potential::PhaseVolume phasevol((potential::PotentialWrapper(sphPot)));
@@ -224,6 +228,9 @@ galaxymodel::PtrSphericalModelLocal createRelaxationModel(
     CautiousLogLogSpline df(galaxymodel::fitSphericalDF(particle_h, particle_m, numbins), minSlope);
 
     // compute diffusion coefficients
+    if(prevModel)
+        return galaxymodel::PtrSphericalModelLocal(
+            new galaxymodel::SphericalModelLocal(phasevol, df, *prevModel, tolerance));
     return galaxymodel::PtrSphericalModelLocal(new galaxymodel::SphericalModelLocal(phasevol, df));
 }
 
@@ -239,9 +246,12 @@ RagaTaskRelaxation::RagaTaskRelaxation(
     particles(_particles),
     ptrPot(_ptrPot),
     bh(_bh),
-    prevOutputTime(-INFINITY)
+    prevOutputTime(-INFINITY),
+    numIncrementalUpdates(0)
 {
     ptrPotSph = createSphericalPotential(*ptrPot, bh.mass);
+    ptrPotSrc = ptrPot;
+    MbhSrc    = bh.mass;
     potential::PhaseVolume phasevol((potential::PotentialWrapper(*ptrPotSph)));
     ptrdiff_t nbody = particles.size();
     std::vector<double> particle_m(nbody);
@@ -295,10 +305,28 @@ void RagaTaskRelaxation::finishEpisode()
             particle_m[i * params.numSamplesPerEpisode + j] = mass;
     }
 
-    // create a new relaxation model for a sphericalized version of the current potential
-    ptrPotSph = createSphericalPotential(*ptrPot, bh.mass);
-    ptrRelaxationModel = createRelaxationModel(*ptrPotSph,
-        particle_h, particle_m, params.gridSizeDF);
+    // create a new relaxation model for a sphericalized version of the current potential;
+    // if the potential has not changed, the previous model is updated incrementally,
+    // and the changes in the DF that are smaller than the tolerance (by default, the statistical
+    // noise of the fit estimated from the number of particles per bin in the DF) are ignored,
+    // but only for a limited number of consecutive episodes, after which the model is rebuilt
+    double tolerance = params.updateToleranceDF >= 0 ? params.updateToleranceDF :
+        0.5 * sqrt(params.gridSizeDF * 1. / nbody);
+    if(ptrPot != ptrPotSrc || bh.mass != MbhSrc) {
+        ptrPotSph = createSphericalPotential(*ptrPot, bh.mass);
+        ptrPotSrc = ptrPot;
+        MbhSrc    = bh.mass;
+        tolerance = 0;
+    }
+    if(tolerance > 0 && numIncrementalUpdates < params.maxIncrementalUpdates) {
+        ptrRelaxationModel = createRelaxationModel(*ptrPotSph,
+            particle_h, particle_m, params.gridSizeDF, ptrRelaxationModel.get(), tolerance);
+        numIncrementalUpdates++;
+    } else {
+        ptrRelaxationModel = createRelaxationModel(*ptrPotSph,
+            particle_h, particle_m, params.gridSizeDF);
+        numIncrementalUpdates = 0;
+    }
 
     // check if we need to output the relaxation model to a file
     double currentTime = episodeStart+episodeLength;
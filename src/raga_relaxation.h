@@ -151,6 +151,18 @@ struct ParamsRelaxation {
     /// size of the grid in energy space for constructing the spherical model
     unsigned int gridSizeDF;
 
+    /// relative tolerance for the incremental update of the spherical model when the potential
+    /// has not changed: the diffusion coefficients are reused from the previous model in the regions
+    /// where the DF has changed by less than this amount; 0 means that the model is always rebuilt
+    /// from scratch, and a negative value sets it to the statistical noise of the DF fit,
+    /// 0.5 * sqrt(gridSizeDF / N_particles)
+    double updateToleranceDF;
+
+    /// maximum number of consecutive incremental updates of the spherical model, after which
+    /// it is rebuilt from scratch (so that the changes in the DF below the tolerance are not
+    /// neglected indefinitely)
+    unsigned int maxIncrementalUpdates;
+
     /// [base] file name for outputting the properties of the spherical model;
     /// the current simulation time is appended to the file name
     std::string outputFilename;
@@ -210,6 +222,16 @@ private:
     */
     potential::PtrPotential ptrPotSph;
 
+    /** the stellar potential and the black hole mass from which ptrPotSph was constructed;
+        if neither has changed by the end of an episode (e.g., when the potential update is disabled),
+        the same spherical potential is kept, and the relaxation model is updated incrementally
+    */
+    potential::PtrPotential ptrPotSrc;
+    double MbhSrc;
+
+    /** number of consecutive episodes in which the relaxation model was updated incrementally  */
+    unsigned int numIncrementalUpdates;
+
     /** internally constructed relaxation model for the spherical potential,
         which provides the diffusion coefficients for perturbing the particle velocity
         during orbit integration
@@ -86,6 +86,11 @@ const char* usage =
     "  timeTotal=...    [G] total evolution time (required)\n"
     "  eps=(0.01)       [G] accuracy parameter for time integration: the timestep is eps times "
     "the geometric mean of the two characteristic timescales - f / (df/dt) and the relaxation time\n"
+    "  adaptive=(false) [G] whether to use the adaptive time integration with error control "
+    "instead of the heuristic timestep choice based on the eps parameter\n"
+    "  timeAccuracy=(1e-3)  [G] relative accuracy of the adaptive time integration (local error per step)\n"
+    "  potentialTolerance=(0)  [G] the potential is updated only when the DF has changed by more than "
+    "this relative amount since the previous update (0 means update after every timestep)\n"
     "  dtmin=(0)        [G] minimum length of FP timestep\n"
     "  dtmax=(inf)      [G] maximum length of FP timestep (both these limits may modify the timestep "
     "that was computed using the eps parameter)\n"
@@ -96,6 +101,9 @@ const char* usage =
     "not h (if provided, overrides the value of hmax)\n"
     "  gridSizeDF=(200) [G] number of grid points in h\n"
     "  method=(0)       [G] the choice of discretization method (0: Chang&Cooper, 1-3: finite element)\n"
+    "  implicit=(0)     [G] maximum number of iterations of the fully implicit time integration scheme, "
+    "in which the relaxation coefficients are recomputed from the DFs of all species at the end "
+    "of each timestep (0 means semi-implicit scheme, which usually needs shorter timesteps)\n"
     "  ==== Central black hole (sink) ====\n"
     "  captureRadius=(0)  in the case of a central black hole, specifies the capture radius "
     "and turns on the absorbing boundary condition f(hmin)=0. In this case hmin is determined by "
@@ -126,6 +134,10 @@ const char* usage =
 /// upper limit on the number of steps (arbitrary)
 const int MAXNSTEP = 1e8;
 
+/// relative tolerance for reaching the output or the final time in the adaptive scheme:
+/// a shorter remaining interval is attributed to roundoff errors rather than making a tiny step
+const double TIME_TOLERANCE = 1e-12;
+
 /// write text file(s) with various quantities in a spherical model
 void exportTable(const std::string& filename, const std::string& header, const double timeSim,
     const galaxymodel::FokkerPlanckSolver& fp)
@@ -246,6 +258,7 @@ int main(int argc, char* argv[])
     double eps          = args.getDouble   ("eps", 1e-2);
     double dtmin        = args.getDouble   ("dtmin", 0);
     double dtmax        = args.getDouble   ("dtmax", INFINITY);
+    bool adaptive       = args.getBool     ("adaptive", false);
     bool initBH         = args.getBool     ("initBH", true);
     double Mbh          = args.getDouble   ("Mbh", 0);
     std::string fileOut = args.getStringAlt("fileOut", "fileOutput");
@@ -267,6 +280,9 @@ int main(int argc, char* argv[])
     params.selfGravity     = args.getBool  ("selfGravity", params.selfGravity);
     params.updatePotential = args.getBool  ("updatePotential", params.updatePotential);
     params.lossConeDrain   = args.getBool  ("lossCone", params.lossConeDrain);
+    params.maxImplicitIterations = args.getInt("implicit", params.maxImplicitIterations);
+    params.timeAccuracy    = args.getDouble("timeAccuracy", params.timeAccuracy);
+    params.potentialUpdateTolerance = args.getDouble("potentialTolerance", params.potentialUpdateTolerance);
 
     // init all model components
     std::vector<galaxymodel::FokkerPlanckComponent> components;
@@ -307,6 +323,18 @@ int main(int argc, char* argv[])
             prevNstepOut = nstep;
         }
 
+        // in the adaptive scheme, the solver chooses the timestep itself,
+        // limited by the time remaining until the next output or the end of simulation
+        if(adaptive) {
+            double timeNext = timeOut > 0 ? fmin(timeTotal, prevTimeOut + timeOut) : timeTotal;
+            dt = fp.evolveAdaptive(fmin(dtmax, timeNext - timeSim));
+            timeSim += dt;
+            if(fabs(timeNext - timeSim) <= TIME_TOLERANCE * fabs(timeNext))
+                timeSim = timeNext;   // eliminate roundoff errors
+            nstep++;
+            continue;
+        }
+
         // adjust the length of the upcoming timestep
         if(timeSim + dt >= timeTotal) {
             dt = timeTotal - timeSim;
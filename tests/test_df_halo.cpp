@@ -14,11 +14,13 @@
 #include "actions_spherical.h"
 #include "df_halo.h"
 #include "galaxymodel_base.h"
+#include "galaxymodel_cache.h"
 #include "particles_io.h"
 #include "math_specfunc.h"
 #include "math_spline.h"
 #include "debug_utils.h"
 #include "utils.h"
+#include <cstdio>
 
 const double reqRelError = 1e-5;
 const int maxNumEval = 1e5;
@@ -148,6 +150,57 @@ bool testDFmoments(const galaxymodel::GalaxyModel& galmod, const coord::PosVelCy
     return dfok && densok && sigmaok && densvdfok && sigmavdfok;
 }
 
+/// check that the moments retrieved from the cache are identical to those computed without it
+bool testCache(const galaxymodel::GalaxyModel& galmod, const coord::PosCyl& point)
+{
+    // the cache holds only two entries, so that the eviction is also exercised
+    galaxymodel::IntegralCache cache(2);
+    const galaxymodel::GalaxyModel galmodC(galmod.potential, galmod.actFinder, galmod.distrFunc,
+        &cache, galaxymodel::hashString("test_df_halo"));
+    double dens[3], densErr[3], vel[3], velErr[3], Sigma[3], h[3], v[3];
+    coord::Vel2Cyl vel2[3], vel2Err[3];
+    // 0th: without the cache, 1st: computed and stored in the cache, 2nd: retrieved from the cache
+    for(int k=0; k<3; k++) {
+        computeMoments(k==0 ? galmod : galmodC, point,
+            &dens[k], &vel[k], &vel2[k], &densErr[k], &velErr[k], &vel2Err[k], 1e-3, maxNumEval);
+        computeProjectedMoments(k==0 ? galmod : galmodC, point.R, &Sigma[k], &h[k], &v[k],
+            NULL, NULL, NULL, 1e-3, maxNumEval);
+    }
+    // a third entry evicts the least recently used one (moments), which is then recomputed
+    // (the set of requested moments is a part of the key, hence the same set is requested here)
+    double densEvicted, densLoaded, tmp;
+    coord::Vel2Cyl tmp2;
+    computeProjectedMoments(galmodC, point.R+1, &tmp, &tmp, &tmp, NULL, NULL, NULL, 1e-3, maxNumEval);
+    computeMoments(galmodC, point, &densEvicted, &tmp, &tmp2, NULL, NULL, NULL, 1e-3, maxNumEval);
+    size_t numHits, numMisses;
+    cache.stats(numHits, numMisses);
+    // the cache saved to a file and loaded into another one gives the same values
+    const char* fileName = "test_df_halo.cache";
+    cache.save(fileName);
+    {
+        galaxymodel::IntegralCache cacheLoaded(2, fileName);
+        const galaxymodel::GalaxyModel galmodL(galmod.potential, galmod.actFinder, galmod.distrFunc,
+            &cacheLoaded, galmodC.cacheKey);
+        computeMoments(galmodL, point, &densLoaded, &tmp, &tmp2, NULL, NULL, NULL, 1e-3, maxNumEval);
+        size_t numHitsLoaded, numMissesLoaded;
+        cacheLoaded.stats(numHitsLoaded, numMissesLoaded);
+        numHits += numHitsLoaded;
+    }
+    std::remove(fileName);
+    bool ok = numHits == 3 && numMisses == 4 && densEvicted == dens[0] && densLoaded == dens[0];
+    for(int k=1; k<3; k++)
+        ok &= dens[k] == dens[0] && densErr[k] == densErr[0] && vel[k] == vel[0] &&
+            velErr[k] == velErr[0] && vel2[k].vR2 == vel2[0].vR2 && vel2[k].vz2 == vel2[0].vz2 &&
+            vel2[k].vphi2 == vel2[0].vphi2 && vel2[k].vRvz == vel2[0].vRvz &&
+            vel2[k].vRvphi == vel2[0].vRvphi && vel2[k].vzvphi == vel2[0].vzvphi &&
+            vel2Err[k].vR2 == vel2Err[0].vR2 && vel2Err[k].vphi2 == vel2Err[0].vphi2 &&
+            Sigma[k] == Sigma[0] && h[k] == h[0] && v[k] == v[0];
+    std::cout << "Cached moments: " << numHits << " hits, " << numMisses << " misses; "
+        "values " << (ok ? "are identical to" : "differ from") << " the uncached ones" <<
+        (ok ? "" : errmsg) << "\n";
+    return ok;
+}
+
 /// analytic expression for the ergodic distribution function f(E)
 /// in a Hernquist model with mass m, scale radius a, at energy E.
 double dfHernquist(double m, double a, double E)
@@ -198,6 +251,7 @@ int main(){
     const galaxymodel::GalaxyModel galmodH(potH, actH, dfH); // all together - the mighty triad
 
     ok &= testTotalMass(galmodH, 1.);
+    ok &= testCache(galmodH, coord::PosCyl(1., 0.5, 0.));
 
     for(int i=0; i<NUM_POINTS_H; i++) {
         const coord::PosVelCyl point(testPointsH[i]);
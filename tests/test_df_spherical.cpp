@@ -18,6 +18,7 @@
 #include <iomanip>
 #include <fstream>
 #include <cmath>
+#include <ctime>
 #include <algorithm>
 #include <stdexcept>
 
@@ -381,6 +382,61 @@ bool test(const potential::BasePotential& pot)
     return ok;
 }
 
+/// DF multiplied by a smooth bump localized in log(h), used to test the incremental update
+class DFPerturbed: public math::IFunctionNoDeriv {
+    const math::IFunction& df;
+    const double logh0;
+public:
+    DFPerturbed(const math::IFunction& _df, double _h0) : df(_df), logh0(log(_h0)) {}
+    virtual double value(const double h) const {
+        return df(h) * (1 + 0.1 * exp(-pow_2(log(h) - logh0))); }
+};
+
+/// test the incremental update of SphericalModelLocal after a change of the DF
+template<class DistrFnc>
+bool testIncremental(const potential::BasePotential& pot)
+{
+    bool ok=true;
+    const potential::PhaseVolume phasevol((potential::PotentialWrapper(pot)));
+    const DistrFnc trueDF(phasevol);
+    // the DF is perturbed only in the outer part of the model
+    const DFPerturbed newDF(trueDF, phasevol(pot.value(coord::PosCyl(10., 0, 0))));
+    clock_t tbegin = std::clock();
+    const galaxymodel::SphericalModelLocal model(phasevol, trueDF);
+    double timeFull = (std::clock()-tbegin) * 1.0 / CLOCKS_PER_SEC;
+    tbegin = std::clock();
+    const galaxymodel::SphericalModelLocal modelSame(phasevol, trueDF, model);
+    double timeSame = (std::clock()-tbegin) * 1.0 / CLOCKS_PER_SEC;
+    tbegin = std::clock();
+    const galaxymodel::SphericalModelLocal modelIncr(phasevol, newDF, model);
+    double timeIncr = (std::clock()-tbegin) * 1.0 / CLOCKS_PER_SEC;
+    const galaxymodel::SphericalModelLocal modelNew (phasevol, newDF);
+    // an unchanged DF should reproduce the original model exactly,
+    // and the incrementally updated one should agree with the one constructed from scratch
+    // to within the accuracy of interpolation (the two use different grids in h)
+    double errSame = 0, errIncr = 0;
+    for(double logr=-3; logr<=3; logr+=0.25) {
+        double Phi = pot.value(coord::PosCyl(pow(10., logr), 0, 0));
+        for(double vrel=0.0625; vrel<1; vrel+=0.0625) {
+            double E = (1-pow_2(vrel)) * Phi, dv[3], dvSame[3], dvIncr[3], dvNew[3];
+            model    .evalLocal(Phi, E, dv    [0], dv    [1], dv    [2]);
+            modelSame.evalLocal(Phi, E, dvSame[0], dvSame[1], dvSame[2]);
+            modelIncr.evalLocal(Phi, E, dvIncr[0], dvIncr[1], dvIncr[2]);
+            modelNew .evalLocal(Phi, E, dvNew [0], dvNew [1], dvNew [2]);
+            for(int k=0; k<3; k++) {
+                errSame = fmax(errSame, fabs(dvSame[k] - dv[k]));
+                errIncr = fmax(errIncr, fabs(dvIncr[k] / dvNew[k] - 1));
+            }
+        }
+    }
+    std::cout << "\033[1;33m " << pot.name() << " \033[0m: incremental update of diffusion coefs: "
+    "time to construct from scratch=" << timeFull << " s, update with unchanged DF=" << timeSame <<
+    " s, with a localized change of DF=" << timeIncr << " s; max difference from the original=" +
+    checkLess(errSame, 1e-15, ok) + ", relative error w.r.t. the model constructed from scratch=" +
+    checkLess(errIncr, 1e-2, ok) + "\n";
+    return ok;
+}
+
 void exportTable(const char* filename, const potential::BasePotential& pot)
 {
     try{
@@ -410,6 +466,8 @@ int main()
     }
     ok &= test<RmaxPlummer,   PhasevolPlummer,   DFPlummer  >(potp);
     ok &= test<RmaxHernquist, PhasevolHernquist, DFHernquist>(poth);
+    ok &= testIncremental<DFPlummer>  (potp);
+    ok &= testIncremental<DFHernquist>(poth);
     if(ok)
         std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
     else
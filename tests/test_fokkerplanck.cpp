@@ -0,0 +1,179 @@
+/** \name   test_fokkerplanck.cpp
+    \author Eugene Vasiliev
+    \date   2018
+
+    This program tests the conservation of mass in the two-dimensional Fokker-Planck solver
+    for the DF f(h, R) in the presence of a central black hole with a loss cone:
+    the decrease of the total mass of stars should match the mass captured by the black hole,
+    which is accumulated from the flux into the loss cone and from the nodes that end up inside
+    the loss cone when its boundary grows together with the black hole mass.
+    It also checks that the one-dimensional solver with implicit iterations in each timestep
+    converges to the same solution as the default semi-implicit scheme in the relaxation of
+    a Plummer sphere, while conserving the total mass and energy, and that the adaptive
+    time integration reaches the requested output times exactly.
+*/
+#include "galaxymodel_fokkerplanck.h"
+#include "potential_analytic.h"
+#include "potential_dehnen.h"
+#include "utils.h"
+#include <iostream>
+#include <cmath>
+
+bool testMassConservation2d(bool updatePotential)
+{
+    const potential::Dehnen dens(/*mass*/ 1., /*scaleRadius*/ 1., /*gamma*/ 1.);
+    galaxymodel::FokkerPlanckComponent comp;
+    comp.initDensity.reset(new potential::DensityWrapper(dens));
+    comp.Mstar = 1e-4;
+    comp.captureRadius = 1e-4;
+    comp.captureMassFraction = 1.;
+    galaxymodel::FokkerPlanckParams2d params;
+    params.Mbh = 0.01;
+    params.coulombLog = log(params.Mbh / comp.Mstar);
+    params.updatePotential = updatePotential;
+    params.gridSize  = 60;
+    params.gridSizeR = 16;
+    galaxymodel::FokkerPlanckSolver2d fp(params, std::vector<galaxymodel::FokkerPlanckComponent>(1, comp));
+
+    const double Mass0 = fp.Mass(), Mbh0 = fp.Mbh();
+    const double eps = 2e-3;  // relative accuracy of the total mass computed from the interpolated DF
+    bool ok = true;
+    for(int step=0; step<20; step++) {
+        fp.evolve(0.1 * fp.relaxationTime());
+        double Merr = (fp.Mass() - Mass0 - fp.drainMass()) / Mass0;
+        ok &= fabs(Merr) < eps && fp.drainMass() <= 0 &&
+            fabs(fp.Mbh() - Mbh0 + fp.drainMass()) < 1e-12 * Mbh0;
+        if(utils::verbosityLevel >= utils::VL_VERBOSE)
+            std::cout << "time=" << fp.time() << ", M=" << fp.Mass() << ", Mbh=" << fp.Mbh() <<
+                ", drainMass=" << fp.drainMass() << ", mass error=" << Merr << '\n';
+    }
+    std::cout << "Mass conservation in the 2d solver " <<
+        (updatePotential ? "with" : "without") << " potential update: "
+        "M0=" << Mass0 << ", M=" << fp.Mass() << ", drainMass=" << fp.drainMass() <<
+        (ok ? "" : " \033[1;31m**\033[0m") << '\n';
+    return ok;
+}
+
+/// create the solver for a Plummer sphere, with the time unit equal to its initial half-mass
+/// relaxation time
+galaxymodel::FokkerPlanckSolver createPlummer(unsigned int maxImplicitIterations)
+{
+    const potential::Plummer dens(/*mass*/ 1., /*scaleRadius*/ 0.589);
+    galaxymodel::FokkerPlanckComponent comp;
+    comp.initDensity.reset(new potential::DensityWrapper(dens));
+    galaxymodel::FokkerPlanckParams params;
+    params.method = galaxymodel::FP_FEM3;
+    params.gridSize = 100;
+    params.hmin = 1e-10;
+    params.hmax = 1e6;
+    params.coulombLog = 0.093;
+    params.maxImplicitIterations = maxImplicitIterations;
+    return galaxymodel::FokkerPlanckSolver(params,
+        std::vector<galaxymodel::FokkerPlanckComponent>(1, comp));
+}
+
+/// return the DF at grid nodes
+std::vector<double> gridDF(const galaxymodel::FokkerPlanckSolver& fp)
+{
+    const std::vector<double> gridh = fp.gridh();
+    const math::PtrFunction df = fp.df(0);
+    std::vector<double> result(gridh.size());
+    for(size_t i=0; i<gridh.size(); i++)
+        result[i] = df->value(gridh[i]);
+    return result;
+}
+
+/// evolve a Plummer sphere for a fixed time with the given number of equal timesteps,
+/// return the DF at grid nodes and the relative errors in total mass and energy
+std::vector<double> evolvePlummer(unsigned int maxImplicitIterations, int numSteps,
+    double& Merr, double& Eerr)
+{
+    galaxymodel::FokkerPlanckSolver fp = createPlummer(maxImplicitIterations);
+    const double Mass0 = fp.Mass(), Etot0 = fp.Etot(), timeTotal = 10.;
+    for(int step=0; step<numSteps; step++)
+        fp.evolve(timeTotal / numSteps);
+    Merr = fp.Mass() / Mass0 - 1;
+    Eerr = fp.Etot() / Etot0 - 1;
+    return gridDF(fp);
+}
+
+/// max |log(f1/f2)| over grid nodes where the DF is not negligibly small
+double maxLogDifference(const std::vector<double>& f1, const std::vector<double>& f2)
+{
+    double result = 0;
+    for(size_t i=0; i<f1.size(); i++)
+        if(f1[i] > 1e-6 && f2[i] > 1e-6)
+            result = fmax(result, fabs(log(f1[i] / f2[i])));
+    return result;
+}
+
+/// reference solution for the Plummer sphere at time 10 (computed in testImplicitIterations)
+std::vector<double> fref;
+
+bool testImplicitIterations()
+{
+    // reference solution: the semi-implicit scheme with short timesteps
+    double Merr, Eerr;
+    fref = evolvePlummer(0, 1000, Merr, Eerr);
+    bool ok = fabs(Merr) < 1e-5 && fabs(Eerr) < 1e-3;
+    std::cout << "Plummer sphere evolved for 10 relaxation times with the semi-implicit scheme "
+        "and 1000 steps: mass error=" << Merr << ", energy error=" << Eerr << '\n';
+    // the fully implicit scheme is also first-order accurate in time, so it should converge to
+    // the same solution, with the difference decreasing proportionally to the timestep
+    double prevdif = INFINITY;
+    for(int numSteps = 50; numSteps <= 1000; numSteps *= 4) {
+        // the semi-implicit scheme with the same timestep: the implicit iterations must make
+        // a difference (otherwise they were not performed at all)
+        double dummy;
+        const std::vector<double> fsemi = evolvePlummer(0, numSteps, dummy, dummy);
+        const std::vector<double> fimpl = evolvePlummer(20, numSteps, Merr, Eerr);
+        double dif = maxLogDifference(fimpl, fref), difsemi = maxLogDifference(fimpl, fsemi);
+        bool okstep = fabs(Merr) < 1e-5 && fabs(Eerr) < 3e-3 && dif < 10. / numSteps &&
+            dif < 0.5 * prevdif && difsemi > 0.1 * dif;
+        prevdif = dif;
+        std::cout << "Same with implicit iterations and " << numSteps << " steps: mass error=" <<
+            Merr << ", energy error=" << Eerr << ", max difference in log(f) from the reference=" <<
+            dif << ", from the semi-implicit scheme with the same timestep=" << difsemi <<
+            (okstep ? "" : " \033[1;31m**\033[0m") << '\n';
+        ok &= okstep;
+    }
+    return ok;
+}
+
+bool testEvolveUntil()
+{
+    // evolve the Plummer sphere with adaptive timesteps until a sequence of output times,
+    // which are not exactly representable in floating-point arithmetic
+    galaxymodel::FokkerPlanckSolver fp = createPlummer(0);
+    const double Mass0 = fp.Mass(), Etot0 = fp.Etot();
+    bool okTime = true;
+    for(int k=1; k<=30; k++) {
+        const double timeOut = k / 3.;
+        okTime &= fp.evolveUntil(timeOut) == timeOut && fp.time() == timeOut;
+    }
+    // the timestep suggested for the last interval should not have been spoiled by a tiny step
+    // needed to reach the output time
+    okTime &= fp.nextTimestep() > 1e-3;
+    const double Merr = fp.Mass() / Mass0 - 1, Eerr = fp.Etot() / Etot0 - 1,
+        dif = maxLogDifference(gridDF(fp), fref);
+    bool ok = okTime && fabs(Merr) < 1e-5 && fabs(Eerr) < 3e-3 && dif < 0.05;
+    std::cout << "Same with adaptive timesteps until " << fp.time() << ": mass error=" << Merr <<
+        ", energy error=" << Eerr << ", max difference in log(f) from the reference=" << dif <<
+        (okTime ? "" : " (target times not reached exactly)") <<
+        (ok ? "" : " \033[1;31m**\033[0m") << '\n';
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= testImplicitIterations();
+    ok &= testEvolveUntil();
+    ok &= testMassConservation2d(false);
+    ok &= testMassConservation2d(true);
+    if(ok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}
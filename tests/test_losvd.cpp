@@ -0,0 +1,414 @@
+/** \name   test_losvd.cpp
+    \author Eugene Vasiliev
+    \date   2018
+
+    This program tests the faster code paths used in the construction of LOSVD models
+    against straightforward (slower) reference implementations:
+    - the sparse matrix of B-spline integrals over many polygons (apertures) is compared with
+    the integrals over each polygon computed by clipping it separately by every grid cell;
+    - the spatial convolution and rebinning matrix of `TargetLOSVD`, which is constructed from
+    the banded one-dimensional convolution matrices, is compared with the dense product of
+    the aperture matrix and the full two-dimensional convolution matrix;
+    - the Gauss-Hermite moments of many LOSVDs computed in batch mode, with given or best-fit
+    parameters of expansion, are compared with those computed for each LOSVD separately
+    (by multiplying its amplitudes by the conversion matrix, or by `GaussHermiteExpansion`);
+    - the LOSVD of an N-body snapshot computed by `computeTargetFromParticles`, which processes
+    particles in parallel and in a different order, is compared with a serial loop over particles;
+    - the result of `finalizeDatacube`, which uses only the rows of the datacube touched by
+    `addPoint`, is compared with the result for the same datacube with all rows marked as touched.
+*/
+#include "galaxymodel_losvd.h"
+#include "particles_base.h"
+#include "math_core.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+const char* errmsg = "\033[1;31m **\033[0m";
+
+/// a random star-shaped polygon with the given center and size, oriented in either direction
+math::Polygon randomPolygon(double xcenter, double ycenter, double radius, bool reverse)
+{
+    math::Polygon poly;
+    int numVertices = 3 + static_cast<int>(math::random() * 6);
+    for(int v=0; v<numVertices; v++) {
+        double angle = 2*M_PI * (v + 0.5 * math::random()) / numVertices,
+            rad = radius * (0.5 + 0.5 * math::random());
+        poly.push_back(math::Point2d(xcenter + rad * cos(angle), ycenter + rad * sin(angle)));
+    }
+    if(reverse)
+        std::reverse(poly.begin(), poly.end());
+    return poly;
+}
+
+/// compare the sparse matrix of integrals over all polygons with the integrals over each polygon,
+/// accumulated from its pieces clipped separately by each cell of the grid
+template<int N>
+bool testApertureMatrix()
+{
+    // nonuniform grids and polygons of various sizes, some of them extending beyond the grid
+    std::vector<double> gridx, gridy;
+    for(int i=0; i<=20; i++)
+        gridx.push_back(-2.0 + 0.2*i + 0.01*sin(i));
+    for(int i=0; i<=15; i++)
+        gridy.push_back(-1.5 + 0.2*i + 0.02*cos(i));
+    const math::BsplineInterpolator1d<N> bsplx(gridx), bsply(gridy);
+    const size_t numBasisFnc = bsplx.numValues() * bsply.numValues();
+    const int numPolygons = 200;
+    std::vector<math::Polygon> polygons;
+    for(int p=0; p<numPolygons; p++)
+        polygons.push_back(randomPolygon(-2.5 + 5*math::random(), -2 + 4*math::random(),
+            0.05 + 0.8*math::random(), p%3 == 0));
+
+    bool outOfBounds = false;
+    const math::SparseMatrix<double> mat =
+        math::computeBsplineIntegralsOverPolygons(polygons, bsplx, bsply, &outOfBounds);
+    bool ok = mat.rows() == (size_t)numPolygons && mat.cols() == numBasisFnc;
+    double maxdifSingle = 0, maxdifCells = 0, maxdifArea = 0;
+    bool refOutOfBounds = false;
+    std::vector<double> single(numBasisFnc), cells(numBasisFnc);
+    for(int p=0; ok && p<numPolygons; p++) {
+        // integrals over a single polygon, using the same method as for the entire matrix
+        std::fill(single.begin(), single.end(), 0.);
+        refOutOfBounds |= math::computeBsplineIntegralsOverPolygon(polygons[p], bsplx, bsply, &single[0]);
+        // reference integrals: clip the polygon by each cell of the grid, then sum up the pieces
+        std::fill(cells.begin(), cells.end(), 0.);
+        for(size_t iy=0; iy<gridy.size()-1; iy++)
+            for(size_t ix=0; ix<gridx.size()-1; ix++)
+                math::computeBsplineIntegralsOverPolygon(math::clipPolygonByRectangle(polygons[p],
+                    math::Rectangle(gridx[ix], gridy[iy], gridx[ix+1], gridy[iy+1])),
+                    bsplx, bsply, &cells[0]);
+        double maxval = 0, sum = 0;
+        for(size_t k=0; k<numBasisFnc; k++) {
+            maxval = fmax(maxval, fabs(cells[k]));
+            sum   += mat.at(p, k);
+        }
+        for(size_t k=0; k<numBasisFnc; k++) {
+            maxdifSingle = fmax(maxdifSingle, fabs(mat.at(p, k) - single[k]) / maxval);
+            maxdifCells  = fmax(maxdifCells,  fabs(mat.at(p, k) - cells [k]) / maxval);
+        }
+        // B-splines form a partition of unity, hence their integrals over a polygon lying
+        // entirely within the grid add up to its area
+        bool inside = true;
+        for(size_t v=0; v<polygons[p].size(); v++)
+            inside &= polygons[p][v].x > gridx.front() && polygons[p][v].x < gridx.back() &&
+                polygons[p][v].y > gridy.front() && polygons[p][v].y < gridy.back();
+        if(inside)
+            maxdifArea = fmax(maxdifArea, fabs(sum / fabs(math::polygonArea(polygons[p])) - 1));
+    }
+    // the triangle quadrature is exact for polynomials up to degree 4, hence for N<=2,
+    // but for N=3 its error (and hence the result) depends on how the polygon is triangulated
+    const double eps = N<=2 ? 1e-12 : 2e-3;
+    ok &= maxdifSingle < 1e-15 && maxdifCells < eps && maxdifArea < 1e-12 &&
+        outOfBounds && refOutOfBounds;
+    std::cout << "Sparse matrix of integrals of degree " << N << " B-splines over " << numPolygons <<
+        " polygons: " << mat.size() << " nonzero elements out of " << mat.rows() * mat.cols() <<
+        "; max relative difference from single-polygon integrals: " << maxdifSingle <<
+        ", from cell-by-cell integrals: " << maxdifCells <<
+        ", sum over basis functions vs. area: " << maxdifArea << (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+/// one-dimensional factor of a two-dimensional Gaussian PSF (hence the square root of its amplitude)
+class GaussianKernel: public math::IFunctionNoDeriv {
+    const galaxymodel::GaussianPSF psf;
+public:
+    GaussianKernel(const galaxymodel::GaussianPSF& _psf) : psf(_psf) {}
+    virtual double value(const double x) const {
+        return sqrt(psf.ampl) / (M_SQRT2 * M_SQRTPI * psf.width) * exp(-0.5 * pow_2(x / psf.width));
+    }
+};
+
+/// dense convolution matrix  P^{-1} C^T P^{-1}  for the amplitudes of a B-spline expansion,
+/// where P is the matrix of products of basis functions, and C is the matrix of their convolutions
+/// (equal to P when the PSF has zero width)
+template<int N>
+math::Matrix<double> convolutionMatrix(const math::BsplineInterpolator1d<N>& bspl,
+    const galaxymodel::GaussianPSF& psf)
+{
+    const size_t size = bspl.numValues();
+    const math::FiniteElement1d<N> fem(bspl);
+    const math::BandMatrix<double> proj = fem.computeProjMatrix();
+    const math::Matrix<double> conv = psf.width > 0 ?
+        fem.computeConvMatrix(GaussianKernel(psf)) : math::Matrix<double>(proj);
+    math::Matrix<double> projInv(size, size), tmp(size, size), result(size, size);
+    for(size_t i=0; i<size; i++) {
+        std::vector<double> unit(size, 0.);
+        unit[i] = 1.;
+        std::vector<double> col = math::solveBand(proj, unit);
+        for(size_t j=0; j<size; j++)
+            projInv(j, i) = col[j];
+    }
+    math::blas_dgemm(math::CblasNoTrans, math::CblasTrans, 1., projInv, conv, 0., tmp);
+    math::blas_dgemm(math::CblasNoTrans, math::CblasNoTrans, 1., tmp, projInv, 0., result);
+    return result;
+}
+
+/// a datacube of TargetLOSVD filled with random values, with all spatial basis functions
+/// marked as touched, so that all rows are used in finalizeDatacube
+math::Matrix<double> randomDatacube(const galaxymodel::BaseTarget& target)
+{
+    math::Matrix<double> datacube = target.newDatacube();
+    double* data = datacube.data();
+    for(size_t i=0; i<target.numValues(); i++)
+        data[i] = math::random();
+    std::fill(data + target.numValues(), data + datacube.size(), 1.);
+    return datacube;
+}
+
+/// compare the LOSVD produced by finalizeDatacube from a random datacube with the one computed
+/// using the dense matrix of spatial convolution and rebinning, assembled from the 2d convolution
+/// matrix L, which is the sum over PSF components of outer products of 1d matrices Lx and Ly
+template<int N>
+bool testConvolutionMatrix()
+{
+    galaxymodel::LOSVDParams params;
+    params.theta = 0.7;
+    params.phi   = 0.4;
+    // grids are not reflection-symmetric, so the datacube is not symmetrized in finalizeDatacube
+    params.gridx = math::createUniformGrid(17, -2.0, 2.4);
+    params.gridy = math::createUniformGrid(13, -1.5, 1.7);
+    params.gridv = math::createUniformGrid(11, -1.2, 1.5);
+    params.spatialPSF.push_back(galaxymodel::GaussianPSF(0.2, 0.7));
+    params.spatialPSF.push_back(galaxymodel::GaussianPSF(0.6, 0.3));
+    params.velocityPSF = 0.15;
+    for(int a=0; a<40; a++)
+        params.apertures.push_back(randomPolygon(-1.4 + 3.2*math::random(), -1.0 + 2.2*math::random(),
+            0.05 + 0.4*math::random(), a%2 == 0));
+    const galaxymodel::TargetLOSVD<N> target(params);
+
+    // reference: Q = A L, output = Q D V^T, where D is the datacube and V the velocity convolution
+    const math::BsplineInterpolator1d<N> bsplx(params.gridx), bsply(params.gridy), bsplv(params.gridv);
+    const size_t numApertures = params.apertures.size(),
+        numBasisFncX = bsplx.numValues(), numBasisFncY = bsply.numValues(),
+        numBasisFnc  = numBasisFncX * numBasisFncY,  numBasisFncV = bsplv.numValues();
+    const math::Matrix<double> apertureMatrix(
+        math::computeBsplineIntegralsOverPolygons(params.apertures, bsplx, bsply));
+    math::Matrix<double> conv(numBasisFnc, numBasisFnc, 0.);
+    for(size_t g=0; g<params.spatialPSF.size(); g++) {
+        const math::Matrix<double>
+            convx = convolutionMatrix(bsplx, params.spatialPSF[g]),
+            convy = convolutionMatrix(bsply, params.spatialPSF[g]);
+        for(size_t j=0; j<numBasisFncY; j++)
+            for(size_t l=0; l<numBasisFncX; l++)
+                for(size_t i=0; i<numBasisFncY; i++)
+                    for(size_t k=0; k<numBasisFncX; k++)
+                        conv(j * numBasisFncX + l, i * numBasisFncX + k) += convx(l, k) * convy(j, i);
+    }
+    const math::Matrix<double> convv =
+        convolutionMatrix(bsplv, galaxymodel::GaussianPSF(params.velocityPSF));
+    math::Matrix<double> datacube = randomDatacube(target);
+    math::Matrix<double> data(numBasisFnc, numBasisFncV);
+    std::copy(datacube.data(), datacube.data() + data.size(), data.data());
+    math::Matrix<double> apconv(numApertures, numBasisFnc), tmp(numApertures, numBasisFncV),
+        result(numApertures, numBasisFncV);
+    math::blas_dgemm(math::CblasNoTrans, math::CblasNoTrans, 1., apertureMatrix, conv, 0., apconv);
+    math::blas_dgemm(math::CblasNoTrans, math::CblasNoTrans, 1., apconv, data, 0., tmp);
+    math::blas_dgemm(math::CblasNoTrans, math::CblasTrans, 1., tmp, convv, 0., result);
+
+    std::vector<galaxymodel::StorageNumT> output(target.numCoefs());
+    target.finalizeDatacube(datacube, &output[0]);
+    double maxval = 0, maxdif = 0;
+    for(size_t c=0; c<output.size(); c++) {
+        maxval = fmax(maxval, fabs(result.data()[c]));
+        maxdif = fmax(maxdif, fabs(result.data()[c] - output[c]));
+    }
+    // the output is stored in single precision
+    bool ok = output.size() == result.size() && maxdif < 1e-6 * maxval;
+    std::cout << "Spatial convolution of degree " << N << " B-splines with " <<
+        params.spatialPSF.size() << " PSFs: max relative difference of the LOSVD in " << numApertures <<
+        " apertures from the dense convolution matrix: " << maxdif / maxval << (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+/// compare the batch conversion of LOSVDs of many components in several apertures into GH moments
+/// with the conversion of each LOSVD separately, for fixed and for best-fit parameters of expansion
+template<int N>
+bool testGaussHermiteBatch()
+{
+    // the number of components exceeds the size of a block in the batch conversion
+    const size_t numComponents = 300, numApertures = 3, order = 6;
+    const std::vector<double> gridv = math::createUniformGrid(25, -3., 3.);
+    const math::FiniteElement1d<N> fem(gridv);
+    const size_t numBasisFnc = fem.interp.numValues(), numLOSVDs = numComponents * numApertures;
+
+    // input LOSVDs are B-spline approximations of random GH series, and some are empty
+    std::vector<galaxymodel::StorageNumT> input(numLOSVDs * numBasisFnc, 0.);
+    for(size_t i=0; i<numLOSVDs; i++) {
+        if(i%7 == 3)
+            continue;
+        std::vector<double> coefs(5, 0.);
+        coefs[0] = 1.;
+        coefs[3] = 0.2 * (math::random() - 0.5);
+        coefs[4] = 0.2 * (math::random() - 0.5);
+        double gamma = 0.5 + math::random(), center = math::random() - 0.5,
+            sigma = 0.4 + 0.5 * math::random();
+        std::vector<double> ampl = fem.computeAmplitudes(
+            galaxymodel::GaussHermiteExpansion(coefs, gamma, center, sigma));
+        std::copy(ampl.begin(), ampl.end(), &input[i * numBasisFnc]);
+    }
+
+    // 1. fixed parameters of GH expansion in each aperture
+    std::vector<double> ghparams(numApertures * 3);
+    for(size_t a=0; a<numApertures; a++) {
+        ghparams[a*3  ] = 0.5 + math::random();
+        ghparams[a*3+1] = math::random() - 0.5;
+        ghparams[a*3+2] = 0.4 + 0.5 * math::random();
+    }
+    std::vector<galaxymodel::StorageNumT> moments(numLOSVDs * (order+1));
+    galaxymodel::computeGaussHermiteMomentsBatch(N, gridv, order, numComponents, numApertures,
+        &ghparams[0], &input[0], &moments[0]);
+    double maxdifMoments = 0;
+    for(size_t a=0; a<numApertures; a++) {
+        const math::Matrix<double> ghmat = galaxymodel::computeGaussHermiteMatrix(N, gridv, order,
+            ghparams[a*3], ghparams[a*3+1], ghparams[a*3+2]);
+        std::vector<double> src(numBasisFnc), dest(order+1);
+        for(size_t c=0; c<numComponents; c++) {
+            const size_t i = c * numApertures + a;
+            src.assign(&input[i * numBasisFnc], &input[(i+1) * numBasisFnc]);
+            math::blas_dgemv(math::CblasNoTrans, 1., ghmat, src, 0., dest);
+            for(size_t m=0; m<=order; m++)
+                maxdifMoments = fmax(maxdifMoments, fabs(dest[m] - moments[i * (order+1) + m]));
+        }
+    }
+
+    // 2. best-fit parameters for each LOSVD
+    std::vector<galaxymodel::StorageNumT> fits(numLOSVDs * (order+4));
+    galaxymodel::fitGaussHermiteBatch(N, gridv, order, numLOSVDs, &input[0], &fits[0]);
+    double maxdifFit = 0;
+    bool okEmpty = true;
+    for(size_t i=0; i<numLOSVDs; i++) {
+        const galaxymodel::StorageNumT* fit = &fits[i * (order+4)];
+        if(i%7 == 3) {   // empty LOSVD: zero normalization and undefined parameters
+            okEmpty &= fit[0] == 0;
+            for(size_t m=1; m<order+4; m++)
+                okEmpty &= fit[m] != fit[m];  // NAN
+            continue;
+        }
+        const galaxymodel::GaussHermiteExpansion ghexp(math::BsplineWrapper<N>(fem.interp,
+            std::vector<double>(&input[i * numBasisFnc], &input[(i+1) * numBasisFnc])), order);
+        maxdifFit = fmax(maxdifFit, fmax(fabs(ghexp.gamma() / fit[0] - 1),
+            fmax(fabs(ghexp.center() - fit[1]), fabs(ghexp.sigma() - fit[2]))));
+        for(size_t m=0; m<=order; m++)
+            maxdifFit = fmax(maxdifFit, fabs(ghexp.coefs()[m] - fit[m+3]));
+    }
+    // the batch fit starts from the exact moments of the LOSVD rather than from their numerical
+    // estimates, so the results agree only within the tolerance of the fit (which also depends
+    // on the nonlinear solver: GSL or Eigen); for N=0 the LOSVD is discontinuous,
+    // and the fit may stop at a noticeably different point
+    bool ok = maxdifMoments < 1e-6 && maxdifFit < (N>0 ? 3e-3 : 0.1) && okEmpty;
+    std::cout << "Gauss-Hermite moments of " << numLOSVDs << " LOSVDs represented by degree " << N <<
+        " B-splines: max difference from the moments computed separately for each LOSVD: " <<
+        maxdifMoments << " for fixed parameters, " << maxdifFit << " for best-fit parameters" <<
+        (okEmpty ? "" : " (empty LOSVDs are not handled correctly)") << (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+/// max absolute difference between two arrays, relative to the max absolute value of the first one
+template<typename T1, typename T2>
+double maxRelDifference(const std::vector<T1>& ref, const std::vector<T2>& val)
+{
+    double maxval = 0, maxdif = 0;
+    for(size_t i=0; i<ref.size(); i++) {
+        maxval = fmax(maxval, fabs(ref[i]));
+        maxdif = fmax(maxdif, fabs(ref[i] - val[i]));
+    }
+    return maxdif / maxval;
+}
+
+/// compare the LOSVD of a particle snapshot computed by computeTargetFromParticles with
+/// a serial loop over particles, and the finalization of a datacube with few touched rows
+/// with the one that uses all rows, for reflection-symmetric and asymmetric grids
+template<int N>
+bool testParticles(bool symmetricGrids)
+{
+    galaxymodel::LOSVDParams params;
+    params.theta = 0.5;
+    params.phi   = 1.2;
+    params.gridx = math::createUniformGrid(25, -2.4, symmetricGrids ? 2.4 : 2.0);
+    params.gridy = math::createUniformGrid(21, -2.0, 2.0);
+    params.gridv = math::createUniformGrid(13, -1.5, 1.5);
+    params.spatialPSF.push_back(galaxymodel::GaussianPSF(0.3));
+    params.velocityPSF = 0.1;
+    for(int a=0; a<30; a++)
+        params.apertures.push_back(randomPolygon(-1.6 + 3.2*math::random(), -1.4 + 2.8*math::random(),
+            0.1 + 0.4*math::random(), false));
+    const galaxymodel::TargetLOSVD<N> target(params);
+    const size_t numCoefs = target.numCoefs();
+
+    // a snapshot with more particles than processed in one block, some of them outside the grid
+    particles::ParticleArrayCar particles;
+    const int numParticles = 150000;
+    for(int i=0; i<numParticles; i++) {
+        double pos[3], vel[3];
+        for(int d=0; d<3; d++) {
+            pos[d] = 1.6 * (math::random() + math::random() + math::random() - 1.5);
+            vel[d] = 0.8 * (math::random() + math::random() + math::random() - 1.5);
+        }
+        particles.add(coord::PosVelCar(pos[0], pos[1], pos[2], vel[0], vel[1], vel[2]),
+            (1 + math::random()) / numParticles);
+    }
+    const std::vector<double> result = galaxymodel::computeTargetFromParticles(target, particles);
+
+    // reference: serial loop over particles in the original order
+    math::Matrix<double> datacube = target.newDatacube();
+    for(int i=0; i<numParticles; i++) {
+        double xv[6];
+        particles.point(i).unpack_to(xv);
+        target.addPoint(xv, particles.mass(i), datacube.data());
+    }
+    std::vector<galaxymodel::StorageNumT> ref(numCoefs);
+    target.finalizeDatacube(datacube, &ref[0]);
+    double difParticles = maxRelDifference(ref, result);
+
+    // a datacube with only a few touched rows (particles in a small region of the image plane),
+    // and the same datacube with all rows marked as touched
+    target.clearDatacube(datacube);
+    bool okClear = true;
+    for(size_t i=0; i<datacube.size(); i++)
+        okClear &= datacube.data()[i] == 0;
+    for(int i=0; i<20; i++) {
+        double xv[6] = { 0.8 + 0.2*math::random(), -0.3 + 0.2*math::random(), 0.2*math::random(),
+            math::random() - 0.5, math::random() - 0.5, math::random() - 0.5 };
+        target.addPoint(xv, math::random(), datacube.data());
+    }
+    math::Matrix<double> fullDatacube(datacube);
+    std::fill(fullDatacube.data() + target.numValues(), fullDatacube.data() + fullDatacube.size(), 1.);
+    std::vector<galaxymodel::StorageNumT> touched(numCoefs), full(numCoefs);
+    target.finalizeDatacube(datacube, &touched[0]);
+    target.finalizeDatacube(fullDatacube, &full[0]);
+    double difTouched = maxRelDifference(full, touched);
+
+    // the order of summation differs, and the output is stored in single precision
+    bool ok = difParticles < 1e-6 && difTouched < 1e-6 && okClear;
+    std::cout << "LOSVD of degree " << N << " from " << numParticles << " particles on " <<
+        (symmetricGrids ? "symmetric" : "asymmetric") << " grids: max relative difference "
+        "from the serial loop over particles: " << difParticles << ", between finalizing "
+        "only touched rows and the entire datacube: " << difTouched <<
+        (okClear ? "" : " (datacube was not cleared)") << (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= testApertureMatrix<0>();
+    ok &= testApertureMatrix<1>();
+    ok &= testApertureMatrix<2>();
+    ok &= testApertureMatrix<3>();
+    ok &= testConvolutionMatrix<0>();
+    ok &= testConvolutionMatrix<1>();
+    ok &= testConvolutionMatrix<3>();
+    ok &= testGaussHermiteBatch<0>();
+    ok &= testGaussHermiteBatch<1>();
+    ok &= testGaussHermiteBatch<2>();
+    ok &= testGaussHermiteBatch<3>();
+    ok &= testParticles<1>(true);
+    ok &= testParticles<1>(false);
+    ok &= testParticles<3>(true);
+    if(ok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}
@@ -7,6 +7,9 @@
 #include <iomanip>
 #include <fstream>
 #include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 int numEval=0;
 
 class test1: public math::IFunctionNoDeriv{
@@ -150,6 +153,40 @@ public:
 };
 #endif
 
+// a smooth 5d function for testing the convergence of quasi-Monte Carlo integration
+class test9Ndim: public math::IFunctionNdim{
+public:
+    virtual void eval(const double x[], double val[]) const{
+        val[0] = 1;
+        for(int d=0; d<5; d++)
+            val[0] *= 1 + (d+1) * 0.2 * (exp(x[d]) - M_E + 1);  // each factor integrates to 1
+    }
+    virtual unsigned int numVars()   const { return 5; }
+    virtual unsigned int numValues() const { return 1; }
+};
+
+// a wrapper for another function that counts the calls made from an active OpenMP parallel region
+class testParallelCalls: public math::IFunctionNdim{
+    const math::IFunctionNdim& fnc;
+public:
+    mutable int numParallelCalls;
+    explicit testParallelCalls(const math::IFunctionNdim& _fnc) : fnc(_fnc), numParallelCalls(0) {}
+    virtual void evalmany(const size_t npoints, const double vars[], double values[]) const{
+#ifdef _OPENMP
+        if(omp_in_parallel()) {
+#pragma omp atomic
+            ++numParallelCalls;
+        }
+#endif
+        fnc.evalmany(npoints, vars, values);
+    }
+    virtual void eval(const double vars[], double values[]) const{
+        evalmany(1, vars, values);
+    }
+    virtual unsigned int numVars()   const { return fnc.numVars(); }
+    virtual unsigned int numValues() const { return fnc.numValues(); }
+};
+
 // test functions for estimating the accuracy of Gauss-Legendre integration
 class test_GL_powerlaw: public math::IFunctionNoDeriv{
 public:
@@ -476,6 +513,74 @@ int main()
         " (delta="<<(result-fnc8.exact)<<"; neval="<<numEval<<")\n";
     ok &= (error < 2.0 && fabs(result-fnc8.exact) < error*2) || err();
 
+    // randomized (quasi-)Monte Carlo integration with a fixed number of points (zero tolerance):
+    // the error estimate should be consistent with the actual error, and for quasi-random
+    // sequences it should decrease with the number of points faster than for pseudo-random numbers
+    {
+        const double xlow[5] = {0,0,0,0,0}, xupp[5] = {1,1,1,1,1};
+        const math::QuasiRandomMethod methods[4] =
+            { math::QR_NONE, math::QR_HALTON, math::QR_SOBOL, math::QR_SOBOL_OWEN };
+        const char* names[4] = { "pseudo-random", "Halton", "Sobol", "Sobol+Owen" };
+        for(int m=0; m<4; m++) {
+            double result1, error1, result2, error2;
+            int numEval1, numEval2;
+            integrateNdim(test9Ndim(), xlow, xupp, 0, 1<<14, &result1, &error1, &numEval1, methods[m]);
+            integrateNdim(test9Ndim(), xlow, xupp, 0, 1<<20, &result2, &error2, &numEval2, methods[m]);
+            double gain = error1 / error2, sqrtN = sqrt(numEval2 * 1. / numEval1);
+            std::cout << "RQMC integration with " << names[m] << " sequence: " <<
+                "N=" << numEval1 << ": " << result1 << " +- " << error1 << ", " <<
+                "N=" << numEval2 << ": " << result2 << " +- " << error2 << " (exact: 1)\n";
+            ok &= (fabs(result1-1) < 4*error1 && fabs(result2-1) < 4*error2 &&
+                // error should decrease at least as N^-1/2 for pseudo-random numbers,
+                // and at least as N^-3/4 for quasi-random sequences
+                gain > (m==0 ? 0.5 * sqrtN : pow(sqrtN, 1.5))) || err();
+        }
+    }
+
+    // the results of N-dimensional integration should not depend on the number of threads,
+    // and no calls should be made from parallel regions if this is not allowed
+    {
+        test9Ndim fnc9;
+        const double xlow[5] = {0,0,0,0,0}, xupp[5] = {1,1,1,1,1};
+        const math::QuasiRandomMethod methods[2] = { math::QR_CUBATURE, math::QR_SOBOL };
+        const char* names[2] = { "Cubature", "RQMC" };
+#ifdef _OPENMP
+        const int maxThreads = omp_get_max_threads();
+#else
+        const int maxThreads = 1;
+#endif
+        for(int m=0; m<2; m++) {
+            // the torus has a discontinuous boundary, which makes the cubature split many regions
+            // in each iteration, so that they are evaluated in several blocks
+            const math::IFunctionNdim& fnc = m==0 ? (const math::IFunctionNdim&)fnc8 : fnc9;
+            const double* xl = m==0 ? fnc8.ymin : xlow;
+            const double* xu = m==0 ? fnc8.ymax : xupp;
+            double result1, error1, resultN, errorN, resultS, errorS;
+            int numEval1, numEvalN, numEvalS;
+            testParallelCalls fncN(fnc), fncS(fnc);
+#ifdef _OPENMP
+            omp_set_num_threads(1);
+#endif
+            integrateNdim(fnc, xl, xu, 1e-5, 100000, &result1, &error1, &numEval1, methods[m]);
+#ifdef _OPENMP
+            omp_set_num_threads(maxThreads);
+#endif
+            integrateNdim(fncN, xl, xu, 1e-5, 100000, &resultN, &errorN, &numEvalN, methods[m]);
+            integrateNdim(fncS, xl, xu, 1e-5, 100000, &resultS, &errorS, &numEvalS, methods[m],
+                /*parallel*/ false);
+            bool same = result1 == resultN && error1 == errorN && numEval1 == numEvalN &&
+                result1 == resultS && error1 == errorS && numEval1 == numEvalS;
+            std::cout << names[m] << " integration with 1 and " << maxThreads << " threads: " <<
+                result1 << " +- " << error1 << " and " << resultN << " +- " << errorN <<
+                " (" << fncN.numParallelCalls << " parallel calls), serial: " <<
+                resultS << " +- " << errorS << " (" << fncS.numParallelCalls << " parallel calls)\n";
+            ok &= (same && fncS.numParallelCalls == 0) || err();
+        }
+#ifdef _OPENMP
+        ok &= omp_get_max_threads() == maxThreads || err();
+#endif
+    }
+
     // N-dimensional sampling
     numEval=0;
     math::Matrix<double> points;
@@ -489,6 +594,82 @@ int main()
             fout << points(i,0) << "\t" << points(i,1) << "\t" << points(i,2) << "\n";
     }
 
+    // sampling with a fixed random seed must produce identical results regardless of the number
+    // of threads used in the exploration of the region and the refinement of cells
+    {
+        math::Matrix<double> points1, pointsN;
+        size_t numTrial1, numTrialN;
+        double integ1, integN, interr1, interrN;
+#ifdef _OPENMP
+        const int maxThreads = omp_get_max_threads();
+        omp_set_num_threads(1);
+#else
+        const int maxThreads = 1;
+#endif
+        math::randomize(42);
+        sampleNdim(fnc8, fnc8.ymin, fnc8.ymax, 50000, points1, &numTrial1, &integ1, &interr1);
+#ifdef _OPENMP
+        omp_set_num_threads(maxThreads);
+#endif
+        math::randomize(42);
+        sampleNdim(fnc8, fnc8.ymin, fnc8.ymax, 50000, pointsN, &numTrialN, &integN, &interrN);
+        bool same = numTrial1 == numTrialN && integ1 == integN && interr1 == interrN &&
+            points1.rows() == pointsN.rows();
+        for(size_t i=0; same && i<points1.rows(); i++)
+            for(int d=0; d<3; d++)
+                same &= points1(i,d) == pointsN(i,d);
+        std::cout << "sampleNdim with a fixed seed, 1 and " << maxThreads << " threads: " <<
+            "integral=" << integ1 << " and " << integN << ", neval=" << numTrial1 << " and " <<
+            numTrialN << ", samples are " << (same ? "identical" : "different") << "\n";
+        ok &= same || err();
+    }
+
+    // chunked sampling: the same seed must produce identical chunks regardless of the number
+    // of threads, both in the exploration phase and in the generation of chunks
+    {
+        const size_t numChunks = 8, chunkSize = 5000, seed = 42;
+        std::vector<math::Matrix<double> > chunks1(numChunks), chunksN(numChunks);
+#ifdef _OPENMP
+        const int maxThreads = omp_get_max_threads();
+        omp_set_num_threads(1);
+#endif
+        math::SampleGenerator gen1(fnc8, fnc8.ymin, fnc8.ymax, 20000, seed);
+        for(size_t c=0; c<numChunks; c++)
+            gen1.generateChunk(c, chunkSize, chunks1[c]);
+#ifdef _OPENMP
+        omp_set_num_threads(maxThreads);
+#endif
+        math::SampleGenerator genN(fnc8, fnc8.ymin, fnc8.ymax, 20000, seed);
+        size_t numInFloor = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:numInFloor)
+#endif
+        for(int c=numChunks-1; c>=0; c--) {  // also in a different order
+            size_t chunkInFloor;
+            genN.generateChunk(c, chunkSize, chunksN[c], NULL, &chunkInFloor);
+            numInFloor += chunkInFloor;
+        }
+        bool same = true;
+        double integ1, integN, interr;
+        gen1.integral(integ1, interr);
+        genN.integral(integN, interr);
+        same &= integ1 == integN && gen1.numFlooredCells() == genN.numFlooredCells();
+        for(size_t c=0; c<numChunks; c++)
+            for(size_t i=0; i<chunkSize; i++)
+                for(int d=0; d<3; d++)
+                    same &= chunks1[c](i,d) == chunksN[c](i,d);
+        std::cout << "SampleGenerator: " << numChunks << " chunks with 1 and " <<
+#ifdef _OPENMP
+            maxThreads <<
+#else
+            1 <<
+#endif
+            " threads are " << (same ? "identical" : "different") <<
+            "; " << genN.numFlooredCells() << " cells with floor envelope, " <<
+            numInFloor << " positive values in them\n";
+        ok &= same || err();
+    }
+
 #if 0
     // test the accuracy of fixed-order (n) Gauss-Legendre quadrature in integrating a power-law function in radius
     for(double p=-40; p<=40; p+=1.77) {
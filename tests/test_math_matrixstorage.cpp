@@ -0,0 +1,253 @@
+/** \name   test_math_matrixstorage.cpp
+    \author Eugene Vasiliev
+    \date   2018
+
+    This program tests the compressed sparse matrix storage (`math::CompressedMatrix`):
+    the conversion between single and half precision, the matrix-vector multiplication
+    in both directions for matrices constructed in memory or read from a file written by
+    `math::CompressedMatrixWriter`, compared with a dense reference matrix, and the rejection
+    of files with corrupted contents.
+*/
+#include "math_matrixstorage.h"
+#include "math_core.h"
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+const char* errmsg = " \033[1;31m**\033[0m";
+
+/// check the conversion between float and half precision
+bool testHalfPrecision()
+{
+    bool ok = true;
+    // all finite half-precision numbers are converted to float and back exactly
+    int numBad = 0;
+    for(unsigned int h=0; h<0x10000; h++) {
+        if((h & 0x7c00) == 0x7c00)  // infinity or NaN
+            continue;
+        unsigned short half = static_cast<unsigned short>(h);
+        if(math::floatToHalf(math::halfToFloat(half)) != half)
+            numBad++;
+    }
+    // random numbers in the normal range are represented with the relative accuracy 2^-11
+    double maxRelError = 0;
+    for(int i=0; i<100000; i++) {
+        float val = static_cast<float>((math::random() > 0.5 ? 1 : -1) *
+            exp((math::random() * 2 - 1) * 9.5));  // between ~7.5e-5 and ~1.3e4
+        maxRelError = fmax(maxRelError, fabs(math::halfToFloat(math::floatToHalf(val)) / val - 1));
+    }
+    // special values: overflow, underflow, infinity and NaN
+    bool okSpecial =
+        math::halfToFloat(math::floatToHalf(1e5f)) == INFINITY &&
+        math::halfToFloat(math::floatToHalf(-1e5f)) == -INFINITY &&
+        math::halfToFloat(math::floatToHalf(1e-9f)) == 0 &&
+        math::halfToFloat(math::floatToHalf(INFINITY)) == INFINITY &&
+        math::halfToFloat(math::floatToHalf(65504.f)) == 65504.f &&
+        math::halfToFloat(math::floatToHalf(ldexp(1.f, -24))) == ldexp(1.f, -24) &&
+        math::halfToFloat(math::floatToHalf(1.f + ldexp(1.f, -11))) == 1.f &&  // round to even
+        std::isnan(math::halfToFloat(math::floatToHalf(NAN)));
+    ok = numBad == 0 && maxRelError <= ldexp(1., -11) && okSpecial;
+    std::cout << "Half precision: " << numBad << " values not converted exactly, "
+        "max relative error=" << maxRelError << (okSpecial ? "" : ", special values are wrong") <<
+        (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+/// compare the products of a compressed matrix and a vector with those of a dense matrix
+template<typename NumT>
+bool testMultiply(const char* name, const math::CompressedMatrix<NumT>& mat,
+    const math::Matrix<double>& ref, double eps)
+{
+    const size_t nrows = ref.rows(), ncols = ref.cols();
+    std::vector<double> x(ncols), y(nrows), Mx, MTy;
+    for(size_t c=0; c<ncols; c++)
+        x[c] = math::random() - 0.5;
+    for(size_t r=0; r<nrows; r++)
+        y[r] = math::random() - 0.5;
+    mat.multiply(x, Mx);
+    mat.multiplyTransposed(y, MTy);
+    double maxdif = 0, maxval = 0;
+    bool ok = mat.rows() == nrows && mat.cols() == ncols && Mx.size() == nrows && MTy.size() == ncols;
+    for(size_t r=0; ok && r<nrows; r++) {
+        double sum = 0;
+        for(size_t c=0; c<ncols; c++)
+            sum += ref(r, c) * x[c];
+        maxdif = fmax(maxdif, fabs(Mx[r] - sum));
+        maxval = fmax(maxval, fabs(sum));
+    }
+    for(size_t c=0; ok && c<ncols; c++) {
+        double sum = 0;
+        for(size_t r=0; r<nrows; r++)
+            sum += ref(r, c) * y[r];
+        maxdif = fmax(maxdif, fabs(MTy[c] - sum));
+        maxval = fmax(maxval, fabs(sum));
+    }
+    // element access should give the same values
+    for(size_t r=0; ok && r<nrows; r++)
+        for(size_t c=0; c<ncols; c++)
+            maxdif = fmax(maxdif, fabs(mat.at(r, c) - ref(r, c)));
+    ok &= maxdif <= eps * maxval;
+    std::cout << name << ": relative difference with the dense matrix=" << maxdif / maxval <<
+        (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+/// read the entire file into a buffer
+std::vector<char> readFile(const std::string& filename)
+{
+    std::vector<char> data;
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if(!file)
+        return data;
+    char buffer[4096];
+    size_t count;
+    while((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + count);
+    std::fclose(file);
+    return data;
+}
+
+/// write a buffer into a file
+void writeFile(const std::string& filename, const std::vector<char>& data)
+{
+    std::FILE* file = std::fopen(filename.c_str(), "wb");
+    if(file) {
+        std::fwrite(&data[0], 1, data.size(), file);
+        std::fclose(file);
+    }
+}
+
+/// a copy of the file layout (the header is not exposed by the library)
+struct FileHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int precision;
+    unsigned long long numRows, numCols, numNonzero;
+    unsigned long long offsetRowPtr, offsetColInd, offsetValues;
+};
+
+/// check that a corrupted copy of the file is rejected
+bool testCorrupted(const char* name, const std::vector<char>& data, const std::string& filename)
+{
+    writeFile(filename, data);
+    bool ok = false;
+    try{
+        math::CompressedMatrix<double> mat(filename);
+    }
+    catch(std::runtime_error&) {
+        ok = true;
+    }
+    std::remove(filename.c_str());
+    std::cout << "File with " << name << (ok ? " is rejected" : " is not rejected") <<
+        (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+bool testMatrices()
+{
+    const size_t nrows = 300, ncols = 200;
+    // a random sparse matrix with values spanning several orders of magnitude, and a few empty rows
+    math::Matrix<double> dense(nrows, ncols, 0.), denseHalf(nrows, ncols, 0.), denseFloat(nrows, ncols, 0.);
+    for(size_t r=0; r<nrows; r++) {
+        if(r % 37 == 5)
+            continue;
+        for(size_t c=0; c<ncols; c++)
+            if(math::random() < 0.05) {
+                double val = (math::random() - 0.5) * exp(math::random() * 8);
+                dense(r, c) = val;
+                denseFloat(r, c) = static_cast<float>(val);
+                denseHalf (r, c) = math::halfToFloat(math::floatToHalf(val));
+            }
+    }
+    bool ok = true;
+
+    // matrices constructed in memory, compared to the dense ones with values rounded to
+    // the storage precision, and for half precision, also to the original values
+    ok &= testMultiply("In memory, float32", math::CompressedMatrix<double>(dense), denseFloat, 1e-14);
+    ok &= testMultiply("In memory, float16", math::CompressedMatrix<double>(
+        dense, false, 0, math::SP_FLOAT16), denseHalf, 1e-14);
+    ok &= testMultiply("In memory, float16 vs original values", math::CompressedMatrix<double>(
+        dense, false, 0, math::SP_FLOAT16), dense, 1e-3);
+    math::Matrix<double> denseFloatT(ncols, nrows);
+    math::Matrix<float> denseSingle(nrows, ncols);
+    for(size_t r=0; r<nrows; r++)
+        for(size_t c=0; c<ncols; c++)
+            denseFloatT(c, r) = denseSingle(r, c) = denseFloat(r, c);
+    ok &= testMultiply("In memory, transposed",
+        math::CompressedMatrix<float>(denseSingle, true), denseFloatT, 1e-14);
+
+    // the same matrices written to a file, with rows provided in a non-sequential order
+    const std::string filename = "test_math_matrixstorage.tmp";
+    for(int p=0; p<2; p++) {
+        math::StoragePrecision prec = p==0 ? math::SP_FLOAT32 : math::SP_FLOAT16;
+        {
+            math::CompressedMatrixWriter writer(filename, nrows, ncols, 0, prec);
+            for(size_t i=0; i<nrows; i++) {
+                size_t r = (i * 7) % nrows;   // a permutation of row indices
+                writer.addRow(r, &dense(r, 0));
+            }
+        }
+        ok &= testMultiply(p==0 ? "From file, float32" : "From file, float16",
+            math::CompressedMatrix<double>(filename), p==0 ? denseFloat : denseHalf, 1e-14);
+        if(p==0)
+            ok &= testMultiply("From file, transposed",
+                math::CompressedMatrix<double>(filename, true), denseFloatT, 1e-14);
+    }
+
+    // corrupted copies of the last file
+    const std::vector<char> data = readFile(filename);
+    std::remove(filename.c_str());
+    FileHeader header;
+    if(data.size() < sizeof(header)) {
+        std::cout << "Cannot read the file" << errmsg << '\n';
+        return false;
+    }
+    std::memcpy(&header, &data[0], sizeof(header));
+    const std::string badname = "test_math_matrixstorage_bad.tmp";
+    std::vector<char> bad;
+    unsigned long long* rowPtr;
+    unsigned int* colInd;
+    // truncated file
+    bad.assign(data.begin(), data.end() - 2);
+    ok &= testCorrupted("truncated values", bad, badname);
+    // huge number of rows, which would overflow the array size computation
+    bad = data;
+    reinterpret_cast<FileHeader*>(&bad[0])->numRows = ~0ULL / 4;
+    ok &= testCorrupted("invalid number of rows", bad, badname);
+    // decreasing row pointers
+    bad = data;
+    rowPtr = reinterpret_cast<unsigned long long*>(&bad[header.offsetRowPtr]);
+    rowPtr[nrows/2] = rowPtr[nrows/2 + 1] + 1;
+    ok &= testCorrupted("decreasing row pointers", bad, badname);
+    // the last row pointer does not match the number of nonzero elements
+    bad = data;
+    rowPtr = reinterpret_cast<unsigned long long*>(&bad[header.offsetRowPtr]);
+    rowPtr[nrows]++;
+    ok &= testCorrupted("inconsistent number of elements", bad, badname);
+    // column index out of range
+    bad = data;
+    colInd = reinterpret_cast<unsigned int*>(&bad[header.offsetColInd]);
+    colInd[header.numNonzero - 1] = ncols;
+    ok &= testCorrupted("column index out of range", bad, badname);
+    // unsorted column indices in a row
+    bad = data;
+    colInd = reinterpret_cast<unsigned int*>(&bad[header.offsetColInd]);
+    rowPtr = reinterpret_cast<unsigned long long*>(&bad[header.offsetRowPtr]);
+    std::swap(colInd[rowPtr[0]], colInd[rowPtr[0] + 1]);
+    ok &= testCorrupted("unsorted column indices", bad, badname);
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= testHalfPrecision();
+    ok &= testMatrices();
+    if(ok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}
@@ -0,0 +1,181 @@
+/** \name   test_math_optimization.cpp
+    \author Eugene Vasiliev
+    \date   2018
+
+    This program tests the built-in first-order solver for linear and quadratic optimization
+    problems (`quadraticOptimizationSolveFirstOrder`), which is also the fallback for the other
+    optimization routines when no external LP/QP solvers are available.
+    The solutions are compared with the known optima of small problems with equality and
+    inequality constraints, box bounds, linear and quadratic penalties for the variables,
+    and quadratic penalties for constraint violation; the same problems are solved with
+    single-precision input arrays, and the warm start from a previous solution is checked
+    on a larger problem.
+*/
+#include "math_optimization.h"
+#include "math_core.h"
+#include <iostream>
+#include <cmath>
+
+const char* errmsg = " \033[1;31m**\033[0m";
+
+/// solve a small problem with the first-order solver and compare the result with the known optimum
+template<typename NumT>
+bool testProblem(const char* name, const math::Matrix<NumT>& A, const std::vector<NumT>& rhs,
+    const std::vector<NumT>& L, const std::vector<NumT>& Qdiag,
+    const std::vector<NumT>& consPenaltyQuad,
+    const std::vector<NumT>& xmin, const std::vector<NumT>& xmax,
+    const std::vector<double>& xtrue, double eps)
+{
+    math::FirstOrderSolverParams params;
+    params.tolerance = 1e-8;
+    params.maxIter = 100000;
+    std::vector<double> x, multipliers;
+    unsigned int numIter = math::quadraticOptimizationSolveFirstOrder(
+        A, rhs, L, math::BandMatrix<NumT>(Qdiag), consPenaltyQuad, xmin, xmax, x, multipliers, params);
+    double maxdif = 0;
+    for(size_t v=0; v<xtrue.size(); v++)
+        maxdif = fmax(maxdif, fabs(x[v] - xtrue[v]));
+    bool ok = x.size() == xtrue.size() && maxdif < eps;
+    std::cout << name << (sizeof(NumT) == sizeof(float) ? " (float)" : "") << ": x=(";
+    for(size_t v=0; v<x.size(); v++)
+        std::cout << (v>0 ? ", " : "") << x[v];
+    std::cout << "), max deviation from the exact solution=" << maxdif <<
+        ", " << numIter << " iterations" << (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+template<typename NumT>
+bool testSmallProblems()
+{
+    typedef std::vector<NumT> Vec;
+    const NumT INF = INFINITY;
+    const Vec none;
+    const double eps = sizeof(NumT) == sizeof(float) ? 1e-5 : 1e-6;
+    bool ok = true;
+    {   // min (1/2) sum q_i x_i^2  subject to  sum x_i = 1,  x>=0:  x_i ~ 1/q_i
+        math::Matrix<NumT> A(1, 3, 1);
+        NumT q[] = {1, 2, 3};
+        double x[] = {6./11, 3./11, 2./11};
+        ok &= testProblem("Equality constraint", A, Vec(1, 1), none, Vec(q, q+3), none, none, none,
+            std::vector<double>(x, x+3), eps);
+        // same with the upper bound on the first variable, which becomes active
+        NumT xmax[] = {0.4, INF, INF};
+        double xb[] = {0.4, 0.36, 0.24};
+        ok &= testProblem("Box bounds", A, Vec(1, 1), none, Vec(q, q+3), none, none, Vec(xmax, xmax+3),
+            std::vector<double>(xb, xb+3), eps);
+        // linear penalty pushing the last variable onto its lower bound
+        NumT L[] = {0, 0, 1}, q1[] = {1, 1, 1};
+        double xl[] = {0.5, 0.5, 0};
+        ok &= testProblem("Linear penalties", A, Vec(1, 1), Vec(L, L+3), Vec(q1, q1+3),
+            none, none, none, std::vector<double>(xl, xl+3), eps);
+    }
+    {   // min (1/2) (x0^2 + x1^2) - x0 - 2 x1  subject to  x0 + x1 <= 1,  x0, x1 unbounded:
+        // the inequality is converted into an equality with the slack variable s>=0,
+        // and the solution is the projection of the unconstrained optimum (1,2) onto x0+x1=1
+        math::Matrix<NumT> A(1, 3, 1);
+        NumT L[] = {-1, -2, 0}, q[] = {1, 1, 0}, xmin[] = {-INF, -INF, 0};
+        double x[] = {0, 1, 0};
+        ok &= testProblem("Inequality constraint", A, Vec(1, 1), Vec(L, L+3), Vec(q, q+3),
+            none, Vec(xmin, xmin+3), none, std::vector<double>(x, x+3), eps);
+    }
+    {   // a linear problem:  min x0 + 2 x1 + 3 x2  subject to  sum x_i = 1,  0 <= x0 <= 0.3
+        math::Matrix<NumT> A(1, 3, 1);
+        NumT L[] = {1, 2, 3}, xmax[] = {0.3, INF, INF};
+        double x[] = {0.3, 0.7, 0};
+        ok &= testProblem("Linear problem", A, Vec(1, 1), Vec(L, L+3), none,
+            none, none, Vec(xmax, xmax+3), std::vector<double>(x, x+3), 1e-4);
+    }
+    {   // one exact and one approximate constraint with a quadratic penalty:
+        // min (1/2) (x0^2 + x1^2) + (1/2) (x0 - x1 - 1)^2  subject to  x0 + x1 = 2
+        math::Matrix<NumT> A(2, 2, 1);
+        A(1, 1) = -1;
+        NumT rhs[] = {2, 1}, q[] = {1, 1}, pen[] = {INF, 1};
+        double x[] = {4./3, 2./3};
+        ok &= testProblem("Quadratic constraint penalties", A, Vec(rhs, rhs+2), none, Vec(q, q+2),
+            Vec(pen, pen+2), none, none, std::vector<double>(x, x+2), eps);
+    }
+    {   // least-square fit with only approximate constraints and no penalties for variables:
+        // min (1/2) [ (x-1)^2 + 3 (x-3)^2 ]  gives x=2.5, but the upper bound x<=2 is active
+        math::Matrix<NumT> A(2, 1, 1);
+        NumT rhs[] = {1, 3}, pen[] = {1, 3};
+        ok &= testProblem("Least squares", A, Vec(rhs, rhs+2), none, none,
+            Vec(pen, pen+2), none, none, std::vector<double>(1, 2.5), eps);
+        ok &= testProblem("Least squares with bounds", A, Vec(rhs, rhs+2), none, none,
+            Vec(pen, pen+2), none, Vec(1, 2), std::vector<double>(1, 2.), eps);
+    }
+    return ok;
+}
+
+/// check that the solver started from the solution of a slightly different problem converges
+/// to the same result as when started from scratch, but in fewer iterations
+bool testWarmStart()
+{
+    const size_t numVars = 200, numCons = 20;
+    math::Matrix<double> A(numCons, numVars);
+    std::vector<double> rhs(numCons), Q(numVars), Qnew(numVars), pen(numCons, INFINITY);
+    for(size_t c=0; c<numCons; c++) {
+        for(size_t v=0; v<numVars; v++)
+            A(c, v) = math::random() - 0.5;
+        rhs[c] = math::random();
+    }
+    for(size_t v=0; v<numVars; v++) {
+        Q[v] = 1 + math::random();
+        Qnew[v] = Q[v] * (1 + 0.01 * (math::random() - 0.5));
+    }
+    // half of the constraints are approximate
+    for(size_t c=0; c<numCons; c+=2)
+        pen[c] = 100.;
+    const std::vector<double> none;
+    math::FirstOrderSolverParams params;
+    params.tolerance = 1e-8;
+    params.maxIter = 100000;
+
+    // solve the original problem
+    std::vector<double> x, multipliers;
+    math::quadraticOptimizationSolveFirstOrder(A, rhs, none, math::BandMatrix<double>(Q), pen,
+        none, none, x, multipliers, params);
+    // solve the modified problem from scratch
+    std::vector<double> xcold, multcold;
+    unsigned int numIterCold = math::quadraticOptimizationSolveFirstOrder(A, rhs, none,
+        math::BandMatrix<double>(Qnew), pen, none, none, xcold, multcold, params);
+    // solve the modified problem starting from the solution of the original one
+    std::vector<double> xwarm(x), multwarm(multipliers);
+    unsigned int numIterWarm = math::quadraticOptimizationSolveFirstOrder(A, rhs, none,
+        math::BandMatrix<double>(Qnew), pen, none, none, xwarm, multwarm, params);
+    // warm start with the solution but without the multipliers
+    std::vector<double> xnomult(x), multnone;
+    unsigned int numIterNoMult = math::quadraticOptimizationSolveFirstOrder(A, rhs, none,
+        math::BandMatrix<double>(Qnew), pen, none, none, xnomult, multnone, params);
+    double maxdif = 0, maxdifNoMult = 0, xnorm = 0;
+    for(size_t v=0; v<numVars; v++) {
+        maxdif = fmax(maxdif, fabs(xwarm[v] - xcold[v]));
+        maxdifNoMult = fmax(maxdifNoMult, fabs(xnomult[v] - xcold[v]));
+        xnorm  = fmax(xnorm, fabs(xcold[v]));
+    }
+    // the multipliers are only as accurate as required to satisfy the exact constraints
+    // within tolerance, so they are not compared, but those of approximate constraints must be zero
+    bool multok = multwarm.size() == numCons && multcold.size() == numCons;
+    for(size_t c=0; multok && c<numCons; c++)
+        if(pen[c] != INFINITY)
+            multok &= multwarm[c] == 0 && multcold[c] == 0;
+    bool ok = maxdif < 1e-5 * xnorm && maxdifNoMult < 1e-5 * xnorm && multok &&
+        numIterWarm < numIterCold && numIterWarm <= numIterNoMult;
+    std::cout << "Warm start: " << numIterCold << " iterations from scratch, " <<
+        numIterWarm << " from the previous solution and multipliers, " <<
+        numIterNoMult << " from the previous solution only; relative difference in solution=" <<
+        maxdif / xnorm << (ok ? "" : errmsg) << '\n';
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= testSmallProblems<double>();
+    ok &= testSmallProblems<float>();
+    ok &= testWarmStart();
+    if(ok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}
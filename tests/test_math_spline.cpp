@@ -258,6 +258,52 @@ bool testPenalizedSplineFit()
     return ok;
 }
 
+/// the streaming mode of SplineApprox, in which the data points are added in several batches
+/// of unequal size, should produce the same fit as the ordinary mode with all points at once,
+/// both for a fixed smoothing parameter and for the one chosen by the AIC scan
+bool testStreamingSplineFit()
+{
+    const int NNODES  = 20;
+    const int NPOINTS = 20000;
+    const double XMAX = 12.;
+    std::vector<double> xnodes = math::createNonuniformGrid(NNODES, 0.2, XMAX, false);
+    std::vector<double> xvalues(NPOINTS), yvalues(NPOINTS), weights(NPOINTS);
+    for(int i=0; i<NPOINTS; i++) {
+        xvalues[i] = math::random()*XMAX;
+        yvalues[i] = sin(4*sqrt(xvalues[i])) + 4*(math::random()-0.5);
+        weights[i] = 0.5 + math::random();
+    }
+    math::SplineApprox appr(xnodes, xvalues, weights), apprs(xnodes);
+    const int batches[] = {0, 1, 1234, 1235, 9000, NPOINTS};
+    for(int b=0; b<5; b++)
+        apprs.addPoints(
+            std::vector<double>(xvalues.begin() + batches[b], xvalues.begin() + batches[b+1]),
+            std::vector<double>(yvalues.begin() + batches[b], yvalues.begin() + batches[b+1]),
+            std::vector<double>(weights.begin() + batches[b], weights.begin() + batches[b+1]));
+    double rms, edf, rmss, edfs, rmsf, rmsfs;
+    std::vector<double>
+    fitOpt  = appr. fitOptimal(yvalues, &rms, &edf),
+    fitOpts = apprs.fitOptimal(&rmss, &edfs),
+    fitFix  = appr. fit(yvalues, 10., &rmsf),
+    fitFixs = apprs.fit(10., &rmsfs);
+    double maxdifOpt = 0, maxdifFix = 0;
+    for(int k=0; k<NNODES; k++) {
+        maxdifOpt = fmax(maxdifOpt, fabs(fitOpt[k] - fitOpts[k]));
+        maxdifFix = fmax(maxdifFix, fabs(fitFix[k] - fitFixs[k]));
+    }
+    std::cout << "Streaming spline fit: EDF=" << edfs << " (non-streaming: " << edf <<
+        "), RMS=" << rmss << " (" << rms << "), max difference in values at knots=" << maxdifOpt <<
+        "; for a fixed EDF: " << maxdifFix << "\n";
+    return
+    testCond(apprs.numPoints() == (size_t)NPOINTS, "streaming fit: incorrect number of points") &&
+    // with a fixed EDF, the only difference is the order of summation in the normal equations
+    testCond(math::fcmp(rmsf, rmsfs, 1e-12) == 0 && maxdifFix < 1e-12,
+        "streaming fit with a fixed EDF differs from the non-streaming one") &&
+    // the AIC minimization is terminated at a finite tolerance, hence a larger difference
+    testCond(math::fcmp(edf, edfs, 1e-4) == 0 && math::fcmp(rms, rmss, 1e-6) == 0 && maxdifOpt < 1e-5,
+        "streaming fit with optimal smoothing differs from the non-streaming one");
+}
+
 //-------- test penalized spline log-density estimation ---------//
 
 // density distribution described by a sum of two Gaussians
@@ -1217,6 +1263,127 @@ bool test3dSpline()
     return ok;
 }
 
+/// compare the batched evaluation of 1d interpolators and the hinted binary search
+/// with the pointwise evaluation and the ordinary binary search, on random points
+/// (including those outside the grid), which may come in arbitrary or sorted order
+bool testEvalMany()
+{
+    const int NNODES = 20, NPOINTS = 1000;
+    std::vector<double> xnodes = math::createNonuniformGrid(NNODES, 0.1, 10., true), ynodes(NNODES), dnodes(NNODES);
+    for(int i=0; i<NNODES; i++) {
+        ynodes[i] = sin(xnodes[i]) + 2;   // positive, so that it can be used in LogLogSpline
+        dnodes[i] = cos(xnodes[i]);
+    }
+    xnodes[0] = 0.01;  // strictly positive for LogLogSpline
+    std::vector<const math::BaseInterpolator1d*> interp;
+    math::LinearInterpolator lin(xnodes, ynodes);
+    math::CubicSpline natural(xnodes, ynodes), hermite(xnodes, ynodes, dnodes);
+    math::QuinticSpline quintic(xnodes, ynodes, dnodes);
+    math::LogLogSpline logcub(xnodes, ynodes), logqui(xnodes, ynodes, dnodes);
+    interp.push_back(&lin);
+    interp.push_back(&natural);
+    interp.push_back(&hermite);
+    interp.push_back(&quintic);
+    interp.push_back(&logcub);
+    interp.push_back(&logqui);
+
+    // random points covering the grid and some distance beyond its boundaries,
+    // plus the grid nodes themselves
+    std::vector<double> xpoints(NPOINTS);
+    for(int i=0; i<NPOINTS; i++)
+        xpoints[i] = i < NNODES ? xnodes[i] : -1 + 12 * math::random();
+    bool okSearch = true, okEval = true;
+    for(int pass=0; pass<2; pass++) {
+        if(pass==1)
+            std::sort(xpoints.begin(), xpoints.end());
+        ptrdiff_t hint = -1;
+        for(int i=0; i<NPOINTS; i++) {
+            ptrdiff_t index = math::binSearch(xpoints[i], &xnodes[0], NNODES);
+            // hint from the previous point, and an arbitrary (possibly invalid) hint
+            okSearch &= math::binSearchHint(xpoints[i], &xnodes[0], NNODES, hint) == index;
+            okSearch &= math::binSearchHint(xpoints[i], &xnodes[0], NNODES,
+                static_cast<ptrdiff_t>(math::random() * (NNODES+2)) - 1) == index;
+            hint = index;
+        }
+        // LogLogSpline is evaluated at the absolute values of these points (still reaching below xmin),
+        // since it is not defined for x<=0
+        std::vector<double> xpos(NPOINTS);
+        for(int i=0; i<NPOINTS; i++)
+            xpos[i] = fabs(xpoints[i]) + 0.005;
+        for(size_t k=0; k<interp.size(); k++) {
+            const std::vector<double>& x = k>=4 ? xpos : xpoints;
+            std::vector<double> val(NPOINTS), der(NPOINTS), der2(NPOINTS), val1(NPOINTS);
+            interp[k]->evalmany(NPOINTS, &x[0], &val[0], &der[0], &der2[0]);
+            interp[k]->evalmany(NPOINTS, &x[0], &val1[0]);
+            for(int i=0; i<NPOINTS; i++) {
+                double v, d, d2;
+                interp[k]->evalDeriv(x[i], &v, &d, &d2);
+                okEval &= v == val[i] && d == der[i] && d2 == der2[i] && v == val1[i];
+            }
+        }
+    }
+    return
+    testCond(okSearch, "binSearchHint is inconsistent with binSearch") &&
+    testCond(okEval, "evalmany is inconsistent with evalDeriv");
+}
+
+/// compare 2d quintic and 3d cubic splines that use single-precision packed tables
+/// with their double-precision counterparts: the values should agree to a relative precision
+/// of a few times float epsilon, and the derivatives - to a somewhat lower precision
+bool testSinglePrecision()
+{
+    const int NX = 20, NY = 25, NZ = 15, NPOINTS = 10000;
+    std::vector<double> xval = math::createUniformGrid(NX, 0, 3), yval = math::createUniformGrid(NY, -2, 2),
+        zval = math::createUniformGrid(NZ, -1, 2);
+    math::Matrix<double> fval(NX, NY), fder_x(NX, NY), fder_y(NX, NY);
+    for(int i=0; i<NX; i++)
+        for(int j=0; j<NY; j++) {
+            double x = xval[i], y = yval[j], e = exp(-0.3*y*y);
+            fval  (i, j) = (1 + sin(x)) * e + 0.1 * x * y;
+            fder_x(i, j) = cos(x) * e + 0.1 * y;
+            fder_y(i, j) =-0.6 * y * (1 + sin(x)) * e + 0.1 * x;
+        }
+    std::vector<double> fval3d(NX * NY * NZ);
+    for(int i=0; i<NX; i++)
+        for(int j=0; j<NY; j++)
+            for(int k=0; k<NZ; k++)
+                fval3d[(i * NY + j) * NZ + k] = fval(i, j) * (1 + 0.5 * cos(zval[k]));
+    math::QuinticSpline2d spl2d(xval, yval, fval, fder_x, fder_y), spl2f(spl2d);
+    math::CubicSpline3d spl3d(xval, yval, zval, fval3d), spl3f(spl3d);
+    double loss2d = spl2f.convertToSinglePrecision();
+    double loss3d = spl3f.convertToSinglePrecision();
+    // maximum absolute deviation and maximum absolute value of the function and its derivatives
+    double maxdif2d[6] = {0}, maxval2d[6] = {0}, maxdif3d = 0, maxval3d = 0;
+    for(int n=0; n<NPOINTS; n++) {
+        double x = math::random() * 3, y = math::random() * 4 - 2, z = math::random() * 3 - 1;
+        double d[6], f[6];
+        spl2d.evalDeriv(x, y, &d[0], &d[1], &d[2], &d[3], &d[4], &d[5]);
+        spl2f.evalDeriv(x, y, &f[0], &f[1], &f[2], &f[3], &f[4], &f[5]);
+        for(int k=0; k<6; k++) {
+            maxdif2d[k] = fmax(maxdif2d[k], fabs(d[k] - f[k]));
+            maxval2d[k] = fmax(maxval2d[k], fabs(d[k]));
+        }
+        double v = spl3d.value(x, y, z);
+        maxdif3d = fmax(maxdif3d, fabs(v - spl3f.value(x, y, z)));
+        maxval3d = fmax(maxval3d, fabs(v));
+    }
+    double err2d = maxdif2d[0] / maxval2d[0], err2dDer = 0, err2dDer2 = 0, err3d = maxdif3d / maxval3d;
+    for(int k=1; k<3; k++)
+        err2dDer  = fmax(err2dDer,  maxdif2d[k] / maxval2d[k]);
+    for(int k=3; k<6; k++)
+        err2dDer2 = fmax(err2dDer2, maxdif2d[k] / maxval2d[k]);
+    std::cout << "Single-precision splines: relative error in 2d quintic value=" << err2d <<
+        " (reported: " << loss2d << "), 1st derivs=" << err2dDer << ", 2nd derivs=" << err2dDer2 <<
+        "; 3d cubic value=" << err3d << " (reported: " << loss3d << ")\n";
+    return
+    testCond(spl2f.singlePrecision() && spl3f.singlePrecision() && !spl2d.singlePrecision(),
+        "single-precision flag is incorrect") &&
+    testCond(err2d < 1e-6 && loss2d < 1e-6, "2d quintic spline value is inaccurate in single precision") &&
+    testCond(err2dDer  < 1e-5, "2d quintic spline derivatives are inaccurate in single precision") &&
+    testCond(err2dDer2 < 2e-4, "2d quintic spline 2nd derivatives are inaccurate in single precision") &&
+    testCond(err3d < 1e-6 && loss3d < 1e-6, "3d cubic spline value is inaccurate in single precision");
+}
+
 bool printFail(const char* msg)
 {
     std::cout << "\033[1;31m " << msg << " failed\033[0m\n";
@@ -1227,10 +1394,13 @@ int main()
 {
     bool ok=true;
     ok &= testPenalizedSplineFit() || printFail("Penalized spline fit");
+    ok &= testStreamingSplineFit() || printFail("Streaming penalized spline fit");
     ok &= testPenalizedSplineDensity() || printFail("Penalized spline density estimator");
     ok &= test1dSpline() || printFail("1d spline");
+    ok &= testEvalMany() || printFail("Batched evaluation of 1d splines");
     ok &= test2dSpline() || printFail("2d spline");
     ok &= test3dSpline() || printFail("3d spline");
+    ok &= testSinglePrecision() || printFail("Single-precision 2d/3d splines");
     if(ok)
         std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
     else
@@ -0,0 +1,148 @@
+/** \name   test_orbitlibrary.cpp
+    \author Eugene Vasiliev
+    \date   2018
+
+    This program tests the construction of an orbit library for several targets at once
+    by `galaxymodel::buildOrbitLibrary`, which reuses the datacubes of each thread for many orbits
+    and may write the library into compressed matrix files. The rows of the library are compared
+    with those obtained by integrating each orbit separately with a single-target runtime function
+    and a freshly allocated datacube (the way the Python interface used to construct the library).
+*/
+#include "galaxymodel_orbitlibrary.h"
+#include "galaxymodel_densitygrid.h"
+#include "galaxymodel_losvd.h"
+#include "potential_analytic.h"
+#include "math_matrixstorage.h"
+#include "math_spline.h"
+#include "utils.h"
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+
+const char* errmsg = "\033[1;31m **\033[0m";
+
+/// max difference between the rows of the library and the reference rows, relative to the max value
+double maxRelDifference(const std::vector<galaxymodel::StorageNumT>& ref,
+    const math::IMatrix<double>& lib)
+{
+    double maxval = 0, maxdif = 0;
+    for(size_t i=0; i<lib.rows(); i++)
+        for(size_t j=0; j<lib.cols(); j++) {
+            double val = ref[i * lib.cols() + j];
+            maxval = fmax(maxval, fabs(val));
+            maxdif = fmax(maxdif, fabs(val - lib.at(i, j)));
+        }
+    return maxdif / maxval;
+}
+
+int main()
+{
+    const potential::Plummer pot(1., 1.);
+    const double Omega = 0.;
+
+    // targets: a density grid and the LOSVD in a few apertures
+    std::vector<galaxymodel::PtrTarget> targets;
+    targets.push_back(galaxymodel::PtrTarget(new galaxymodel::TargetDensitySphHarm(
+        /*lmax*/ 4, /*mmax*/ 2, math::createUniformGrid(11, 0., 5.))));
+    galaxymodel::LOSVDParams losvdParams;
+    losvdParams.theta = 0.6;
+    losvdParams.phi   = 0.3;
+    losvdParams.gridx = math::createUniformGrid(21, -2.5, 2.5);
+    losvdParams.gridy = math::createUniformGrid(21, -2.5, 2.5);
+    losvdParams.gridv = math::createUniformGrid(17, -1.6, 1.6);
+    losvdParams.spatialPSF.push_back(galaxymodel::GaussianPSF(0.3));
+    losvdParams.velocityPSF = 0.1;
+    for(int a=0; a<8; a++) {
+        double x = -2 + 0.5*a, y = 0.25 * (a%3 - 1);
+        math::Polygon poly;
+        poly.push_back(math::Point2d(x-0.3, y-0.2));
+        poly.push_back(math::Point2d(x+0.3, y-0.2));
+        poly.push_back(math::Point2d(x+0.3, y+0.2));
+        poly.push_back(math::Point2d(x-0.3, y+0.2));
+        losvdParams.apertures.push_back(poly);
+    }
+    targets.push_back(galaxymodel::PtrTarget(new galaxymodel::TargetLOSVD<2>(losvdParams)));
+    const unsigned int numTargets = targets.size();
+
+    // a small set of orbits with different radii and orientations
+    const int numOrbits = 40;
+    std::vector<coord::PosVelCar> initConds;
+    std::vector<double> integrTimes;
+    for(int orb=0; orb<numOrbits; orb++) {
+        double r = 0.2 + 0.1 * orb, a = 0.7 * orb, vc = sqrt(r * r / pow(r*r + 1, 1.5));
+        initConds.push_back(coord::PosVelCar(r * cos(a), r * sin(a), 0.1 * r * sin(3*a),
+            -0.8 * vc * sin(a), 0.8 * vc * cos(a), 0.4 * vc * cos(2*a)));
+        integrTimes.push_back(20. + orb);
+    }
+
+    // reference rows: each orbit and target integrated separately with its own datacube
+    std::vector< std::vector<galaxymodel::StorageNumT> > ref(numTargets);
+    const orbit::OrbitIntegratorRot orbitIntegrator(pot, Omega);
+    for(unsigned int t=0; t<numTargets; t++) {
+        const size_t numCoefs = targets[t]->numCoefs();
+        ref[t].resize(numOrbits * numCoefs);
+        for(int orb=0; orb<numOrbits; orb++) {
+            orbit::RuntimeFncArray fncs(1, orbit::PtrRuntimeFnc(
+                new galaxymodel::RuntimeFncTarget(*targets[t], &ref[t][orb * numCoefs])));
+            orbit::integrate(initConds[orb], integrTimes[orb], orbitIntegrator, fncs);
+        }   // the runtime function writes the output row upon destruction
+    }
+
+    // the library stored in dense matrices and in compressed matrix files
+    std::vector< std::vector<galaxymodel::StorageNumT> > denseStorage(numTargets);
+    std::vector<galaxymodel::StorageNumT*> densePtrs(numTargets);
+    std::vector<size_t> rowSizes(numTargets);
+    std::vector<std::string> fileNames(numTargets);
+    std::vector<math::CompressedMatrixWriter*> writers(numTargets);
+    for(unsigned int t=0; t<numTargets; t++) {
+        rowSizes[t] = targets[t]->numCoefs();
+        denseStorage[t].resize(numOrbits * rowSizes[t]);
+        densePtrs[t] = &denseStorage[t][0];
+        fileNames[t] = "test_orbitlibrary" + utils::toString(t) + ".tmp";
+        writers[t] = new math::CompressedMatrixWriter(fileNames[t], numOrbits, rowSizes[t]);
+    }
+    galaxymodel::OrbitLibraryOutputDense outputDense(densePtrs, rowSizes);
+    galaxymodel::OrbitLibraryOutputCompressed outputCompressed(writers);
+    galaxymodel::buildOrbitLibrary(pot, Omega, initConds, integrTimes, targets, outputDense);
+    galaxymodel::buildOrbitLibrary(pot, Omega, initConds, integrTimes, targets, outputCompressed);
+    for(unsigned int t=0; t<numTargets; t++)
+        delete writers[t];  // finalizes the file
+
+    // the same library with more points per timestep: should differ only by discreteness noise
+    std::vector< std::vector<galaxymodel::StorageNumT> > fineStorage(numTargets);
+    std::vector<galaxymodel::StorageNumT*> finePtrs(numTargets);
+    for(unsigned int t=0; t<numTargets; t++) {
+        fineStorage[t].resize(numOrbits * rowSizes[t]);
+        finePtrs[t] = &fineStorage[t][0];
+    }
+    galaxymodel::OrbitLibraryOutputDense outputFine(finePtrs, rowSizes);
+    galaxymodel::buildOrbitLibrary(pot, Omega, initConds, integrTimes, targets, outputFine,
+        orbit::OrbitIntParams(), /*numSamplesPerStep*/ 40);
+
+    bool ok = true;
+    for(unsigned int t=0; t<numTargets; t++) {
+        math::Matrix<double> libDense(numOrbits, rowSizes[t]);
+        math::Matrix<double> libFine (numOrbits, rowSizes[t]);
+        for(size_t i=0; i<libDense.size(); i++) {
+            libDense.data()[i] = denseStorage[t][i];
+            libFine .data()[i] = fineStorage [t][i];
+        }
+        math::CompressedMatrix<double> libCompressed(fileNames[t]);
+        double difDense = maxRelDifference(ref[t], libDense);
+        double difComp  = maxRelDifference(ref[t], libCompressed);
+        double difFine  = maxRelDifference(ref[t], libFine);
+        bool okDense = difDense < 1e-6, okComp = difComp < 1e-6, okFine = difFine < 2e-2;
+        std::cout << targets[t]->name() << ": " << rowSizes[t] << " coefs, "
+            "max relative difference from the reference rows: dense=" << difDense << (okDense?"":errmsg) <<
+            ", compressed=" << difComp << " (" << libCompressed.size() << " nonzero elements)" <<
+            (okComp?"":errmsg) << ", with 40 samples per step=" << difFine << (okFine?"":errmsg) << "\n";
+        ok &= okDense && okComp && okFine;
+        std::remove(fileNames[t].c_str());
+    }
+
+    if(ok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}
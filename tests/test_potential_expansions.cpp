@@ -421,6 +421,15 @@ int main() {
     ok &= testAverageError(*test2d, test2_Dehnen0Tri, 0.02);
     ok &= testAverageError(*test2c, test2_Dehnen0Tri, 0.02);
     ok &= testAverageError(*test2c, *test2c_clone, 3e-4);
+    // the same CylSpline with single-precision tables: the relative error should be ~1e-7
+    // in the potential, but is larger in the force and especially in the density
+    {
+        std::vector<double> gridR, gridz;
+        std::vector<math::Matrix<double> > Phi, dPhidR, dPhidz;
+        dynamic_cast<const potential::CylSpline&>(*test2d).getCoefs(gridR, gridz, Phi, dPhidR, dPhidz);
+        potential::CylSpline test2d_float(gridR, gridz, Phi, dPhidR, dPhidz, /*singlePrecision*/ true);
+        ok &= testAverageError(test2d_float, *test2d, 1e-3);
+    }
 
     // mildly triaxial, cuspy
     std::cout << "--- Triaxial Dehnen gamma=1.5 ---\n";
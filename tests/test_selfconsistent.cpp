@@ -0,0 +1,308 @@
+/** \name   test_selfconsistent.cpp
+    \author Eugene Vasiliev
+    \date   2018
+
+    This program tests the self-consistent modelling machinery on a simple spherical model,
+    whose distribution function is the Eddington DF of the Plummer sphere expressed in terms
+    of actions. The incremental update of densities of DF-based components is compared with
+    the full recomputation of densities, and the iterations accelerated by Anderson mixing
+    are compared with the simple iterations. The densities of a two-component model computed
+    in a single pass are compared with those computed separately for each component,
+    and the model updated by running independent tasks concurrently is compared with
+    the one updated sequentially.
+*/
+#include "galaxymodel_selfconsistent.h"
+#include "galaxymodel_spherical.h"
+#include "df_quasiisotropic.h"
+#include "potential_analytic.h"
+#include "potential_composite.h"
+#include <iostream>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+const char* errmsg = " \033[1;31m**\033[0m";
+
+/// wrapper for a distribution function that counts the number of its evaluations
+class CountingDF: public df::BaseDistributionFunction {
+    const df::PtrDistributionFunction df;
+public:
+    mutable long numEval;
+    explicit CountingDF(const df::PtrDistributionFunction& _df) : df(_df), numEval(0) {}
+    virtual double value(const actions::Actions &J) const {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+        numEval++;
+        return df->value(J);
+    }
+};
+
+/// parameters of the density representation of the component and of the potential expansion
+const unsigned int GRID_SIZE = 20;
+const double RMIN = 0.01, RMAX = 100., REL_ERROR = 1e-3;
+const unsigned int MAX_NUM_EVAL = 1e5;
+
+/// create the quasi-isotropic DF of a Plummer sphere with the given mass and scale radius,
+/// embedded in the given total potential
+df::PtrDistributionFunction createDF(double mass, double scaleRadius,
+    const potential::BasePotential& totalPot)
+{
+    const potential::Plummer dens(mass, scaleRadius);
+    return df::PtrDistributionFunction(new df::QuasiIsotropic(
+        galaxymodel::makeEddingtonDF(potential::DensityWrapper(dens),
+        potential::PotentialWrapper(totalPot)), totalPot));
+}
+
+/// create a self-consistent model with one spherical component with the given DF,
+/// starting from a deliberately wrong initial density profile
+galaxymodel::SelfConsistentModel createModel(const df::PtrDistributionFunction& df)
+{
+    galaxymodel::SelfConsistentModel model;
+    model.useActionInterpolation = false;
+    model.lmaxAngularSph = 0;
+    model.sizeRadialSph  = GRID_SIZE;
+    model.rminSph = RMIN;
+    model.rmaxSph = RMAX;
+    model.components.push_back(galaxymodel::PtrComponent(
+        new galaxymodel::ComponentWithSpheroidalDF(df,
+        potential::PtrDensity(new potential::Plummer(0.8, 1.5)),
+        0, 0, GRID_SIZE, RMIN, RMAX, REL_ERROR, MAX_NUM_EVAL)));
+    return model;
+}
+
+/// max relative difference between two density profiles on a grid of radii
+double densityDifference(const potential::BaseDensity& dens1, const potential::BaseDensity& dens2)
+{
+    double maxdif = 0;
+    for(double r=0.05; r<20; r*=1.25) {
+        coord::PosCyl point(r, 0, 0);
+        double rho1 = dens1.density(point), rho2 = dens2.density(point);
+        maxdif = fmax(maxdif, fabs(rho1-rho2) / rho2);
+    }
+    return maxdif;
+}
+
+/// compare the incremental and the full update of the density of a component
+bool testIncremental()
+{
+    const double tolerance = 0.01;
+    const potential::Plummer truePot(1., 1.);
+    const shared_ptr<CountingDF> df(new CountingDF(createDF(1., 1., truePot)));
+    galaxymodel::SelfConsistentModel model = createModel(df);
+    // first approach the self-consistent solution with the ordinary iterations
+    for(int iter=0; iter<10; iter++)
+        doIteration(model);
+    model.incrementalTolerance = tolerance;
+    model.maxIncrementalUpdates = 2;
+    // the counter of incremental updates is reset after maxIncrementalUpdates
+    bool ok = true;
+    unsigned int expected[] = {1, 2, 0, 1};
+    for(int iter=0; iter<4; iter++) {
+        doIteration(model);
+        if(model.numIncrementalUpdates != expected[iter]) {
+            std::cout << "Iteration " << iter << ": number of incremental updates is " <<
+                model.numIncrementalUpdates << " instead of " << expected[iter] << errmsg << '\n';
+            ok = false;
+        }
+    }
+
+    // now perform both a full and an incremental update of the same component in the same potential
+    galaxymodel::BaseComponentWithDF& comp =
+        dynamic_cast<galaxymodel::BaseComponentWithDF&>(*model.components[0]);
+    const potential::PtrDensity prevDens = comp.getDensity();
+    df->numEval = 0;
+    comp.update(*model.totalPotential, *model.actionFinder);
+    const potential::PtrDensity fullDens = comp.getDensity();
+    long numEvalFull = df->numEval;
+    comp.setDensity(prevDens);
+    df->numEval = 0;
+    comp.updateIncremental(*model.totalPotential, *model.actionFinder, tolerance);
+    const potential::PtrDensity incrDens = comp.getDensity();
+    long numEvalIncr = df->numEval;
+    double difIncr = densityDifference(*incrDens, *fullDens);
+    double difPrev = densityDifference(*prevDens, *fullDens);
+    double difTrue = densityDifference(*fullDens, truePot);
+    // the incremental update should be cheaper and agree with the full one within tolerance
+    // (plus the accuracy of the density computation and interpolation)
+    bool okIncr = numEvalIncr < numEvalFull && difIncr < 1.5 * tolerance && difTrue < 0.02;
+    std::cout << "Incremental update: " << numEvalIncr << " DF evaluations vs " << numEvalFull <<
+        " for the full update; max relative difference in density: " << difIncr <<
+        " (previous iteration: " << difPrev << ", true density: " << difTrue << ")" <<
+        (okIncr ? "" : errmsg) << '\n';
+    ok &= okIncr;
+
+    // iterateToConvergence could not detect the convergence below the incremental tolerance
+    bool okThrow = false;
+    try{
+        iterateToConvergence(model, 10, /*tolerance*/ tolerance);
+    }
+    catch(std::invalid_argument&) {
+        okThrow = true;
+    }
+    if(!okThrow)
+        std::cout << "iterateToConvergence did not reject the incremental tolerance "
+            "larger than the required tolerance" << errmsg << '\n';
+    ok &= okThrow;
+    return ok;
+}
+
+/// compare the iterations with Anderson mixing and the simple iterations
+bool testAnderson()
+{
+    const double tolerance = 3e-3;
+    const potential::Plummer truePot(1., 1.);
+    const df::PtrDistributionFunction df = createDF(1., 1., truePot);
+    bool ok = true;
+
+    // iterateToConvergence without the history and mixing is exactly equivalent to doIteration
+    galaxymodel::SelfConsistentModel modelIter = createModel(df), modelPlain = createModel(df);
+    const unsigned int numIterFixed = 3;
+    for(unsigned int iter=0; iter<numIterFixed; iter++)
+        doIteration(modelIter);
+    unsigned int numIterPlain = iterateToConvergence(modelPlain, numIterFixed, 1e-10, 0, 1.);
+    bool identical = numIterPlain == numIterFixed;
+    for(double r=0.05; r<20; r*=1.25) {
+        coord::PosCyl point(r, 0, 0);
+        identical &= modelIter.totalPotential->value(point) == modelPlain.totalPotential->value(point) &&
+            modelIter.components[0]->getDensity()->density(point) ==
+            modelPlain.components[0]->getDensity()->density(point);
+    }
+    std::cout << "Simple iterations via iterateToConvergence and doIteration " <<
+        (identical ? "are identical" : "differ") << (identical ? "" : errmsg) << '\n';
+    ok &= identical;
+
+    // Anderson mixing reaches the same solution in fewer iterations than the simple iteration
+    galaxymodel::SelfConsistentModel modelSimple = createModel(df), modelAnderson = createModel(df);
+    const unsigned int maxNumIter = 30;
+    unsigned int numIterSimple   = iterateToConvergence(modelSimple,   maxNumIter, tolerance, 0, 1.);
+    unsigned int numIterAnderson = iterateToConvergence(modelAnderson, maxNumIter, tolerance, 4, 1.);
+    double difSimple   = densityDifference(*modelSimple.  components[0]->getDensity(), truePot);
+    double difAnderson = densityDifference(*modelAnderson.components[0]->getDensity(), truePot);
+    double difModels   = densityDifference(*modelAnderson.components[0]->getDensity(),
+        *modelSimple.components[0]->getDensity());
+    bool okAnderson = numIterSimple < maxNumIter && numIterAnderson < numIterSimple &&
+        difSimple < 0.02 && difAnderson < 0.02 && difModels < 0.01;
+    std::cout << "Anderson mixing: " << numIterAnderson << " iterations vs " << numIterSimple <<
+        " for the simple iteration; max relative deviation from the true density: " << difAnderson <<
+        " vs " << difSimple << ", between the two models: " << difModels <<
+        (okAnderson ? "" : errmsg) << '\n';
+    ok &= okAnderson;
+    return ok;
+}
+
+/// accuracy of density computation in the two-component model
+const double REL_ERROR_FUSED = 1e-4;
+const unsigned int MAX_NUM_EVAL_FUSED = 1e6;
+
+/// create a model with two spherical components of different extent, whose DFs are constructed
+/// in the total potential of both, and with different radial grids for their density profiles
+galaxymodel::SelfConsistentModel createTwoComponentModel(bool fuse)
+{
+    std::vector<potential::PtrPotential> comps(2);
+    comps[0].reset(new potential::Plummer(0.7, 1.0));
+    comps[1].reset(new potential::Plummer(0.3, 0.3));
+    const potential::CompositeCyl totalPot(comps);
+    galaxymodel::SelfConsistentModel model;
+    model.useActionInterpolation = false;
+    model.fuseDensityComputation = fuse;
+    model.lmaxAngularSph = 0;
+    model.sizeRadialSph  = GRID_SIZE;
+    model.rminSph = RMIN;
+    model.rmaxSph = RMAX;
+    model.components.push_back(galaxymodel::PtrComponent(
+        new galaxymodel::ComponentWithSpheroidalDF(createDF(0.7, 1.0, totalPot),
+        potential::PtrDensity(new potential::Plummer(0.6, 1.5)),
+        0, 0, GRID_SIZE, RMIN, RMAX, REL_ERROR_FUSED, MAX_NUM_EVAL_FUSED)));
+    model.components.push_back(galaxymodel::PtrComponent(
+        new galaxymodel::ComponentWithSpheroidalDF(createDF(0.3, 0.3, totalPot),
+        potential::PtrDensity(new potential::Plummer(0.4, 0.2)),
+        0, 0, GRID_SIZE-5, RMIN*0.3, RMAX*0.3, REL_ERROR_FUSED, MAX_NUM_EVAL_FUSED)));
+    return model;
+}
+
+/// compare the densities of two components computed in a single pass and separately
+bool testFused()
+{
+    galaxymodel::SelfConsistentModel modelFused = createTwoComponentModel(true),
+        modelSeparate = createTwoComponentModel(false);
+    // both models start from the same initial potential, in which the densities are computed
+    doIteration(modelFused);
+    doIteration(modelSeparate);
+    bool ok = true;
+    for(int c=0; c<2; c++) {
+        // the velocity integration is performed with different sets of points in the two cases,
+        // so the results agree only within the accuracy of density computation (the actual error
+        // occasionally exceeds the error estimate of the adaptive integration by a few times)
+        double dif = densityDifference(*modelFused.components[c]->getDensity(),
+            *modelSeparate.components[c]->getDensity());
+        bool okComp = dif < 10 * REL_ERROR_FUSED;
+        std::cout << "Component " << c << ": max relative difference in density "
+            "between the fused and separate computation: " << dif << (okComp ? "" : errmsg) << '\n';
+        ok &= okComp;
+    }
+    return ok;
+}
+
+/// compare the model updated with and without running the independent tasks concurrently
+bool testConcurrent()
+{
+    galaxymodel::SelfConsistentModel modelConcurrent = createTwoComponentModel(false),
+        modelSequential = createTwoComponentModel(false);
+    // add a static disk component, so that both Multipole and CylSpline potentials are constructed
+    galaxymodel::SelfConsistentModel* models[2] = {&modelConcurrent, &modelSequential};
+    for(int m=0; m<2; m++) {
+        models[m]->components.push_back(galaxymodel::PtrComponent(new galaxymodel::ComponentStatic(
+            potential::PtrDensity(new potential::MiyamotoNagai(0.1, 1.0, 0.2)), true)));
+        models[m]->RminCyl = 0.1;
+        models[m]->RmaxCyl = 20;
+        models[m]->zminCyl = 0.05;
+        models[m]->zmaxCyl = 10;
+        models[m]->sizeRadialCyl   = 15;
+        models[m]->sizeVerticalCyl = 15;
+    }
+    modelConcurrent.concurrentTasks = true;
+#ifdef _OPENMP
+    const int numThreads = omp_get_max_threads(), maxLevels = omp_get_max_active_levels();
+#endif
+    doIteration(modelConcurrent);
+    doIteration(modelSequential);
+    bool ok = true;
+#ifdef _OPENMP
+    // the OpenMP settings must be restored after running the concurrent tasks
+    if(omp_get_max_threads() != numThreads || omp_get_max_active_levels() != maxLevels) {
+        std::cout << "OpenMP settings changed after the concurrent tasks: max threads " <<
+            omp_get_max_threads() << " instead of " << numThreads << ", max active levels " <<
+            omp_get_max_active_levels() << " instead of " << maxLevels << errmsg << '\n';
+        ok = false;
+    }
+#endif
+    // the results do not depend on how the threads are assigned to tasks
+    bool identical = true;
+    for(double r=0.05; r<20; r*=1.25) {
+        coord::PosCyl point(r, r * 0.3, 0);
+        identical &= modelConcurrent.totalPotential->value(point) ==
+            modelSequential.totalPotential->value(point);
+        for(int c=0; c<2; c++)
+            identical &= modelConcurrent.components[c]->getDensity()->density(point) ==
+                modelSequential.components[c]->getDensity()->density(point);
+    }
+    std::cout << "Concurrent and sequential updates of the model " <<
+        (identical ? "are identical" : "differ") << (identical ? "" : errmsg) << '\n';
+    return ok && identical;
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= testIncremental();
+    ok &= testAnderson();
+    ok &= testFused();
+    ok &= testConcurrent();
+    if(ok)
+        std::cout << "\033[1;32mALL TESTS PASSED\033[0m\n";
+    else
+        std::cout << "\033[1;31mSOME TESTS FAILED\033[0m\n";
+    return 0;
+}